@@ -44,7 +44,7 @@ typedef struct _mp_machine_soft_spi_obj_t {
 
 extern const mp_machine_spi_p_t mp_machine_soft_spi_p;
 extern const mp_obj_type_t mp_machine_soft_spi_type;
-extern const mp_obj_dict_t mp_machine_spi_locals_dict;
+extern const mp_obj_rom_dict_t mp_machine_spi_locals_dict;
 
 mp_obj_t mp_machine_spi_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args);
 
@@ -0,0 +1,1559 @@
+/*
+Copyright 2019 Owen Lyke
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+/*
+
+The multipython module is designed to allow creation and execution of new MicroPython interpreters
+
+This file holds the port-independent part of the module. The tasks that contexts
+run on are provided by the port in ports/<port>/mpmultipythonport.c
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "py/compile.h"
+#include "py/frozenmod.h"
+#include "py/gc.h"
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/mpstate.h"
+#include "py/nlr.h"
+#include "py/obj.h"
+#include "py/objarray.h"
+#include "py/objint.h"
+#include "py/objstr.h"
+#include "py/parse.h"
+#include "py/persistentcode.h"
+#include "py/runtime.h"
+
+#include "extmod/modmultipython.h"
+
+#if MICROPY_PY_MULTIPYTHON
+
+#define MULTIPYTHON_SWITCH_BENCH_TID_BASE       (0x10)  // small values are never valid task IDs
+#define MULTIPYTHON_QUEUE_DEPTH_MAX             (0x10000)
+#define MULTIPYTHON_BUDGET_PERIOD_US            (100000) // default period of CPU budgets
+#define MULTIPYTHON_HEAP_MIN                    (16 * MICROPY_BYTES_PER_GC_BLOCK) // the tables of the GC and a few blocks, once the end is aligned
+
+volatile bool multipython_is_initialized = false;
+
+// STATIC mp_obj_t multipython_response_context(mp_obj_t self_in, mp_obj_t context);
+// MP_DEFINE_CONST_FUN_OBJ_2(multipython_response_context_obj, multipython_response_context);
+
+// STATIC mp_obj_t multipython_response_operation(mp_obj_t self_in, mp_obj_t operation);
+// MP_DEFINE_CONST_FUN_OBJ_2(multipython_response_operation_obj, multipython_response_operation);
+
+STATIC void multipython_response_print( const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind );
+mp_obj_t multipython_response_make_new( const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args );
+
+STATIC const mp_rom_map_elem_t multipython_response_locals_dict_table[] = {
+    // { MP_ROM_QSTR(MP_QSTR_context), MP_ROM_PTR(&multipython_response_context_obj) },
+    // { MP_ROM_QSTR(MP_QSTR_operation), MP_ROM_PTR(&multipython_response_operation_obj) },
+ };
+STATIC MP_DEFINE_CONST_DICT(multipython_response_locals_dict, multipython_response_locals_dict_table);
+
+const mp_obj_type_t multipython_responseObj_type = {
+    { &mp_type_type },                              // "inherit" the type "type"
+    .name = MP_QSTR_responseObj,                    // give it a name
+    .print = multipython_response_print,            // give it a print-function
+    .make_new = multipython_response_make_new,      // give it a constructor
+    .locals_dict = (mp_obj_dict_t*)&multipython_response_locals_dict, // and the global members
+};
+
+typedef struct _multipython_response_obj_t {
+    mp_obj_base_t               base;       // base represents some basic information, like type
+    mp_obj_t                    condition;  // the condition for which this response applies - can be any iterable micropython object such as int, string, list, dict or compound of those
+    mp_context_node_t*          context;    // which context to apply the response to
+    multipython_op_e            control_op; // a control operation to execute, if any. For example suspend or resume the context
+    mp_obj_t                    argument;   // an arbitrary micropython argument that you can place into the queue for the task (useful for providing directions to a context without using the context control operators)
+} multipython_response_obj_t;
+
+typedef struct _multipython_response_node_t multipython_response_node_t;
+struct _multipython_response_node_t{
+    multipython_response_obj_t*     response;
+    mp_uint_t                       hash;       // hash of the condition, 0 if it is unhashable
+    multipython_response_node_t*    next;
+};
+
+typedef multipython_response_node_t* multipython_response_iter_t;
+#define MODADD_RESPONSE_PTR_FROM_ITER(iter)     ((multipython_response_node_t*)iter)
+#define MODADD_ITER_FROM_RESPONSE_PTR(ptr)      ((multipython_response_iter_t)ptr)
+
+multipython_response_iter_t multipython_response_iter_first( multipython_response_iter_t head ){ return head; }
+bool multipython_response_iter_done( multipython_response_iter_t iter ){ return (iter == NULL); }
+multipython_response_iter_t multipython_response_iter_next( multipython_response_iter_t iter ){ return (MODADD_RESPONSE_PTR_FROM_ITER(iter)->next); }
+void multipython_response_foreach(multipython_response_iter_t head, void (*f)(multipython_response_iter_t iter, void*), void* args){
+    multipython_response_iter_t iter = NULL;
+    for( iter = multipython_response_iter_first(head); !multipython_response_iter_done(iter); iter = multipython_response_iter_next(iter) ){
+        f(iter, args);
+    }
+}
+
+
+// globals
+// responses are indexed by the hash of their condition. Nodes are only ever appended,
+// each with a single pointer store, so notify can walk a bucket without a lock (even
+// from an ISR) while another task registers a response
+#define MULTIPYTHON_RESPONSE_INDEX_MASK         (MICROPY_MULTIPYTHON_RESPONSE_BUCKETS - 1)
+multipython_response_node_t* multipython_response_index[MICROPY_MULTIPYTHON_RESPONSE_BUCKETS];
+
+// a copy of the state and heap of an interpreter that has booted, for contexts to
+// start from. It is followed by the heap image and freed once it has no users
+typedef struct _multipython_snapshot_t {
+    size_t          users;          // contexts about to restore it, plus one while it is current
+    uintptr_t       state_base;     // where the state and heap were when they were captured
+    uintptr_t       heap_base;
+    size_t          heap_size;
+    size_t          gap_start;      // offsets in the heap of its longest run of free blocks,
+    size_t          gap_end;        // which the image leaves out
+    size_t          image_size;     // bytes of the heap before the gap and after it up to the end of the pool
+    mp_state_ctx_t  state;
+} multipython_snapshot_t;
+// the image is followed by a bit for each of its words that holds a pointer
+#define MULTIPYTHON_SNAPSHOT_HEAP(snapshot)     ((uint8_t*)((snapshot) + 1))
+#define MULTIPYTHON_SNAPSHOT_WORDS(snapshot)    ((snapshot)->image_size / sizeof(uintptr_t))
+#define MULTIPYTHON_SNAPSHOT_POINTERS(snapshot) ((uintptr_t*)( MULTIPYTHON_SNAPSHOT_HEAP(snapshot) + (snapshot)->image_size ))
+#define MULTIPYTHON_SNAPSHOT_BITS               (8 * sizeof(uintptr_t))
+
+multipython_snapshot_t* multipython_snapshot = NULL;
+volatile uint32_t multipython_snapshot_generation = 0;
+
+// Forward declarations
+mp_obj_t execute_from_str(const char *str);
+
+// helper functions (not visible to users)
+#if MICROPY_MULTIPYTHON_STATS
+#define MULTIPYTHON_NUM_STATS   (7)
+
+STATIC void multipython_stats_read( mp_context_node_t* context, uint64_t* values ) {
+    // (run_us, switches, gc_collections, gc_us, alloc_bytes, heap_used, heap_peak)
+    // times are microseconds that the context spent switched in and collecting
+    mp_state_mem_t* mem = &context->state->mem;
+    values[0] = mp_context_run_us( context );
+    values[1] = context->run_stats.switches;
+    values[2] = mem->gc_collections;
+    values[3] = mem->gc_collect_us;
+    values[4] = mem->gc_alloc_blocks * MICROPY_BYTES_PER_GC_BLOCK;
+    values[5] = (uint64_t)mem->gc_used_blocks * MICROPY_BYTES_PER_GC_BLOCK;
+    values[6] = (uint64_t)mem->gc_peak_blocks * MICROPY_BYTES_PER_GC_BLOCK;
+}
+
+STATIC mp_obj_t multipython_stats_tuple( const uint64_t* values ) {
+    mp_obj_t stats[MULTIPYTHON_NUM_STATS];
+    for( size_t indi = 0; indi < MULTIPYTHON_NUM_STATS; indi++ ){
+        stats[indi] = mp_obj_new_int_from_ull( values[indi] );
+    }
+    return mp_obj_new_tuple( MULTIPYTHON_NUM_STATS, stats );
+}
+#endif
+
+STATIC mp_obj_t multipython_get_context_dict( mp_context_node_t* context, mp_int_t position ) {
+    if( context == NULL ){ return mp_const_none; }
+
+    mp_obj_t context_dict = mp_obj_new_dict(7);
+
+    const char* str_key_pos = "pos";
+    const char* str_key_tID = "tID";
+    const char* str_key_state = "state";
+    const char* str_key_mem = "mem";
+    const char* str_key_thread = "thread";
+    const char* str_key_args = "args";
+    const char* str_key_status = "status";
+    const char* str_key_context = "context_address";
+
+    mp_obj_t key_pos = mp_obj_new_str_via_qstr(str_key_pos, strlen(str_key_pos));
+    mp_obj_t key_tID = mp_obj_new_str_via_qstr(str_key_tID, strlen(str_key_tID));
+    mp_obj_t key_state = mp_obj_new_str_via_qstr(str_key_state, strlen(str_key_state));
+    mp_obj_t key_mem = mp_obj_new_str_via_qstr(str_key_mem, strlen(str_key_mem));
+    mp_obj_t key_thread = mp_obj_new_str_via_qstr(str_key_thread, strlen(str_key_thread));
+    mp_obj_t key_args = mp_obj_new_str_via_qstr(str_key_args, strlen(str_key_args));
+    mp_obj_t key_status = mp_obj_new_str_via_qstr(str_key_status, strlen(str_key_status));
+    mp_obj_t key_context = mp_obj_new_str_via_qstr(str_key_context, strlen(str_key_context));
+
+    mp_obj_t pos;
+    if(position < 0){ pos = mp_const_none; }
+    else{ pos = mp_obj_new_int(position); }
+    mp_obj_t tID = mp_obj_new_int((mp_int_t)context->id);
+    mp_obj_t state = mp_obj_new_int((mp_int_t)context->state);
+    mp_obj_t mem = mp_obj_new_int((mp_int_t)context->memhead);
+    mp_obj_t thread = mp_obj_new_int((mp_int_t)context->threadctrl);
+    mp_obj_t args = mp_obj_new_int((mp_int_t)&context->args);
+    mp_obj_t status = mp_obj_new_int((mp_int_t)context->status);
+    mp_obj_t context_obj = mp_obj_new_int((mp_int_t)context);
+
+    mp_obj_dict_store( context_dict,    key_pos,       pos      );
+    mp_obj_dict_store( context_dict,    key_tID,       tID      );
+    mp_obj_dict_store( context_dict,    key_state,     state    );
+    mp_obj_dict_store( context_dict,    key_mem,       mem      );
+    mp_obj_dict_store( context_dict,    key_thread,    thread   );
+    mp_obj_dict_store( context_dict,    key_args,      args     );
+    mp_obj_dict_store( context_dict,    key_status,    status   );
+    mp_obj_dict_store( context_dict,    key_context,   context_obj   );
+    #if MICROPY_MULTIPYTHON_STATS
+    uint64_t values[MULTIPYTHON_NUM_STATS];
+    multipython_stats_read( context, values );
+    mp_obj_dict_store( context_dict, MP_OBJ_NEW_QSTR(MP_QSTR_stats), multipython_stats_tuple( values ) );
+    #endif
+    // (size, high water) of the stack of the task in bytes, 0 where the port can't tell
+    mp_obj_t stack[2];
+    multipython_port_enter_critical();
+    size_t stack_size = context->args.stack_size;
+    size_t stack_used = multipython_port_stack_high_water( context );
+    multipython_port_exit_critical();
+    stack[0] = mp_obj_new_int_from_uint( stack_size );
+    stack[1] = mp_obj_new_int_from_uint( stack_used );
+    mp_obj_dict_store( context_dict, MP_OBJ_NEW_QSTR(MP_QSTR_stack), mp_obj_new_tuple( 2, stack ) );
+    mp_obj_dict_store( context_dict, MP_OBJ_NEW_QSTR(MP_QSTR_priority), MP_OBJ_NEW_SMALL_INT( context->args.priority ) );
+    #if MICROPY_MULTIPYTHON_BUDGET
+    // (budget_us, period_us, overruns, held_us), all 0 for a context without a budget
+    mp_obj_t budget[4];
+    budget[0] = mp_obj_new_int_from_uint( context->budget.budget_us );
+    budget[1] = mp_obj_new_int_from_uint( context->budget.period_us );
+    budget[2] = mp_obj_new_int_from_uint( context->budget.overruns );
+    budget[3] = mp_obj_new_int_from_ull( context->budget.held_us );
+    mp_obj_dict_store( context_dict, MP_OBJ_NEW_QSTR(MP_QSTR_budget), mp_obj_new_tuple( 4, budget ) );
+    #endif
+
+    return context_dict;
+}
+
+
+STATIC bool multipython_condition_hash( mp_obj_t condition, mp_uint_t* hash ){
+    // small ints hash to their value, so ISRs can find them without the Python heap
+    // returns false (and a hash of 0) for conditions that can't be hashed, e.g. lists
+    *hash = 0;
+    if( mp_obj_is_small_int(condition) ){
+        *hash = (mp_uint_t)MP_OBJ_SMALL_INT_VALUE(condition);
+        return true;
+    }
+    nlr_buf_t nlr;
+    if( nlr_push(&nlr) == 0 ){
+        *hash = (mp_uint_t)mp_obj_get_int_truncated( mp_unary_op(MP_UNARY_OP_HASH, condition) );
+        nlr_pop();
+        return true;
+    }
+    return false;
+}
+
+static inline multipython_response_node_t** multipython_response_bucket( mp_uint_t hash ){
+    // mix the bits so that runs of small ints spread over the buckets
+    uint32_t mixed = (uint32_t)hash;
+    mixed ^= mixed >> 16;
+    mixed *= 0x45d9f3b;
+    mixed ^= mixed >> 16;
+    return &multipython_response_index[mixed & MULTIPYTHON_RESPONSE_INDEX_MASK];
+}
+
+STATIC void multipython_apply_control( mp_context_node_t* context, multipython_op_e op ){
+    // apply the control operation of a response as soon as it is notified, so that
+    // the target does not have to wait for anyone to poll its queue. Must not allocate
+    if( context == mp_context_head ){ return; }
+    switch( op ){
+        case MP_CONTROL_OP_RESUME :
+            if( context->status & MP_CSUSP ){
+                context->status &= ~MP_CSUSP;
+                multipython_port_task_resume( context );
+            }
+            break;
+        case MP_CONTROL_OP_SUSPEND :
+            context->status |= MP_CSUSP;
+            if( multipython_port_task_suspend( context ) != 0 ){
+                context->status &= ~MP_CSUSP; // e.g. the port can't suspend from an interrupt
+            }
+            break;
+        case MP_CONTROL_OP_STOP :
+            multipython_port_task_end( context );
+            break;
+        default :
+            break;
+    }
+}
+
+STATIC MULTIPYTHON_NOTIFY_ATTR void multipython_deliver( multipython_response_obj_t* response ){
+    // queue a response for its context and apply its control operation. Must not
+    // allocate, since it is also used from ISRs
+    mp_response_t response_entry = {
+        .control_op = response->control_op,
+        .argument = response->argument,
+    };
+    if( mp_response_queue_write( &(response->context->response_queue), response_entry ) == 1 ){
+        multipython_port_signal( response->context );
+    }
+    if( response->control_op != MP_CONTROL_OP_NONE ){
+        multipython_apply_control( response->context, response->control_op );
+    }
+}
+
+typedef int8_t (*multipython_control_f)( uint32_t taskID );
+
+int8_t multipython_end_task( uint32_t taskID ){
+    mp_context_node_t* context = mp_context_by_tid( taskID );
+    if( context == mp_context_head )                { mp_raise_OSError(MP_EACCES); }
+    if( ( taskID == 0 ) || ( context == NULL ) )    { mp_raise_OSError(MP_ENXIO); }
+    return multipython_port_task_end( context );
+}
+
+int8_t multipython_suspend_task( uint32_t taskID ){
+    mp_context_node_t* context = mp_context_by_tid( taskID );
+    if( context == mp_context_head )                { mp_raise_OSError(MP_EACCES); }
+    if( ( taskID == 0 ) || ( context == NULL ) )    { mp_raise_OSError(MP_ENXIO); }
+    context->status |= MP_CSUSP;
+    return multipython_port_task_suspend( context );
+}
+
+int8_t multipython_resume_task( uint32_t taskID ){
+    mp_context_node_t* context = mp_context_by_tid( taskID );
+    if( context == mp_context_head )                { mp_raise_OSError(MP_EACCES); }
+    if( ( taskID == 0 ) || ( context == NULL ) )    { mp_raise_OSError(MP_ENXIO); }
+    if( !(context->status & MP_CSUSP) )             { return -1; }
+    context->status &= ~MP_CSUSP;
+    return multipython_port_task_resume( context );
+}
+
+
+
+
+// interface
+STATIC mp_obj_t multipython_start(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    // start new processes (contexts)
+    // sizes of 0 select the defaults of the port. The heap starts at 'heap_size' bytes (at
+    // least MULTIPYTHON_HEAP_MIN) and grows on demand up to 'heap_max' bytes in total.
+    // The heap is allocated before start() returns. The response queue holds
+    // 'queue_depth' responses, rounded up to a power of 2. With MICROPY_ENABLE_PYSTACK
+    // the frames of calls go to a pystack of 'pystack_size' bytes instead of the heap.
+    // 'stack_size' is the stack of the task of the context and 'thread_stack_size' the
+    // stack of the threads it starts, until it calls _thread.stack_size()
+    // 'priority' is one of the PRIORITY_ classes. A context given 'budget_us' runs for at
+    // most that long in every 'period_us', and is held back for the rest of a period once
+    // it has used up its budget (see multipython_budget_point())
+    // with 'snapshot' the context clones the interpreter captured by snapshot() instead
+    // of booting one, and its heap starts at the size of the snapshot
+    enum { ARG_source, ARG_type, ARG_core, ARG_suspend, ARG_heap_size, ARG_stack_size, ARG_heap_max, ARG_queue_depth, ARG_snapshot, ARG_pystack_size, ARG_thread_stack_size, ARG_priority, ARG_budget_us, ARG_period_us };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_source,       MP_ARG_REQUIRED | MP_ARG_OBJ,   {.u_obj = mp_const_none} },
+        { MP_QSTR_type,         MP_ARG_INT,                     {.u_int = MP_PARSE_FILE_INPUT} },
+        { MP_QSTR_core,         MP_ARG_OBJ,                     {.u_obj = mp_const_none} },
+        { MP_QSTR_suspend,      MP_ARG_INT,                     {.u_int = 0} },
+        { MP_QSTR_heap_size,    MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 0} },
+        { MP_QSTR_stack_size,   MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 0} },
+        { MP_QSTR_heap_max,     MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 0} },
+        { MP_QSTR_queue_depth,  MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 0} },
+        { MP_QSTR_snapshot,     MP_ARG_KW_ONLY | MP_ARG_BOOL,   {.u_bool = false} },
+        { MP_QSTR_pystack_size, MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 0} },
+        { MP_QSTR_thread_stack_size, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_priority,     MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = MULTIPYTHON_PRIORITY_NORMAL} },
+        { MP_QSTR_budget_us,    MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 0} },
+        { MP_QSTR_period_us,    MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = MULTIPYTHON_BUDGET_PERIOD_US} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if( ( args[ARG_heap_size].u_int < 0 ) || ( args[ARG_stack_size].u_int < 0 ) || ( args[ARG_heap_max].u_int < 0 ) || ( args[ARG_pystack_size].u_int < 0 ) || ( args[ARG_thread_stack_size].u_int < 0 ) ){
+        mp_raise_ValueError("sizes must not be negative");
+        return mp_const_none;
+    }
+    if( ( args[ARG_heap_size].u_int != 0 ) && ( args[ARG_heap_size].u_int < MULTIPYTHON_HEAP_MIN ) ){
+        mp_raise_ValueError("heap_size too small");
+        return mp_const_none;
+    }
+    if( ( args[ARG_queue_depth].u_int < 0 ) || ( args[ARG_queue_depth].u_int > MULTIPYTHON_QUEUE_DEPTH_MAX ) ){
+        mp_raise_ValueError("queue depth out of range");
+        return mp_const_none;
+    }
+    if( ( args[ARG_priority].u_int < MULTIPYTHON_PRIORITY_LOW ) || ( args[ARG_priority].u_int > MULTIPYTHON_PRIORITY_REALTIME ) ){
+        mp_raise_ValueError("unknown priority class");
+        return mp_const_none;
+    }
+    if( ( args[ARG_budget_us].u_int < 0 ) || ( (uint64_t)args[ARG_budget_us].u_int > UINT32_MAX ) || ( args[ARG_period_us].u_int <= 0 ) || ( (uint64_t)args[ARG_period_us].u_int > UINT32_MAX ) ){
+        mp_raise_ValueError("budget out of range");
+        return mp_const_none;
+    }
+    #if !MICROPY_MULTIPYTHON_BUDGET
+    if( args[ARG_budget_us].u_int != 0 ){
+        mp_raise_ValueError("budgets not supported");
+        return mp_const_none;
+    }
+    #endif
+
+    multipython_port_enter_critical();
+    mp_context_node_t* context = mp_task_register( 0, args[ARG_queue_depth].u_int, NULL ); // register a task with unknown ID and NULL additional arguments
+    multipython_port_exit_critical();
+    if( context == NULL ){
+        mp_raise_OSError(MP_ENOMEM);
+        return mp_const_none;
+    }
+
+    // the source is text (code, or the name of a file with type=1), the name of a frozen
+    // module with type=FROZEN, or an .mpy image given as bytes (see compile()). Code
+    // from an image or a frozen module only has to be loaded by the context, not compiled
+    const void* str = NULL;
+    size_t len = 0;
+    mp_task_source_kind_t source_kind = MP_TASK_SOURCE_TEXT;
+    if( mp_obj_is_str(args[ARG_source].u_obj) ){
+        str = mp_obj_str_get_str(args[ARG_source].u_obj);
+        len = strlen(str) + 1;
+        if( args[ARG_type].u_int == MULTIPYTHON_TYPE_FROZEN ){
+            source_kind = MP_TASK_SOURCE_FROZEN;
+            #if MICROPY_MODULE_FROZEN
+            bool found = ( mp_frozen_stat(str) == MP_IMPORT_STAT_FILE );
+            #else
+            bool found = false;
+            #endif
+            if( !found ){
+                multipython_port_enter_critical();
+                mp_context_remove( context );
+                multipython_port_exit_critical();
+                mp_raise_OSError(MP_ENOENT);
+                return mp_const_none;
+            }
+        }
+    }else{
+        mp_buffer_info_t bufinfo;
+        if( !mp_get_buffer(args[ARG_source].u_obj, &bufinfo, MP_BUFFER_READ) ){
+            multipython_port_enter_critical();
+            mp_context_remove( context );
+            multipython_port_exit_critical();
+            mp_raise_TypeError("source must be str or bytes");
+            return mp_const_none;
+        }
+        str = bufinfo.buf;
+        len = bufinfo.len;
+        source_kind = MP_TASK_SOURCE_MPY;
+    }
+
+    void* source = mp_context_dynmem_alloc( len, context ); // allocate global memory tied to the allocated context
+    if( source == NULL ){
+        multipython_port_enter_critical();
+        mp_context_remove( context );
+        multipython_port_exit_critical();
+        mp_raise_OSError(MP_ENOMEM);
+        return mp_const_none;
+    }
+    memcpy(source, str, len);
+    context->args.input_kind = MP_PARSE_FILE_INPUT;
+    context->args.source_kind = source_kind;
+    context->args.source = source;
+    context->args.source_len = len;
+    context->args.suspend = args[ARG_suspend].u_int;
+    context->args.heap_size = args[ARG_heap_size].u_int;
+    context->args.heap_max = args[ARG_heap_max].u_int;
+    context->args.stack_size = args[ARG_stack_size].u_int;
+    context->args.pystack_size = args[ARG_pystack_size].u_int;
+    context->args.thread_stack_size = args[ARG_thread_stack_size].u_int;
+    context->args.priority = args[ARG_priority].u_int;
+    #if MICROPY_MULTIPYTHON_BUDGET
+    if( args[ARG_budget_us].u_int != 0 ){
+        context->budget.budget_us = args[ARG_budget_us].u_int;
+        context->budget.period_us = args[ARG_period_us].u_int;
+        context->budget.period_start = mp_hal_ticks_us();
+        context->budget.countdown = MICROPY_MULTIPYTHON_BUDGET_INTERVAL;
+        context->status |= MP_CBUDGET;
+    }
+    #endif
+
+    if( args[ARG_snapshot].u_bool ){
+        multipython_port_enter_critical();
+        multipython_snapshot_t* snapshot = multipython_snapshot;
+        if( snapshot != NULL ){
+            snapshot->users++;
+        }
+        context->args.snapshot = snapshot;
+        multipython_port_exit_critical();
+        if( snapshot == NULL ){
+            multipython_port_enter_critical();
+            mp_context_remove( context );
+            multipython_port_exit_critical();
+            mp_raise_OSError(MP_ENOENT); // snapshot() has not been called
+            return mp_const_none;
+        }
+    }
+
+    if( args[ARG_type].u_int == MP_PARSE_SINGLE_INPUT ){
+        context->args.input_kind = MP_PARSE_SINGLE_INPUT;
+    }
+
+    mp_int_t core = -1; // core determined by the port
+    if( args[ARG_core].u_obj != mp_const_none ){
+        core = mp_obj_get_int( args[ARG_core].u_obj );
+        if( core < 0 ){
+            core = 0;
+        }
+    }
+
+    int ret = multipython_port_task_create( context, core );
+    if( ret != 0 ){
+        multipython_snapshot_release( context );
+        multipython_port_enter_critical();
+        mp_context_remove( context );
+        multipython_port_exit_critical();
+        mp_raise_OSError(ret);
+        return mp_const_none;
+    }
+
+    return MP_OBJ_NEW_SMALL_INT((mp_int_t)context);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(multipython_start_obj, 1, multipython_start);
+
+STATIC mp_obj_t multipython_snapshot_take(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    // boot an interpreter in a new context, run the code given as source in it if any,
+    // and keep a copy of it for start(snapshot=True). Blocks until the copy is taken
+    // and returns its size in bytes
+    enum { ARG_heap_size, ARG_source };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_heap_size,    MP_ARG_INT,     {.u_int = 0} },
+        { MP_QSTR_source,       MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if( args[ARG_heap_size].u_int < 0 ){
+        mp_raise_ValueError("sizes must not be negative");
+        return mp_const_none;
+    }
+    if( ( args[ARG_heap_size].u_int != 0 ) && ( args[ARG_heap_size].u_int < MULTIPYTHON_HEAP_MIN ) ){
+        mp_raise_ValueError("heap_size too small");
+        return mp_const_none;
+    }
+
+    multipython_port_enter_critical();
+    mp_context_node_t* context = mp_task_register( 0, 0, NULL );
+    multipython_port_exit_critical();
+    if( context == NULL ){
+        mp_raise_OSError(MP_ENOMEM);
+        return mp_const_none;
+    }
+    context->args.capture = 1;
+    context->args.heap_size = args[ARG_heap_size].u_int;
+    if( args[ARG_source].u_obj != mp_const_none ){
+        const char* str = mp_obj_str_get_str(args[ARG_source].u_obj);
+        size_t len = strlen(str) + 1;
+        void* source = mp_context_dynmem_alloc( len, context );
+        if( source == NULL ){
+            multipython_port_enter_critical();
+            mp_context_remove( context );
+            multipython_port_exit_critical();
+            mp_raise_OSError(MP_ENOMEM);
+            return mp_const_none;
+        }
+        memcpy(source, str, len);
+        context->args.input_kind = MP_PARSE_SINGLE_INPUT;
+        context->args.source_kind = MP_TASK_SOURCE_TEXT;
+        context->args.source = source;
+        context->args.source_len = len;
+    }
+
+    uint32_t generation = multipython_snapshot_generation;
+    int ret = multipython_port_task_create( context, -1 );
+    if( ret != 0 ){
+        multipython_port_enter_critical();
+        mp_context_remove( context );
+        multipython_port_exit_critical();
+        mp_raise_OSError(ret);
+        return mp_const_none;
+    }
+
+    // the context ends right after the capture
+    for( ;; ){
+        mp_context_iter_t iter = NULL;
+        multipython_port_enter_critical();
+        for( iter = mp_context_iter_first(MP_ITER_FROM_CONTEXT_PTR(mp_context_head)); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter) ){
+            if(MP_CONTEXT_PTR_FROM_ITER(iter) == context){ break; }
+        }
+        multipython_port_exit_critical();
+        if( mp_context_iter_done(iter) ){ break; }
+        mp_hal_delay_ms(1);
+    }
+
+    size_t size = 0;
+    multipython_port_enter_critical();
+    if( ( multipython_snapshot_generation != generation ) && ( multipython_snapshot != NULL ) ){
+        size = sizeof(multipython_snapshot_t) + multipython_snapshot->image_size;
+    }
+    multipython_port_exit_critical();
+    if( size == 0 ){
+        mp_raise_OSError(MP_ENOMEM);
+        return mp_const_none;
+    }
+    return mp_obj_new_int_from_uint(size);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(multipython_snapshot_take_obj, 0, multipython_snapshot_take);
+
+#if MICROPY_PERSISTENT_CODE_SAVE
+STATIC mp_obj_t multipython_compile(size_t n_args, const mp_obj_t *args) {
+    // compile source (or a file with type=1) once and return it as an .mpy image,
+    // which start() can run in any number of contexts without compiling it again
+    const char *str = mp_obj_str_get_str(args[0]);
+    mp_int_t type = ( n_args > 1 ) ? mp_obj_get_int(args[1]) : MP_PARSE_FILE_INPUT;
+    mp_lexer_t *lex;
+    if( type == MP_PARSE_FILE_INPUT ){
+        lex = mp_lexer_new_from_file(str);
+    }else{
+        lex = mp_lexer_new_from_str_len(MP_QSTR__lt_string_gt_, str, strlen(str), false);
+    }
+    qstr src_name = lex->source_name;
+    mp_parse_tree_t pt = mp_parse(lex, MP_PARSE_FILE_INPUT);
+    mp_raw_code_t *rc = mp_compile_to_raw_code(&pt, src_name, MP_EMIT_OPT_NONE, false);
+
+    vstr_t vstr;
+    mp_print_t print;
+    vstr_init_print(&vstr, 64, &print);
+    mp_raw_code_save(rc, &print);
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(multipython_compile_obj, 1, 2, multipython_compile);
+#endif
+
+#if MICROPY_MULTIPYTHON_CODE_CACHE
+STATIC mp_obj_t multipython_code_cache( void ){
+    // modules whose code is shared, as a list of (path, users, bytes)
+    return multipython_code_cache_info();
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(multipython_code_cache_obj, multipython_code_cache);
+#endif
+
+STATIC mp_obj_t multipython_control(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args){
+    // apply an operation to specified processes
+    // specify which processes to affect by:
+    // - providing the argument 'ids' as None to affect the calling process
+    // - providing an integer, or list of integers
+    //   - if 'use_context' is false then the 'ids' correspond to taskIDs                                       // todo: remove tID from multipython interface. Users should deal only with the id of the context as the address of the multipython context node.
+    //   - if 'use_context' is true then the 'ids' correspond to pointers to the multipython context objects
+    // specify the operation as one of the 'multipython_op_e' values
+
+    // typically returns a list of tIDs that were affected                                                      // todo: change API to simply always return the micropython object correspinding to the context. that means making contexts into a micropython object type
+    // when the operation is 'GET' returns a list of dictionaries containing information about active contexts.
+
+    enum { ARG_ids, ARG_op, ARG_use_context};
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_ids,          MP_ARG_OBJ,                     {.u_obj = mp_const_none} },
+        { MP_QSTR_op,           MP_ARG_INT,                     {.u_int = MP_CONTROL_OP_NONE } },
+        { MP_QSTR_use_context,  MP_ARG_OBJ,                     {.u_obj = mp_const_false} },
+    };
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    // determine the operation
+    multipython_control_f op_func = NULL;
+    switch( args[ARG_op].u_int ){
+        case MP_CONTROL_OP_STOP :       op_func = multipython_end_task;     /*printf("operation: stop\n");*/        break; // todo: rename 'stop' to 'end' b/c it is more dramatic
+        case MP_CONTROL_OP_RESUME :     op_func = multipython_resume_task;  /*printf("operation: resume\n");*/      break;
+        case MP_CONTROL_OP_SUSPEND :    op_func = multipython_suspend_task; /*printf("operation: suspend\n");*/     break;
+
+        case MP_CONTROL_OP_NONE :
+        case MP_CONTROL_OP_NUM :
+            mp_raise_msg(&mp_type_OSError, "Operation not supported\n");
+            return mp_const_none;
+            break;
+    }
+
+    mp_context_iter_t iter = NULL;
+    mp_obj_t controlled_contexts = mp_obj_new_list( 0, NULL );
+
+    // append items to the list
+    if(n_args == 0){    // with 0 arguments all contexts are affected
+        for(iter = mp_context_iter_next(mp_context_iter_first(mp_context_head)); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter)){
+            if( op_func( (uint32_t)MP_CONTEXT_PTR_FROM_ITER(iter)->id ) == 0 ){
+                mp_obj_list_append(controlled_contexts, mp_obj_new_int(MP_CONTEXT_PTR_FROM_ITER(iter)->id) );
+            }
+        }
+    }else{
+        if(mp_obj_is_int(args[ARG_ids].u_obj)){
+            mp_int_t id = mp_obj_int_get_truncated(args[ARG_ids].u_obj);
+            uint32_t target_id = (uint32_t)id;
+            if( mp_obj_is_true( args[ARG_use_context].u_obj ) ){
+                mp_context_node_t* node = (mp_context_node_t*)id;
+                target_id = node->id;
+            }
+            for(iter = mp_context_iter_first(mp_context_head); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter)){
+                if( MP_CONTEXT_PTR_FROM_ITER(iter)->id == target_id ){
+                    if( op_func( (uint32_t)MP_CONTEXT_PTR_FROM_ITER(iter)->id ) == 0 ){
+                        mp_obj_list_append(controlled_contexts, mp_obj_new_int(target_id) );
+                    }
+                    break;
+                }
+            }
+        }else if( mp_obj_is_type(args[ARG_ids].u_obj, &mp_type_list) ){
+            size_t size;
+            mp_obj_t* items;
+            mp_obj_list_get(args[ARG_ids].u_obj, &size, &items );
+            for( size_t indi = 0; indi < size; indi++ ){
+                if( !mp_obj_is_int(items[indi]) ){
+                    mp_raise_TypeError("list element of non-integer type");
+                    return mp_const_none;
+                }
+            }
+            for( size_t indi = 0; indi < size; indi++ ){
+                mp_int_t id = mp_obj_int_get_truncated(items[indi]);
+                uint32_t target_id = (uint32_t)id;
+                if( mp_obj_is_true( args[ARG_use_context].u_obj ) ){
+                    mp_context_node_t* node = (mp_context_node_t*)id;
+                    target_id = node->id;
+                }
+                if( mp_context_by_tid( target_id ) != NULL ){
+                    if( op_func( target_id ) == 0 ){
+                        mp_obj_list_append(controlled_contexts, mp_obj_new_int(target_id) );
+                    }
+                }
+            }
+        }else if( mp_obj_is_type(args[ARG_ids].u_obj, &mp_type_NoneType ) ){
+            uint32_t self_id = mp_active_contexts[MICROPY_GET_CORE_INDEX]->id;
+            if( op_func( self_id ) == 0 ){
+                mp_obj_list_append(controlled_contexts, mp_obj_new_int(self_id) );
+            }
+        }else{
+            mp_raise_TypeError("expects integer or list of integers");
+            return mp_const_none;
+        }
+    }
+    return controlled_contexts;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(multipython_control_obj, 0, multipython_control);
+
+STATIC mp_obj_t multipython_get(size_t n_args, const mp_obj_t *args) {
+    // return a list of dictionaries that represent each context
+    // optionally use a list of tIDs for which to return the information as the argument
+    // if 'None' is passed as an argument then the information for the current context is returned
+
+    size_t num_entries = 0;
+    mp_context_iter_t iter = NULL;
+    mp_obj_t context_list = mp_obj_new_list( 0, NULL );
+
+    // append items to the list
+    switch( n_args ){
+        case 1:
+            if(mp_obj_is_int(args[0])){
+                for(iter = mp_context_iter_first(mp_context_head); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter)){
+                    if( MP_CONTEXT_PTR_FROM_ITER(iter)->id == mp_obj_int_get_truncated(args[0]) ){
+                        mp_obj_list_append(context_list, multipython_get_context_dict( MP_CONTEXT_PTR_FROM_ITER(iter), num_entries++ ));
+                    }
+                }
+            }else if( mp_obj_is_type(args[0], &mp_type_list) ){
+                size_t size;
+                mp_obj_t* items;
+                mp_obj_list_get(args[0], &size, &items );
+                for( size_t indi = 0; indi < size; indi++ ){
+                    if( !mp_obj_is_type(items[indi], &mp_type_int) ){
+                        mp_raise_TypeError("list element of non-integer type");
+                        return mp_const_none;
+                    }
+                }
+                for(iter = mp_context_iter_first(mp_context_head); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter)){
+                    for( size_t indi = 0; indi < size; indi++ ){
+                        if( MP_CONTEXT_PTR_FROM_ITER(iter)->id == mp_obj_int_get_truncated(items[indi]) ){
+                            mp_obj_list_append(context_list, multipython_get_context_dict( MP_CONTEXT_PTR_FROM_ITER(iter), num_entries++ ));
+                        }
+                    }
+                }
+            }else if( mp_obj_is_type(args[0], &mp_type_NoneType ) ){
+                mp_obj_list_append(context_list, multipython_get_context_dict( mp_active_contexts[MICROPY_GET_CORE_INDEX], -1 ));
+            }else{
+                mp_raise_TypeError("expects integer or list of integers");
+                return mp_const_none;
+            }
+            break;
+
+        case 0:
+        default:
+            for(iter = mp_context_iter_first(mp_context_head); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter)){
+                mp_obj_list_append(context_list, multipython_get_context_dict( MP_CONTEXT_PTR_FROM_ITER(iter), num_entries++ ));
+            }
+            break;
+    }
+    return context_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(multipython_get_obj, 0, 1, multipython_get);
+
+STATIC mp_obj_t multipython_get_task_id(mp_obj_t context_ptr_obj) {
+    // return the taskID for the task whose context is at the address pointed to by the context ptr number
+
+    // todo: make this function default to returning the tID of the executing process, if no arguments supplied
+
+    if( !mp_obj_is_int(context_ptr_obj) ){
+        return mp_const_none;
+    }
+
+    mp_context_node_t* context = (mp_context_node_t*)mp_obj_int_get_truncated( context_ptr_obj );
+    mp_context_iter_t iter = NULL;
+
+    if( context == NULL ){
+        return mp_const_none;
+    }
+
+    uint32_t id = 0;
+    multipython_port_enter_critical(); // the context may be ending on another task
+    for( iter = mp_context_iter_first(MP_ITER_FROM_CONTEXT_PTR(mp_context_head)); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter) ){
+        if(MP_CONTEXT_PTR_FROM_ITER(iter) == context){ break; }
+    }
+    if( !mp_context_iter_done(iter) ){
+        id = MP_CONTEXT_PTR_FROM_ITER(iter)->id;
+    }
+    multipython_port_exit_critical();
+    if( mp_context_iter_done(iter) ){
+        return mp_const_none;
+    }
+
+    return mp_obj_new_int_from_uint(id);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(multipython_get_task_id_obj, multipython_get_task_id);
+
+MULTIPYTHON_NOTIFY_ATTR mp_obj_t multipython_notify(mp_obj_t condition) { // notify any applicable tasks about a given condition
+    if( mp_obj_equal(condition, mp_const_none) ){ return mp_const_none; }
+
+    // only the responses in the bucket of the condition can match it
+    mp_uint_t hash;
+    multipython_condition_hash( condition, &hash );
+    multipython_response_iter_t iter = NULL;
+    for( iter = multipython_response_iter_first(*multipython_response_bucket(hash)); !multipython_response_iter_done(iter); iter = multipython_response_iter_next(iter) ){
+        multipython_response_node_t* node = MODADD_RESPONSE_PTR_FROM_ITER(iter);
+        if( node->hash != hash ){ continue; }
+        if( ( node->response->condition == condition ) || mp_obj_equal(node->response->condition, condition) ){
+            multipython_deliver( node->response );
+        }
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(multipython_notify_obj, multipython_notify);
+
+MULTIPYTHON_NOTIFY_ATTR size_t multipython_notify_from_isr( mp_int_t condition ){
+    // notify about a small int condition without touching the Python heap, so that it
+    // is safe to call from GPIO and timer ISRs. Returns the number of matching responses
+    mp_obj_t condition_obj = MP_OBJ_NEW_SMALL_INT(condition);
+    size_t matched = 0;
+    multipython_response_iter_t iter = NULL;
+    for( iter = multipython_response_iter_first(*multipython_response_bucket((mp_uint_t)condition)); !multipython_response_iter_done(iter); iter = multipython_response_iter_next(iter) ){
+        multipython_response_node_t* node = MODADD_RESPONSE_PTR_FROM_ITER(iter);
+        if( node->response->condition == condition_obj ){
+            multipython_deliver( node->response );
+            matched++;
+        }
+    }
+    return matched;
+}
+
+STATIC mp_obj_t multipython_check_responses(size_t n_args, const mp_obj_t *args) {
+    // check if there are any pending operations for the calling process
+    // the optional timeout is in ms: 0 (the default) only polls, None or a negative
+    // value waits for as long as it takes. Returns None if nothing arrived
+
+    mp_context_node_t* self = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    mp_int_t timeout_ms = 0;
+    if( n_args > 0 ){
+        timeout_ms = ( args[0] == mp_const_none ) ? -1 : mp_obj_get_int(args[0]);
+    }
+
+    mp_uint_t start = mp_hal_ticks_ms();
+    mp_response_t response;
+    while( mp_response_queue_read(&(self->response_queue), &response) != 1 ){
+        mp_int_t remaining = -1;
+        if( timeout_ms >= 0 ){
+            remaining = timeout_ms - (mp_int_t)( mp_hal_ticks_ms() - start );
+            if( remaining <= 0 ){
+                return mp_const_none;
+            }
+        }
+        multipython_port_wait( self, remaining );
+
+        // the context may have been stopped (or interrupted) while it was parked
+        mp_obj_t exc = MP_STATE_VM(mp_pending_exception);
+        if( ( exc == MP_OBJ_NULL ) && ( self->status & MP_CSTOP ) ){
+            exc = MP_OBJ_FROM_PTR(&MP_STATE_VM(mp_kbd_exception)); // one of its threads took the first one
+        }
+        if( exc != MP_OBJ_NULL ){
+            MP_STATE_VM(mp_pending_exception) = MP_OBJ_NULL;
+            nlr_raise(exc);
+        }
+    }
+    return response.argument;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(multipython_check_responses_obj, 0, 1, multipython_check_responses);
+
+STATIC mp_obj_t multipython_queue_stats(size_t n_args, const mp_obj_t *args) {
+    // return (depth, pending, overflows, dropped) for the response queue of a context
+    // given by its address, or of the calling context
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    if( ( n_args > 0 ) && ( args[0] != mp_const_none ) ){
+        context = (mp_context_node_t*)mp_obj_int_get_truncated( args[0] );
+    }
+
+    mp_obj_t stats[4];
+    mp_context_iter_t iter = NULL;
+    multipython_port_enter_critical(); // the context may be ending on another task
+    for( iter = mp_context_iter_first(MP_ITER_FROM_CONTEXT_PTR(mp_context_head)); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter) ){
+        if(MP_CONTEXT_PTR_FROM_ITER(iter) == context){ break; }
+    }
+    size_t values[4] = {0};
+    if( !mp_context_iter_done(iter) ){
+        mp_response_queue_t* queue = &context->response_queue;
+        values[0] = mp_response_queue_depth( queue );
+        values[1] = mp_response_queue_available( queue );
+        values[2] = queue->overflows;
+        values[3] = queue->dropped;
+    }
+    multipython_port_exit_critical();
+    if( mp_context_iter_done(iter) ){
+        return mp_const_none;
+    }
+
+    for( size_t indi = 0; indi < MP_ARRAY_SIZE(stats); indi++ ){
+        stats[indi] = mp_obj_new_int_from_uint( values[indi] );
+    }
+    return mp_obj_new_tuple( MP_ARRAY_SIZE(stats), stats );
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(multipython_queue_stats_obj, 0, 1, multipython_queue_stats);
+
+#if MICROPY_MULTIPYTHON_STATS
+STATIC mp_obj_t multipython_stats(size_t n_args, const mp_obj_t *args) {
+    // return the runtime accounting of a context given by its address, or of the
+    // calling context, as (run_us, switches, gc_collections, gc_us, alloc_bytes, heap_used, heap_peak)
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    if( ( n_args > 0 ) && ( args[0] != mp_const_none ) ){
+        context = (mp_context_node_t*)mp_obj_int_get_truncated( args[0] );
+    }
+
+    uint64_t values[MULTIPYTHON_NUM_STATS];
+    mp_context_iter_t iter = NULL;
+    multipython_port_enter_critical(); // the context may be ending on another task
+    for( iter = mp_context_iter_first(MP_ITER_FROM_CONTEXT_PTR(mp_context_head)); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter) ){
+        if(MP_CONTEXT_PTR_FROM_ITER(iter) == context){ break; }
+    }
+    if( !mp_context_iter_done(iter) ){
+        multipython_stats_read( context, values );
+    }
+    multipython_port_exit_critical();
+    if( mp_context_iter_done(iter) ){
+        return mp_const_none;
+    }
+    return multipython_stats_tuple( values );
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(multipython_stats_obj, 0, 1, multipython_stats);
+#endif
+
+STATIC mp_obj_t multipython_context( void ) {
+    // return the context address of calling process
+    return MP_OBJ_NEW_SMALL_INT((mp_int_t)mp_active_contexts[MICROPY_GET_CORE_INDEX]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(multipython_context_obj, multipython_context);
+
+STATIC mp_obj_t multipython_switch_bench( mp_obj_t num_contexts_in, mp_obj_t iterations_in ) {
+    // measure the cost of the task switch hook with a given number of registered contexts
+    // returns the average time per switch in nanoseconds
+    mp_int_t num_contexts = mp_obj_get_int(num_contexts_in);
+    mp_int_t iterations = mp_obj_get_int(iterations_in);
+    if( ( num_contexts < 1 ) || ( iterations < 1 ) ){
+        mp_raise_ValueError("expects positive numbers of contexts and iterations");
+        return mp_const_none;
+    }
+
+    // register dummy contexts with IDs that cannot collide with real tasks
+    mp_int_t registered = 0;
+    multipython_port_enter_critical();
+    for( ; registered < num_contexts; registered++ ){
+        if( mp_task_register( MULTIPYTHON_SWITCH_BENCH_TID_BASE + registered, 0, NULL ) == NULL ){ break; }
+    }
+    if( registered != num_contexts ){
+        for( mp_int_t indi = 0; indi < registered; indi++ ){
+            mp_task_remove( MULTIPYTHON_SWITCH_BENCH_TID_BASE + indi );
+        }
+        multipython_port_exit_critical();
+        mp_raise_OSError(MP_ENOMEM);
+        return mp_const_none;
+    }
+    multipython_port_exit_critical();
+
+    // the calling task must not be scheduled out while a dummy context is active
+    uint32_t self_id = mp_current_tIDs[MICROPY_GET_CORE_INDEX];
+    multipython_port_sched_lock();
+    mp_uint_t start = mp_hal_ticks_us();
+    for( mp_int_t indi = 0; indi < iterations; indi++ ){
+        mp_task_switched_in( MULTIPYTHON_SWITCH_BENCH_TID_BASE + (indi % num_contexts) );
+        mp_task_switched_in( self_id );
+    }
+    mp_uint_t elapsed = mp_hal_ticks_us() - start;
+    multipython_port_sched_unlock();
+
+    multipython_port_enter_critical();
+    for( mp_int_t indi = 0; indi < num_contexts; indi++ ){
+        mp_task_remove( MULTIPYTHON_SWITCH_BENCH_TID_BASE + indi );
+    }
+    multipython_port_exit_critical();
+
+    return mp_obj_new_int_from_uint( ((uint64_t)elapsed * 1000) / (2 * (uint64_t)iterations) );
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(multipython_switch_bench_obj, multipython_switch_bench);
+
+STATIC mp_obj_t multipython_init( void ){
+    if(multipython_is_initialized == true){ return mp_const_none; }
+
+    multipython_port_init();
+
+    multipython_is_initialized = true;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(multipython_init_obj, multipython_init);
+
+
+// Module Definitions
+STATIC const mp_rom_map_elem_t mp_module_multipython_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_multipython) },
+
+    { MP_ROM_QSTR(MP_QSTR_start), MP_ROM_PTR(&multipython_start_obj) },                 // processes
+    { MP_ROM_QSTR(MP_QSTR_snapshot), MP_ROM_PTR(&multipython_snapshot_take_obj) },
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    { MP_ROM_QSTR(MP_QSTR_compile), MP_ROM_PTR(&multipython_compile_obj) },
+    #endif
+    #if MICROPY_MULTIPYTHON_CODE_CACHE
+    { MP_ROM_QSTR(MP_QSTR_code_cache), MP_ROM_PTR(&multipython_code_cache_obj) },
+    #endif
+    { MP_ROM_QSTR(MP_QSTR_control), MP_ROM_PTR(&multipython_control_obj) },
+    { MP_ROM_QSTR(MP_QSTR_get), MP_ROM_PTR(&multipython_get_obj) },
+    { MP_ROM_QSTR(MP_QSTR_check_responses), MP_ROM_PTR(&multipython_check_responses_obj) },
+    { MP_ROM_QSTR(MP_QSTR_queue_stats), MP_ROM_PTR(&multipython_queue_stats_obj) },
+    #if MICROPY_MULTIPYTHON_STATS
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&multipython_stats_obj) },
+    #endif
+    #if MICROPY_MULTIPYTHON_POOL
+    { MP_ROM_QSTR(MP_QSTR_Pool), MP_ROM_PTR(&multipython_pool_type) },                 // worker pools
+    { MP_ROM_QSTR(MP_QSTR__pool_worker), MP_ROM_PTR(&multipython_pool_worker_obj) },
+    #endif
+    #if MICROPY_MULTIPYTHON_SHARED
+    { MP_ROM_QSTR(MP_QSTR_shared_alloc), MP_ROM_PTR(&multipython_shared_alloc_obj) },   // shared buffers
+    { MP_ROM_QSTR(MP_QSTR_shared_attach), MP_ROM_PTR(&multipython_shared_attach_obj) },
+    { MP_ROM_QSTR(MP_QSTR_shared_handle), MP_ROM_PTR(&multipython_shared_handle_obj) },
+    { MP_ROM_QSTR(MP_QSTR_shared_release), MP_ROM_PTR(&multipython_shared_release_obj) },
+    { MP_ROM_QSTR(MP_QSTR_shared_info), MP_ROM_PTR(&multipython_shared_info_obj) },
+    #endif
+
+
+    { MP_ROM_QSTR(MP_QSTR_get_tID), MP_ROM_PTR(&multipython_get_task_id_obj) },         // todo: switch to using only the address of context nodes as identifiers within multipython
+    { MP_ROM_QSTR(MP_QSTR_notify), MP_ROM_PTR(&multipython_notify_obj) },               // utility
+    { MP_ROM_QSTR(MP_QSTR_context), MP_ROM_PTR(&multipython_context_obj) },
+    { MP_ROM_QSTR(MP_QSTR_init), MP_ROM_PTR(&multipython_init_obj) },                           // initializes multipython (starts any helper tasks of the port)
+    { MP_ROM_QSTR(MP_QSTR_switch_bench), MP_ROM_PTR(&multipython_switch_bench_obj) },           // diagnostics
+
+
+    { MP_ROM_QSTR(MP_QSTR_response),     MP_ROM_PTR(&multipython_responseObj_type) },   // response objects
+
+    { MP_ROM_QSTR(MP_QSTR_CONTROL_NONE), MP_ROM_INT(MP_CONTROL_OP_NONE) },           // control operations
+    { MP_ROM_QSTR(MP_QSTR_CONTROL_STOP), MP_ROM_INT(MP_CONTROL_OP_STOP) },
+    { MP_ROM_QSTR(MP_QSTR_CONTROL_RESUME), MP_ROM_INT(MP_CONTROL_OP_RESUME) },
+    { MP_ROM_QSTR(MP_QSTR_CONTROL_SUSPEND), MP_ROM_INT(MP_CONTROL_OP_SUSPEND) },
+
+    { MP_ROM_QSTR(MP_QSTR_FROZEN), MP_ROM_INT(MULTIPYTHON_TYPE_FROZEN) },          // source types for start()
+
+    { MP_ROM_QSTR(MP_QSTR_PRIORITY_LOW), MP_ROM_INT(MULTIPYTHON_PRIORITY_LOW) },           // priority classes for start()
+    { MP_ROM_QSTR(MP_QSTR_PRIORITY_NORMAL), MP_ROM_INT(MULTIPYTHON_PRIORITY_NORMAL) },
+    { MP_ROM_QSTR(MP_QSTR_PRIORITY_HIGH), MP_ROM_INT(MULTIPYTHON_PRIORITY_HIGH) },
+    { MP_ROM_QSTR(MP_QSTR_PRIORITY_REALTIME), MP_ROM_INT(MULTIPYTHON_PRIORITY_REALTIME) },
+};
+STATIC MP_DEFINE_CONST_DICT(mp_module_multipython_globals, mp_module_multipython_globals_table);
+
+const mp_obj_module_t mp_module_multipython = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&mp_module_multipython_globals,
+};
+
+
+
+
+// helpers for the port task templates
+void multipython_budget_point( mp_context_node_t* context ){
+    // every MICROPY_MULTIPYTHON_BUDGET_INTERVAL backward branches, compare the run time of
+    // the context in its current period with its budget. Once it is used up, the context
+    // is held back until the period ends and counts an overrun. A context that is being
+    // stopped or has a pending exception isn't held, so it can get to raise it
+    #if MICROPY_MULTIPYTHON_BUDGET
+    mp_context_budget_t* budget = &context->budget;
+    if( --budget->countdown != 0 ){ return; }
+    budget->countdown = MICROPY_MULTIPYTHON_BUDGET_INTERVAL;
+
+    uint64_t run_us = mp_context_run_us( context );
+    mp_uint_t now = mp_hal_ticks_us();
+    mp_uint_t elapsed = now - budget->period_start;
+    if( elapsed < budget->period_us ){
+        if( run_us - budget->period_run_us < budget->budget_us ){
+            return;
+        }
+        budget->overruns++;
+        if( !( context->status & MP_CSTOP ) && ( MP_STATE_VM(mp_pending_exception) == MP_OBJ_NULL ) ){
+            multipython_port_hold( context, budget->period_us - elapsed );
+            mp_uint_t resumed = mp_hal_ticks_us();
+            budget->held_us += resumed - now;
+            now = resumed;
+        }
+        run_us = mp_context_run_us( context );
+    }
+    budget->period_start = now;
+    budget->period_run_us = run_us;
+    #else
+    (void)context;
+    #endif
+}
+
+STATIC mp_obj_t execute_exception(mp_obj_t exc) {
+    // uncaught exception
+    // SystemExit, or the exception used to stop the context, ends it quietly
+    bool stopped = ( mp_active_contexts[MICROPY_GET_CORE_INDEX]->status & MP_CSTOP );
+    if( !stopped && !mp_obj_is_subclass_fast(MP_OBJ_FROM_PTR(((mp_obj_base_t*)exc)->type), MP_OBJ_FROM_PTR(&mp_type_SystemExit)) ){
+        mp_obj_print_exception(&mp_plat_print, exc);
+    }
+    return exc;
+}
+
+STATIC mp_obj_t execute_from_lexer(mp_lexer_t *lex) {
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        qstr src_name = lex->source_name;
+        mp_parse_tree_t pt = mp_parse(lex, MP_PARSE_FILE_INPUT);
+        mp_obj_t module_fun = mp_compile(&pt, src_name, MP_EMIT_OPT_NONE, false);
+        mp_call_function_0(module_fun);
+        nlr_pop();
+        return 0;
+    } else {
+        return execute_exception((mp_obj_t)nlr.ret_val);
+    }
+}
+
+#if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_MODULE_FROZEN_MPY
+STATIC mp_obj_t execute_from_raw_code(const mp_raw_code_t *rc, const byte *mpy, size_t len) {
+    // runs rc, or the code loaded from the .mpy image when rc is NULL
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        #if MICROPY_PERSISTENT_CODE_LOAD
+        if (rc == NULL) {
+            rc = mp_raw_code_load_mem(mpy, len);
+        }
+        #endif
+        if (rc == NULL) {
+            mp_raise_ValueError("incompatible .mpy file");
+        }
+        mp_obj_t module_fun = mp_make_function_from_raw_code(rc, MP_OBJ_NULL, MP_OBJ_NULL);
+        mp_call_function_0(module_fun);
+        nlr_pop();
+        return 0;
+    } else {
+        return execute_exception((mp_obj_t)nlr.ret_val);
+    }
+}
+#endif
+
+mp_obj_t execute_from_str(const char *str) {
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_lexer_t *lex = mp_lexer_new_from_str_len(MP_QSTR__lt_string_gt_, str, strlen(str), false);
+        nlr_pop();
+        return execute_from_lexer(lex);
+    } else {
+        mp_obj_print_exception(&mp_plat_print, (mp_obj_t)nlr.ret_val);
+        return (mp_obj_t)nlr.ret_val;
+    }
+}
+
+STATIC mp_obj_t execute_from_file(const char *filename) {
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_lexer_t *lex = mp_lexer_new_from_file(filename);
+        nlr_pop();
+        return execute_from_lexer(lex);
+    } else {
+        mp_obj_print_exception(&mp_plat_print, (mp_obj_t)nlr.ret_val);
+        return (mp_obj_t)nlr.ret_val;
+    }
+}
+
+STATIC mp_obj_t execute_from_frozen(const char *name) {
+    #if MICROPY_MODULE_FROZEN
+    void *frozen_data;
+    switch( mp_find_frozen_module(name, strlen(name), &frozen_data) ){
+        #if MICROPY_MODULE_FROZEN_STR
+        case MP_FROZEN_STR:
+            return execute_from_lexer((mp_lexer_t*)frozen_data);
+        #endif
+        #if MICROPY_MODULE_FROZEN_MPY
+        case MP_FROZEN_MPY:
+            return execute_from_raw_code((const mp_raw_code_t*)frozen_data, NULL, 0);
+        #endif
+        default:
+            break;
+    }
+    #endif
+    printf("could not find module '%s'\n", name);
+    return mp_const_none;
+}
+
+uint8_t multipython_exec_source( mp_context_node_t* context ){
+    // run the source of a context inside the (already initialised) interpreter of that context
+    if( context->args.source == NULL ){ return 0; }
+    switch( context->args.source_kind ){
+        case MP_TASK_SOURCE_FROZEN:
+            return ( execute_from_frozen( (char*)(context->args.source) ) != 0 );
+
+        case MP_TASK_SOURCE_MPY:
+            #if MICROPY_PERSISTENT_CODE_LOAD
+            return ( execute_from_raw_code( NULL, (const byte*)(context->args.source), context->args.source_len ) != 0 );
+            #else
+            printf(".mpy files are not supported\n");
+            return 1;
+            #endif
+
+        default:
+            break;
+    }
+    if( context->args.input_kind == MP_PARSE_FILE_INPUT ){
+        if( execute_from_file( (char*)(context->args.source) ) ){
+            return 1;
+        }
+    }else if( context->args.input_kind == MP_PARSE_SINGLE_INPUT){
+        if ( execute_from_str( (char*)(context->args.source) ) ){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int multipython_pystack_init( mp_context_node_t* context, size_t default_size ){
+    // give the calling context a pystack from its dynmem, to be called before mp_init()
+    #if MICROPY_ENABLE_PYSTACK
+    size_t size = context->args.pystack_size ? context->args.pystack_size : default_size;
+    size = ( size + MICROPY_PYSTACK_ALIGN - 1 ) & ~( MICROPY_PYSTACK_ALIGN - 1 );
+    uint8_t* pystack = (uint8_t*)mp_context_dynmem_alloc( size, context );
+    if( pystack == NULL ){ return MP_ENOMEM; }
+    mp_pystack_init( pystack, pystack + size );
+    #else
+    (void)context;
+    (void)default_size;
+    #endif
+    return 0;
+}
+
+STATIC void** multipython_snapshot_data_field( const mp_obj_base_t* obj, bool* typed, bool* raw_data ){
+    // the only field of a heap object that may point into the heap, besides its type,
+    // for the objects that also hold raw data. typed is false for other objects, whose
+    // words are all taken for pointers. raw_data is true if the field points to a
+    // block that holds no pointers
+    *typed = true;
+    *raw_data = true;
+    const mp_obj_type_t* type = obj->type;
+    if( ( type == &mp_type_str ) || ( type == &mp_type_bytes ) ){
+        return (void**)&((mp_obj_str_t*)obj)->data;
+    }
+    #if MICROPY_PY_BUILTINS_BYTEARRAY
+    if( type == &mp_type_bytearray ){
+        return (void**)&((mp_obj_array_t*)obj)->items;
+    }
+    #endif
+    #if MICROPY_PY_ARRAY
+    if( type == &mp_type_array ){
+        return (void**)&((mp_obj_array_t*)obj)->items;
+    }
+    #endif
+    #if MICROPY_PY_BUILTINS_MEMORYVIEW
+    if( type == &mp_type_memoryview ){
+        *raw_data = false; // it may be a view of any object
+        return (void**)&((mp_obj_array_t*)obj)->items;
+    }
+    #endif
+    #if MICROPY_LONGINT_IMPL == MICROPY_LONGINT_IMPL_MPZ
+    if( type == &mp_type_int ){
+        return (void**)&((mp_obj_int_t*)obj)->mpz.dig;
+    }
+    #elif MICROPY_LONGINT_IMPL == MICROPY_LONGINT_IMPL_LONGLONG
+    if( type == &mp_type_int ){
+        return NULL;
+    }
+    #endif
+    #if MICROPY_PY_BUILTINS_FLOAT && ( MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_A || MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_B )
+    if( type == &mp_type_float ){
+        return NULL;
+    }
+    #endif
+    #if MICROPY_PY_BUILTINS_COMPLEX
+    if( type == &mp_type_complex ){
+        return NULL;
+    }
+    #endif
+    *typed = false;
+    return NULL;
+}
+
+STATIC bool multipython_snapshot_in( const multipython_snapshot_t* snapshot, uintptr_t word ){
+    return ( ( word >= snapshot->heap_base ) && ( word <= snapshot->heap_base + snapshot->heap_size ) )
+        || ( ( word >= snapshot->state_base ) && ( word < snapshot->state_base + sizeof(mp_state_ctx_t) ) );
+}
+
+STATIC void multipython_snapshot_mark( multipython_snapshot_t* snapshot, const uintptr_t* word ){
+    // note that a word of the captured heap holds a pointer
+    if( !multipython_snapshot_in( snapshot, *word ) ){ return; }
+    size_t offset = (uintptr_t)word - snapshot->heap_base;
+    if( offset >= snapshot->gap_end ){
+        offset -= snapshot->gap_end - snapshot->gap_start;
+    }
+    size_t index = offset / sizeof(uintptr_t);
+    MULTIPYTHON_SNAPSHOT_POINTERS(snapshot)[index / MULTIPYTHON_SNAPSHOT_BITS] |= (uintptr_t)1 << ( index % MULTIPYTHON_SNAPSHOT_BITS );
+}
+
+STATIC int multipython_snapshot_find_pointers( multipython_snapshot_t* snapshot ){
+    // Find the words of the blocks in use that are pointers into the heap or the state,
+    // so that a restore doesn't move data that only looks like a pointer. Blocks that
+    // are known to hold raw data (that of str, bytes, bytearray, array and long int
+    // objects) are left out, as are the fields of these objects and floats other than
+    // the pointer to their data. The words of any other block are all taken for pointers,
+    // like the GC does, which only mistakes raw data that C code keeps in its own blocks.
+    // A raw block that starts with the address of one of these types is read as an object
+    // of the type, as long as the block owning it comes after it
+    uint8_t* pool = MP_STATE_MEM(area).gc_pool_start;
+    size_t num_blocks = ( MP_STATE_MEM(area).gc_pool_end - pool ) / MICROPY_BYTES_PER_GC_BLOCK;
+    uint8_t* raw = (uint8_t*)MULTIPYTHON_MALLOC( ( num_blocks + 7 ) / 8 );
+    if( raw == NULL ){ return MP_ENOMEM; }
+    memset( raw, 0x00, ( num_blocks + 7 ) / 8 );
+    for( int pass = 0; pass < 2; pass++ ){
+        for( size_t block = 0; block < num_blocks; ){
+            uint8_t* ptr = pool + block * MICROPY_BYTES_PER_GC_BLOCK;
+            size_t n_bytes = gc_nbytes( ptr );
+            if( n_bytes == 0 ){
+                block++; // free, the gap among them
+                continue;
+            }
+            bool typed;
+            bool raw_data;
+            void** field = multipython_snapshot_data_field( (const mp_obj_base_t*)ptr, &typed, &raw_data );
+            if( raw[block / 8] & ( 1 << ( block % 8 ) ) ){
+                // holds no pointers
+            }else if( pass == 0 ){
+                // only blocks at the start of the data are raw, a pointer into the
+                // middle of one can't be told from a pointer into an object
+                if( ( field != NULL ) && raw_data && ( (uint8_t*)*field >= pool ) && ( gc_nbytes( *field ) != 0 ) ){
+                    size_t data_block = ( (uint8_t*)*field - pool ) / MICROPY_BYTES_PER_GC_BLOCK;
+                    raw[data_block / 8] |= 1 << ( data_block % 8 );
+                }
+            }else if( typed ){
+                if( field != NULL ){
+                    multipython_snapshot_mark( snapshot, (const uintptr_t*)field );
+                }
+            }else{
+                for( const uintptr_t* word = (const uintptr_t*)ptr; word < (const uintptr_t*)( ptr + n_bytes ); word++ ){
+                    multipython_snapshot_mark( snapshot, word );
+                }
+            }
+            block += n_bytes / MICROPY_BYTES_PER_GC_BLOCK;
+        }
+    }
+    MULTIPYTHON_FREE( raw );
+    return 0;
+}
+
+int multipython_snapshot_capture( mp_context_node_t* context, void* heap, size_t heap_size ){
+    // called by a context that has just booted, with the heap given to gc_init
+    #if MICROPY_GC_SPLIT_HEAP
+    if( MP_STATE_MEM(area).next != NULL ){ return MP_EINVAL; } // only a heap of one region can be cloned
+    #endif
+    // the allocation tables and the blocks in use, which lie either side of the
+    // longest run of free blocks, are enough
+    void* gap_start;
+    void* gap_end;
+    gc_free_gap( &gap_start, &gap_end );
+    size_t low_size = (uint8_t*)gap_start - (uint8_t*)heap;
+    size_t high_size = MP_STATE_MEM(area).gc_pool_end - (uint8_t*)gap_end;
+    size_t image_size = low_size + high_size;
+    size_t pointers_size = ( image_size / sizeof(uintptr_t) + MULTIPYTHON_SNAPSHOT_BITS - 1 ) / MULTIPYTHON_SNAPSHOT_BITS * sizeof(uintptr_t);
+    multipython_snapshot_t* snapshot = (multipython_snapshot_t*)MULTIPYTHON_MALLOC( sizeof(multipython_snapshot_t) + image_size + pointers_size );
+    if( snapshot == NULL ){ return MP_ENOMEM; }
+    snapshot->users = 1;
+    snapshot->state_base = (uintptr_t)context->state;
+    snapshot->heap_base = (uintptr_t)heap;
+    snapshot->heap_size = heap_size;
+    snapshot->gap_start = low_size;
+    snapshot->gap_end = (uint8_t*)gap_end - (uint8_t*)heap;
+    snapshot->image_size = image_size;
+    memcpy( (void*)&snapshot->state, (void*)context->state, sizeof(mp_state_ctx_t) );
+    memcpy( (void*)MULTIPYTHON_SNAPSHOT_HEAP(snapshot), heap, low_size );
+    memcpy( (void*)( MULTIPYTHON_SNAPSHOT_HEAP(snapshot) + low_size ), gap_end, high_size );
+    memset( (void*)MULTIPYTHON_SNAPSHOT_POINTERS(snapshot), 0x00, pointers_size );
+    if( multipython_snapshot_find_pointers( snapshot ) != 0 ){
+        MULTIPYTHON_FREE(snapshot);
+        return MP_ENOMEM;
+    }
+
+    multipython_port_enter_critical();
+    multipython_snapshot_t* previous = multipython_snapshot;
+    multipython_snapshot = snapshot;
+    multipython_snapshot_generation++;
+    bool unused = ( ( previous != NULL ) && ( --previous->users == 0 ) );
+    multipython_port_exit_critical();
+    if( unused ){
+        MULTIPYTHON_FREE(previous);
+    }
+    return 0;
+}
+
+size_t multipython_snapshot_heap_size( mp_context_node_t* context ){
+    // one block more than the captured heap, so the clone can line up its blocks the same way
+    multipython_snapshot_t* snapshot = (multipython_snapshot_t*)context->args.snapshot;
+    return ( snapshot == NULL ) ? 0 : snapshot->heap_size + MICROPY_BYTES_PER_GC_BLOCK;
+}
+
+void multipython_snapshot_release( mp_context_node_t* context ){
+    multipython_snapshot_t* snapshot = (multipython_snapshot_t*)context->args.snapshot;
+    if( snapshot == NULL ){ return; }
+    context->args.snapshot = NULL;
+    multipython_port_enter_critical();
+    bool unused = ( --snapshot->users == 0 );
+    multipython_port_exit_critical();
+    if( unused ){
+        MULTIPYTHON_FREE(snapshot);
+    }
+}
+
+STATIC void multipython_snapshot_relocate( uintptr_t* word, multipython_snapshot_t* snapshot, uintptr_t state, uintptr_t heap ){
+    // move a word that points into the captured state or heap over to the clone
+    if( ( *word >= snapshot->heap_base ) && ( *word <= snapshot->heap_base + snapshot->heap_size ) ){
+        *word = *word - snapshot->heap_base + heap;
+    }else if( ( *word >= snapshot->state_base ) && ( *word < snapshot->state_base + sizeof(mp_state_ctx_t) ) ){
+        *word = *word - snapshot->state_base + state;
+    }
+}
+
+void* multipython_snapshot_restore( mp_context_node_t* context, void* mem ){
+    // mem must be multipython_snapshot_heap_size() bytes. The caller sets up the
+    // stack afterwards, since the stack of the captured context is copied too
+    multipython_snapshot_t* snapshot = (multipython_snapshot_t*)context->args.snapshot;
+    mp_state_ctx_t* state = context->state;
+    // the GC only takes block aligned pointers, so the clone must sit at the same
+    // offset from a block boundary as the captured heap did
+    uintptr_t misalign = ( snapshot->heap_base - (uintptr_t)mem ) & ( MICROPY_BYTES_PER_GC_BLOCK - 1 );
+    void* heap = (uint8_t*)mem + misalign;
+    memcpy( (void*)state, (void*)&snapshot->state, sizeof(mp_state_ctx_t) );
+    size_t high_size = snapshot->image_size - snapshot->gap_start;
+    uint8_t* high = (uint8_t*)heap + snapshot->gap_end;
+    memcpy( heap, (void*)MULTIPYTHON_SNAPSHOT_HEAP(snapshot), snapshot->gap_start );
+    memcpy( high, (void*)( MULTIPYTHON_SNAPSHOT_HEAP(snapshot) + snapshot->gap_start ), high_size );
+
+    // the state is C code's own, which keeps no raw data that looks like a pointer into
+    // it or the heap, so all its words are taken for pointers. In the heap only the
+    // words found by multipython_snapshot_find_pointers() are
+    for( size_t indi = 0; indi < sizeof(mp_state_ctx_t) / sizeof(uintptr_t); indi++ ){
+        multipython_snapshot_relocate( (uintptr_t*)state + indi, snapshot, (uintptr_t)state, (uintptr_t)heap );
+    }
+    const uintptr_t* pointers = MULTIPYTHON_SNAPSHOT_POINTERS(snapshot);
+    for( size_t indi = 0; indi < MULTIPYTHON_SNAPSHOT_WORDS(snapshot); indi++ ){
+        if( pointers[indi / MULTIPYTHON_SNAPSHOT_BITS] == 0 ){
+            indi |= MULTIPYTHON_SNAPSHOT_BITS - 1; // none in this word of the bitmap
+            continue;
+        }
+        if( pointers[indi / MULTIPYTHON_SNAPSHOT_BITS] & ( (uintptr_t)1 << ( indi % MULTIPYTHON_SNAPSHOT_BITS ) ) ){
+            size_t offset = indi * sizeof(uintptr_t);
+            uint8_t* word = ( offset < snapshot->gap_start ) ? (uint8_t*)heap + offset : high + ( offset - snapshot->gap_start );
+            multipython_snapshot_relocate( (uintptr_t*)word, snapshot, (uintptr_t)state, (uintptr_t)heap );
+        }
+    }
+    multipython_snapshot_release( context );
+
+    state->thread.nlr_top = NULL;
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_init(&state->mem.gc_mutex);
+    mp_thread_mutex_init(&state->vm.qstr_mutex);
+    #if MICROPY_PY_THREAD_GIL
+    mp_thread_mutex_init(&state->vm.gil_mutex);
+    #endif
+    #endif
+    #if MICROPY_MULTIPYTHON_STATS
+    // the clone starts out using the heap of the snapshot, but has done no work yet
+    state->mem.gc_peak_blocks = state->mem.gc_used_blocks;
+    state->mem.gc_alloc_blocks = 0;
+    state->mem.gc_collections = 0;
+    state->mem.gc_collect_us = 0;
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    state->mem.gc_inc_finisher = NULL;
+    memset(state->mem.gc_pause_hist, 0, sizeof(state->mem.gc_pause_hist));
+    #endif
+    mp_context_refresh();
+    return heap;
+}
+
+
+
+
+// response type functions
+STATIC void multipython_response_print( const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind ) {
+    mp_printf(print, "multipython response class object:\n");
+}
+
+mp_obj_t multipython_response_make_new( const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args ) {
+    enum { ARG_condition, ARG_context, ARG_control_op, ARG_argument };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_condition,    MP_ARG_OBJ,    {.u_obj = mp_const_none} },
+        { MP_QSTR_context,      MP_ARG_INT,    {.u_int = 0} },
+        { MP_QSTR_control_op,   MP_ARG_INT,    {.u_int = MP_CONTROL_OP_NONE} },
+        { MP_QSTR_argument,     MP_ARG_OBJ,    {.u_obj = mp_const_none} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    // Instead of using micropython's allocation here we will use the system's, to ensure(?) that they have global scope and lifetime for access from any process
+    multipython_response_obj_t* response = (multipython_response_obj_t*)MULTIPYTHON_MALLOC(1*sizeof(multipython_response_obj_t));
+    if( response == NULL ){
+        mp_raise_OSError(MP_ENOMEM);
+        return mp_const_none;
+    }
+
+    // If that succeeded allocate a new node:
+    multipython_response_node_t* node = (multipython_response_node_t*)MULTIPYTHON_MALLOC(1*sizeof(multipython_response_node_t));
+    if( node == NULL ){
+        MULTIPYTHON_FREE(response);
+        mp_raise_OSError(MP_ENOMEM);
+        return mp_const_none;
+    }
+
+    // If that succeeded then fill out the node and response:
+    node->response = response;
+    node->next = NULL;
+
+    memset( (void*)response, 0x00, sizeof(multipython_response_obj_t) );
+    response->base.type = &multipython_responseObj_type; // give it a type
+    response->condition = args[ARG_condition].u_obj;
+    response->context = (mp_context_node_t*)args[ARG_context].u_int;
+    response->control_op = (multipython_op_e)args[ARG_control_op].u_int;
+    response->argument = args[ARG_argument].u_obj;
+
+    // Then link the node into its bucket, at the end so that responses are delivered in the order they were made
+    multipython_condition_hash( response->condition, &node->hash );
+    multipython_response_node_t** bucket = multipython_response_bucket( node->hash );
+    multipython_port_enter_critical();
+    if( *bucket == NULL ){
+        __atomic_store_n(bucket, node, __ATOMIC_RELEASE); // the node is complete before notify can see it
+    }else{
+        multipython_response_iter_t iter = NULL;
+        for( iter = multipython_response_iter_first(*bucket); !multipython_response_iter_done(iter); iter = multipython_response_iter_next(iter) ){
+            if( MODADD_RESPONSE_PTR_FROM_ITER(iter)->next == NULL ){ break; }
+        }
+        __atomic_store_n(&MODADD_RESPONSE_PTR_FROM_ITER(iter)->next, node, __ATOMIC_RELEASE);
+    }
+    multipython_port_exit_critical();
+
+    return response;
+}
+
+#endif // MICROPY_PY_MULTIPYTHON
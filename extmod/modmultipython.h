@@ -0,0 +1,134 @@
+/*
+Copyright 2019 Owen Lyke
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef MICROPY_INCLUDED_EXTMOD_MODMULTIPYTHON_H
+#define MICROPY_INCLUDED_EXTMOD_MODMULTIPYTHON_H
+
+#include "py/emitglue.h"
+#include "py/mpstate.h"
+#include "py/reader.h"
+
+#if MICROPY_PY_MULTIPYTHON
+
+#ifndef MULTIPYTHON_MALLOC
+#define MULTIPYTHON_MALLOC(size)        (malloc(size))
+#define MULTIPYTHON_FREE(ptr)           (free(ptr))
+#endif
+
+// attribute for the notify entry point (e.g. to place it in IRAM)
+#ifndef MULTIPYTHON_NOTIFY_ATTR
+#define MULTIPYTHON_NOTIFY_ATTR
+#endif
+
+// control operations
+typedef enum{
+    MP_CONTROL_OP_NONE = 0x00,
+    MP_CONTROL_OP_STOP,
+    MP_CONTROL_OP_RESUME,
+    MP_CONTROL_OP_SUSPEND,
+
+    MP_CONTROL_OP_NUM,
+}multipython_op_e;
+
+// priority classes of contexts, which each port maps onto the priorities of its tasks
+typedef enum{
+    MULTIPYTHON_PRIORITY_LOW = -1,
+    MULTIPYTHON_PRIORITY_NORMAL = 0,
+    MULTIPYTHON_PRIORITY_HIGH,
+    MULTIPYTHON_PRIORITY_REALTIME,
+}multipython_priority_e;
+
+// start() type for the name of a frozen module, next to the parse input kinds
+// (MP_PARSE_SINGLE_INPUT for source code, MP_PARSE_FILE_INPUT for a file name)
+#define MULTIPYTHON_TYPE_FROZEN     (0x10)
+
+// generic helpers available to the port
+uint8_t multipython_exec_source( mp_context_node_t* context );  // runs the source of a context, returns 1 on error
+int multipython_pystack_init( mp_context_node_t* context, size_t default_size ); // pystack for the calling context (if MICROPY_ENABLE_PYSTACK), returns 0 or an errno
+void multipython_budget_point( mp_context_node_t* context );   // called at backward branches of a context with MP_CBUDGET, holds it back once its budget is used up
+mp_obj_t multipython_notify(mp_obj_t condition);
+size_t multipython_notify_from_isr( mp_int_t condition );       // notify about a small int condition, safe in ISRs as it doesn't use the Python heap
+
+// snapshots of a booted interpreter, used by the port task templates
+int multipython_snapshot_capture( mp_context_node_t* context, void* heap, size_t heap_size ); // store the interpreter of the calling context, returns 0 or an errno
+size_t multipython_snapshot_heap_size( mp_context_node_t* context );   // heap size needed by the snapshot the context starts from
+void* multipython_snapshot_restore( mp_context_node_t* context, void* mem ); // clone the snapshot into the state of the context and the given memory, returns the start of the heap
+void multipython_snapshot_release( mp_context_node_t* context );       // let go of the snapshot when the context won't restore it
+
+#if MICROPY_MULTIPYTHON_CODE_CACHE
+// code of modules compiled from source, shared by the contexts that import them
+// (extmod/multipython_codecache.c). Entries are only used for the source they were
+// compiled from, told by its length and a hash of it
+typedef struct _multipython_code_stamp_t {
+    size_t      len;
+    uint32_t    hash;
+} multipython_code_stamp_t;
+void multipython_code_stamp( const char* path, multipython_code_stamp_t* stamp ); // stamp of the source in the file at path, may raise OSError
+void multipython_code_stamp_reader( mp_reader_t* reader, multipython_code_stamp_t* stamp ); // make reader stamp the source as it is read, up to its end
+bool multipython_code_cache_has( const char* path );                 // whether there may be shared code of path, so stamping it first is worth it
+const mp_raw_code_t* multipython_code_cache_get( const char* path, const multipython_code_stamp_t* stamp );   // shared code of path that the calling context can run, or NULL
+const mp_raw_code_t* multipython_code_cache_put( const char* path, const multipython_code_stamp_t* stamp, const mp_raw_code_t* rc ); // share code the calling context compiled, returns the code to run
+void multipython_code_cache_release( mp_context_node_t* context );   // let go of the code a context used, when it ends
+mp_obj_t multipython_code_cache_info( void );                        // list of (path, users, bytes)
+#endif
+
+MP_DECLARE_CONST_FUN_OBJ_KW(multipython_start_obj);
+
+#if MICROPY_MULTIPYTHON_POOL
+// worker contexts that run jobs submitted from other contexts (extmod/multipython_pool.c)
+extern const mp_obj_type_t multipython_pool_type;
+MP_DECLARE_CONST_FUN_OBJ_2(multipython_pool_worker_obj);
+void multipython_pool_release_all( mp_context_node_t* context );  // close the pools and drop the Futures of a context, when it ends
+#endif
+
+#if MICROPY_MULTIPYTHON_SHARED
+// buffers held by any number of contexts, seen as memoryviews (extmod/multipython_shared.c)
+void multipython_shared_release_all( mp_context_node_t* context ); // let go of the buffers a context holds, when it ends
+MP_DECLARE_CONST_FUN_OBJ_1(multipython_shared_alloc_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(multipython_shared_attach_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(multipython_shared_handle_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(multipython_shared_release_obj);
+MP_DECLARE_CONST_FUN_OBJ_0(multipython_shared_info_obj);
+#endif
+
+// Port interface, implemented by ports/<port>/mpmultipythonport.c
+// The port owns the tasks (or threads) that contexts run on. Task IDs given to
+// the port are the IDs stored in the context nodes.
+void multipython_port_init( void );                                     // start any helper tasks
+int multipython_port_task_create( mp_context_node_t* context, mp_int_t core ); // start a task for a registered context at the priority class in its args, core < 0 for any. Returns 0 or an errno
+// end, suspend and resume may be called by notify from an interrupt, and return
+// nonzero when they can't act from there
+int8_t multipython_port_task_end( mp_context_node_t* context );
+int8_t multipython_port_task_suspend( mp_context_node_t* context );
+int8_t multipython_port_task_resume( mp_context_node_t* context );
+void multipython_port_enter_critical( void );                           // protects the context list
+void multipython_port_exit_critical( void );
+void multipython_port_sched_lock( void );                               // keep the calling task on its core, without being switched out
+void multipython_port_sched_unlock( void );
+void multipython_port_wait( mp_context_node_t* context, mp_int_t timeout_ms ); // park the calling context until it is signalled or timeout_ms passes (< 0 for no timeout). May return early
+void multipython_port_signal( mp_context_node_t* context );              // wake a context parked in multipython_port_wait, callable from any context. A context that isn't parked returns from its next wait at once
+size_t multipython_port_stack_high_water( mp_context_node_t* context ); // most bytes of its stack the task of a context has used, 0 if unknown. Called in the critical section
+void multipython_port_hold( mp_context_node_t* context, mp_uint_t hold_us ); // keep the calling context off the CPU for hold_us, or until it is stopped. Responses don't end it
+
+#endif // MICROPY_PY_MULTIPYTHON
+
+#endif // MICROPY_INCLUDED_EXTMOD_MODMULTIPYTHON_H
@@ -29,6 +29,7 @@
 
 #include "py/objlist.h"
 #include "py/runtime.h"
+#include "py/gc.h"
 #include "py/smallint.h"
 
 #if MICROPY_PY_UTIMEQ
@@ -133,6 +134,7 @@ STATIC mp_obj_t mod_utimeq_heappush(size_t n_args, const mp_obj_t *args) {
     heap->items[l].id = utimeq_id++;
     heap->items[l].callback = args[2];
     heap->items[l].args = args[3];
+    gc_write_barrier(heap);
     heap_siftdown(heap, 0, heap->len);
     heap->len++;
     return mp_const_none;
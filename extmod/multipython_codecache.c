@@ -0,0 +1,447 @@
+/*
+Copyright 2019 Owen Lyke
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+/*
+
+Code of modules imported from source, shared by all the contexts that import them
+
+The first context to import a module compiles it as usual and then moves the raw
+code, its bytecode and its constants out of its GC heap into one block of memory
+that no context owns. Later imports in other contexts only make a module function
+from that code. An entry is freed when the last context using it ends.
+
+Bytecode names qstrs by number and the dynamic qstrs are numbered per context, so
+an entry also keeps the dynamic qstrs of the context that compiled it. Another
+context can run the code only if its qstrs with those numbers are the same strings,
+interning the missing ones in the same order. That holds for contexts that reached
+the import the same way, e.g. workers started from the same source or snapshot.
+Contexts that can't use an entry compile the module for themselves and may add an
+entry of their own.
+
+An entry is only used for the source it was compiled from, told by its length and
+hash, so a module rewritten since the entry was made is compiled again into a new
+entry rather than run from the old code. An import reads the file to stamp it before
+looking it up only if there are entries of its path. Otherwise the source is stamped
+as the lexer reads it, so importing a module no context shares reads it just once.
+
+*/
+#include <string.h>
+#include <stdlib.h>
+
+#include "py/bc.h"
+#include "py/gc.h"
+#include "py/mperrno.h"
+#include "py/nlr.h"
+#include "py/objstr.h"
+#include "py/qstr.h"
+#include "py/reader.h"
+#include "py/runtime.h"
+
+#include "extmod/modmultipython.h"
+
+#if MICROPY_PY_MULTIPYTHON && MICROPY_MULTIPYTHON_CODE_CACHE
+
+#define MULTIPYTHON_CODE_ALIGN      (2 * sizeof(void*))
+// FNV-1a hash of the source
+#define MULTIPYTHON_CODE_HASH_INIT  (2166136261u)
+#define MULTIPYTHON_CODE_HASH(hash, c)  ( ( (hash) ^ (uint8_t)(c) ) * 16777619u )
+
+typedef struct _multipython_code_entry_t {
+    struct _multipython_code_entry_t*   next;
+    size_t                  users;          // contexts that run the code
+    size_t                  size;           // bytes of the entry, including the code
+    multipython_code_stamp_t stamp;         // of the source the code was compiled from
+    const mp_raw_code_t*    rc;
+    size_t                  qstr_first;     // dynamic qstrs of the context that compiled the code
+    size_t                  qstr_end;
+    const size_t*           qstr_offsets;   // where each of them starts in qstr_data, plus the end
+    const char*             qstr_data;
+    char                    path[];
+} multipython_code_entry_t;
+
+// a context uses an entry once for each time it imported the module from it
+typedef struct _multipython_code_use_t {
+    struct _multipython_code_use_t* next;
+    multipython_code_entry_t*       entry;
+} multipython_code_use_t;
+
+multipython_code_entry_t* multipython_code_cache = NULL;
+
+// The code is copied in two passes, first to measure and then, with a base, to copy
+typedef struct _multipython_code_arena_t {
+    uint8_t*    base;   // NULL while measuring
+    size_t      used;
+} multipython_code_arena_t;
+
+STATIC void* multipython_code_take( multipython_code_arena_t* arena, size_t size ){
+    void* ptr = ( arena->base == NULL ) ? NULL : arena->base + arena->used;
+    arena->used += ( size + MULTIPYTHON_CODE_ALIGN - 1 ) & ~( MULTIPYTHON_CODE_ALIGN - 1 );
+    return ptr;
+}
+
+STATIC bool multipython_code_copy_obj( multipython_code_arena_t* arena, mp_obj_t obj, mp_obj_t* copy ){
+    if( !mp_obj_is_obj(obj) || ( gc_nbytes(MP_OBJ_TO_PTR(obj)) == 0 ) ){
+        // immediate objects and objects outside of the heap are the same in every context
+        *copy = obj;
+        return true;
+    }
+    if( mp_obj_is_type(obj, &mp_type_str) || mp_obj_is_type(obj, &mp_type_bytes) ){
+        const mp_obj_str_t* str = (const mp_obj_str_t*)MP_OBJ_TO_PTR(obj);
+        mp_obj_str_t* str_copy = (mp_obj_str_t*)multipython_code_take( arena, sizeof(mp_obj_str_t) );
+        byte* data = (byte*)multipython_code_take( arena, str->len + 1 );
+        if( str_copy != NULL ){
+            *str_copy = *str;
+            memcpy( data, str->data, str->len );
+            data[str->len] = '\0';
+            str_copy->data = data;
+            *copy = MP_OBJ_FROM_PTR(str_copy);
+        }
+        return true;
+    }
+    #if MICROPY_PY_BUILTINS_FLOAT
+    if( mp_obj_is_type(obj, &mp_type_float)
+        #if MICROPY_PY_BUILTINS_COMPLEX
+        || mp_obj_is_type(obj, &mp_type_complex)
+        #endif
+        ){
+        // these hold no pointers
+        size_t size = gc_nbytes(MP_OBJ_TO_PTR(obj));
+        void* obj_copy = multipython_code_take( arena, size );
+        if( obj_copy != NULL ){
+            memcpy( obj_copy, MP_OBJ_TO_PTR(obj), size );
+            *copy = MP_OBJ_FROM_PTR(obj_copy);
+        }
+        return true;
+    }
+    #endif
+    return false; // e.g. big integers, which point to their digits in the heap
+}
+
+STATIC bool multipython_code_copy_rc( multipython_code_arena_t* arena, const mp_raw_code_t* rc, const mp_raw_code_t** copy ){
+    if( rc->kind != MP_CODE_BYTECODE ){ return false; } // native code is linked to the context that made it
+
+    // the constant table starts with the names of the arguments, see py/bc.h
+    const byte* ip = mp_decode_uint_skip( mp_decode_uint_skip( (const byte*)rc->fun_data ) );
+    size_t n_args = ip[1] + ip[2];
+    size_t n_const = n_args + rc->n_obj + rc->n_raw_code;
+
+    mp_raw_code_t* rc_copy = (mp_raw_code_t*)multipython_code_take( arena, sizeof(mp_raw_code_t) );
+    byte* fun_data = (byte*)multipython_code_take( arena, rc->fun_data_len );
+    mp_uint_t* const_table = (mp_uint_t*)multipython_code_take( arena, n_const * sizeof(mp_uint_t) );
+    if( rc_copy != NULL ){
+        // the VM may still write its map lookup caches and specialised opcodes into
+        // the bytecode. Both are checked before use, so contexts can share them
+        *rc_copy = *rc;
+        memcpy( fun_data, rc->fun_data, rc->fun_data_len );
+        memcpy( const_table, rc->const_table, n_args * sizeof(mp_uint_t) );
+        rc_copy->fun_data = fun_data;
+        rc_copy->const_table = const_table;
+    }
+
+    mp_obj_t obj = MP_OBJ_NULL;
+    for( size_t indi = n_args; indi < n_args + rc->n_obj; indi++ ){
+        if( !multipython_code_copy_obj( arena, (mp_obj_t)rc->const_table[indi], &obj ) ){ return false; }
+        if( rc_copy != NULL ){ const_table[indi] = (mp_uint_t)obj; }
+    }
+    const mp_raw_code_t* child = NULL;
+    for( size_t indi = n_args + rc->n_obj; indi < n_const; indi++ ){
+        if( !multipython_code_copy_rc( arena, (const mp_raw_code_t*)rc->const_table[indi], &child ) ){ return false; }
+        if( rc_copy != NULL ){ const_table[indi] = (mp_uint_t)(uintptr_t)child; }
+    }
+    *copy = rc_copy;
+    return true;
+}
+
+STATIC multipython_code_entry_t* multipython_code_entry_new( const char* path, const multipython_code_stamp_t* stamp, const mp_raw_code_t* rc ){
+    // copies the code and the dynamic qstrs of the calling context into a new entry
+    size_t path_len = strlen(path) + 1;
+    size_t qstr_first = qstr_count_static();
+    size_t qstr_end = qstr_count();
+    size_t qstr_bytes = 0;
+    for( size_t q = qstr_first; q < qstr_end; q++ ){
+        qstr_bytes += qstr_len(q);
+    }
+
+    multipython_code_entry_t* entry = NULL;
+    multipython_code_arena_t arena = { NULL, 0 };
+    for( ;; ){
+        entry = (multipython_code_entry_t*)multipython_code_take( &arena, sizeof(multipython_code_entry_t) + path_len );
+        size_t* qstr_offsets = (size_t*)multipython_code_take( &arena, ( qstr_end - qstr_first + 1 ) * sizeof(size_t) );
+        char* strings = (char*)multipython_code_take( &arena, qstr_bytes );
+        const mp_raw_code_t* rc_copy = NULL;
+        if( !multipython_code_copy_rc( &arena, rc, &rc_copy ) ){ return NULL; }
+        if( arena.base != NULL ){
+            entry->next = NULL;
+            entry->users = 1;
+            entry->size = arena.used;
+            entry->stamp = *stamp;
+            entry->rc = rc_copy;
+            entry->qstr_first = qstr_first;
+            entry->qstr_end = qstr_end;
+            entry->qstr_offsets = qstr_offsets;
+            entry->qstr_data = strings;
+            memcpy( entry->path, path, path_len );
+            size_t offset = 0;
+            for( size_t q = qstr_first; q < qstr_end; q++ ){
+                size_t len = 0;
+                const byte* data = qstr_data(q, &len);
+                qstr_offsets[q - qstr_first] = offset;
+                memcpy( strings + offset, data, len );
+                offset += len;
+            }
+            qstr_offsets[qstr_end - qstr_first] = offset;
+            return entry;
+        }
+        arena.base = (uint8_t*)MULTIPYTHON_MALLOC( arena.used );
+        if( arena.base == NULL ){ return NULL; }
+        arena.used = 0;
+    }
+}
+
+STATIC bool multipython_code_entry_fits( const multipython_code_entry_t* entry ){
+    // whether the qstrs of the calling context are numbered like those of the entry,
+    // interning the ones it doesn't have yet. May raise MemoryError
+    if( qstr_count_static() != entry->qstr_first ){ return false; }
+    size_t count = qstr_count();
+    for( size_t q = entry->qstr_first; q < entry->qstr_end; q++ ){
+        const char* str = entry->qstr_data + entry->qstr_offsets[q - entry->qstr_first];
+        size_t len = entry->qstr_offsets[q - entry->qstr_first + 1] - entry->qstr_offsets[q - entry->qstr_first];
+        if( q < count ){
+            size_t have_len = 0;
+            const byte* have = qstr_data(q, &have_len);
+            if( ( have_len != len ) || ( memcmp( have, str, len ) != 0 ) ){ return false; }
+        }else if( qstr_from_strn( str, len ) != q ){
+            return false;
+        }
+    }
+    return true;
+}
+
+STATIC void multipython_code_entry_unuse( multipython_code_entry_t* entry ){
+    multipython_port_enter_critical();
+    bool unused = ( --entry->users == 0 );
+    if( unused ){
+        multipython_code_entry_t** link = &multipython_code_cache;
+        while( *link != entry ){ link = &(*link)->next; }
+        *link = entry->next;
+    }
+    multipython_port_exit_critical();
+    if( unused ){
+        MULTIPYTHON_FREE(entry);
+    }
+}
+
+STATIC void multipython_code_use( mp_context_node_t* context, multipython_code_entry_t* entry, multipython_code_use_t* use ){
+    // the entry already counts the context as a user
+    use->entry = entry;
+    multipython_port_enter_critical();
+    use->next = (multipython_code_use_t*)context->code_uses;
+    context->code_uses = use;
+    multipython_port_exit_critical();
+}
+
+STATIC multipython_code_entry_t* multipython_code_find( multipython_code_entry_t* entry, const char* path, const multipython_code_stamp_t* stamp ){
+    // first entry of path and its source from entry on, which is kept until multipython_code_entry_unuse()
+    // must be called with the lock held
+    while( ( entry != NULL ) && ( ( entry->stamp.len != stamp->len ) || ( entry->stamp.hash != stamp->hash ) || ( strcmp( entry->path, path ) != 0 ) ) ){
+        entry = entry->next;
+    }
+    if( entry != NULL ){
+        entry->users++;
+    }
+    return entry;
+}
+
+void multipython_code_stamp( const char* path, multipython_code_stamp_t* stamp ){
+    mp_reader_t reader;
+    mp_reader_new_file( &reader, path );
+    size_t len = 0;
+    uint32_t hash = MULTIPYTHON_CODE_HASH_INIT;
+    for( mp_uint_t c = reader.readbyte( reader.data ); c != MP_READER_EOF; c = reader.readbyte( reader.data ) ){
+        hash = MULTIPYTHON_CODE_HASH( hash, c );
+        len++;
+    }
+    reader.close( reader.data );
+    stamp->len = len;
+    stamp->hash = hash;
+}
+
+// a reader that stamps the bytes it passes on from another one
+typedef struct _multipython_code_stamp_reader_t {
+    mp_reader_t                 reader;
+    multipython_code_stamp_t*   stamp;
+} multipython_code_stamp_reader_t;
+
+STATIC mp_uint_t multipython_code_stamp_readbyte( void* data ){
+    multipython_code_stamp_reader_t* stamp_reader = (multipython_code_stamp_reader_t*)data;
+    mp_uint_t c = stamp_reader->reader.readbyte( stamp_reader->reader.data );
+    if( c != MP_READER_EOF ){
+        stamp_reader->stamp->hash = MULTIPYTHON_CODE_HASH( stamp_reader->stamp->hash, c );
+        stamp_reader->stamp->len++;
+    }
+    return c;
+}
+
+STATIC void multipython_code_stamp_close( void* data ){
+    multipython_code_stamp_reader_t* stamp_reader = (multipython_code_stamp_reader_t*)data;
+    stamp_reader->reader.close( stamp_reader->reader.data );
+    m_del_obj( multipython_code_stamp_reader_t, stamp_reader );
+}
+
+void multipython_code_stamp_reader( mp_reader_t* reader, multipython_code_stamp_t* stamp ){
+    // the stamp is complete once the reader has returned MP_READER_EOF, as the lexer
+    // has by the end of mp_parse(). It must outlive the reader until then
+    multipython_code_stamp_reader_t* stamp_reader = m_new_obj_maybe( multipython_code_stamp_reader_t );
+    if( stamp_reader == NULL ){
+        reader->close( reader->data );
+        m_malloc_fail( sizeof(multipython_code_stamp_reader_t) );
+    }
+    stamp_reader->reader = *reader;
+    stamp_reader->stamp = stamp;
+    stamp->len = 0;
+    stamp->hash = MULTIPYTHON_CODE_HASH_INIT;
+    reader->data = stamp_reader;
+    reader->readbyte = multipython_code_stamp_readbyte;
+    reader->close = multipython_code_stamp_close;
+}
+
+bool multipython_code_cache_has( const char* path ){
+    multipython_port_enter_critical();
+    multipython_code_entry_t* entry = multipython_code_cache;
+    while( ( entry != NULL ) && ( strcmp( entry->path, path ) != 0 ) ){
+        entry = entry->next;
+    }
+    multipython_port_exit_critical();
+    return ( entry != NULL );
+}
+
+const mp_raw_code_t* multipython_code_cache_get( const char* path, const multipython_code_stamp_t* stamp ){
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    if( context == NULL ){ return NULL; }
+    multipython_code_use_t* use = (multipython_code_use_t*)MULTIPYTHON_MALLOC( sizeof(multipython_code_use_t) );
+    if( use == NULL ){ return NULL; }
+
+    multipython_port_enter_critical();
+    multipython_code_entry_t* entry = multipython_code_find( multipython_code_cache, path, stamp );
+    multipython_port_exit_critical();
+    while( entry != NULL ){
+        bool fits = false;
+        nlr_buf_t nlr;
+        if( nlr_push(&nlr) == 0 ){
+            fits = multipython_code_entry_fits( entry );
+            nlr_pop();
+        }else{
+            multipython_code_entry_unuse( entry );
+            MULTIPYTHON_FREE(use);
+            nlr_jump(nlr.ret_val);
+        }
+        if( fits ){
+            multipython_code_use( context, entry, use );
+            return entry->rc;
+        }
+        multipython_port_enter_critical();
+        multipython_code_entry_t* next = multipython_code_find( entry->next, path, stamp );
+        multipython_port_exit_critical();
+        multipython_code_entry_unuse( entry );
+        entry = next;
+    }
+    MULTIPYTHON_FREE(use);
+    return NULL;
+}
+
+const mp_raw_code_t* multipython_code_cache_put( const char* path, const multipython_code_stamp_t* stamp, const mp_raw_code_t* rc ){
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    if( context == NULL ){ return rc; }
+    multipython_code_use_t* use = (multipython_code_use_t*)MULTIPYTHON_MALLOC( sizeof(multipython_code_use_t) );
+    if( use == NULL ){ return rc; }
+    multipython_code_entry_t* entry = multipython_code_entry_new( path, stamp, rc );
+    if( entry == NULL ){
+        MULTIPYTHON_FREE(use);
+        return rc; // the code can't be shared, the context keeps its own
+    }
+
+    multipython_port_enter_critical();
+    entry->next = multipython_code_cache;
+    multipython_code_cache = entry;
+    multipython_port_exit_critical();
+    multipython_code_use( context, entry, use );
+    return entry->rc;
+}
+
+void multipython_code_cache_release( mp_context_node_t* context ){
+    multipython_port_enter_critical();
+    multipython_code_use_t* use = (multipython_code_use_t*)context->code_uses;
+    context->code_uses = NULL;
+    multipython_port_exit_critical();
+    while( use != NULL ){
+        multipython_code_use_t* next = use->next;
+        multipython_code_entry_unuse( use->entry );
+        MULTIPYTHON_FREE(use);
+        use = next;
+    }
+}
+
+mp_obj_t multipython_code_cache_info( void ){
+    // the lock can't be held while allocating, so the entries are kept while the list is made
+    multipython_port_enter_critical();
+    size_t num = 0;
+    for( multipython_code_entry_t* entry = multipython_code_cache; entry != NULL; entry = entry->next ){
+        num++;
+    }
+    multipython_port_exit_critical();
+    multipython_code_entry_t** entries = (multipython_code_entry_t**)MULTIPYTHON_MALLOC( ( num + 1 ) * sizeof(multipython_code_entry_t*) );
+    if( entries == NULL ){
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    multipython_port_enter_critical();
+    size_t kept = 0;
+    for( multipython_code_entry_t* entry = multipython_code_cache; ( entry != NULL ) && ( kept < num ); entry = entry->next ){
+        entry->users++;
+        entries[kept++] = entry;
+    }
+    multipython_port_exit_critical();
+
+    mp_obj_t list = MP_OBJ_NULL;
+    nlr_buf_t nlr;
+    if( nlr_push(&nlr) == 0 ){
+        list = mp_obj_new_list(0, NULL);
+        for( size_t indi = 0; indi < kept; indi++ ){
+            mp_obj_t tuple[3] = {
+                mp_obj_new_str( entries[indi]->path, strlen(entries[indi]->path) ),
+                mp_obj_new_int_from_uint( entries[indi]->users - 1 ),
+                mp_obj_new_int_from_uint( entries[indi]->size ),
+            };
+            mp_obj_list_append( list, mp_obj_new_tuple(3, tuple) );
+        }
+        nlr_pop();
+    }
+    for( size_t indi = 0; indi < kept; indi++ ){
+        multipython_code_entry_unuse( entries[indi] );
+    }
+    MULTIPYTHON_FREE(entries);
+    if( list == MP_OBJ_NULL ){
+        nlr_jump(nlr.ret_val);
+    }
+    return list;
+}
+
+#endif // MICROPY_PY_MULTIPYTHON && MICROPY_MULTIPYTHON_CODE_CACHE
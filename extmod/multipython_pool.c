@@ -0,0 +1,990 @@
+/*
+Copyright 2019 Owen Lyke
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+/*
+
+multipython.Pool: a fixed set of worker contexts that run jobs
+
+The workers are started once, spread over the cores, and each runs a loop in
+_pool_worker() that takes jobs from its own deque and steals from the deques of
+the others when it runs dry. Submitting a job costs a copy of its arguments, not
+the start of a context.
+
+Contexts don't share objects, so a job is a function named by its module and its
+name, plus arguments that are copied: None, bools, ints, floats, str, bytes,
+bytearray and tuples, lists and dicts of those. The worker imports the module
+(the code cache lets the workers share its code) and calls the function. The
+result, or the exception, is copied back the same way and the Future returned by
+submit() hands it over.
+
+Jobs, deques and pools live in memory that no context owns and are protected by
+the critical section of the port. A job is referenced by its Future and by the
+pool until a worker has finished it. The owner of a job or a pool is the context
+whose Future or Pool object holds it, and a context that ends without running
+their finalisers lets go of them through multipython_pool_release_all().
+
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "py/builtin.h"
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/nlr.h"
+#include "py/objfun.h"
+#include "py/objstr.h"
+#include "py/objtuple.h"
+#include "py/parsenum.h"
+#include "py/runtime.h"
+#include "py/stackctrl.h"
+
+#include "extmod/modmultipython.h"
+
+#if MICROPY_PY_MULTIPYTHON && MICROPY_MULTIPYTHON_POOL
+
+#define MULTIPYTHON_POOL_WORKERS_MAX    (MICROPY_NUM_CORES * 8)
+
+typedef enum {
+    MULTIPYTHON_JOB_PENDING = 0,
+    MULTIPYTHON_JOB_DONE,
+    MULTIPYTHON_JOB_FAILED,         // data is the (exception name, args) that the job raised
+    MULTIPYTHON_JOB_ABANDONED,      // the pool lost its workers before running the job
+} multipython_job_state_e;
+
+typedef struct _multipython_job_t {
+    struct _multipython_job_t*  above;  // towards the top (oldest end) of the deque
+    struct _multipython_job_t*  below;
+    struct _multipython_job_t*  next;   // in multipython_jobs
+    struct _multipython_job_t** link;   // the pointer to this job in multipython_jobs
+    mp_context_node_t*          owner;  // context to signal when the job is finished, NULL once it lost interest
+    uint8_t*                    data;   // the copied call, then the copied result
+    size_t                      len;
+    volatile uint8_t            state;
+    uint8_t                     refs;   // the Future, and the pool until the job is finished
+} multipython_job_t;
+
+typedef struct _multipython_worker_t {
+    multipython_job_t*  top;        // stolen from here
+    multipython_job_t*  bottom;     // pushed and taken by the worker from here
+    size_t              jobs;
+    mp_context_node_t*  context;    // NULL until the worker runs, and once it has ended
+    uint8_t             idle;       // parked with nothing to do
+} multipython_worker_t;
+
+typedef struct _multipython_pool_t {
+    struct _multipython_pool_t* next;
+    mp_context_node_t*  owner;      // context that created the pool, signalled as workers end
+    size_t              refs;       // the Pool object and the workers that haven't ended
+    size_t              num_workers;
+    size_t              alive;
+    size_t              next_worker; // round robin for submit()
+    uint8_t             closing;
+    size_t              submitted;
+    size_t              completed;
+    size_t              stolen;
+    multipython_worker_t workers[];
+} multipython_pool_t;
+
+STATIC multipython_pool_t* multipython_pools = NULL; // so that _pool_worker() only accepts real pools
+STATIC multipython_job_t* multipython_jobs = NULL;   // so that the jobs of an ending context can be found
+
+typedef struct _multipython_pool_obj_t {
+    mp_obj_base_t           base;
+    multipython_pool_t*     pool;   // NULL once closed
+} multipython_pool_obj_t;
+
+typedef struct _multipython_future_obj_t {
+    mp_obj_base_t           base;
+    multipython_job_t*      job;    // NULL once the result is taken
+    mp_obj_t                value;  // the result, or the exception, once taken
+    bool                    failed;
+} multipython_future_obj_t;
+
+STATIC const mp_obj_type_t multipython_future_type;
+
+
+
+// copies of objects between contexts
+enum {
+    MULTIPYTHON_COPY_NONE = 'N',
+    MULTIPYTHON_COPY_TRUE = 'T',
+    MULTIPYTHON_COPY_FALSE = 'F',
+    MULTIPYTHON_COPY_SMALL_INT = 'i',
+    MULTIPYTHON_COPY_INT = 'I',         // decimal digits of an int that isn't small
+    MULTIPYTHON_COPY_FLOAT = 'f',
+    MULTIPYTHON_COPY_STR = 's',
+    MULTIPYTHON_COPY_BYTES = 'b',
+    MULTIPYTHON_COPY_BYTEARRAY = 'a',
+    MULTIPYTHON_COPY_TUPLE = 't',
+    MULTIPYTHON_COPY_LIST = 'l',
+    MULTIPYTHON_COPY_DICT = 'd',
+};
+
+typedef struct _multipython_copy_reader_t {
+    const byte* pos;
+    const byte* end;
+} multipython_copy_reader_t;
+
+STATIC void multipython_copy_put_uint( vstr_t* out, mp_uint_t value ){
+    do {
+        byte b = value & 0x7f;
+        value >>= 7;
+        vstr_add_byte( out, value ? ( b | 0x80 ) : b );
+    } while( value );
+}
+
+STATIC mp_uint_t multipython_copy_get_uint( multipython_copy_reader_t* in ){
+    mp_uint_t value = 0;
+    for( size_t shift = 0; in->pos < in->end; shift += 7 ){
+        byte b = *in->pos++;
+        value |= (mp_uint_t)( b & 0x7f ) << shift;
+        if( !( b & 0x80 ) ){ break; }
+    }
+    return value;
+}
+
+STATIC void multipython_copy_put_bytes( vstr_t* out, byte kind, const void* buf, size_t len ){
+    vstr_add_byte( out, kind );
+    multipython_copy_put_uint( out, len );
+    vstr_add_strn( out, (const char*)buf, len );
+}
+
+STATIC void multipython_copy_put( vstr_t* out, mp_obj_t obj ){
+    MP_STACK_CHECK();
+    if( obj == mp_const_none ){
+        vstr_add_byte( out, MULTIPYTHON_COPY_NONE );
+    }else if( obj == mp_const_true ){
+        vstr_add_byte( out, MULTIPYTHON_COPY_TRUE );
+    }else if( obj == mp_const_false ){
+        vstr_add_byte( out, MULTIPYTHON_COPY_FALSE );
+    }else if( mp_obj_is_small_int(obj) ){
+        mp_int_t value = MP_OBJ_SMALL_INT_VALUE(obj);
+        vstr_add_byte( out, MULTIPYTHON_COPY_SMALL_INT );
+        multipython_copy_put_uint( out, ( (mp_uint_t)value << 1 ) ^ (mp_uint_t)( value >> ( 8 * sizeof(mp_int_t) - 1 ) ) ); // zigzag
+    }else if( mp_obj_is_type(obj, &mp_type_int) ){
+        vstr_t digits;
+        mp_print_t print;
+        vstr_init_print( &digits, 16, &print );
+        mp_obj_print_helper( &print, obj, PRINT_REPR );
+        multipython_copy_put_bytes( out, MULTIPYTHON_COPY_INT, digits.buf, digits.len );
+        vstr_clear( &digits );
+    #if MICROPY_PY_BUILTINS_FLOAT
+    }else if( mp_obj_is_float(obj) ){
+        mp_float_t value = mp_obj_float_get(obj);
+        vstr_add_byte( out, MULTIPYTHON_COPY_FLOAT );
+        vstr_add_strn( out, (const char*)&value, sizeof(value) );
+    #endif
+    }else if( mp_obj_is_str(obj) ){
+        size_t len;
+        const char* str = mp_obj_str_get_data( obj, &len );
+        multipython_copy_put_bytes( out, MULTIPYTHON_COPY_STR, str, len );
+    }else if( mp_obj_is_type(obj, &mp_type_bytes) || mp_obj_is_type(obj, &mp_type_bytearray) ){
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise( obj, &bufinfo, MP_BUFFER_READ );
+        multipython_copy_put_bytes( out, mp_obj_is_type(obj, &mp_type_bytes) ? MULTIPYTHON_COPY_BYTES : MULTIPYTHON_COPY_BYTEARRAY, bufinfo.buf, bufinfo.len );
+    }else if( mp_obj_is_type(obj, &mp_type_tuple) || mp_obj_is_type(obj, &mp_type_list) ){
+        size_t len;
+        mp_obj_t* items;
+        mp_obj_get_array( obj, &len, &items );
+        vstr_add_byte( out, mp_obj_is_type(obj, &mp_type_tuple) ? MULTIPYTHON_COPY_TUPLE : MULTIPYTHON_COPY_LIST );
+        multipython_copy_put_uint( out, len );
+        for( size_t indi = 0; indi < len; indi++ ){
+            multipython_copy_put( out, items[indi] );
+        }
+    }else if( mp_obj_is_type(obj, &mp_type_dict) ){
+        mp_map_t* map = mp_obj_dict_get_map( obj );
+        vstr_add_byte( out, MULTIPYTHON_COPY_DICT );
+        multipython_copy_put_uint( out, map->used );
+        for( size_t indi = 0; indi < map->alloc; indi++ ){
+            if( mp_map_slot_is_filled( map, indi ) ){
+                multipython_copy_put( out, map->table[indi].key );
+                multipython_copy_put( out, map->table[indi].value );
+            }
+        }
+    }else{
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "can't copy '%s' to another context", mp_obj_get_type_str(obj)));
+    }
+}
+
+STATIC mp_obj_t multipython_copy_get( multipython_copy_reader_t* in ){
+    MP_STACK_CHECK();
+    byte kind = *in->pos++;
+    switch( kind ){
+        case MULTIPYTHON_COPY_NONE :    return mp_const_none;
+        case MULTIPYTHON_COPY_TRUE :    return mp_const_true;
+        case MULTIPYTHON_COPY_FALSE :   return mp_const_false;
+        case MULTIPYTHON_COPY_SMALL_INT : {
+            mp_uint_t value = multipython_copy_get_uint( in );
+            return MP_OBJ_NEW_SMALL_INT( (mp_int_t)( value >> 1 ) ^ -(mp_int_t)( value & 1 ) );
+        }
+        #if MICROPY_PY_BUILTINS_FLOAT
+        case MULTIPYTHON_COPY_FLOAT : {
+            mp_float_t value;
+            memcpy( &value, in->pos, sizeof(value) );
+            in->pos += sizeof(value);
+            return mp_obj_new_float( value );
+        }
+        #endif
+        case MULTIPYTHON_COPY_TUPLE :
+        case MULTIPYTHON_COPY_LIST : {
+            size_t len = multipython_copy_get_uint( in );
+            mp_obj_t seq = ( kind == MULTIPYTHON_COPY_TUPLE ) ? mp_obj_new_tuple( len, NULL ) : mp_obj_new_list( len, NULL );
+            size_t seq_len;
+            mp_obj_t* items;
+            mp_obj_get_array( seq, &seq_len, &items );
+            for( size_t indi = 0; indi < len; indi++ ){
+                items[indi] = multipython_copy_get( in );
+            }
+            return seq;
+        }
+        case MULTIPYTHON_COPY_DICT : {
+            size_t len = multipython_copy_get_uint( in );
+            mp_obj_t dict = mp_obj_new_dict( len );
+            for( size_t indi = 0; indi < len; indi++ ){
+                mp_obj_t key = multipython_copy_get( in );
+                mp_obj_dict_store( dict, key, multipython_copy_get( in ) );
+            }
+            return dict;
+        }
+        default : {
+            size_t len = multipython_copy_get_uint( in );
+            const byte* buf = in->pos;
+            in->pos += len;
+            switch( kind ){
+                case MULTIPYTHON_COPY_INT :     return mp_parse_num_integer( (const char*)buf, len, 10, NULL );
+                case MULTIPYTHON_COPY_STR :     return mp_obj_new_str( (const char*)buf, len );
+                case MULTIPYTHON_COPY_BYTES :   return mp_obj_new_bytes( buf, len );
+                default :                       return mp_obj_new_bytearray( len, (void*)buf );
+            }
+        }
+    }
+}
+
+STATIC uint8_t* multipython_copy_out( mp_obj_t obj, size_t* len ){
+    // copy an object into memory that no context owns
+    vstr_t out;
+    vstr_init( &out, 32 );
+    multipython_copy_put( &out, obj );
+    uint8_t* data = (uint8_t*)MULTIPYTHON_MALLOC( out.len );
+    if( data == NULL ){
+        vstr_clear( &out );
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    memcpy( data, out.buf, out.len );
+    *len = out.len;
+    vstr_clear( &out );
+    return data;
+}
+
+STATIC mp_obj_t multipython_copy_in( const uint8_t* data, size_t len ){
+    multipython_copy_reader_t in = { .pos = data, .end = data + len };
+    return multipython_copy_get( &in );
+}
+
+
+
+// jobs and deques (must be called in the critical section)
+STATIC void multipython_deque_push_bottom( multipython_worker_t* worker, multipython_job_t* job ){
+    job->above = worker->bottom;
+    job->below = NULL;
+    if( worker->bottom != NULL ){
+        worker->bottom->below = job;
+    }else{
+        worker->top = job;
+    }
+    worker->bottom = job;
+    worker->jobs++;
+}
+
+STATIC multipython_job_t* multipython_deque_take( multipython_worker_t* worker, bool from_top ){
+    multipython_job_t* job = from_top ? worker->top : worker->bottom;
+    if( job == NULL ){ return NULL; }
+    if( job->above != NULL ){ job->above->below = job->below; }else{ worker->top = job->below; }
+    if( job->below != NULL ){ job->below->above = job->above; }else{ worker->bottom = job->above; }
+    job->above = NULL;
+    job->below = NULL;
+    worker->jobs--;
+    return job;
+}
+
+STATIC multipython_job_t* multipython_pool_take( multipython_pool_t* pool, size_t index ){
+    // newest job of our own deque, or else the oldest job of the busiest worker
+    multipython_job_t* job = multipython_deque_take( &pool->workers[index], false );
+    if( job != NULL ){ return job; }
+    multipython_worker_t* victim = NULL;
+    for( size_t indi = 0; indi < pool->num_workers; indi++ ){
+        multipython_worker_t* worker = &pool->workers[indi];
+        if( ( worker->jobs != 0 ) && ( ( victim == NULL ) || ( worker->jobs > victim->jobs ) ) ){
+            victim = worker;
+        }
+    }
+    if( victim == NULL ){ return NULL; }
+    pool->stolen++;
+    return multipython_deque_take( victim, true );
+}
+
+STATIC bool multipython_job_unref( multipython_job_t* job ){
+    // returns true when the caller has to free the job, outside of the critical section
+    if( --job->refs != 0 ){ return false; }
+    if( job->next != NULL ){ job->next->link = job->link; }
+    *job->link = job->next;
+    return true;
+}
+
+STATIC void multipython_job_free( multipython_job_t* job ){
+    MULTIPYTHON_FREE( job->data );
+    MULTIPYTHON_FREE( job );
+}
+
+STATIC void multipython_job_finish( multipython_pool_t* pool, multipython_job_t* job, uint8_t state, uint8_t* data, size_t len ){
+    multipython_port_enter_critical();
+    uint8_t* call = job->data;
+    job->data = data;
+    job->len = len;
+    job->state = state;
+    pool->completed++;
+    if( job->owner != NULL ){
+        multipython_port_signal( job->owner );
+    }
+    bool free_job = multipython_job_unref( job );
+    multipython_port_exit_critical();
+    MULTIPYTHON_FREE( call );
+    if( free_job ){
+        multipython_job_free( job );
+    }
+}
+
+STATIC void multipython_pool_signal_workers( multipython_pool_t* pool, bool idle_only ){
+    // signals are sent in the critical section, so that a worker can't end in between
+    for( size_t indi = 0; indi < pool->num_workers; indi++ ){
+        multipython_worker_t* worker = &pool->workers[indi];
+        if( ( worker->context != NULL ) && ( worker->idle || !idle_only ) ){
+            multipython_port_signal( worker->context );
+        }
+    }
+}
+
+STATIC bool multipython_pool_unref( multipython_pool_t* pool ){
+    // returns true when the caller has to free the pool, outside of the critical section
+    if( --pool->refs != 0 ){ return false; }
+    multipython_pool_t** link = &multipython_pools;
+    while( *link != pool ){ link = &(*link)->next; }
+    *link = pool->next;
+    return true;
+}
+
+
+
+// workers
+STATIC void multipython_pool_run_job( multipython_pool_t* pool, multipython_job_t* job ){
+    size_t len = 0;
+    uint8_t* data = NULL;
+    mp_obj_t fatal = MP_OBJ_NULL;
+    nlr_buf_t nlr;
+    if( nlr_push(&nlr) == 0 ){
+        // (module, name, args, kwargs)
+        mp_obj_t* call;
+        mp_obj_get_array_fixed_n( multipython_copy_in( job->data, job->len ), 4, &call );
+        mp_obj_t module = mp_import_name( mp_obj_str_get_qstr(call[0]), mp_const_true, MP_OBJ_NEW_SMALL_INT(0) );
+        mp_obj_t fun = mp_load_attr( module, mp_obj_str_get_qstr(call[1]) );
+
+        size_t n_args;
+        mp_obj_t* pos_args;
+        mp_obj_tuple_get( call[2], &n_args, &pos_args );
+        mp_map_t* kw_map = mp_obj_dict_get_map( call[3] );
+        mp_obj_t* fun_args = m_new( mp_obj_t, n_args + 2 * kw_map->used );
+        memcpy( fun_args, pos_args, n_args * sizeof(mp_obj_t) );
+        size_t n_kw = 0;
+        for( size_t indi = 0; indi < kw_map->alloc; indi++ ){
+            if( mp_map_slot_is_filled( kw_map, indi ) ){
+                fun_args[n_args + 2 * n_kw] = kw_map->table[indi].key;
+                fun_args[n_args + 2 * n_kw + 1] = kw_map->table[indi].value;
+                n_kw++;
+            }
+        }
+        mp_obj_t ret = mp_call_function_n_kw( fun, n_args, n_kw, fun_args );
+        data = multipython_copy_out( ret, &len );
+        nlr_pop();
+        multipython_job_finish( pool, job, MULTIPYTHON_JOB_DONE, data, len );
+        return;
+    }
+
+    // hand the exception over by the name of its type and its args
+    mp_obj_t exc = MP_OBJ_FROM_PTR(nlr.ret_val);
+    const mp_obj_type_t* type = mp_obj_get_type( exc );
+    if( mp_obj_is_subclass_fast( MP_OBJ_FROM_PTR(type), MP_OBJ_FROM_PTR(&mp_type_KeyboardInterrupt) )
+        || mp_obj_is_subclass_fast( MP_OBJ_FROM_PTR(type), MP_OBJ_FROM_PTR(&mp_type_SystemExit) ) ){
+        fatal = exc; // the worker is being stopped
+    }
+    if( nlr_push(&nlr) == 0 ){
+        mp_obj_t failure[2] = { MP_OBJ_NEW_QSTR(type->name), mp_load_attr( exc, MP_QSTR_args ) };
+        nlr_buf_t inner;
+        if( nlr_push(&inner) == 0 ){
+            data = multipython_copy_out( mp_obj_new_tuple( 2, failure ), &len );
+            nlr_pop();
+        }else{
+            // args that can't be copied are replaced by their text
+            mp_obj_t text = mp_obj_str_make_new( &mp_type_str, 1, 0, &exc );
+            failure[1] = mp_obj_new_tuple( 1, &text );
+            data = multipython_copy_out( mp_obj_new_tuple( 2, failure ), &len );
+        }
+        nlr_pop();
+    }else{
+        data = NULL; // no memory for the exception either
+        len = 0;
+    }
+    multipython_job_finish( pool, job, MULTIPYTHON_JOB_FAILED, data, len );
+    if( fatal != MP_OBJ_NULL ){
+        nlr_raise( fatal );
+    }
+}
+
+STATIC void multipython_pool_worker_loop( multipython_pool_t* pool, size_t index, mp_context_node_t* self ){
+    multipython_worker_t* worker = &pool->workers[index];
+    for( ;; ){
+        multipython_port_enter_critical();
+        multipython_job_t* job = multipython_pool_take( pool, index );
+        bool done = ( job == NULL ) && pool->closing;
+        worker->idle = ( job == NULL );
+        multipython_port_exit_critical();
+        if( done ){
+            return;
+        }
+        if( job != NULL ){
+            multipython_pool_run_job( pool, job );
+            continue;
+        }
+
+        multipython_port_wait( self, -1 );
+        mp_obj_t exc = MP_STATE_VM(mp_pending_exception);
+        if( exc != MP_OBJ_NULL ){
+            MP_STATE_VM(mp_pending_exception) = MP_OBJ_NULL;
+            nlr_raise(exc);
+        }
+    }
+}
+
+STATIC void multipython_pool_worker_end( multipython_pool_t* pool, size_t index ){
+    // the last worker to end gives up on the jobs that are left
+    multipython_job_t* abandoned = NULL;
+    multipython_port_enter_critical();
+    pool->workers[index].context = NULL;
+    pool->workers[index].idle = 0;
+    if( --pool->alive == 0 ){
+        for( size_t indi = 0; indi < pool->num_workers; indi++ ){
+            multipython_job_t* job;
+            while( ( job = multipython_deque_take( &pool->workers[indi], true ) ) != NULL ){
+                job->below = abandoned;
+                abandoned = job;
+            }
+        }
+    }
+    if( pool->owner != NULL ){
+        multipython_port_signal( pool->owner );
+    }
+    multipython_port_exit_critical();
+
+    while( abandoned != NULL ){
+        multipython_job_t* job = abandoned;
+        abandoned = job->below;
+        job->below = NULL;
+        multipython_job_finish( pool, job, MULTIPYTHON_JOB_ABANDONED, NULL, 0 );
+    }
+
+    multipython_port_enter_critical();
+    bool free_pool = multipython_pool_unref( pool );
+    multipython_port_exit_critical();
+    if( free_pool ){
+        MULTIPYTHON_FREE( pool );
+    }
+}
+
+STATIC mp_obj_t multipython_pool_worker( mp_obj_t pool_in, mp_obj_t index_in ){
+    // the code that workers run, started by Pool()
+    multipython_pool_t* pool = (multipython_pool_t*)mp_obj_int_get_truncated( pool_in );
+    size_t index = mp_obj_get_int( index_in );
+    mp_context_node_t* self = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+
+    multipython_port_enter_critical();
+    multipython_pool_t* known = multipython_pools;
+    while( ( known != NULL ) && ( known != pool ) ){ known = known->next; }
+    bool valid = ( known != NULL ) && ( index < pool->num_workers ) && ( pool->workers[index].context == NULL );
+    if( valid ){
+        pool->workers[index].context = self;
+    }
+    multipython_port_exit_critical();
+    if( !valid ){
+        mp_raise_ValueError("not a pool worker");
+    }
+
+    nlr_buf_t nlr;
+    if( nlr_push(&nlr) == 0 ){
+        multipython_pool_worker_loop( pool, index, self );
+        nlr_pop();
+        multipython_pool_worker_end( pool, index );
+    }else{
+        multipython_pool_worker_end( pool, index );
+        nlr_jump( nlr.ret_val );
+    }
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_2(multipython_pool_worker_obj, multipython_pool_worker);
+
+
+
+// Future
+STATIC void multipython_future_release( multipython_future_obj_t* self ){
+    multipython_job_t* job = self->job;
+    if( job == NULL ){ return; }
+    self->job = NULL;
+    multipython_port_enter_critical();
+    job->owner = NULL;
+    bool free_job = multipython_job_unref( job );
+    multipython_port_exit_critical();
+    if( free_job ){
+        multipython_job_free( job );
+    }
+}
+
+STATIC mp_obj_t multipython_future_take( multipython_future_obj_t* self ){
+    // turn the copy held by a finished job into the value or exception of the future
+    multipython_job_t* job = self->job;
+    if( job->state == MULTIPYTHON_JOB_DONE ){
+        self->value = multipython_copy_in( job->data, job->len );
+    }else{
+        self->failed = true;
+        self->value = MP_OBJ_NULL;
+        if( ( job->state == MULTIPYTHON_JOB_FAILED ) && ( job->data != NULL ) ){
+            mp_obj_t* failure;
+            mp_obj_get_array_fixed_n( multipython_copy_in( job->data, job->len ), 2, &failure );
+            mp_map_elem_t* elem = mp_map_lookup( (mp_map_t*)&mp_module_builtins_globals.map, failure[0], MP_MAP_LOOKUP );
+            size_t n_args;
+            mp_obj_t* args;
+            mp_obj_tuple_get( failure[1], &n_args, &args );
+            if( ( elem != NULL ) && mp_obj_is_exception_type( elem->value ) ){
+                self->value = mp_obj_new_exception_args( MP_OBJ_TO_PTR(elem->value), n_args, args );
+            }else{
+                self->value = mp_obj_new_exception_msg_varg( &mp_type_RuntimeError, "job raised %s", mp_obj_str_get_str(failure[0]) );
+            }
+        }else if( job->state == MULTIPYTHON_JOB_FAILED ){
+            self->value = mp_obj_new_exception_msg( &mp_type_MemoryError, "job failed" );
+        }else{
+            self->value = mp_obj_new_exception_msg( &mp_type_RuntimeError, "pool has no workers" );
+        }
+    }
+    multipython_future_release( self );
+    return self->value;
+}
+
+STATIC mp_obj_t multipython_future_done( mp_obj_t self_in ){
+    multipython_future_obj_t* self = MP_OBJ_TO_PTR(self_in);
+    return mp_obj_new_bool( ( self->job == NULL ) || ( self->job->state != MULTIPYTHON_JOB_PENDING ) );
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(multipython_future_done_obj, multipython_future_done);
+
+STATIC mp_obj_t multipython_future_result( size_t n_args, const mp_obj_t *args ){
+    // wait for the job (timeout in ms, None to wait for as long as it takes) and
+    // return its result or raise its exception. OSError(ETIMEDOUT) on timeout
+    multipython_future_obj_t* self = MP_OBJ_TO_PTR(args[0]);
+    mp_int_t timeout_ms = -1;
+    if( ( n_args > 1 ) && ( args[1] != mp_const_none ) ){
+        timeout_ms = mp_obj_get_int( args[1] );
+    }
+
+    if( self->job != NULL ){
+        mp_context_node_t* me = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+        mp_uint_t start = mp_hal_ticks_ms();
+        while( self->job->state == MULTIPYTHON_JOB_PENDING ){
+            mp_int_t remaining = -1;
+            if( timeout_ms >= 0 ){
+                remaining = timeout_ms - (mp_int_t)( mp_hal_ticks_ms() - start );
+                if( remaining <= 0 ){
+                    mp_raise_OSError(MP_ETIMEDOUT);
+                }
+            }
+            multipython_port_wait( me, remaining );
+
+            mp_obj_t exc = MP_STATE_VM(mp_pending_exception);
+            if( exc != MP_OBJ_NULL ){
+                MP_STATE_VM(mp_pending_exception) = MP_OBJ_NULL;
+                nlr_raise(exc);
+            }
+        }
+        multipython_port_enter_critical(); // the state is written before the data is visible
+        multipython_port_exit_critical();
+        multipython_future_take( self );
+    }
+    if( self->failed ){
+        nlr_raise( self->value );
+    }
+    return self->value;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(multipython_future_result_obj, 1, 2, multipython_future_result);
+
+STATIC mp_obj_t multipython_future_del( mp_obj_t self_in ){
+    multipython_future_release( MP_OBJ_TO_PTR(self_in) );
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(multipython_future_del_obj, multipython_future_del);
+
+STATIC const mp_rom_map_elem_t multipython_future_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_done), MP_ROM_PTR(&multipython_future_done_obj) },
+    { MP_ROM_QSTR(MP_QSTR_result), MP_ROM_PTR(&multipython_future_result_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&multipython_future_del_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(multipython_future_locals_dict, multipython_future_locals_dict_table);
+
+STATIC const mp_obj_type_t multipython_future_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Future,
+    .locals_dict = (mp_obj_dict_t*)&multipython_future_locals_dict,
+};
+
+
+
+// Pool
+STATIC multipython_pool_t* multipython_pool_get( mp_obj_t self_in ){
+    multipython_pool_obj_t* self = MP_OBJ_TO_PTR(self_in);
+    if( self->pool == NULL ){
+        mp_raise_ValueError("pool is closed");
+    }
+    return self->pool;
+}
+
+STATIC void multipython_pool_detach( multipython_pool_obj_t* self ){
+    // stop taking jobs and let the workers end once the queued ones are done
+    multipython_pool_t* pool = self->pool;
+    if( pool == NULL ){ return; }
+    self->pool = NULL;
+    multipython_port_enter_critical();
+    pool->closing = 1;
+    pool->owner = NULL;
+    multipython_pool_signal_workers( pool, false );
+    bool free_pool = multipython_pool_unref( pool );
+    multipython_port_exit_critical();
+    if( free_pool ){
+        MULTIPYTHON_FREE( pool );
+    }
+}
+
+void multipython_pool_release_all( mp_context_node_t* context ){
+    // what the finalisers of the Pools and Futures of context do, for a context that
+    // ends without running them. Nothing is left to signal the context afterwards
+    multipython_job_t* free_jobs = NULL;
+    multipython_pool_t* free_pools = NULL;
+    multipython_port_enter_critical();
+    multipython_job_t* job = multipython_jobs;
+    while( job != NULL ){
+        multipython_job_t* next = job->next;
+        if( job->owner == context ){
+            job->owner = NULL;
+            if( multipython_job_unref( job ) ){
+                job->below = free_jobs; // finished, so in no deque
+                free_jobs = job;
+            }
+        }
+        job = next;
+    }
+    multipython_pool_t* pool = multipython_pools;
+    while( pool != NULL ){
+        multipython_pool_t* next = pool->next;
+        if( pool->owner == context ){
+            pool->closing = 1;
+            pool->owner = NULL;
+            multipython_pool_signal_workers( pool, false );
+            if( multipython_pool_unref( pool ) ){
+                pool->next = free_pools;
+                free_pools = pool;
+            }
+        }
+        pool = next;
+    }
+    multipython_port_exit_critical();
+
+    while( free_jobs != NULL ){
+        job = free_jobs;
+        free_jobs = job->below;
+        multipython_job_free( job );
+    }
+    while( free_pools != NULL ){
+        pool = free_pools;
+        free_pools = pool->next;
+        MULTIPYTHON_FREE( pool );
+    }
+}
+
+STATIC mp_obj_t multipython_pool_make_new( const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args ){
+    // Pool(workers=MICROPY_NUM_CORES, heap_size=0): start the workers, spread over the
+    // cores. heap_size is that of each worker, 0 for the port default
+    enum { ARG_workers, ARG_heap_size };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_workers,      MP_ARG_INT,                     {.u_int = ( MICROPY_NUM_CORES < 2 ) ? 2 : MICROPY_NUM_CORES } },
+        { MP_QSTR_heap_size,    MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mp_int_t num_workers = args[ARG_workers].u_int;
+    if( ( num_workers < 1 ) || ( num_workers > MULTIPYTHON_POOL_WORKERS_MAX ) ){
+        mp_raise_ValueError("number of workers out of range");
+    }
+
+    multipython_pool_t* pool = (multipython_pool_t*)MULTIPYTHON_MALLOC( sizeof(multipython_pool_t) + num_workers * sizeof(multipython_worker_t) );
+    if( pool == NULL ){
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    memset( pool, 0x00, sizeof(multipython_pool_t) + num_workers * sizeof(multipython_worker_t) );
+    pool->owner = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    pool->num_workers = num_workers;
+    pool->refs = 1;
+
+    #if MICROPY_ENABLE_FINALISER
+    multipython_pool_obj_t* self = m_new_obj_with_finaliser(multipython_pool_obj_t);
+    #else
+    multipython_pool_obj_t* self = m_new_obj(multipython_pool_obj_t);
+    #endif
+    self->base.type = type;
+    self->pool = pool;
+
+    multipython_port_enter_critical();
+    pool->next = multipython_pools;
+    multipython_pools = pool;
+    multipython_port_exit_critical();
+
+    nlr_buf_t nlr;
+    if( nlr_push(&nlr) == 0 ){
+        for( mp_int_t indi = 0; indi < num_workers; indi++ ){
+            char source[80];
+            snprintf( source, sizeof(source), "import multipython\nmultipython._pool_worker(0x%lx, %u)\n", (unsigned long)(uintptr_t)pool, (unsigned)indi );
+            mp_obj_t start_args[] = {
+                mp_obj_new_str( source, strlen(source) ),
+                MP_OBJ_NEW_SMALL_INT( MP_PARSE_SINGLE_INPUT ),
+                MP_OBJ_NEW_SMALL_INT( indi % MICROPY_NUM_CORES ),
+                MP_OBJ_NEW_QSTR(MP_QSTR_heap_size), MP_OBJ_NEW_SMALL_INT( args[ARG_heap_size].u_int ),
+            };
+            // each worker holds the pool until it ends
+            multipython_port_enter_critical();
+            pool->refs++;
+            pool->alive++;
+            multipython_port_exit_critical();
+            nlr_buf_t inner;
+            if( nlr_push(&inner) == 0 ){
+                mp_call_function_n_kw( MP_OBJ_FROM_PTR(&multipython_start_obj), 3, 1, start_args );
+                nlr_pop();
+            }else{
+                multipython_port_enter_critical();
+                pool->refs--;
+                pool->alive--;
+                multipython_port_exit_critical();
+                nlr_jump( inner.ret_val );
+            }
+        }
+        nlr_pop();
+    }else{
+        multipython_pool_detach( self );
+        nlr_jump( nlr.ret_val );
+    }
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC mp_obj_t multipython_pool_submit( size_t n_args, const mp_obj_t *args, mp_map_t *kw_args ){
+    // submit(function, *args, **kwargs): run function(*args, **kwargs) on a worker and
+    // return a Future. The function is given by a function of an importable module or
+    // by its name, 'module.function'
+    multipython_pool_t* pool = multipython_pool_get( args[0] );
+    mp_obj_t fun = args[1];
+
+    mp_obj_t call[4];
+    if( mp_obj_is_str(fun) ){
+        size_t len;
+        const char* name = mp_obj_str_get_data( fun, &len );
+        const char* dot = NULL;
+        for( const char* pos = name; pos < name + len; pos++ ){
+            if( *pos == '.' ){ dot = pos; }
+        }
+        if( ( dot == NULL ) || ( dot == name ) || ( dot == name + len - 1 ) ){
+            mp_raise_ValueError("expects 'module.function'");
+        }
+        call[0] = mp_obj_new_str( name, dot - name );
+        call[1] = mp_obj_new_str( dot + 1, name + len - dot - 1 );
+    }else if( mp_obj_is_type(fun, &mp_type_fun_bc) ){
+        mp_obj_fun_bc_t* fun_bc = MP_OBJ_TO_PTR(fun);
+        mp_map_elem_t* elem = mp_map_lookup( &fun_bc->globals->map, MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_MAP_LOOKUP );
+        if( ( elem == NULL ) || ( elem->value == MP_OBJ_NEW_QSTR(MP_QSTR___main__) ) ){
+            mp_raise_ValueError("function must come from an importable module");
+        }
+        call[0] = elem->value;
+        call[1] = MP_OBJ_NEW_QSTR( mp_obj_fun_get_name(fun) );
+    }else{
+        mp_raise_TypeError("expects a function or 'module.function'");
+    }
+    call[2] = mp_obj_new_tuple( n_args - 2, args + 2 );
+    call[3] = mp_obj_new_dict( kw_args->used );
+    for( size_t indi = 0; indi < kw_args->alloc; indi++ ){
+        if( mp_map_slot_is_filled( kw_args, indi ) ){
+            mp_obj_dict_store( call[3], kw_args->table[indi].key, kw_args->table[indi].value );
+        }
+    }
+
+    #if MICROPY_ENABLE_FINALISER
+    multipython_future_obj_t* future = m_new_obj_with_finaliser(multipython_future_obj_t);
+    #else
+    multipython_future_obj_t* future = m_new_obj(multipython_future_obj_t);
+    #endif
+    future->base.type = &multipython_future_type;
+    future->job = NULL;
+    future->value = mp_const_none;
+    future->failed = false;
+
+    size_t len;
+    uint8_t* data = multipython_copy_out( mp_obj_new_tuple( 4, call ), &len );
+    multipython_job_t* job = (multipython_job_t*)MULTIPYTHON_MALLOC( sizeof(multipython_job_t) );
+    if( job == NULL ){
+        MULTIPYTHON_FREE( data );
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    memset( job, 0x00, sizeof(multipython_job_t) );
+    job->owner = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    job->data = data;
+    job->len = len;
+    job->state = MULTIPYTHON_JOB_PENDING;
+    job->refs = 2;
+    future->job = job;
+
+    // queue it for the next worker in turn, and let idle workers steal it
+    multipython_port_enter_critical();
+    job->next = multipython_jobs;
+    job->link = &multipython_jobs;
+    if( multipython_jobs != NULL ){ multipython_jobs->link = &job->next; }
+    multipython_jobs = job;
+    multipython_worker_t* worker = &pool->workers[pool->next_worker];
+    pool->next_worker = ( pool->next_worker + 1 ) % pool->num_workers;
+    multipython_deque_push_bottom( worker, job );
+    pool->submitted++;
+    if( ( worker->context != NULL ) && !worker->idle ){
+        multipython_port_signal( worker->context );
+    }
+    multipython_pool_signal_workers( pool, true );
+    multipython_port_exit_critical();
+
+    return MP_OBJ_FROM_PTR(future);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(multipython_pool_submit_obj, 2, multipython_pool_submit);
+
+STATIC mp_obj_t multipython_pool_map( mp_obj_t self_in, mp_obj_t fun, mp_obj_t iterable ){
+    // [function(item) for item in iterable], with the calls spread over the workers
+    mp_obj_t futures = mp_obj_new_list( 0, NULL );
+    mp_obj_t iter = mp_getiter( iterable, NULL );
+    mp_obj_t item;
+    while( ( item = mp_iternext( iter ) ) != MP_OBJ_STOP_ITERATION ){
+        mp_obj_t submit_args[] = { self_in, fun, item };
+        mp_obj_list_append( futures, multipython_pool_submit( 3, submit_args, (mp_map_t*)&mp_const_empty_map ) );
+    }
+    size_t len;
+    mp_obj_t* items;
+    mp_obj_list_get( futures, &len, &items );
+    for( size_t indi = 0; indi < len; indi++ ){
+        items[indi] = multipython_future_result( 1, &items[indi] );
+    }
+    return futures;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(multipython_pool_map_obj, multipython_pool_map);
+
+STATIC mp_obj_t multipython_pool_stats( mp_obj_t self_in ){
+    // (workers, submitted, completed, stolen)
+    multipython_pool_t* pool = multipython_pool_get( self_in );
+    size_t values[4];
+    multipython_port_enter_critical();
+    values[0] = pool->alive;
+    values[1] = pool->submitted;
+    values[2] = pool->completed;
+    values[3] = pool->stolen;
+    multipython_port_exit_critical();
+    mp_obj_t stats[4];
+    for( size_t indi = 0; indi < MP_ARRAY_SIZE(stats); indi++ ){
+        stats[indi] = mp_obj_new_int_from_uint( values[indi] );
+    }
+    return mp_obj_new_tuple( MP_ARRAY_SIZE(stats), stats );
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(multipython_pool_stats_obj, multipython_pool_stats);
+
+STATIC mp_obj_t multipython_pool_close( mp_obj_t self_in ){
+    // finish the queued jobs and wait for the workers to end
+    multipython_pool_obj_t* self = MP_OBJ_TO_PTR(self_in);
+    multipython_pool_t* pool = self->pool;
+    if( pool == NULL ){ return mp_const_none; }
+    mp_context_node_t* me = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+
+    multipython_port_enter_critical();
+    pool->closing = 1;
+    pool->owner = me;
+    multipython_pool_signal_workers( pool, false );
+    multipython_port_exit_critical();
+
+    for( ;; ){
+        multipython_port_enter_critical();
+        size_t alive = pool->alive;
+        multipython_port_exit_critical();
+        if( alive == 0 ){ break; }
+        multipython_port_wait( me, -1 );
+        mp_obj_t exc = MP_STATE_VM(mp_pending_exception);
+        if( exc != MP_OBJ_NULL ){
+            MP_STATE_VM(mp_pending_exception) = MP_OBJ_NULL;
+            nlr_raise(exc);
+        }
+    }
+    multipython_pool_detach( self );
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(multipython_pool_close_obj, multipython_pool_close);
+
+STATIC mp_obj_t multipython_pool_del( mp_obj_t self_in ){
+    multipython_pool_detach( MP_OBJ_TO_PTR(self_in) );
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(multipython_pool_del_obj, multipython_pool_del);
+
+STATIC mp_obj_t multipython_pool_exit( size_t n_args, const mp_obj_t *args ){
+    (void)n_args;
+    return multipython_pool_close( args[0] );
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(multipython_pool_exit_obj, 4, 4, multipython_pool_exit);
+
+STATIC const mp_rom_map_elem_t multipython_pool_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_submit), MP_ROM_PTR(&multipython_pool_submit_obj) },
+    { MP_ROM_QSTR(MP_QSTR_map), MP_ROM_PTR(&multipython_pool_map_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&multipython_pool_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&multipython_pool_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&multipython_pool_exit_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&multipython_pool_del_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(multipython_pool_locals_dict, multipython_pool_locals_dict_table);
+
+const mp_obj_type_t multipython_pool_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Pool,
+    .make_new = multipython_pool_make_new,
+    .locals_dict = (mp_obj_dict_t*)&multipython_pool_locals_dict,
+};
+
+#endif // MICROPY_PY_MULTIPYTHON && MICROPY_MULTIPYTHON_POOL
@@ -0,0 +1,324 @@
+/*
+Copyright 2019 Owen Lyke
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+/*
+
+Buffers shared by contexts without copies
+
+A shared buffer is a block of memory that no context owns. Each context that holds
+it sees it as a writable memoryview of its own. The buffer is named between contexts
+by a small int handle, which can travel as the argument of a response:
+
+    producer                                consumer
+    view = shared_alloc(256)
+    fill view
+    response(argument=shared_handle(view))
+                                            view = shared_attach(handle)
+                                            read view
+                                            shared_release(view)
+    shared_release(view)
+
+A context holds a buffer from shared_alloc() or shared_attach() until it calls
+shared_release() as many times, or until it ends. The buffer is freed when no context
+holds it, so a handle is only good while some context holds the buffer; attaching to
+one that is gone raises ValueError rather than reaching freed memory.
+
+shared_release() empties the memoryview it is given, but slices and other views
+taken from it earlier keep the memory alive: a context that released a buffer keeps a
+reference to it while memoryviews in its heap point into it, and lets go of it once
+they are collected (checked as the context allocates, attaches or releases buffers, and
+when it ends). Access to the data itself isn't synchronised: contexts hand a buffer
+over with responses or notify().
+
+*/
+#include <string.h>
+#include <stdlib.h>
+
+#include "py/gc.h"
+#include "py/mperrno.h"
+#include "py/objarray.h"
+#include "py/smallint.h"
+#include "py/runtime.h"
+
+#include "extmod/modmultipython.h"
+
+#if MICROPY_PY_MULTIPYTHON && MICROPY_MULTIPYTHON_SHARED
+
+typedef struct _multipython_shared_t {
+    struct _multipython_shared_t*   next;
+    mp_int_t            handle;
+    size_t              holders;    // contexts that hold the buffer, it can be attached while there are any
+    size_t              refs;       // the holders, and contexts that released it but may have views of it left
+    size_t              size;
+    uint64_t            data[];     // aligned for any element type
+} multipython_shared_t;
+
+// a context holds a buffer once for each time it allocated or attached it
+typedef struct _multipython_shared_use_t {
+    struct _multipython_shared_use_t*   next;
+    multipython_shared_t*               buffer;
+    size_t                              count;  // 0 once released, while views of the buffer may be left
+} multipython_shared_use_t;
+
+STATIC multipython_shared_t* multipython_shared = NULL;
+STATIC mp_int_t multipython_shared_next_handle = 1;
+
+STATIC mp_obj_t multipython_shared_view( multipython_shared_t* buffer ){
+    mp_obj_array_t* view = MP_OBJ_TO_PTR(mp_obj_new_memoryview( 'B', buffer->size, buffer->data ));
+    view->typecode |= MP_OBJ_ARRAY_TYPECODE_FLAG_RW;
+    return MP_OBJ_FROM_PTR(view);
+}
+
+STATIC multipython_shared_use_t* multipython_shared_find_use( mp_context_node_t* context, const void* ptr, bool released ){
+    // the use by the context of the buffer that ptr points into, or NULL. Uses of
+    // buffers the context has released are only found if released is true
+    // must be called with the lock held
+    multipython_shared_use_t* use = (multipython_shared_use_t*)context->shared_uses;
+    for( ; use != NULL; use = use->next ){
+        if( ( use->count == 0 ) && !released ){ continue; }
+        const uint8_t* data = (const uint8_t*)use->buffer->data;
+        if( ( (const uint8_t*)ptr == data ) || ( ( (const uint8_t*)ptr > data ) && ( (const uint8_t*)ptr < data + use->buffer->size ) ) ){
+            break;
+        }
+    }
+    return use;
+}
+
+STATIC multipython_shared_use_t* multipython_shared_get_use( mp_context_node_t* context, mp_obj_t view_in ){
+    // the use by the context of the buffer behind a memoryview it was given
+    if( !mp_obj_is_type(view_in, &mp_type_memoryview) ){
+        mp_raise_TypeError("expects a shared buffer memoryview");
+    }
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise( view_in, &bufinfo, MP_BUFFER_READ );
+    multipython_port_enter_critical();
+    multipython_shared_use_t* use = multipython_shared_find_use( context, bufinfo.buf, false );
+    multipython_port_exit_critical();
+    if( use == NULL ){
+        mp_raise_ValueError("not a shared buffer of this context");
+    }
+    return use;
+}
+
+STATIC void multipython_shared_unhold( multipython_shared_t* buffer ){
+    // must be called with the lock held. A buffer nobody holds can't be attached
+    if( --buffer->holders == 0 ){
+        multipython_shared_t** link = &multipython_shared;
+        while( *link != buffer ){ link = &(*link)->next; }
+        *link = buffer->next;
+    }
+}
+
+STATIC void multipython_shared_unref( multipython_shared_t* buffer ){
+    // the buffer is freed with its last reference
+    multipython_port_enter_critical();
+    bool unused = ( --buffer->refs == 0 );
+    multipython_port_exit_critical();
+    if( unused ){
+        MULTIPYTHON_FREE(buffer);
+    }
+}
+
+STATIC bool multipython_shared_is_view( const void* ptr, void* arg ){
+    // whether a block of the heap is a memoryview into the buffer. Other blocks only
+    // look like one by chance, which keeps the buffer a little longer
+    const mp_obj_array_t* view = (const mp_obj_array_t*)ptr;
+    const multipython_shared_t* buffer = (const multipython_shared_t*)arg;
+    const uint8_t* data = (const uint8_t*)buffer->data;
+    return ( view->base.type == &mp_type_memoryview ) && ( (const uint8_t*)view->items >= data ) && ( (const uint8_t*)view->items <= data + buffer->size );
+}
+
+STATIC void multipython_shared_unpin( mp_context_node_t* context ){
+    // let go of the buffers the context released once its heap has no views of them.
+    // Only the context changes its list of uses, so it is walked without the lock
+    multipython_shared_use_t* use = (multipython_shared_use_t*)context->shared_uses;
+    while( use != NULL ){
+        multipython_shared_use_t* next = use->next;
+        if( ( use->count == 0 ) && !gc_any_block( multipython_shared_is_view, use->buffer ) ){
+            multipython_port_enter_critical();
+            multipython_shared_use_t** link = (multipython_shared_use_t**)&context->shared_uses;
+            while( *link != use ){ link = &(*link)->next; }
+            *link = use->next;
+            multipython_port_exit_critical();
+            multipython_shared_unref( use->buffer );
+            MULTIPYTHON_FREE(use);
+        }
+        use = next;
+    }
+}
+
+void multipython_shared_release_all( mp_context_node_t* context ){
+    // the heap of the context is gone, so its views are too
+    multipython_port_enter_critical();
+    multipython_shared_use_t* use = (multipython_shared_use_t*)context->shared_uses;
+    context->shared_uses = NULL;
+    for( multipython_shared_use_t* held = use; held != NULL; held = held->next ){
+        if( held->count != 0 ){
+            multipython_shared_unhold( held->buffer );
+        }
+    }
+    multipython_port_exit_critical();
+    while( use != NULL ){
+        multipython_shared_use_t* next = use->next;
+        multipython_shared_unref( use->buffer );
+        MULTIPYTHON_FREE(use);
+        use = next;
+    }
+}
+
+STATIC mp_obj_t multipython_shared_alloc( mp_obj_t size_in ){
+    // a new zeroed buffer of size bytes, held by the calling context
+    mp_int_t size = mp_obj_get_int( size_in );
+    if( size < 0 ){
+        mp_raise_ValueError("sizes must not be negative");
+    }
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    multipython_shared_unpin( context );
+    multipython_shared_t* buffer = (multipython_shared_t*)MULTIPYTHON_MALLOC( sizeof(multipython_shared_t) + size );
+    multipython_shared_use_t* use = (multipython_shared_use_t*)MULTIPYTHON_MALLOC( sizeof(multipython_shared_use_t) );
+    if( ( buffer == NULL ) || ( use == NULL ) ){
+        MULTIPYTHON_FREE(buffer);
+        MULTIPYTHON_FREE(use);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    memset( buffer->data, 0x00, size );
+    buffer->holders = 1;
+    buffer->refs = 1;
+    buffer->size = size;
+    use->buffer = buffer;
+    use->count = 1;
+
+    multipython_port_enter_critical();
+    buffer->handle = multipython_shared_next_handle;
+    multipython_shared_next_handle = ( multipython_shared_next_handle == MP_SMALL_INT_MAX ) ? 1 : multipython_shared_next_handle + 1;
+    buffer->next = multipython_shared;
+    multipython_shared = buffer;
+    use->next = (multipython_shared_use_t*)context->shared_uses;
+    context->shared_uses = use;
+    multipython_port_exit_critical();
+    return multipython_shared_view( buffer );
+}
+MP_DEFINE_CONST_FUN_OBJ_1(multipython_shared_alloc_obj, multipython_shared_alloc);
+
+STATIC mp_obj_t multipython_shared_attach( mp_obj_t handle_in ){
+    // a memoryview of the buffer with the handle, which the calling context then holds
+    mp_int_t handle = mp_obj_get_int( handle_in );
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    multipython_shared_unpin( context );
+    multipython_shared_use_t* use = (multipython_shared_use_t*)MULTIPYTHON_MALLOC( sizeof(multipython_shared_use_t) );
+    if( use == NULL ){
+        mp_raise_OSError(MP_ENOMEM);
+    }
+
+    multipython_port_enter_critical();
+    multipython_shared_t* buffer = multipython_shared;
+    while( ( buffer != NULL ) && ( buffer->handle != handle ) ){
+        buffer = buffer->next;
+    }
+    multipython_shared_use_t* held = NULL;
+    if( buffer != NULL ){
+        held = multipython_shared_find_use( context, buffer->data, true );
+        if( ( held != NULL ) && ( held->buffer == buffer ) ){
+            if( held->count++ == 0 ){
+                buffer->holders++; // released, but still referenced by the context
+            }
+        }else{
+            held = NULL;
+            buffer->holders++;
+            buffer->refs++;
+            use->buffer = buffer;
+            use->count = 1;
+            use->next = (multipython_shared_use_t*)context->shared_uses;
+            context->shared_uses = use;
+        }
+    }
+    multipython_port_exit_critical();
+
+    if( ( buffer == NULL ) || ( held != NULL ) ){
+        MULTIPYTHON_FREE(use);
+    }
+    if( buffer == NULL ){
+        mp_raise_ValueError("no shared buffer with that handle");
+    }
+    return multipython_shared_view( buffer );
+}
+MP_DEFINE_CONST_FUN_OBJ_1(multipython_shared_attach_obj, multipython_shared_attach);
+
+STATIC mp_obj_t multipython_shared_handle( mp_obj_t view_in ){
+    // the handle that other contexts attach to the buffer of view with
+    multipython_shared_use_t* use = multipython_shared_get_use( mp_active_contexts[MICROPY_GET_CORE_INDEX], view_in );
+    return MP_OBJ_NEW_SMALL_INT( use->buffer->handle );
+}
+MP_DEFINE_CONST_FUN_OBJ_1(multipython_shared_handle_obj, multipython_shared_handle);
+
+STATIC mp_obj_t multipython_shared_release( mp_obj_t view_in ){
+    // stop holding the buffer of view once, and empty view so that it doesn't keep
+    // the buffer alive
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    multipython_shared_use_t* use = multipython_shared_get_use( context, view_in );
+    mp_obj_array_t* view = MP_OBJ_TO_PTR(view_in);
+    view->free = 0;
+    view->len = 0;
+    view->items = NULL;
+
+    multipython_port_enter_critical();
+    if( --use->count == 0 ){
+        multipython_shared_unhold( use->buffer );
+    }
+    multipython_port_exit_critical();
+    multipython_shared_unpin( context );
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(multipython_shared_release_obj, multipython_shared_release);
+
+STATIC mp_obj_t multipython_shared_info( void ){
+    // list of (handle, size, holders) of all the shared buffers
+    mp_obj_t list = mp_obj_new_list( 0, NULL );
+    multipython_port_enter_critical();
+    size_t num = 0;
+    for( multipython_shared_t* buffer = multipython_shared; buffer != NULL; buffer = buffer->next ){
+        num++;
+    }
+    multipython_port_exit_critical();
+    // the lock can't be held while allocating, so the values are read into a block of our own
+    mp_int_t* values = m_new( mp_int_t, 3 * num );
+    size_t used = 0;
+    multipython_port_enter_critical();
+    for( multipython_shared_t* buffer = multipython_shared; ( buffer != NULL ) && ( used < num ); buffer = buffer->next, used++ ){
+        values[3 * used + 0] = buffer->handle;
+        values[3 * used + 1] = buffer->size;
+        values[3 * used + 2] = buffer->holders;
+    }
+    multipython_port_exit_critical();
+    for( size_t indi = 0; indi < used; indi++ ){
+        mp_obj_t entry[3];
+        for( size_t indj = 0; indj < 3; indj++ ){
+            entry[indj] = mp_obj_new_int( values[3 * indi + indj] );
+        }
+        mp_obj_list_append( list, mp_obj_new_tuple( 3, entry ) );
+    }
+    m_del( mp_int_t, values, 3 * num );
+    return list;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(multipython_shared_info_obj, multipython_shared_info);
+
+#endif // MICROPY_PY_MULTIPYTHON && MICROPY_MULTIPYTHON_SHARED
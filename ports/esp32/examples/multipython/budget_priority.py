@@ -0,0 +1,31 @@
+import multipython as mp
+import utime
+
+# A background context that would spin forever gets a CPU budget of 20 ms in every
+# 100 ms, so a high priority context on the same core keeps a steady tick rate.
+# The counters of the budget show how often the background context ran out of it.
+BUDGET_US = 20000
+PERIOD_US = 100000
+
+def info(ctx):
+	return [c for c in mp.get() if c['context_address'] == ctx][0]
+
+background = mp.start("while True:\n\tpass\n", 0, 1, priority=mp.PRIORITY_LOW, budget_us=BUDGET_US, period_us=PERIOD_US)
+
+src = """
+import multipython as mp, utime
+late = 0
+for n in range(100):
+	t = utime.ticks_ms()
+	utime.sleep_ms(10)
+	late = max(late, utime.ticks_diff(utime.ticks_ms(), t) - 10)
+print("ticker worst lateness", late, "ms")
+"""
+ticker = mp.start(src, 0, 1, priority=mp.PRIORITY_HIGH)
+while mp.get_tID(ticker) is not None:
+	utime.sleep_ms(10)
+
+run_us = mp.stats(background)[0]
+budget_us, period_us, overruns, held_us = info(background)['budget']
+print("background ran", run_us // 1000, "ms, held back", held_us // 1000, "ms in", overruns, "overruns")
+mp.control(ids=background, op=mp.CONTROL_STOP, use_context=True)
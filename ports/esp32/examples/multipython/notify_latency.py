@@ -0,0 +1,53 @@
+import multipython as mp
+import utime
+
+# Measure how long it takes a notified context to run: the time from notify() in
+# this context until the worker has answered with a notify() of its own.
+ROUNDS = 1000
+
+me = mp.context()
+mp.response(condition=1, context=me, argument=1)    # answers from the workers
+
+def report(name, total_us):
+	print('{:10s}  {:8d} us/round trip'.format(name, total_us // ROUNDS))
+
+# a worker parked in check_responses()
+src = """
+import multipython as mp
+mp.notify(1)
+while True:
+	mp.check_responses(None)
+	mp.notify(1)
+"""
+worker = mp.start(src, 0)
+mp.check_responses(None)
+mp.response(condition=2, context=worker, argument=2)
+total = 0
+for i in range(ROUNDS):
+	t = utime.ticks_us()
+	mp.notify(2)
+	mp.check_responses(None)
+	total += utime.ticks_diff(utime.ticks_us(), t)
+report('parked', total)
+mp.control(ids=worker, op=mp.CONTROL_STOP, use_context=True)
+
+# a suspended worker resumed by a response
+src = """
+import multipython as mp
+while True:
+	mp.control(None, mp.CONTROL_SUSPEND)
+	mp.notify(1)
+"""
+worker = mp.start(src, 0)
+tid = mp.get_tID(worker)
+mp.response(condition=3, context=worker, control_op=mp.CONTROL_RESUME)
+total = 0
+for i in range(ROUNDS):
+	while not (mp.get(tid)[0]['status'] & 1):
+		pass
+	t = utime.ticks_us()
+	mp.notify(3)
+	mp.check_responses(None)
+	total += utime.ticks_diff(utime.ticks_us(), t)
+report('suspended', total)
+mp.control(ids=worker, op=mp.CONTROL_STOP, use_context=True)
@@ -0,0 +1,37 @@
+import multipython as mp
+import utime
+
+# Compare jobs run by a pool of workers with a context started for each job.
+# The jobs have uneven costs, so the pool also shows how much work is stolen.
+# The job has to come from a module the workers can import.
+JOBS = 40
+MOD = 'pool_jobs'
+
+with open(MOD + '.py', 'w') as f:
+	f.write('def work(n):\n\treturn sum(i * i for i in range(n))\n')
+import pool_jobs
+
+me = mp.context()
+mp.response(condition=1, context=me, argument=1)
+sizes = [1000 + 9000 * (i % 4 == 0) for i in range(JOBS)]
+
+def spawned():
+	t = utime.ticks_ms()
+	for n in sizes:
+		ctx = mp.start('import multipython, pool_jobs\npool_jobs.work({})\nmultipython.notify(1)'.format(n), 0)
+		mp.check_responses(None)
+		while mp.get_tID(ctx) is not None:
+			utime.sleep_ms(1)
+	return utime.ticks_diff(utime.ticks_ms(), t)
+
+def pooled(pool):
+	t = utime.ticks_ms()
+	pool.map(pool_jobs.work, sizes)
+	return utime.ticks_diff(utime.ticks_ms(), t)
+
+print('context per job  {:6d} ms'.format(spawned()))
+for workers in (1, 2, 4):
+	with mp.Pool(workers) as pool:
+		pool.map(pool_jobs.work, [1] * workers) # let the workers start
+		ms = pooled(pool)
+		print('pool of {}        {:6d} ms, {} jobs stolen'.format(workers, ms, pool.stats()[3]))
@@ -0,0 +1,40 @@
+import multipython as mp
+import utime
+
+# Start the same worker in several contexts at once, from source that every context
+# compiles for itself and from an .mpy image that the parent compiled once.
+# Needs a port with MICROPY_PERSISTENT_CODE_SAVE for multipython.compile().
+CONTEXTS = 8
+
+me = mp.context()
+mp.response(condition=1, context=me, argument=1)
+src = '''
+import multipython
+class Worker:
+	def __init__(self, n):
+		self.data = [i for i in range(n)]
+	def run(self):
+		return sum(x * x for x in self.data if x % 3)
+def fib(n):
+	return n if n < 2 else fib(n - 1) + fib(n - 2)
+Worker(100).run()
+fib(10)
+multipython.notify(1)
+'''
+
+def spawn(code):
+	t = utime.ticks_us()
+	ctxs = [mp.start(code, 0) for i in range(CONTEXTS)]
+	for i in range(CONTEXTS):
+		mp.check_responses(None)
+	total = utime.ticks_diff(utime.ticks_us(), t)
+	for ctx in ctxs:
+		while mp.get_tID(ctx) is not None:
+			utime.sleep_ms(1)
+	return total
+
+t = utime.ticks_us()
+mpy = mp.compile(src, 0)
+print('compile     {:8d} us, {} bytes'.format(utime.ticks_diff(utime.ticks_us(), t), len(mpy)))
+print('source      {:8d} us for {} contexts'.format(spawn(src), CONTEXTS))
+print('mpy         {:8d} us for {} contexts'.format(spawn(mpy), CONTEXTS))
@@ -0,0 +1,43 @@
+import multipython as mp
+import utime
+
+# A renderer context fills LED frames in a shared buffer and this context consumes
+# them, without copying the frames or passing pointers into another heap.
+# Two frames alternate: the renderer fills one while the other is being shown.
+LEDS = 64
+FRAMES = 200
+FRAME_BYTES = 3 * LEDS
+
+me = mp.context()
+frames = mp.shared_alloc(2 * FRAME_BYTES)
+mp.response(condition=1, context=me, argument=0) # frame 0 is ready
+mp.response(condition=2, context=me, argument=1) # frame 1 is ready
+
+src = """
+import multipython as mp
+frames = mp.shared_attach({handle})
+mp.response(condition=3, context=mp.context(), argument=0) # frame 0 may be refilled
+mp.response(condition=4, context=mp.context(), argument=1) # frame 1 may be refilled
+n = 0
+while True:
+	for index in (0, 1):
+		base = index * {frame}
+		for i in range(0, {frame}, 3):
+			frames[base + i] = n & 0xff
+		mp.notify(1 + index)
+		n += 1
+		mp.check_responses(None)
+""".format(handle=mp.shared_handle(frames), frame=FRAME_BYTES)
+renderer = mp.start(src, 0, 1)
+
+t = utime.ticks_us()
+checksum = 0
+for n in range(FRAMES):
+	index = mp.check_responses(None)
+	checksum += frames[index * FRAME_BYTES] # show the frame here
+	mp.notify(3 + index)
+us = utime.ticks_diff(utime.ticks_us(), t)
+
+mp.control(ids=renderer, op=mp.CONTROL_STOP, use_context=True)
+mp.shared_release(frames)
+print('{} frames of {} bytes, {} us/frame, checksum {}'.format(FRAMES, FRAME_BYTES, us // FRAMES, checksum))
@@ -0,0 +1,25 @@
+import multipython as mp
+import utime
+
+# Measure how long it takes a new context to run its first line, when it boots
+# an interpreter of its own (cold) and when it clones a snapshot of one.
+SPAWNS = 50
+
+me = mp.context()
+mp.response(condition=1, context=me, argument=1)
+src = 'import multipython\nmultipython.notify(1)'
+
+def spawn(**kw):
+	total = 0
+	for i in range(SPAWNS):
+		t = utime.ticks_us()
+		ctx = mp.start(src, 0, **kw)
+		mp.check_responses(None)
+		total += utime.ticks_diff(utime.ticks_us(), t)
+		while mp.get_tID(ctx) is not None:
+			utime.sleep_ms(1)
+	return total // SPAWNS
+
+print('snapshot: {} bytes'.format(mp.snapshot()))
+print('cold        {:8d} us/spawn'.format(spawn()))
+print('snapshot    {:8d} us/spawn'.format(spawn(snapshot=True)))
@@ -0,0 +1,10 @@
+import multipython as mp
+
+# Measure the cost of the task switch hook as the number of registered contexts grows.
+# Each switch alternates between a dummy context and this one, so every switch
+# really changes the active context.
+ITERATIONS = 10000
+
+print('contexts    ns/switch')
+for contexts in (1, 2, 4, 8, 16, 32, 64, 128):
+	print('{:8d}    {:9d}'.format(contexts, mp.switch_bench(contexts, ITERATIONS)))
@@ -54,12 +54,15 @@
 #include "mpthreadport.h"
 
 #include "mpstate_spiram.h"
+#include "extmod/modmultipython.h"
 #include "modmach1.h"
 
 // MicroPython runs as a task under FreeRTOS
 #define MP_TASK_PRIORITY        (ESP_TASK_PRIO_MIN + 1)
 #define MP_TASK_STACK_SIZE      (16 * 1024)
 #define MP_TASK_STACK_LEN       (MP_TASK_STACK_SIZE / sizeof(StackType_t))
+#define MP_TASK_HEAP_GROW_LIMIT (1024 * 1024)   // the REPL heap grows on demand up to this many bytes
+#define MP_TASK_PYSTACK_SIZE    (8 * 1024)
 
 int vprintf_null(const char *format, va_list ap) {
     // do nothing: this is used as a log target during raw repl mode
@@ -70,7 +73,8 @@ void mp_task(void *pvParameter) {
     // Main task has special treatment b/c the state is not dynamically allocated
     // Normally all that is required is to call mp_task_register with the ID and args
     uint32_t mp_task_id = mp_current_tIDs[MICROPY_GET_CORE_INDEX];
-    mp_context_head->id = mp_task_id;
+    mp_context_set_id(mp_context_head, mp_task_id);
+    mp_context_head->args.stack_size = MP_TASK_STACK_SIZE; // for the stack watermark in multipython.get()
     mp_context_switch(mp_context_head);
 
     volatile uint32_t sp = (uint32_t)get_sp();
@@ -114,6 +118,12 @@ void mp_task(void *pvParameter) {
             vTaskDelay(1000 / portTICK_RATE_MS );
         }
     }
+    if( multipython_pystack_init( mp_context_head, MP_TASK_PYSTACK_SIZE ) != 0 ){
+        printf("Could not allocate the pystack of the task. aborting\n");
+        while(1){
+            vTaskDelay(1000 / portTICK_RATE_MS );
+        }
+    }
 
 
 soft_reset:
@@ -121,6 +131,7 @@ soft_reset:
     mp_stack_set_top((void *)sp);
     mp_stack_set_limit(MP_TASK_STACK_SIZE - 1024);
     gc_init(mp_task_heap, mp_task_heap + mp_task_heap_size);
+    gc_set_grow_limit(MP_TASK_HEAP_GROW_LIMIT);
     mp_init();
     mp_obj_list_init(mp_sys_path, 0);
     mp_obj_list_append(mp_sys_path, MP_OBJ_NEW_QSTR(MP_QSTR_));
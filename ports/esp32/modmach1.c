@@ -37,6 +37,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "py/runtime.h"
 // #include "py/stackctrl.h"
 
+#include "extmod/modmultipython.h"
+
 #include "esp_log.h"
 #include "esp_spiram.h"
 #include "driver/gpio.h"
@@ -229,7 +231,6 @@ volatile m1_input_states_t m1_input_state_current = {   // initialize the curren
 
 volatile bool isr_fired = false;
 
-extern mp_obj_t multipython_notify(mp_obj_t condition);
 IRAM_ATTR void mach1_gpio_input_isr( void*  args ){
     // sample all the inputs and notify of any applicable conditions
 
@@ -252,33 +253,33 @@ IRAM_ATTR void mach1_gpio_input_isr( void*  args ){
 
         // check for changes
         if( m1_input_state_current.brk != m1_input_state_previous.brk ){
-            if( m1_input_state_current.brk ){ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_RISING_BRK)); }
-            else{ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_FALLING_BRK)); }
+            if( m1_input_state_current.brk ){ multipython_notify_from_isr(MACH1_COND_RISING_BRK); }
+            else{ multipython_notify_from_isr(MACH1_COND_FALLING_BRK); }
         }
         if( m1_input_state_current.lts != m1_input_state_previous.lts ){
-            if( m1_input_state_current.lts ){ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_RISING_LTS)); }
-            else{ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_FALLING_LTS)); }
+            if( m1_input_state_current.lts ){ multipython_notify_from_isr(MACH1_COND_RISING_LTS); }
+            else{ multipython_notify_from_isr(MACH1_COND_FALLING_LTS); }
         }
         if( m1_input_state_current.rts != m1_input_state_previous.rts ){
-            if( m1_input_state_current.rts ){ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_RISING_RTS)); }
-            else{ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_FALLING_RTS)); }
+            if( m1_input_state_current.rts ){ multipython_notify_from_isr(MACH1_COND_RISING_RTS); }
+            else{ multipython_notify_from_isr(MACH1_COND_FALLING_RTS); }
         }
         if( m1_input_state_current.rev != m1_input_state_previous.rev ){
-            if( m1_input_state_current.rev ){ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_RISING_REV)); }
-            else{ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_FALLING_REV)); }
+            if( m1_input_state_current.rev ){ multipython_notify_from_isr(MACH1_COND_RISING_REV); }
+            else{ multipython_notify_from_isr(MACH1_COND_FALLING_REV); }
         }
 
         if( m1_input_state_current.sw1 != m1_input_state_previous.sw1 ){
-            if( m1_input_state_current.sw1 ){ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_RISING_USW1)); }
-            else{ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_FALLING_USW1)); }
+            if( m1_input_state_current.sw1 ){ multipython_notify_from_isr(MACH1_COND_RISING_USW1); }
+            else{ multipython_notify_from_isr(MACH1_COND_FALLING_USW1); }
         }
         if( m1_input_state_current.sw2 != m1_input_state_previous.sw2 ){
-            if( m1_input_state_current.sw2 ){ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_RISING_USW2)); }
-            else{ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_FALLING_USW2)); }
+            if( m1_input_state_current.sw2 ){ multipython_notify_from_isr(MACH1_COND_RISING_USW2); }
+            else{ multipython_notify_from_isr(MACH1_COND_FALLING_USW2); }
         }
         if( m1_input_state_current.sw3 != m1_input_state_previous.sw3 ){
-            if( m1_input_state_current.sw3 ){ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_RISING_USW3)); }
-            else{ multipython_notify(MP_OBJ_NEW_SMALL_INT(MACH1_COND_FALLING_USW3)); }
+            if( m1_input_state_current.sw3 ){ multipython_notify_from_isr(MACH1_COND_RISING_USW3); }
+            else{ multipython_notify_from_isr(MACH1_COND_FALLING_USW3); }
         }
     }
 }
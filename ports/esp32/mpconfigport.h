@@ -4,12 +4,24 @@
 #include <stdint.h>
 #include <alloca.h>
 #include "rom/ets_sys.h"
+#include "esp_attr.h"
 
 // multi-core configuration
 #define MICROPY_NUM_CORES                   (2)
 #define MICROPY_GET_CORE_INDEX              (xPortGetCoreID())
 #define MICROPY_REPL_CORE                   (1)
 #define MICROPY_MULTIPY_DEFAULT_CORE        (1)
+#define MICROPY_GC_SPLIT_HEAP               (1)
+#define MICROPY_PY_MULTIPYTHON              (1)
+#define MICROPY_ENABLE_PYSTACK              (1) // frames of calls come from a pystack of each context rather than its heap
+#define MULTIPYTHON_NOTIFY_ATTR             IRAM_ATTR
+// contexts with a CPU budget check it on backward branches (see multipython.start())
+struct _mp_context_node_t;
+void multipython_budget_point(struct _mp_context_node_t* context);
+#define MICROPY_VM_HOOK_LOOP \
+    if (mp_active_contexts[MICROPY_GET_CORE_INDEX]->status & MP_CBUDGET) { \
+        multipython_budget_point(mp_active_contexts[MICROPY_GET_CORE_INDEX]); \
+    }
 
 // flash block device sizing 
 // - should take into consideration the partition file in use
@@ -25,6 +37,7 @@
 
 // emitters
 #define MICROPY_PERSISTENT_CODE_LOAD        (1)
+#define MICROPY_PERSISTENT_CODE_SAVE        (1) // for multipython.compile() and the code cache
 
 // compiler configuration
 #define MICROPY_COMP_MODULE_CONST           (1)
@@ -33,11 +46,20 @@
 // optimisations
 #define MICROPY_OPT_COMPUTED_GOTO           (1)
 #define MICROPY_OPT_MPZ_BITWISE             (1)
+#define MICROPY_OPT_INLINE_CACHE            (1)
+#define MICROPY_OPT_INLINE_CACHE_SIZE       (32)
+#define MICROPY_OPT_QUICKEN                 (1)
+#define MICROPY_OPT_SUPERINSTRUCTIONS       (1)
+#define MICROPY_OPT_QSTR_INDEX              (1)
+#define MICROPY_OPT_MAP_ROM_INDEX           (1)
 
 // Python internal features
 #define MICROPY_READER_VFS                  (1)
 #define MICROPY_ENABLE_GC                   (1)
 #define MICROPY_ENABLE_FINALISER            (1)
+#define MICROPY_GC_INCREMENTAL              (1)
+#define MICROPY_GC_SIZE_CLASSES             (8)
+#define MICROPY_GC_LARGE_BLOCKS             (64)
 #define MICROPY_STACK_CHECK                 (1)
 #define MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF (1)
 #define MICROPY_KBD_EXCEPTION               (1)
@@ -0,0 +1,376 @@
+/*
+Copyright 2019 Owen Lyke
+
+Permission is hereby granted, free of charge, to any person 
+obtaining a copy of this software and associated documentation 
+files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, 
+publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included 
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+/*
+
+FreeRTOS backend for the multipython module (extmod/modmultipython.c)
+Each context runs as its own FreeRTOS task and the task switch hook selects the active context
+
+Contexts are woken directly: control operations suspend and resume the task, and
+queued responses are signalled through the task notification. notify may run in
+an ISR (see modmach1.c), so the calls it reaches use the FromISR variants there.
+
+*/
+
+#include "py/gc.h"
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/mpthread.h"
+#include "py/mpstate.h"
+#include "py/runtime.h"
+#include "py/stackctrl.h"
+
+#include "lib/mp-readline/readline.h"
+#include "lib/utils/pyexec.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_task.h"
+#include "soc/cpu.h"
+
+#include "extmod/modmultipython.h"
+#include "mpstate_spiram.h" // temporary - want to replace this with a general multipython heap allocator file
+
+#include <string.h>
+
+#if MICROPY_PY_MULTIPYTHON
+
+// MicroPython runs as a task under FreeRTOS
+#define MULTIPYTHON_TASK_PRIORITY        (ESP_TASK_PRIO_MIN + 1)
+#define MULTIPYTHON_TASK_STACK_SIZE      (16 * 1024)
+#define MULTIPYTHON_TASK_STACK_LEN       (MULTIPYTHON_TASK_STACK_SIZE / sizeof(StackType_t))
+#define MULTIPYTHON_TASK_STACK_MIN       (4 * 1024)     // smallest stack start() can ask for, see multipython.get() for the watermark
+#define MULTIPYTHON_TASK_PYSTACK_SIZE    (4 * 1024)     // default, start() can override it
+
+#define MULTIPYTHON_CONTEXT_TASK_PRIORITY       (MULTIPYTHON_TASK_PRIORITY + 1)    // for MULTIPYTHON_PRIORITY_NORMAL, the other classes are one step apart
+#define MULTIPYTHON_CONTEXT_TASK_PRIORITY_OF(context)   (MULTIPYTHON_CONTEXT_TASK_PRIORITY + (context)->args.priority)
+
+// globals
+portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Forward declarations
+void multipython_task_template( void* void_context );
+
+// port interface
+void multipython_port_init( void ){
+    // no helper tasks are needed
+}
+
+STATIC int multipython_port_heap_alloc( mp_context_node_t* context ){
+    // the heap is allocated before the task is created so that start() raises when
+    // there is no memory for it
+    void* mp_task_heap = NULL;
+    size_t mp_task_heap_size = 0;
+    #if CONFIG_SPIRAM_SUPPORT
+    switch (esp_spiram_get_chip_size()) {
+        case ESP_SPIRAM_SIZE_16MBITS:
+            // mp_task_heap_size = 2 * 1024 * 1024;
+            mp_task_heap_size = 1024*200; // temporarily hard-coded at ~1/10th of available SPIRAM. One day will make this customizable, then one day will make it dynamically increasable as needed
+            break;
+        case ESP_SPIRAM_SIZE_32MBITS:
+        case ESP_SPIRAM_SIZE_64MBITS:   // 8 MB needs special API to access upper 4MB, so for now cap at 4 MB heap
+            // mp_task_heap_size = 4 * 1024 * 1024;
+            // mp_task_heap_size = 400000;
+            mp_task_heap_size = 1024*200; // ~1/200 of available memory - should allow plenty of tasks! needs to be 4-byte aligned
+            break;
+        default:
+            // // No SPIRAM, fallback to normal allocation
+            // mp_task_heap_size = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+            mp_task_heap_size = 32 * 1024; // todo: temporary trying to reduce heap usage
+            // size_t mp_task_heap_size = 10000; // todo: temporary trying to reduce heap usage
+            // mp_task_heap = mp_task_alloc( mp_task_heap_size, mp_current_tIDs[MICROPY_GET_CORE_INDEX] ); // todo: allow the task to decide on the GC heap size (user input or something)
+            break;
+    }
+    if( context->args.heap_size != 0 ){
+        mp_task_heap_size = context->args.heap_size;
+    }
+    if( context->args.snapshot != NULL ){
+        mp_task_heap_size = multipython_snapshot_heap_size( context );
+    }
+    mp_task_heap = mp_context_dynmem_alloc_heap_caps( mp_task_heap_size, context, MALLOC_CAP_SPIRAM );
+    // printf("mp_task_heap ptr: 0x%X, size = 0x%X\n", (uint32_t)mp_task_heap, mp_task_heap_size );
+    #else
+    // // Allocate the uPy heap using mp_task_alloc and get the largest available region
+    // size_t mp_task_heap_size = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    mp_task_heap_size = 32 * 1024;
+    if( context->args.heap_size != 0 ){
+        mp_task_heap_size = context->args.heap_size;
+    }
+    if( context->args.snapshot != NULL ){
+        mp_task_heap_size = multipython_snapshot_heap_size( context );
+    }
+    mp_task_heap = mp_context_dynmem_alloc( mp_task_heap_size, context );
+    #endif
+    if( mp_task_heap == NULL ){
+        return MP_ENOMEM;
+    }
+    context->args.heap = mp_task_heap;
+    context->args.heap_size = mp_task_heap_size;
+    return 0;
+}
+
+int multipython_port_task_create( mp_context_node_t* context, mp_int_t core ){
+    BaseType_t result = pdFAIL;
+    if( context->args.stack_size == 0 ){
+        context->args.stack_size = MULTIPYTHON_TASK_STACK_SIZE;
+    }
+    if( context->args.stack_size < MULTIPYTHON_TASK_STACK_MIN ){
+        context->args.stack_size = MULTIPYTHON_TASK_STACK_MIN; // the stack limit leaves 1 KB of it to recover
+    }
+    if( multipython_port_heap_alloc( context ) != 0 ){
+        return MP_ENOMEM;
+    }
+    uint32_t stack_len = context->args.stack_size / sizeof(StackType_t);
+    if( core >= 0 ){
+        if( core > 1 ){
+            core = 1;
+        }
+        result = xTaskCreatePinnedToCore( multipython_task_template, "", stack_len, (void*)context, MULTIPYTHON_CONTEXT_TASK_PRIORITY_OF(context), NULL, core );
+        //             /* Function to implement the task */
+        //                                        /* Name of the task */
+        //                                                       /* Stack size in words */
+        //                                                                              /* Task input parameter */
+        //                                                                                                      /* Priority of the task */
+        //                                                                                                                          /* Task handle. */
+        //                                                                                                                      /* Core where the task should run */
+    }else{
+        result = xTaskCreate(multipython_task_template, "", stack_len, (void*)context, MULTIPYTHON_CONTEXT_TASK_PRIORITY_OF(context), NULL); // core determined by FreeRTOS
+    }
+    return ( result == pdPASS ) ? 0 : MP_ENOMEM;
+}
+
+int8_t multipython_port_task_end( mp_context_node_t* context ){
+    if( xPortInIsrContext() ){ return -1; }
+    xTaskHandle task = (xTaskHandle)context->id;
+    #if MICROPY_PY_THREAD
+    mp_thread_deinit_context( context ); // before the task, which may hold the thread mutex afterwards
+    #endif
+    // the task never reaches remove_task, so release what it holds the same way here.
+    // It is suspended first so that it can't take new references meanwhile
+    vTaskSuspend(task);
+    multipython_snapshot_release( context );
+    #if MICROPY_MULTIPYTHON_CODE_CACHE
+    multipython_code_cache_release( context );
+    #endif
+    #if MICROPY_MULTIPYTHON_SHARED
+    multipython_shared_release_all( context );
+    #endif
+    #if MICROPY_MULTIPYTHON_POOL
+    multipython_pool_release_all( context );
+    #endif
+    portENTER_CRITICAL(&mux);
+    mp_task_remove( context->id );
+    vTaskDelete(task);     
+    portEXIT_CRITICAL(&mux);  
+    return 0;
+}
+
+int8_t multipython_port_task_suspend( mp_context_node_t* context ){
+    if( xPortInIsrContext() ){ return -1; }
+    vTaskSuspend((xTaskHandle)context->id);
+    return 0;
+}
+
+int8_t multipython_port_task_resume( mp_context_node_t* context ){
+    if( xPortInIsrContext() ){
+        if( xTaskResumeFromISR((xTaskHandle)context->id) == pdTRUE ){
+            portYIELD_FROM_ISR();
+        }
+        return 0;
+    }
+    vTaskResume((xTaskHandle)context->id);
+    return 0;
+}
+
+void multipython_port_enter_critical( void ){
+    portENTER_CRITICAL(&mux);
+}
+
+void multipython_port_exit_critical( void ){
+    portEXIT_CRITICAL(&mux);
+}
+
+void multipython_port_sched_lock( void ){
+    vTaskSuspendAll();
+}
+
+void multipython_port_sched_unlock( void ){
+    xTaskResumeAll();
+}
+
+void multipython_port_wait( mp_context_node_t* context, mp_int_t timeout_ms ){
+    // the notification value of the task counts signals, so one that arrived before
+    // the wait started returns immediately
+    (void)context;
+    TickType_t ticks = ( timeout_ms < 0 ) ? portMAX_DELAY : ( timeout_ms / portTICK_PERIOD_MS );
+    if( ( ticks == 0 ) && ( timeout_ms > 0 ) ){
+        ticks = 1;
+    }
+    ulTaskNotifyTake( pdTRUE, ticks );
+}
+
+void multipython_port_signal( mp_context_node_t* context ){
+    if( context->id == 0 ){ return; } // the task has not started yet
+    if( xPortInIsrContext() ){
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR( (xTaskHandle)context->id, &woken );
+        if( woken == pdTRUE ){
+            portYIELD_FROM_ISR();
+        }
+        return;
+    }
+    xTaskNotifyGive( (xTaskHandle)context->id );
+}
+
+
+size_t multipython_port_stack_high_water( mp_context_node_t* context ){
+    // FreeRTOS keeps the watermark of each task (in bytes on the ESP32)
+    if( context->id == 0 ){ return 0; } // the task has not started yet
+    size_t unused = uxTaskGetStackHighWaterMark( (xTaskHandle)context->id ) * sizeof(StackType_t);
+    return ( context->args.stack_size > unused ) ? context->args.stack_size - unused : 0;
+}
+
+void multipython_port_hold( mp_context_node_t* context, mp_uint_t hold_us ){
+    // a stop deletes the task, so it doesn't need to be woken for one
+    (void)context;
+    TickType_t ticks = hold_us / ( portTICK_PERIOD_MS * 1000 );
+    vTaskDelay( ( ticks == 0 ) ? 1 : ticks );
+}
+
+
+// multipython task template
+void multipython_task_template( void* void_context ){
+    // when a new task spawns it already has a context allocated, but
+    // it is up to the task to set the context id correctly
+    mp_context_node_t* context = (mp_context_node_t*)void_context;
+    mp_context_set_id(context, mp_current_tIDs[MICROPY_GET_CORE_INDEX]);
+    mp_context_switch(context);
+    
+    volatile uint32_t sp = (uint32_t)get_sp();
+    #if MICROPY_PY_THREAD
+    mp_thread_init(pxTaskGetStackStart(NULL), context->args.stack_size / sizeof(StackType_t));
+    #endif
+    // uart_init();
+
+    void* mp_task_heap = context->args.heap;
+    size_t mp_task_heap_size = context->args.heap_size;
+
+    if( context->args.snapshot != NULL ){
+        // the snapshot is an interpreter that has already booted
+        mp_task_heap = multipython_snapshot_restore( context, mp_task_heap );
+        if( multipython_pystack_init( context, MULTIPYTHON_TASK_PYSTACK_SIZE ) != 0 ){
+            printf("Could not allocate memory for task. aborting\n");
+            goto remove_task;
+        }
+        mp_stack_set_top((void *)sp);
+        mp_stack_set_limit(context->args.stack_size - 1024);
+        gc_set_grow_limit( ( context->args.heap_max > mp_task_heap_size ) ? context->args.heap_max - mp_task_heap_size : 0 );
+        goto run_source;
+    }
+    if( multipython_pystack_init( context, MULTIPYTHON_TASK_PYSTACK_SIZE ) != 0 ){
+        printf("Could not allocate memory for task. aborting\n");
+        goto remove_task;
+    }
+
+soft_reset:
+    // initialise the stack pointer for the main thread
+    mp_stack_set_top((void *)sp);
+    mp_stack_set_limit(context->args.stack_size - 1024);
+    gc_init(mp_task_heap, mp_task_heap + mp_task_heap_size);
+    // the heap only grows when start() was given a heap_max above the initial size
+    gc_set_grow_limit( ( context->args.heap_max > mp_task_heap_size ) ? context->args.heap_max - mp_task_heap_size : 0 );
+    mp_init();
+    mp_obj_list_init(mp_sys_path, 0);
+    mp_obj_list_append(mp_sys_path, MP_OBJ_NEW_QSTR(MP_QSTR_));
+    mp_obj_list_append(mp_sys_path, MP_OBJ_NEW_QSTR(MP_QSTR__slash_lib));
+    mp_obj_list_init(mp_sys_argv, 0);
+    mp_context_refresh();
+    readline_init0();
+
+    // // initialise peripherals
+    // machine_pins_init();
+
+    // run boot-up scripts
+    pyexec_frozen_module("_boot.py");
+    // pyexec_file("boot.py");
+    // if (pyexec_mode_kind == PYEXEC_MODE_FRIENDLY_REPL) {
+    //     pyexec_file("main.py");
+    // }
+
+    if( context->args.capture ){
+        multipython_exec_source( context );
+        multipython_snapshot_capture( context, mp_task_heap, mp_task_heap_size );
+        gc_sweep_all();
+        mp_deinit();
+        goto remove_task;
+    }
+
+run_source:
+    #if MICROPY_PY_THREAD
+    MP_STATE_VM(thread_stack_size) = context->args.thread_stack_size;
+    #endif
+
+    // Option to suspend the task at startup
+    if( context->args.suspend ){
+        context->status |= MP_CSUSP;
+        vTaskSuspend(NULL);
+    }
+
+    uint8_t error = multipython_exec_source( context );
+
+    #if MICROPY_PY_THREAD
+    mp_thread_deinit(); // threads must not outlive their context
+    #endif
+    gc_sweep_all();
+
+    mp_deinit();
+    fflush(stdout);
+    const uint8_t reset = 0;
+    
+    if(error){ // todo: eventually we will want to be able to catch errors and restart, but allow the task to go to end if it ended of it's own accord
+        // vTaskDelay(500/portTICK_PERIOD_MS);
+        printf("Error. Current context ID: 0x%x\n", (uint32_t)context->id);
+        mp_hal_stdout_tx_str("MPY task: soft restart\r\n"); // todo: add more info saying which task is restarting
+        if(reset){
+            goto soft_reset;
+        }
+    }
+
+remove_task:
+    multipython_snapshot_release( context );
+    #if MICROPY_MULTIPYTHON_CODE_CACHE
+    multipython_code_cache_release( context );
+    #endif
+    #if MICROPY_MULTIPYTHON_SHARED
+    multipython_shared_release_all( context );
+    #endif
+    #if MICROPY_MULTIPYTHON_POOL
+    multipython_pool_release_all( context );
+    #endif
+
+    portENTER_CRITICAL(&mux);
+    mp_task_remove( mp_current_tIDs[MICROPY_GET_CORE_INDEX] );
+    portEXIT_CRITICAL(&mux);
+    vTaskDelete(NULL);  // When a task deletes itself make sure to release the mux *before* dying
+}
+
+#endif // MICROPY_PY_MULTIPYTHON
@@ -35,57 +35,83 @@
 
 #include "esp_task.h"
 
+extern portMUX_TYPE mux; // the context list lock, see mpmultipythonport.c
+
 #if MICROPY_PY_THREAD
 
 #define MP_THREAD_MIN_STACK_SIZE                        (4 * 1024)
 #define MP_THREAD_DEFAULT_STACK_SIZE                    (MP_THREAD_MIN_STACK_SIZE + 1024)
 #define MP_THREAD_PRIORITY                              (ESP_TASK_PRIO_MIN + 1)
 
-// this structure forms a linked list, one node per active thread
+// one per active thread, in the list of threads of the context it belongs to. The
+// entry registers the task with the context index, so the switch hook switches in the
+// state of the context and GC only walks the threads of the context collecting
 typedef struct _thread_t {
-    TaskHandle_t id;        // system id of thread
+    mp_context_thread_t entry; // first, so the threads of a context are a list of these
     int ready;              // whether the thread is ready and running
     void *arg;              // thread Python args, a GC root pointer
     void *stack;            // pointer to the stack
     size_t stack_len;       // number of words in the stack
-    struct _thread_t *next;
 } thread_t;
 
-// the mutex controls access to the linked list
+#define THREAD_FIRST(context)   ((thread_t*)(context)->threads)
+#define THREAD_NEXT(th)         ((thread_t*)(th)->entry.next)
+#define THREAD_HANDLE(th)       ((TaskHandle_t)(th)->entry.id)
+
+// the mutex controls access to the threads of the context, the context list lock
+// (held only briefly) to the index they are registered in
 typedef struct _ctx_thread_ctrl_t {
     mp_thread_mutex_t   mux;
     thread_t            entry0;
-    thread_t*           thread;
 } ctx_thread_ctrl_t;
 
+STATIC ctx_thread_ctrl_t* mp_thread_ctrl(void) {
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    return ( context == NULL ) ? NULL : (ctx_thread_ctrl_t*)context->threadctrl;
+}
+
+STATIC thread_t* mp_thread_self(mp_context_node_t* context) {
+    // the thread mutex must be held
+    for (thread_t *th = THREAD_FIRST(context); th != NULL; th = THREAD_NEXT(th)) {
+        if (THREAD_HANDLE(th) == xTaskGetCurrentTaskHandle()) {
+            return th;
+        }
+    }
+    return NULL;
+}
+
 void mp_thread_init(void *stack, uint32_t stack_len) {
-    if( mp_active_contexts[MICROPY_GET_CORE_INDEX] == NULL ){ return; }
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    if( context == NULL ){ return; }
 
-    mp_thread_set_state(&mp_active_context_mirrors[MICROPY_GET_CORE_INDEX].state->thread);
+    mp_thread_set_state(&mp_active_states[MICROPY_GET_CORE_INDEX]->thread);
     ctx_thread_ctrl_t* thread_ctrl = (ctx_thread_ctrl_t*)mp_task_alloc( sizeof(ctx_thread_ctrl_t), mp_current_tIDs[MICROPY_GET_CORE_INDEX] );
     if( thread_ctrl == NULL ){ return; }// todo: handle this error (no heap)
-    mp_active_contexts[MICROPY_GET_CORE_INDEX]->threadctrl = (void*)thread_ctrl;
-    // create the first entry in the linked list of all threads
-    thread_ctrl->thread = &(thread_ctrl->entry0);
-    thread_ctrl->thread->id = (TaskHandle_t)mp_current_tIDs[MICROPY_GET_CORE_INDEX];
-    thread_ctrl->thread->ready = 1;
-    thread_ctrl->thread->arg = NULL;
-    thread_ctrl->thread->stack = stack;
-    thread_ctrl->thread->stack_len = stack_len;
-    thread_ctrl->thread->next = NULL;
     mp_thread_mutex_init(&(thread_ctrl->mux));
+    // the first thread is the task of the context, which is already in the index
+    thread_t* th = &(thread_ctrl->entry0);
+    th->entry.id = mp_current_tIDs[MICROPY_GET_CORE_INDEX];
+    th->entry.state = mp_thread_get_state();
+    th->ready = 1;
+    th->arg = NULL;
+    th->stack = stack;
+    th->stack_len = stack_len;
+    portENTER_CRITICAL(&mux);
+    context->threadctrl = (void*)thread_ctrl;
+    mp_context_thread_add( context, &th->entry );
+    portEXIT_CRITICAL(&mux);
 }
 
 void mp_thread_gc_others(void) {
-    if( mp_active_contexts[MICROPY_GET_CORE_INDEX] == NULL ){ return; }
-    ctx_thread_ctrl_t* thread_ctrl = (ctx_thread_ctrl_t*)mp_active_contexts[MICROPY_GET_CORE_INDEX]->threadctrl;
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    ctx_thread_ctrl_t* thread_ctrl = mp_thread_ctrl();
     if(thread_ctrl == NULL){ return; }
 
+    // threads of other contexts have their own heaps
     mp_thread_mutex_lock(&(thread_ctrl->mux), 1);
-    for (thread_t *th = (thread_ctrl->thread); th != NULL; th = th->next) {
-        gc_collect_root((void**)&th, 1);
+    for (thread_t *th = THREAD_FIRST(context); th != NULL; th = THREAD_NEXT(th)) {
         gc_collect_root(&th->arg, 1); // probably not needed
-        if (th->id == xTaskGetCurrentTaskHandle()) {
+        if (THREAD_HANDLE(th) == xTaskGetCurrentTaskHandle()) {
             continue;
         }
         if (!th->ready) {
@@ -105,16 +131,14 @@ void mp_thread_set_state(void *state) {
 }
 
 void mp_thread_start(void) {
-    if( mp_active_contexts[MICROPY_GET_CORE_INDEX] == NULL ){ return; }
-    ctx_thread_ctrl_t* thread_ctrl = (ctx_thread_ctrl_t*)mp_active_contexts[MICROPY_GET_CORE_INDEX]->threadctrl;
+    ctx_thread_ctrl_t* thread_ctrl = mp_thread_ctrl();
     if(thread_ctrl == NULL){ return; }
 
     mp_thread_mutex_lock(&(thread_ctrl->mux), 1);
-    for (thread_t *th = (thread_ctrl->thread); th != NULL; th = th->next) {
-        if (th->id == xTaskGetCurrentTaskHandle()) {
-            th->ready = 1;
-            break;
-        }
+    thread_t *th = mp_thread_self(mp_active_contexts[MICROPY_GET_CORE_INDEX]);
+    if (th != NULL) {
+        th->entry.state = mp_thread_get_state();
+        th->ready = 1;
     }
     mp_thread_mutex_unlock(&(thread_ctrl->mux));
 }
@@ -140,32 +164,43 @@ void mp_thread_create_ex(void *(*entry)(void*), void *arg, size_t *stack_size, i
     }
 
     // Get thread control from this context
-    if( mp_active_contexts[MICROPY_GET_CORE_INDEX] == NULL ){ return; }
-    ctx_thread_ctrl_t* thread_ctrl = (ctx_thread_ctrl_t*)mp_active_contexts[MICROPY_GET_CORE_INDEX]->threadctrl;
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    ctx_thread_ctrl_t* thread_ctrl = mp_thread_ctrl();
     if(thread_ctrl == NULL){ return; }
 
-    // Allocate linked-list node (must be outside thread_mutex lock)
-    thread_t *th = m_new_obj(thread_t);
+    // Allocate the thread outside of the GC heap, as it is freed by whichever task ends it
+    thread_t *th = (thread_t*)MP_STATE_MALLOC(sizeof(thread_t));
+    if (th == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "can't create thread"));
+    }
 
     mp_thread_mutex_lock(&(thread_ctrl->mux), 1);
 
-    // create thread
-    BaseType_t result = xTaskCreate(freertos_entry, name, *stack_size / sizeof(StackType_t), arg, priority, &th->id);
+    // create the thread suspended, so it can't run before it is registered
+    TaskHandle_t id = NULL;
+    vTaskSuspendAll();
+    BaseType_t result = xTaskCreate(freertos_entry, name, *stack_size / sizeof(StackType_t), arg, priority, &id);
     if (result != pdPASS) {
+        xTaskResumeAll();
         mp_thread_mutex_unlock(&(thread_ctrl->mux));
+        MP_STATE_FREE(th);
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "can't create thread"));
     }
 
     // adjust the stack_size to provide room to recover from hitting the limit
     *stack_size -= 1024;
 
-    // add thread to linked list of all threads
+    // add thread to the threads of the context
+    th->entry.id = (uint32_t)id;
+    th->entry.state = NULL;
     th->ready = 0;
     th->arg = arg;
-    th->stack = pxTaskGetStackStart(th->id);
+    th->stack = pxTaskGetStackStart(id);
     th->stack_len = *stack_size / sizeof(StackType_t);
-    th->next = (thread_ctrl->thread);
-    (thread_ctrl->thread) = th;
+    portENTER_CRITICAL(&mux);
+    mp_context_thread_add( context, &th->entry );
+    portEXIT_CRITICAL(&mux);
+    xTaskResumeAll();
 
     mp_thread_mutex_unlock(&(thread_ctrl->mux));
 }
@@ -174,47 +209,35 @@ void mp_thread_create(void *(*entry)(void*), void *arg, size_t *stack_size) {
     mp_thread_create_ex(entry, arg, stack_size, MP_THREAD_PRIORITY, "mp_thread");
 }
 
-void mp_thread_finish(void) {    
-    if( mp_active_contexts[MICROPY_GET_CORE_INDEX] == NULL ){ return; }
-    ctx_thread_ctrl_t* thread_ctrl = (ctx_thread_ctrl_t*)mp_active_contexts[MICROPY_GET_CORE_INDEX]->threadctrl;
+void mp_thread_finish(void) {
+    // the thread leaves the registry here rather than when its task is cleaned up,
+    // which happens later in the idle task where the mutex can't be waited for
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    ctx_thread_ctrl_t* thread_ctrl = mp_thread_ctrl();
     if(thread_ctrl == NULL){ return; }
 
     mp_thread_mutex_lock(&(thread_ctrl->mux), 1);
-    for (thread_t *th = (thread_ctrl->thread); th != NULL; th = th->next) {
-        if (th->id == xTaskGetCurrentTaskHandle()) {
-            th->ready = 0;
-            break;
-        }
+    thread_t *th = mp_thread_self(context);
+    if ((th != NULL) && (th != &thread_ctrl->entry0)) {
+        portENTER_CRITICAL(&mux);
+        mp_context_thread_remove( &th->entry );
+        portEXIT_CRITICAL(&mux);
+        MP_STATE_FREE(th);
     }
     mp_thread_mutex_unlock(&(thread_ctrl->mux));
 }
 
 void vPortCleanUpTCB(void *tcb) {
-    thread_t *prev = NULL;
-    mp_context_iter_t citer = NULL;
-    for(citer = mp_context_iter_first(MP_ITER_FROM_CONTEXT_PTR(mp_context_head)); !mp_context_iter_done(citer); citer = mp_context_iter_next(citer)){
-        ctx_thread_ctrl_t* thread_ctrl = (ctx_thread_ctrl_t*)(MP_CONTEXT_PTR_FROM_ITER(citer)->threadctrl);
-        if( thread_ctrl != NULL ){ 
-            mp_thread_mutex_lock(&(thread_ctrl->mux), 1);
-            for (thread_t *th = (thread_ctrl->thread); th != NULL; th = th->next) {
-                // unlink the node from the list
-                if ((void*)th->id == tcb) { // todo: make it more clear that tID, tcb, TaskHandle etc all mean the same thing
-                    if (prev != NULL) {
-                        prev->next = th->next;
-                    } else {
-                        // move the start pointer
-                        (thread_ctrl->thread) = th->next;
-                    }
-                    // explicitly release all its memory
-                    m_del(thread_t, th, 1);
-                    mp_thread_mutex_unlock(&(thread_ctrl->mux));
-                    goto cleanup_complete;
-                }
-            }
-            mp_thread_mutex_unlock(&(thread_ctrl->mux));
-        }
-    }   
-cleanup_complete:; // Need this odd ';' to avoid 'label at the end of compund statement' error
+    // a thread that was deleted without finishing may still be registered. Its stack
+    // and task ID are gone, but the idle task can't wait for the thread mutex to unlist
+    // it, so the entry stays until its context ends its threads
+    portENTER_CRITICAL(&mux);
+    mp_context_thread_t* entry = mp_context_thread_by_tid( (uint32_t)tcb );
+    if( entry != NULL ){
+        ((thread_t*)entry)->ready = 0;
+        mp_context_thread_set_id( entry, 0 ); // the TCB may be reused by another task
+    }
+    portEXIT_CRITICAL(&mux);
 }
 
 void mp_thread_mutex_init(mp_thread_mutex_t *mutex) {
@@ -229,32 +252,32 @@ void mp_thread_mutex_unlock(mp_thread_mutex_t *mutex) {
     xSemaphoreGive(mutex->handle);
 }
 
-void mp_thread_deinit(void) {
-    if( mp_active_contexts[MICROPY_GET_CORE_INDEX] == NULL ){ return; }
-    ctx_thread_ctrl_t* thread_ctrl = (ctx_thread_ctrl_t*)mp_active_contexts[MICROPY_GET_CORE_INDEX]->threadctrl;
+void mp_thread_deinit_context(mp_context_node_t* context) {
+    // end the threads of a context other than the calling task, and unregister them all
+    ctx_thread_ctrl_t* thread_ctrl = (ctx_thread_ctrl_t*)context->threadctrl;
     if(thread_ctrl == NULL){ return; }
 
-    for (;;) {
-        // Find a task to delete
-        TaskHandle_t id = NULL;
-        mp_thread_mutex_lock(&(thread_ctrl->mux), 1);
-        for (thread_t *th = (thread_ctrl->thread); th != NULL; th = th->next) {
-            // Don't delete the current task
-            if (th->id != xTaskGetCurrentTaskHandle()) {
-                id = th->id;
-                break;
-            }
+    mp_thread_mutex_lock(&(thread_ctrl->mux), 1);
+    while (context->threads != NULL) {
+        thread_t *th = THREAD_FIRST(context);
+        TaskHandle_t id = THREAD_HANDLE(th);
+        portENTER_CRITICAL(&mux);
+        mp_context_thread_remove( &th->entry );
+        portEXIT_CRITICAL(&mux);
+        if (th == &thread_ctrl->entry0) {
+            continue;
         }
-        mp_thread_mutex_unlock(&(thread_ctrl->mux));
-
-        if (id == NULL) {
-            // No tasks left to delete
-            break;
-        } else {
-            // Call FreeRTOS to delete the task (it will call vPortCleanUpTCB)
+        if ((id != NULL) && (id != xTaskGetCurrentTaskHandle())) {
             vTaskDelete(id);
         }
+        MP_STATE_FREE(th);
     }
+    mp_thread_mutex_unlock(&(thread_ctrl->mux));
+}
+
+void mp_thread_deinit(void) {
+    if( mp_active_contexts[MICROPY_GET_CORE_INDEX] == NULL ){ return; }
+    mp_thread_deinit_context(mp_active_contexts[MICROPY_GET_CORE_INDEX]);
 }
 
 #else
@@ -41,5 +41,7 @@ typedef struct _mp_thread_mutex_t {
 void mp_thread_init(void *stack, uint32_t stack_len);
 void mp_thread_gc_others(void);
 void mp_thread_deinit(void);
+struct _mp_context_node_t;
+void mp_thread_deinit_context(struct _mp_context_node_t* context);
 
 #endif // MICROPY_INCLUDED_ESP32_MPTHREADPORT_H
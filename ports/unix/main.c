@@ -407,6 +407,11 @@ STATIC void set_sys_argv(char *argv[], int argc, int start_arg) {
 MP_NOINLINE int main_(int argc, char **argv);
 
 int main(int argc, char **argv) {
+    #if MICROPY_PY_MULTIPYTHON
+    // task ID 0 is reserved for contexts that are still being started
+    mp_context_set_id(mp_context_head, 1);
+    mp_task_switched_in(1);
+    #endif
     mp_context_switch(mp_context_head);
     #if MICROPY_PY_THREAD
     mp_thread_init();
@@ -28,6 +28,7 @@
 
 #define MICROPY_ALLOC_PATH_MAX      (PATH_MAX)
 #define MICROPY_PERSISTENT_CODE_LOAD (1)
+#define MICROPY_PERSISTENT_CODE_SAVE (1) // for multipython.compile()
 #if !defined(MICROPY_EMIT_X64) && defined(__x86_64__)
     #define MICROPY_EMIT_X64        (1)
 #endif
@@ -48,6 +49,9 @@
 #define MICROPY_COMP_RETURN_IF_EXPR (1)
 #define MICROPY_ENABLE_GC           (1)
 #define MICROPY_ENABLE_FINALISER    (1)
+#define MICROPY_GC_INCREMENTAL      (1)
+#define MICROPY_GC_SIZE_CLASSES     (8)
+#define MICROPY_GC_LARGE_BLOCKS     (64)
 #define MICROPY_STACK_CHECK         (1)
 #define MICROPY_MALLOC_USES_ALLOCATED_SIZE (1)
 #define MICROPY_MEM_STATS           (1)
@@ -70,6 +74,21 @@
 #ifndef MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (1)
 #endif
+#ifndef MICROPY_OPT_INLINE_CACHE
+#define MICROPY_OPT_INLINE_CACHE    (1)
+#endif
+#ifndef MICROPY_OPT_QUICKEN
+#define MICROPY_OPT_QUICKEN         (1)
+#endif
+#ifndef MICROPY_OPT_SUPERINSTRUCTIONS
+#define MICROPY_OPT_SUPERINSTRUCTIONS (1)
+#endif
+#ifndef MICROPY_OPT_QSTR_INDEX
+#define MICROPY_OPT_QSTR_INDEX      (1)
+#endif
+#ifndef MICROPY_OPT_MAP_ROM_INDEX
+#define MICROPY_OPT_MAP_ROM_INDEX   (1)
+#endif
 #define MICROPY_CAN_OVERRIDE_BUILTINS (1)
 #define MICROPY_PY_FUNCTION_ATTRS   (1)
 #define MICROPY_PY_DESCRIPTORS      (1)
@@ -172,6 +191,32 @@ extern const struct _mp_print_t mp_stderr_print;
 #define MICROPY_KBD_EXCEPTION       (1)
 #define MICROPY_ASYNC_KBD_INTR      (1)
 
+// multipython contexts run on threads of their own; each thread takes a slot of
+// the per-core state arrays (slot 0 is the main interpreter) and checks for
+// suspension and its CPU budget on backward branches. A context never moves between threads, so
+// its state pointer can be thread-local (see tests/bench/state-*.py)
+#if MICROPY_PY_THREAD
+#define MICROPY_PY_MULTIPYTHON      (1)
+#define MICROPY_GC_SPLIT_HEAP       (1)
+#define MICROPY_NUM_CORES           (16)
+#define MICROPY_GET_CORE_INDEX      (mp_multipython_slot)
+#ifndef MICROPY_STATE_PTR
+#define MICROPY_STATE_PTR           (MICROPY_STATE_PTR_THREAD_LOCAL)
+#endif
+// full collections mark the heap on up to this many more threads, one for each other CPU
+#define MICROPY_GC_MARK_THREADS     (3)
+// frames of calls come from a pystack of each context rather than its small heap
+#ifndef MICROPY_ENABLE_PYSTACK
+#define MICROPY_ENABLE_PYSTACK      (1)
+#endif
+extern __thread int mp_multipython_slot;
+void multipython_port_suspend_point(void);
+#define MICROPY_VM_HOOK_LOOP \
+    if (mp_active_contexts[MICROPY_GET_CORE_INDEX]->status & (MP_CSUSP | MP_CSTOP | MP_CBUDGET)) { \
+        multipython_port_suspend_point(); \
+    }
+#endif
+
 extern const struct _mp_obj_module_t mp_module_machine;
 extern const struct _mp_obj_module_t mp_module_os;
 extern const struct _mp_obj_module_t mp_module_uos_vfs;
@@ -181,6 +226,7 @@ extern const struct _mp_obj_module_t mp_module_termios;
 extern const struct _mp_obj_module_t mp_module_socket;
 extern const struct _mp_obj_module_t mp_module_ffi;
 extern const struct _mp_obj_module_t mp_module_jni;
+extern const struct _mp_obj_module_t mp_module_multipython;
 
 #if MICROPY_PY_UOS_VFS
 #define MICROPY_PY_UOS_DEF { MP_ROM_QSTR(MP_QSTR_uos), MP_ROM_PTR(&mp_module_uos_vfs) },
@@ -212,6 +258,11 @@ extern const struct _mp_obj_module_t mp_module_jni;
 #else
 #define MICROPY_PY_SOCKET_DEF
 #endif
+#if MICROPY_PY_MULTIPYTHON
+#define MICROPY_PY_MULTIPYTHON_DEF { MP_ROM_QSTR(MP_QSTR_multipython), MP_ROM_PTR(&mp_module_multipython) },
+#else
+#define MICROPY_PY_MULTIPYTHON_DEF
+#endif
 #if MICROPY_PY_USELECT_POSIX
 #define MICROPY_PY_USELECT_DEF { MP_ROM_QSTR(MP_QSTR_uselect), MP_ROM_PTR(&mp_module_uselect) },
 #else
@@ -227,6 +278,7 @@ extern const struct _mp_obj_module_t mp_module_jni;
     MICROPY_PY_UOS_DEF \
     MICROPY_PY_USELECT_DEF \
     MICROPY_PY_TERMIOS_DEF \
+    MICROPY_PY_MULTIPYTHON_DEF \
 
 // type definitions for the specific machine
 
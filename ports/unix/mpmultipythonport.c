@@ -0,0 +1,549 @@
+/*
+Copyright 2019 Owen Lyke
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+/*
+
+multipython backend for the unix port
+
+Every context runs on its own pthread. The thread owns one slot of the per-core
+arrays (mp_active_contexts, mp_active_states and the mirrors), and
+MICROPY_GET_CORE_INDEX resolves to that slot through a thread-local variable.
+Slot 0 belongs to the main interpreter.
+
+Threads can't be suspended from the outside, so suspension is cooperative: the
+VM checks the status of its context at every backward branch (MICROPY_VM_HOOK_LOOP)
+and blocks in multipython_port_suspend_point() until it is resumed. A context
+is stopped by raising KeyboardInterrupt in it through its pending exception.
+
+A context waiting for responses sleeps on the same condition variable that
+resumes it, and notify signals it once a response is queued. Nothing polls:
+every control operation and response wakes its context directly.
+
+The host scheduler is invisible to us, so for the runtime accounting a context
+counts as switched in while its thread runs, and as switched out while it is
+parked waiting for responses or suspended.
+
+A context with a CPU budget is held back in multipython_port_hold(), a timed wait
+on the same condition variable that only a stop cuts short. Priority classes map
+onto the nice value of the thread; the realtime class asks for SCHED_RR first.
+Raising the priority above normal needs privileges the process may not have, and
+without them the thread keeps running at the normal priority.
+
+The stack of each thread is painted when it starts, so the deepest point the
+context has reached can be found later by looking for the first word that was
+overwritten.
+
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // pthread_getattr_np
+#endif
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "py/gc.h"
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/mpstate.h"
+#include "py/mpthread.h"
+#include "py/runtime.h"
+#include "py/stackctrl.h"
+#include "extmod/vfs.h"
+#include "extmod/vfs_posix.h"
+
+#include "extmod/modmultipython.h"
+
+#if MICROPY_PY_MULTIPYTHON
+
+#define MULTIPYTHON_TASK_HEAP_SIZE      (256 * 1024)        // defaults, start() can override them
+#define MULTIPYTHON_TASK_HEAP_MAX       (16 * 1024 * 1024)
+#define MULTIPYTHON_TASK_STACK_SIZE     (256 * 1024)
+#define MULTIPYTHON_TASK_PYSTACK_SIZE   (32 * 1024)
+#define MULTIPYTHON_TASK_STACK_MARGIN   (8192)      // room to recover from hitting the stack limit
+#define MULTIPYTHON_TASK_ID_BASE        (0x10000)   // keeps clear of the IDs used by switch_bench
+#define MULTIPYTHON_MAIN_WAIT_SLICE_MS  (100)       // the main interpreter wakes up this often to take Ctrl-C
+#define MULTIPYTHON_STACK_PAINT         ((uintptr_t)0x5a5aa5a55a5aa5a5ULL)
+#define MULTIPYTHON_STACK_PAINT_GAP     (1024)      // left alone below the stack pointer of the painter
+
+typedef struct _multipython_port_task_t {
+    mp_context_node_t*  context;    // NULL when the slot is free
+    pthread_t           thread;
+    pthread_cond_t      wake;       // signalled when the context is resumed, stopped or sent a response
+    uint8_t             signalled;  // multipython_port_signal() was called since the context last waited
+    const uintptr_t*    stack_low;  // painted part of the stack of the thread, NULL if not painted
+    const uintptr_t*    stack_top;
+} multipython_port_task_t;
+
+__thread int mp_multipython_slot = 0;
+
+STATIC pthread_mutex_t multipython_port_list_mutex = PTHREAD_MUTEX_INITIALIZER;    // protects the context list
+STATIC pthread_mutex_t multipython_port_task_mutex = PTHREAD_MUTEX_INITIALIZER;    // protects the task slots and the suspend status
+STATIC multipython_port_task_t multipython_port_tasks[MICROPY_NUM_CORES] = {
+    [0] = { .wake = PTHREAD_COND_INITIALIZER }, // the main interpreter, which never ends
+};
+STATIC uint32_t multipython_port_next_id = MULTIPYTHON_TASK_ID_BASE;
+
+STATIC void* multipython_task_template( void* arg );
+
+// helpers
+STATIC multipython_port_task_t* multipython_port_task_of( mp_context_node_t* context ){
+    // the task mutex must be held
+    if( ( context == mp_context_head ) && ( context != NULL ) ){
+        return &multipython_port_tasks[0];
+    }
+    for( size_t slot = 1; slot < MICROPY_NUM_CORES; slot++ ){
+        if( multipython_port_tasks[slot].context == context ){
+            return &multipython_port_tasks[slot];
+        }
+    }
+    return NULL;
+}
+
+// a parked thread stands in for the context being switched out
+STATIC void multipython_port_switched_out( void ){
+    #if MICROPY_MULTIPYTHON_STATS
+    mp_context_account( NULL );
+    #endif
+}
+
+STATIC void multipython_port_switched_in( mp_context_node_t* context ){
+    #if MICROPY_MULTIPYTHON_STATS
+    mp_context_account( context );
+    #endif
+    (void)context;
+}
+
+STATIC void multipython_port_wait_while_suspended( mp_context_node_t* context ){
+    multipython_port_task_t* task = &multipython_port_tasks[MICROPY_GET_CORE_INDEX];
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    if( ( context->status & MP_CSUSP ) && !( context->status & MP_CSTOP ) ){
+        multipython_port_switched_out();
+        while( ( context->status & MP_CSUSP ) && !( context->status & MP_CSTOP ) ){
+            pthread_cond_wait(&task->wake, &multipython_port_task_mutex);
+        }
+        multipython_port_switched_in( context );
+    }
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+}
+
+void multipython_port_suspend_point( void ){
+    mp_context_node_t* context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    if( context == mp_context_head ){ return; }
+    if( ( context->status & MP_CSTOP ) && ( MP_STATE_VM(mp_pending_exception) == MP_OBJ_NULL ) ){
+        // a thread of the context took the exception that stops it, which all the
+        // threads of the context share, so raise it again until they have all ended
+        MP_STATE_VM(mp_pending_exception) = MP_OBJ_FROM_PTR(&MP_STATE_VM(mp_kbd_exception));
+        return;
+    }
+    if( context->status & MP_CBUDGET ){
+        multipython_budget_point( context );
+    }
+    multipython_port_wait_while_suspended( context );
+}
+
+STATIC void multipython_port_deadline( struct timespec* deadline, mp_uint_t us ){
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += us / 1000000;
+    deadline->tv_nsec += ( us % 1000000 ) * 1000;
+    if( deadline->tv_nsec >= 1000000000 ){
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+STATIC void multipython_port_set_priority( int8_t priority ){
+    // applies to the calling thread only; failures leave it where it was
+    static const int nice_values[] = {
+        [MULTIPYTHON_PRIORITY_LOW + 1] = 10,
+        [MULTIPYTHON_PRIORITY_NORMAL + 1] = 0,
+        [MULTIPYTHON_PRIORITY_HIGH + 1] = -5,
+        [MULTIPYTHON_PRIORITY_REALTIME + 1] = -10,
+    };
+    if( priority == MULTIPYTHON_PRIORITY_REALTIME ){
+        struct sched_param param = { .sched_priority = sched_get_priority_min(SCHED_RR) };
+        if( pthread_setschedparam(pthread_self(), SCHED_RR, &param) == 0 ){
+            return;
+        }
+    }
+    if( priority != MULTIPYTHON_PRIORITY_NORMAL ){
+        #ifdef SYS_gettid
+        setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice_values[priority + 1]); // a thread's own nice value on Linux
+        #else
+        (void)nice_values;
+        #endif
+    }
+}
+
+// port interface
+void multipython_port_init( void ){
+    // no helper threads are needed
+}
+
+int multipython_port_task_create( mp_context_node_t* context, mp_int_t core ){
+    (void)core; // the host scheduler places the thread
+
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    multipython_port_task_t* task = multipython_port_task_of( NULL );
+    if( task == NULL ){
+        pthread_mutex_unlock(&multipython_port_task_mutex);
+        return MP_EAGAIN; // all slots taken
+    }
+    task->context = context;
+    task->signalled = 0;
+    task->stack_low = NULL;
+    task->stack_top = NULL;
+    pthread_cond_init(&task->wake, NULL);
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+
+    // threads have no ID of their own that fits a context ID, so hand one out
+    pthread_mutex_lock(&multipython_port_list_mutex);
+    mp_context_set_id( context, multipython_port_next_id++ );
+    pthread_mutex_unlock(&multipython_port_list_mutex);
+
+    if( context->args.stack_size == 0 ){
+        context->args.stack_size = MULTIPYTHON_TASK_STACK_SIZE;
+    }
+    if( context->args.stack_size < PTHREAD_STACK_MIN ){
+        context->args.stack_size = PTHREAD_STACK_MIN;
+    }
+
+    // the heap is allocated here so that start() raises when there is no memory for it
+    if( context->args.heap_size == 0 ){
+        context->args.heap_size = MULTIPYTHON_TASK_HEAP_SIZE;
+    }
+    if( context->args.snapshot != NULL ){
+        context->args.heap_size = multipython_snapshot_heap_size( context );
+    }
+    context->args.heap = mp_context_dynmem_alloc( context->args.heap_size, context );
+    if( context->args.heap == NULL ){
+        pthread_mutex_lock(&multipython_port_task_mutex);
+        pthread_cond_destroy(&task->wake);
+        task->context = NULL;
+        pthread_mutex_unlock(&multipython_port_task_mutex);
+        return MP_ENOMEM;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, context->args.stack_size);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&task->thread, &attr, multipython_task_template, (void*)task);
+    pthread_attr_destroy(&attr);
+
+    if( ret != 0 ){
+        pthread_mutex_lock(&multipython_port_task_mutex);
+        pthread_cond_destroy(&task->wake);
+        task->context = NULL;
+        pthread_mutex_unlock(&multipython_port_task_mutex);
+        return ret;
+    }
+    return 0;
+}
+
+int8_t multipython_port_task_end( mp_context_node_t* context ){
+    if( context == mp_active_contexts[MICROPY_GET_CORE_INDEX] ){
+        // ending ourselves: unwind back to the task template
+        nlr_raise(mp_obj_new_exception(&mp_type_SystemExit));
+    }
+
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    multipython_port_task_t* task = multipython_port_task_of( context );
+    if( task == NULL ){
+        pthread_mutex_unlock(&multipython_port_task_mutex);
+        return -1;
+    }
+    context->status |= MP_CSTOP;
+    context->state->vm.mp_pending_exception = MP_OBJ_FROM_PTR(&context->state->vm.mp_kbd_exception);
+    pthread_cond_broadcast(&task->wake);
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+    return 0;
+}
+
+int8_t multipython_port_task_suspend( mp_context_node_t* context ){
+    // other contexts notice the flag at their next suspend point
+    if( context == mp_active_contexts[MICROPY_GET_CORE_INDEX] ){
+        multipython_port_wait_while_suspended( context );
+    }
+    return 0;
+}
+
+int8_t multipython_port_task_resume( mp_context_node_t* context ){
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    multipython_port_task_t* task = multipython_port_task_of( context );
+    if( task != NULL ){
+        pthread_cond_broadcast(&task->wake);
+    }
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+    return ( task != NULL ) ? 0 : -1;
+}
+
+void multipython_port_enter_critical( void ){
+    pthread_mutex_lock(&multipython_port_list_mutex);
+}
+
+void multipython_port_exit_critical( void ){
+    pthread_mutex_unlock(&multipython_port_list_mutex);
+}
+
+void multipython_port_sched_lock( void ){
+    // each context has a slot of its own, so being switched out is harmless
+}
+
+void multipython_port_sched_unlock( void ){
+}
+
+void multipython_port_wait( mp_context_node_t* context, mp_int_t timeout_ms ){
+    bool is_main = ( context == mp_context_head );
+    if( is_main && ( ( timeout_ms < 0 ) || ( timeout_ms > MULTIPYTHON_MAIN_WAIT_SLICE_MS ) ) ){
+        timeout_ms = MULTIPYTHON_MAIN_WAIT_SLICE_MS;
+    }
+
+    // Ctrl-C may raise straight out of the signal handler, which must not happen
+    // while the task mutex is held
+    sigset_t block, previous;
+    if( is_main ){
+        sigemptyset(&block);
+        sigaddset(&block, SIGINT);
+        pthread_sigmask(SIG_BLOCK, &block, &previous);
+    }
+
+    struct timespec deadline;
+    if( timeout_ms >= 0 ){
+        multipython_port_deadline( &deadline, (mp_uint_t)timeout_ms * 1000 );
+    }
+
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    multipython_port_task_t* task = multipython_port_task_of( context );
+    // checked under the mutex, so a signal sent after this point can't be missed
+    if( ( task != NULL ) && !task->signalled && ( mp_response_queue_available( &context->response_queue ) == 0 ) && !( context->status & MP_CSTOP ) ){
+        multipython_port_switched_out();
+        if( timeout_ms < 0 ){
+            pthread_cond_wait(&task->wake, &multipython_port_task_mutex);
+        }else{
+            pthread_cond_timedwait(&task->wake, &multipython_port_task_mutex, &deadline);
+        }
+        multipython_port_switched_in( context );
+    }
+    if( task != NULL ){
+        task->signalled = 0;
+    }
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+
+    if( is_main ){
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    }
+}
+
+void multipython_port_signal( mp_context_node_t* context ){
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    multipython_port_task_t* task = multipython_port_task_of( context );
+    if( task != NULL ){
+        task->signalled = 1; // like a task notification, a signal sent before the wait isn't lost
+        pthread_cond_broadcast(&task->wake); // threads of the context may be waiting too
+    }
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+}
+
+size_t multipython_port_stack_high_water( mp_context_node_t* context ){
+    size_t used = 0;
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    multipython_port_task_t* task = multipython_port_task_of( context );
+    if( ( task != NULL ) && ( task->stack_low != NULL ) ){
+        // the thread can't end while we hold the slot, so its stack is still there
+        const volatile uintptr_t* word = task->stack_low;
+        while( ( word < task->stack_top ) && ( *word == MULTIPYTHON_STACK_PAINT ) ){
+            word++;
+        }
+        used = (const uint8_t*)task->stack_top - (const uint8_t*)word;
+    }
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+    return used;
+}
+
+void multipython_port_hold( mp_context_node_t* context, mp_uint_t hold_us ){
+    struct timespec deadline;
+    multipython_port_deadline( &deadline, hold_us );
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    multipython_port_task_t* task = multipython_port_task_of( context );
+    if( task != NULL ){
+        multipython_port_switched_out();
+        while( !( context->status & MP_CSTOP ) ){
+            if( pthread_cond_timedwait(&task->wake, &multipython_port_task_mutex, &deadline) == ETIMEDOUT ){
+                break;
+            }
+        }
+        multipython_port_switched_in( context );
+    }
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+}
+
+// threads
+STATIC void multipython_port_stack_paint( multipython_port_task_t* task ){
+    // paint the stack of the calling thread below what it uses now
+    pthread_attr_t attr;
+    void* addr;
+    size_t size;
+    if( pthread_getattr_np( pthread_self(), &attr ) != 0 ){ return; }
+    int ret = pthread_attr_getstack( &attr, &addr, &size );
+    pthread_attr_destroy( &attr );
+    if( ret != 0 ){ return; }
+    volatile uintptr_t* word = (uintptr_t*)addr;
+    const uintptr_t* end = (const uintptr_t*)( (uintptr_t)&attr - MULTIPYTHON_STACK_PAINT_GAP );
+    while( word < end ){
+        *word++ = MULTIPYTHON_STACK_PAINT;
+    }
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    task->stack_low = (const uintptr_t*)addr;
+    task->stack_top = (const uintptr_t*)( (uint8_t*)addr + size );
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+}
+
+STATIC void* multipython_task_template( void* arg ){
+    multipython_port_task_t* task = (multipython_port_task_t*)arg;
+    mp_context_node_t* context = task->context;
+
+    mp_multipython_slot = task - multipython_port_tasks;
+    multipython_port_stack_paint( task );
+    multipython_port_set_priority( context->args.priority );
+    mp_task_switched_in( context->id );
+    #if MICROPY_PY_THREAD
+    mp_thread_set_state(&context->state->thread);
+    mp_thread_init_context();
+    #endif
+
+    size_t heap_size = context->args.heap_size;
+    size_t heap_max = context->args.heap_max ? context->args.heap_max : MULTIPYTHON_TASK_HEAP_MAX;
+    bool boot = ( context->args.snapshot == NULL );
+    char* heap = context->args.heap;
+
+    if( boot ){
+        gc_init(heap, heap + heap_size);
+    }else{
+        // the snapshot is an interpreter that has already booted
+        heap = multipython_snapshot_restore( context, heap );
+    }
+    // after the restore, which brings the pystack of the snapshot context along
+    if( multipython_pystack_init( context, MULTIPYTHON_TASK_PYSTACK_SIZE ) != 0 ){
+        printf("Could not allocate memory for task. aborting\n");
+        goto remove_task;
+    }
+
+    mp_stack_set_top(&arg);
+    if( context->args.stack_size > 2 * MULTIPYTHON_TASK_STACK_MARGIN ){
+        mp_stack_set_limit(context->args.stack_size - MULTIPYTHON_TASK_STACK_MARGIN);
+    }else{
+        mp_stack_set_limit(context->args.stack_size / 2);
+    }
+    gc_set_grow_limit( ( heap_max > heap_size ) ? heap_max - heap_size : 0 );
+
+    if( boot ){
+        mp_init();
+
+        #if MICROPY_VFS_POSIX
+        {
+            // Mount the host FS at the root of our internal VFS
+            mp_obj_t args[2] = {
+                mp_type_vfs_posix.make_new(&mp_type_vfs_posix, 0, 0, NULL),
+                MP_OBJ_NEW_QSTR(MP_QSTR__slash_),
+            };
+            mp_vfs_mount(2, args, (mp_map_t*)&mp_const_empty_map);
+            MP_STATE_VM(vfs_cur) = MP_STATE_VM(vfs_mount_table);
+        }
+        #endif
+
+        mp_obj_list_init(mp_sys_path, 0);
+        mp_obj_list_append(mp_sys_path, MP_OBJ_NEW_QSTR(MP_QSTR_));
+        mp_obj_list_init(mp_sys_argv, 0);
+        mp_context_refresh();
+    }
+
+    #if MICROPY_PY_THREAD
+    MP_STATE_VM(thread_stack_size) = context->args.thread_stack_size;
+    #endif
+
+    if( context->args.capture ){
+        multipython_exec_source( context );
+        multipython_snapshot_capture( context, heap, heap_size );
+        goto deinit;
+    }
+
+    // Option to suspend the task at startup
+    if( context->args.suspend ){
+        context->status |= MP_CSUSP;
+        multipython_port_wait_while_suspended( context );
+    }
+
+    // a stop that arrived before mp_init() was wiped with the pending exception
+    if( !( context->status & MP_CSTOP ) ){
+        multipython_exec_source( context );
+    }
+
+deinit:
+    #if MICROPY_PY_THREAD
+    {
+        // stopping the context makes its threads unwind before they are cancelled
+        pthread_mutex_lock(&multipython_port_task_mutex);
+        int32_t stopped = context->status & MP_CSTOP;
+        context->status |= MP_CSTOP;
+        pthread_mutex_unlock(&multipython_port_task_mutex);
+        mp_thread_deinit_context();
+        pthread_mutex_lock(&multipython_port_task_mutex);
+        context->status = ( context->status & ~MP_CSTOP ) | stopped;
+        pthread_mutex_unlock(&multipython_port_task_mutex);
+    }
+    #endif
+    gc_sweep_all();
+    mp_deinit();
+    fflush(stdout);
+
+remove_task:
+    multipython_snapshot_release( context );
+    #if MICROPY_MULTIPYTHON_CODE_CACHE
+    multipython_code_cache_release( context );
+    #endif
+    #if MICROPY_MULTIPYTHON_SHARED
+    multipython_shared_release_all( context );
+    #endif
+    #if MICROPY_MULTIPYTHON_POOL
+    multipython_pool_release_all( context );
+    #endif
+    pthread_mutex_lock(&multipython_port_list_mutex);
+    pthread_mutex_lock(&multipython_port_task_mutex);
+    pthread_cond_destroy(&task->wake);
+    task->context = NULL;
+    mp_task_remove( context->id );
+    pthread_mutex_unlock(&multipython_port_task_mutex);
+    pthread_mutex_unlock(&multipython_port_list_mutex);
+    return NULL;
+}
+
+#endif // MICROPY_PY_MULTIPYTHON
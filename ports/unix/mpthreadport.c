@@ -38,20 +38,37 @@
 #include <signal.h>
 #include <sched.h>
 #include <semaphore.h>
+#include <unistd.h>
 
-// this structure forms a linked list, one node per active thread
+// one per active thread, in the list of threads of the context it belongs to, so GC
+// only walks the threads of the context collecting. The switch hook never sees these
+// threads, so they aren't given task IDs for the index
 typedef struct _thread_t {
+    mp_context_thread_t entry; // first, so the threads of a context are a list of these
     pthread_t id;           // system id of thread
     int ready;              // whether the thread is ready and running
     void *arg;              // thread Python args, a GC root pointer
-    struct _thread_t *next;
 } thread_t;
 
+#define THREAD_FIRST(context)   ((thread_t*)(context)->threads)
+#define THREAD_NEXT(th)         ((thread_t*)(th)->entry.next)
+
+#if MICROPY_STATE_PTR == MICROPY_STATE_PTR_THREAD_LOCAL
+// the state pointer of the context is thread-local too, so keep this one alongside
+STATIC MICROPY_THREAD_LOCAL mp_state_thread_t *thread_state;
+#else
 STATIC pthread_key_t tls_key;
+#endif
 
-// the mutex controls access to the linked list
+// the mutex controls access to the thread lists of all contexts
 STATIC pthread_mutex_t thread_mutex = PTHREAD_MUTEX_INITIALIZER;
-STATIC thread_t *thread;
+
+#if MICROPY_PY_MULTIPYTHON
+// threads cancelled with their context that haven't ended yet, see thread_cancelled()
+STATIC int thread_cancelling = 0;
+#define THREAD_CANCEL_WAIT_US (1000000)
+#define THREAD_UNWIND_WAIT_US (100000)  // time a stopped context gives its threads to end on their own
+#endif
 
 // this is used to synchronise the signal handler of the thread
 // it's needed because we can't use any pthread calls in a signal handler
@@ -86,18 +103,26 @@ STATIC void mp_thread_gc(int signo, siginfo_t *info, void *context) {
 }
 
 void mp_thread_init(void) {
+    #if MICROPY_STATE_PTR == MICROPY_STATE_PTR_THREAD_LOCAL
+    thread_state = &MP_STATE_PTR->thread;
+    #else
     pthread_key_create(&tls_key, NULL);
-    pthread_setspecific(tls_key, &(mp_active_context_mirrors[MICROPY_GET_CORE_INDEX].state->thread));
+    pthread_setspecific(tls_key, &MP_STATE_PTR->thread);
+    #endif
 
-    // create first entry in linked list of all threads
-    thread = malloc(sizeof(thread_t));
-    thread->id = pthread_self();
-    thread->ready = 1;
-    thread->arg = NULL;
-    thread->next = NULL;
+    // the first thread of the main interpreter
+    thread_t *th = malloc(sizeof(thread_t));
+    th->id = pthread_self();
+    th->ready = 1;
+    th->arg = NULL;
+    th->entry.id = 0;
+    th->entry.state = mp_thread_get_state();
+    pthread_mutex_lock(&thread_mutex);
+    mp_context_thread_add(mp_active_contexts[MICROPY_GET_CORE_INDEX], &th->entry);
+    pthread_mutex_unlock(&thread_mutex);
 
     #if defined(__APPLE__)
-    snprintf(thread_signal_done_name, sizeof(thread_signal_done_name), "micropython_sem_%d", (int)thread->id);
+    snprintf(thread_signal_done_name, sizeof(thread_signal_done_name), "micropython_sem_%d", (int)th->id);
     thread_signal_done_p = sem_open(thread_signal_done_name, O_CREAT | O_EXCL, 0666, 0);
     #else
     sem_init(&thread_signal_done, 0, 0);
@@ -111,23 +136,73 @@ void mp_thread_init(void) {
     sigaction(SIGUSR1, &sa, NULL);
 }
 
-void mp_thread_deinit(void) {
+// Cancel the other threads of the calling context and remove all its threads
+STATIC void mp_thread_end_context_threads(void) {
+    mp_context_node_t *context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
     pthread_mutex_lock(&thread_mutex);
-    while (thread->next != NULL) {
-        thread_t *th = thread;
-        thread = thread->next;
-        pthread_cancel(th->id);
+    while (context->threads != NULL) {
+        thread_t *th = THREAD_FIRST(context);
+        mp_context_thread_remove(&th->entry);
+        if (th->id != pthread_self()) {
+            #if MICROPY_PY_MULTIPYTHON
+            __atomic_add_fetch(&thread_cancelling, 1, __ATOMIC_RELAXED);
+            #endif
+            pthread_cancel(th->id);
+        }
         free(th);
     }
     pthread_mutex_unlock(&thread_mutex);
+
+    #if MICROPY_PY_MULTIPYTHON
+    // cancellation is asynchronous, and a thread still running once its context has
+    // ended would find the state and the slot of the context gone
+    for (int waited = 0; (__atomic_load_n(&thread_cancelling, __ATOMIC_ACQUIRE) > 0) && (waited < THREAD_CANCEL_WAIT_US); waited += 100) {
+        usleep(100);
+    }
+    #endif
+}
+
+void mp_thread_deinit(void) {
+    mp_thread_end_context_threads();
     #if defined(__APPLE__)
     sem_close(thread_signal_done_p);
     sem_unlink(thread_signal_done_name);
     #endif
-    assert(thread->id == pthread_self());
-    free(thread);
 }
 
+#if MICROPY_PY_MULTIPYTHON
+// Each multipython context runs on a thread of its own, which is the first thread of
+// the context so that threads started within the context can scan its stack.
+void mp_thread_init_context(void) {
+    thread_t *th = malloc(sizeof(thread_t));
+    th->id = pthread_self();
+    th->ready = 1;
+    th->arg = NULL;
+    th->entry.id = 0;
+    th->entry.state = mp_thread_get_state();
+    pthread_mutex_lock(&thread_mutex);
+    mp_context_thread_add(mp_active_contexts[MICROPY_GET_CORE_INDEX], &th->entry);
+    pthread_mutex_unlock(&thread_mutex);
+}
+
+// The context has been stopped, so its threads running Python code unwind on their
+// own; only those blocked elsewhere are cancelled, which might leave a lock held
+void mp_thread_deinit_context(void) {
+    mp_context_node_t *context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    for (int waited = 0; waited < THREAD_UNWIND_WAIT_US; waited += 100) {
+        pthread_mutex_lock(&thread_mutex);
+        thread_t *th = THREAD_FIRST(context);
+        bool alone = (th == NULL) || ((th->id == pthread_self()) && (THREAD_NEXT(th) == NULL));
+        pthread_mutex_unlock(&thread_mutex);
+        if (alone) {
+            break;
+        }
+        usleep(100);
+    }
+    mp_thread_end_context_threads();
+}
+#endif
+
 // This function scans all pointers that are external to the current thread.
 // It does this by signalling all other threads and getting them to scan their
 // own registers and stack.  Note that there may still be some edge cases left
@@ -135,8 +210,10 @@ void mp_thread_deinit(void) {
 // the global root pointers (in mp_state_ctx) while another thread is doing a
 // garbage collection and tracing these pointers.
 void mp_thread_gc_others(void) {
+    // threads of other contexts have their own heaps
+    mp_context_node_t *context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
     pthread_mutex_lock(&thread_mutex);
-    for (thread_t *th = thread; th != NULL; th = th->next) {
+    for (thread_t *th = THREAD_FIRST(context); th != NULL; th = THREAD_NEXT(th)) {
         gc_collect_root(&th->arg, 1);
         if (th->id == pthread_self()) {
             continue;
@@ -155,18 +232,27 @@ void mp_thread_gc_others(void) {
 }
 
 mp_state_thread_t *mp_thread_get_state(void) {
+    #if MICROPY_STATE_PTR == MICROPY_STATE_PTR_THREAD_LOCAL
+    return thread_state;
+    #else
     return (mp_state_thread_t*)pthread_getspecific(tls_key);
+    #endif
 }
 
 void mp_thread_set_state(void *state) {
+    #if MICROPY_STATE_PTR == MICROPY_STATE_PTR_THREAD_LOCAL
+    thread_state = state;
+    #else
     pthread_setspecific(tls_key, state);
+    #endif
 }
 
 void mp_thread_start(void) {
     pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
     pthread_mutex_lock(&thread_mutex);
-    for (thread_t *th = thread; th != NULL; th = th->next) {
+    for (thread_t *th = THREAD_FIRST(mp_active_contexts[MICROPY_GET_CORE_INDEX]); th != NULL; th = THREAD_NEXT(th)) {
         if (th->id == pthread_self()) {
+            th->entry.state = mp_thread_get_state();
             th->ready = 1;
             break;
         }
@@ -174,6 +260,34 @@ void mp_thread_start(void) {
     pthread_mutex_unlock(&thread_mutex);
 }
 
+#if MICROPY_PY_MULTIPYTHON
+typedef struct _thread_entry_t {
+    void *(*entry)(void*);
+    void *arg;
+    int slot;
+} thread_entry_t;
+
+STATIC void thread_cancelled(void *arg) {
+    (void)arg;
+    __atomic_sub_fetch(&thread_cancelling, 1, __ATOMIC_RELEASE);
+}
+
+// new threads run in the context, and so the slot, of the thread creating them
+STATIC void *thread_entry_in_context(void *entry_in) {
+    thread_entry_t entry = *(thread_entry_t*)entry_in;
+    free(entry_in);
+    mp_multipython_slot = entry.slot;
+    #if MICROPY_STATE_PTR == MICROPY_STATE_PTR_THREAD_LOCAL
+    mp_active_state = mp_active_states[entry.slot];
+    #endif
+    void *ret;
+    pthread_cleanup_push(thread_cancelled, NULL);
+    ret = entry.entry(entry.arg);
+    pthread_cleanup_pop(0);
+    return ret;
+}
+#endif
+
 void mp_thread_create(void *(*entry)(void*), void *arg, size_t *stack_size) {
     // default stack size is 8k machine-words
     if (*stack_size == 0) {
@@ -201,13 +315,31 @@ void mp_thread_create(void *(*entry)(void*), void *arg, size_t *stack_size) {
         goto er;
     }
 
+    #if MICROPY_PY_MULTIPYTHON
+    thread_entry_t *entry_in = malloc(sizeof(thread_entry_t));
+    if (entry_in == NULL) {
+        ret = ENOMEM;
+        goto er;
+    }
+    entry_in->entry = entry;
+    entry_in->arg = arg;
+    entry_in->slot = mp_multipython_slot;
+    #endif
+
     pthread_mutex_lock(&thread_mutex);
 
     // create thread
     pthread_t id;
+    #if MICROPY_PY_MULTIPYTHON
+    ret = pthread_create(&id, &attr, thread_entry_in_context, entry_in);
+    #else
     ret = pthread_create(&id, &attr, entry, arg);
+    #endif
     if (ret != 0) {
         pthread_mutex_unlock(&thread_mutex);
+        #if MICROPY_PY_MULTIPYTHON
+        free(entry_in);
+        #endif
         goto er;
     }
 
@@ -215,13 +347,14 @@ void mp_thread_create(void *(*entry)(void*), void *arg, size_t *stack_size) {
     // this value seems to be about right for both 32-bit and 64-bit builds
     *stack_size -= 8192;
 
-    // add thread to linked list of all threads
+    // add thread to the threads of the context
     thread_t *th = malloc(sizeof(thread_t));
     th->id = id;
     th->ready = 0;
     th->arg = arg;
-    th->next = thread;
-    thread = th;
+    th->entry.id = 0;
+    th->entry.state = NULL;
+    mp_context_thread_add(mp_active_contexts[MICROPY_GET_CORE_INDEX], &th->entry);
 
     pthread_mutex_unlock(&thread_mutex);
 
@@ -233,18 +366,12 @@ er:
 
 void mp_thread_finish(void) {
     pthread_mutex_lock(&thread_mutex);
-    thread_t *prev = NULL;
-    for (thread_t *th = thread; th != NULL; th = th->next) {
+    for (thread_t *th = THREAD_FIRST(mp_active_contexts[MICROPY_GET_CORE_INDEX]); th != NULL; th = THREAD_NEXT(th)) {
         if (th->id == pthread_self()) {
-            if (prev == NULL) {
-                thread = th->next;
-            } else {
-                prev->next = th->next;
-            }
+            mp_context_thread_remove(&th->entry);
             free(th);
             break;
         }
-        prev = th;
     }
     pthread_mutex_unlock(&thread_mutex);
 }
@@ -276,4 +403,82 @@ void mp_thread_mutex_unlock(mp_thread_mutex_t *mutex) {
     // TODO check return value
 }
 
+#if MICROPY_GC_MARK_THREADS
+
+// The helper threads of the GC, one for each CPU besides that of the collecting
+// thread, up to MICROPY_GC_MARK_THREADS. They are started by the first
+// collection and then wait for each one after it.
+STATIC pthread_mutex_t gc_helper_mutex = PTHREAD_MUTEX_INITIALIZER;
+STATIC pthread_cond_t gc_helper_start_cond = PTHREAD_COND_INITIALIZER;
+STATIC pthread_cond_t gc_helper_done_cond = PTHREAD_COND_INITIALIZER;
+STATIC int gc_helper_num = -1;      // -1 until the helpers are started
+STATIC unsigned int gc_helper_runs; // counts the calls of mp_thread_gc_helpers_start
+STATIC int gc_helper_busy;          // helpers that haven't returned from gc_helper_fn
+STATIC void (*gc_helper_fn)(void*);
+STATIC void *gc_helper_arg;
+
+#define GC_HELPER_STACK_SIZE (64 * 1024)
+
+STATIC void *gc_helper_entry(void *arg) {
+    (void)arg;
+    unsigned int runs = 0;
+    pthread_mutex_lock(&gc_helper_mutex);
+    for (;;) {
+        while (gc_helper_runs == runs) {
+            pthread_cond_wait(&gc_helper_start_cond, &gc_helper_mutex);
+        }
+        runs = gc_helper_runs;
+        pthread_mutex_unlock(&gc_helper_mutex);
+        gc_helper_fn(gc_helper_arg);
+        pthread_mutex_lock(&gc_helper_mutex);
+        if (--gc_helper_busy == 0) {
+            pthread_cond_signal(&gc_helper_done_cond);
+        }
+    }
+    return NULL;
+}
+
+int mp_thread_gc_helpers_start(void (*fn)(void*), void *arg) {
+    pthread_mutex_lock(&gc_helper_mutex);
+    if (gc_helper_num < 0) {
+        gc_helper_num = 0;
+        long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+        pthread_attr_t attr;
+        if (pthread_attr_init(&attr) == 0) {
+            pthread_attr_setstacksize(&attr, GC_HELPER_STACK_SIZE);
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+            // the signals are left to the threads that run Python
+            sigset_t all, old;
+            sigfillset(&all);
+            pthread_sigmask(SIG_BLOCK, &all, &old);
+            while (gc_helper_num < MICROPY_GC_MARK_THREADS && gc_helper_num < n_cpu - 1) {
+                pthread_t id;
+                if (pthread_create(&id, &attr, gc_helper_entry, NULL) != 0) {
+                    break;
+                }
+                gc_helper_num++;
+            }
+            pthread_sigmask(SIG_SETMASK, &old, NULL);
+            pthread_attr_destroy(&attr);
+        }
+    }
+    gc_helper_fn = fn;
+    gc_helper_arg = arg;
+    gc_helper_busy = gc_helper_num;
+    gc_helper_runs++;
+    pthread_cond_broadcast(&gc_helper_start_cond);
+    pthread_mutex_unlock(&gc_helper_mutex);
+    return gc_helper_num;
+}
+
+void mp_thread_gc_helpers_wait(void) {
+    pthread_mutex_lock(&gc_helper_mutex);
+    while (gc_helper_busy > 0) {
+        pthread_cond_wait(&gc_helper_done_cond, &gc_helper_mutex);
+    }
+    pthread_mutex_unlock(&gc_helper_mutex);
+}
+
+#endif // MICROPY_GC_MARK_THREADS
+
 #endif // MICROPY_PY_THREAD
@@ -31,3 +31,8 @@ typedef pthread_mutex_t mp_thread_mutex_t;
 void mp_thread_init(void);
 void mp_thread_deinit(void);
 void mp_thread_gc_others(void);
+
+#if MICROPY_PY_MULTIPYTHON
+void mp_thread_init_context(void);
+void mp_thread_deinit_context(void);
+#endif
@@ -284,13 +284,91 @@ continue2:;
     dump_args(code_state->state, n_state);
 }
 
+#if MICROPY_OPT_QUICKEN
+
+byte mp_bc_quicken_binary_op(byte opcode, mp_obj_t lhs, mp_obj_t rhs) {
+    if (mp_obj_is_small_int(lhs) && mp_obj_is_small_int(rhs)) {
+        switch (opcode - MP_BC_BINARY_OP_MULTI) {
+            case MP_BINARY_OP_LESS: return MP_BC_BINARY_OP_INT_LESS;
+            case MP_BINARY_OP_MORE: return MP_BC_BINARY_OP_INT_MORE;
+            case MP_BINARY_OP_LESS_EQUAL: return MP_BC_BINARY_OP_INT_LESS_EQUAL;
+            case MP_BINARY_OP_MORE_EQUAL: return MP_BC_BINARY_OP_INT_MORE_EQUAL;
+            case MP_BINARY_OP_ADD: return MP_BC_BINARY_OP_INT_ADD;
+            case MP_BINARY_OP_SUBTRACT: return MP_BC_BINARY_OP_INT_SUBTRACT;
+            case MP_BINARY_OP_INPLACE_ADD: return MP_BC_BINARY_OP_INT_INPLACE_ADD;
+            case MP_BINARY_OP_INPLACE_SUBTRACT: return MP_BC_BINARY_OP_INT_INPLACE_SUBTRACT;
+        }
+    }
+    #if MICROPY_PY_BUILTINS_FLOAT
+    // the float variants take a small int for either operand, but not for both
+    else if ((mp_obj_is_float(lhs) && (mp_obj_is_float(rhs) || mp_obj_is_small_int(rhs)))
+        || (mp_obj_is_small_int(lhs) && mp_obj_is_float(rhs))) {
+        switch (opcode - MP_BC_BINARY_OP_MULTI) {
+            case MP_BINARY_OP_ADD: return MP_BC_BINARY_OP_FLOAT_ADD;
+            case MP_BINARY_OP_SUBTRACT: return MP_BC_BINARY_OP_FLOAT_SUBTRACT;
+            case MP_BINARY_OP_MULTIPLY: return MP_BC_BINARY_OP_FLOAT_MULTIPLY;
+            case MP_BINARY_OP_TRUE_DIVIDE: return MP_BC_BINARY_OP_FLOAT_TRUE_DIVIDE;
+            case MP_BINARY_OP_INPLACE_ADD: return MP_BC_BINARY_OP_FLOAT_INPLACE_ADD;
+            case MP_BINARY_OP_INPLACE_SUBTRACT: return MP_BC_BINARY_OP_FLOAT_INPLACE_SUBTRACT;
+            case MP_BINARY_OP_INPLACE_MULTIPLY: return MP_BC_BINARY_OP_FLOAT_INPLACE_MULTIPLY;
+            case MP_BINARY_OP_INPLACE_TRUE_DIVIDE: return MP_BC_BINARY_OP_FLOAT_INPLACE_TRUE_DIVIDE;
+        }
+    }
+    #endif
+    return opcode;
+}
+
+byte mp_bc_quicken_subscr(byte opcode, mp_obj_t base, mp_obj_t index) {
+    if (mp_obj_is_small_int(index)) {
+        if (mp_obj_is_type(base, &mp_type_list)) {
+            return opcode == MP_BC_LOAD_SUBSCR ? MP_BC_LOAD_SUBSCR_LIST_INT : MP_BC_STORE_SUBSCR_LIST_INT;
+        }
+        #if MICROPY_PY_BUILTINS_BYTEARRAY
+        if (mp_obj_is_type(base, &mp_type_bytearray)) {
+            return opcode == MP_BC_LOAD_SUBSCR ? MP_BC_LOAD_SUBSCR_BYTEARRAY_INT : MP_BC_STORE_SUBSCR_BYTEARRAY_INT;
+        }
+        #endif
+    }
+    return opcode;
+}
+
+byte mp_bc_unquicken(byte opcode) {
+    switch (opcode) {
+        case MP_BC_BINARY_OP_INT_LESS: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_LESS;
+        case MP_BC_BINARY_OP_INT_MORE: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_MORE;
+        case MP_BC_BINARY_OP_INT_LESS_EQUAL: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_LESS_EQUAL;
+        case MP_BC_BINARY_OP_INT_MORE_EQUAL: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_MORE_EQUAL;
+        case MP_BC_BINARY_OP_INT_ADD:
+        case MP_BC_BINARY_OP_FLOAT_ADD: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_ADD;
+        case MP_BC_BINARY_OP_INT_SUBTRACT:
+        case MP_BC_BINARY_OP_FLOAT_SUBTRACT: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_SUBTRACT;
+        case MP_BC_BINARY_OP_INT_INPLACE_ADD:
+        case MP_BC_BINARY_OP_FLOAT_INPLACE_ADD: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_INPLACE_ADD;
+        case MP_BC_BINARY_OP_INT_INPLACE_SUBTRACT:
+        case MP_BC_BINARY_OP_FLOAT_INPLACE_SUBTRACT: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_INPLACE_SUBTRACT;
+        case MP_BC_BINARY_OP_FLOAT_MULTIPLY: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_MULTIPLY;
+        case MP_BC_BINARY_OP_FLOAT_TRUE_DIVIDE: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_TRUE_DIVIDE;
+        case MP_BC_BINARY_OP_FLOAT_INPLACE_MULTIPLY: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_INPLACE_MULTIPLY;
+        case MP_BC_BINARY_OP_FLOAT_INPLACE_TRUE_DIVIDE: return MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_INPLACE_TRUE_DIVIDE;
+        case MP_BC_LOAD_SUBSCR_LIST_INT:
+        case MP_BC_LOAD_SUBSCR_BYTEARRAY_INT: return MP_BC_LOAD_SUBSCR;
+        case MP_BC_STORE_SUBSCR_LIST_INT:
+        case MP_BC_STORE_SUBSCR_BYTEARRAY_INT: return MP_BC_STORE_SUBSCR;
+        default: return opcode;
+    }
+}
+
+#endif // MICROPY_OPT_QUICKEN
+
 #if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_PERSISTENT_CODE_SAVE
 
 // The following table encodes the number of bytes that a specific opcode
-// takes up.  There are 3 special opcodes that always have an extra byte:
+// takes up.  There are 5 special opcodes that always have an extra byte:
 //     MP_BC_MAKE_CLOSURE
 //     MP_BC_MAKE_CLOSURE_DEFARGS
 //     MP_BC_RAISE_VARARGS
+//     MP_BC_LOAD_FAST_2
+//     MP_BC_COMPARE_JUMP
 // There are 4 special opcodes that have an extra byte only when
 // MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE is enabled (and they take a qstr):
 //     MP_BC_LOAD_NAME
@@ -315,10 +393,10 @@ STATIC const byte opcode_format_table[64] = {
     OC4(B, B, V, V), // 0x20-0x23
     OC4(Q, Q, Q, B), // 0x24-0x27
     OC4(V, V, Q, Q), // 0x28-0x2b
-    OC4(U, U, U, U), // 0x2c-0x2f
+    OC4(B, V, U, U), // 0x2c-0x2f
     OC4(B, B, B, B), // 0x30-0x33
     OC4(B, O, O, O), // 0x34-0x37
-    OC4(O, O, U, U), // 0x38-0x3b
+    OC4(O, O, O, U), // 0x38-0x3b
     OC4(U, O, B, O), // 0x3c-0x3f
     OC4(O, B, B, O), // 0x40-0x43
     OC4(O, U, O, B), // 0x44-0x47
@@ -400,6 +478,8 @@ uint mp_opcode_format(const byte *ip, size_t *opcode_size, bool count_var_uint)
             *ip == MP_BC_RAISE_VARARGS
             || *ip == MP_BC_MAKE_CLOSURE
             || *ip == MP_BC_MAKE_CLOSURE_DEFARGS
+            || *ip == MP_BC_LOAD_FAST_2
+            || *ip == MP_BC_COMPARE_JUMP
         );
         ip += 1;
         if (f == MP_OPCODE_VAR_UINT) {
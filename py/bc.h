@@ -101,6 +101,14 @@ void mp_bytecode_print2(const byte *code, size_t len, const mp_uint_t *const_tab
 const byte *mp_bytecode_print_str(const byte *ip);
 #define mp_bytecode_print_inst(code, const_table) mp_bytecode_print2(code, 1, const_table)
 
+#if MICROPY_OPT_QUICKEN
+// the variant of opcode specialised for the given operands, or opcode if there's none
+byte mp_bc_quicken_binary_op(byte opcode, mp_obj_t lhs, mp_obj_t rhs);
+byte mp_bc_quicken_subscr(byte opcode, mp_obj_t base, mp_obj_t index);
+// the opcode that a specialised one was rewritten from, or opcode if it isn't one
+byte mp_bc_unquicken(byte opcode);
+#endif
+
 // Helper macros to access pointer with least significant bits holding flags
 #define MP_TAGPTR_PTR(x) ((void*)((uintptr_t)(x) & ~((uintptr_t)3)))
 #define MP_TAGPTR_TAG0(x) ((uintptr_t)(x) & 1)
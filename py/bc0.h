@@ -59,6 +59,11 @@
 #define MP_BC_DELETE_NAME        (0x2a) // qstr
 #define MP_BC_DELETE_GLOBAL      (0x2b) // qstr
 
+// Superinstructions, fused from common sequences by the emitter (see
+// MICROPY_OPT_SUPERINSTRUCTIONS); .mpy files using them carry a feature flag.
+#define MP_BC_LOAD_FAST_2        (0x2c) // byte: local a in low nibble, local b in high nibble
+#define MP_BC_INC_FAST           (0x2d) // uint: local << 8 | op << 6 | (small int + 16)
+
 #define MP_BC_DUP_TOP            (0x30)
 #define MP_BC_DUP_TOP_TWO        (0x31)
 #define MP_BC_POP_TOP            (0x32)
@@ -70,6 +75,7 @@
 #define MP_BC_POP_JUMP_IF_FALSE  (0x37) // rel byte code offset, 16-bit signed, in excess
 #define MP_BC_JUMP_IF_TRUE_OR_POP    (0x38) // rel byte code offset, 16-bit signed, in excess
 #define MP_BC_JUMP_IF_FALSE_OR_POP   (0x39) // rel byte code offset, 16-bit signed, in excess
+#define MP_BC_COMPARE_JUMP       (0x3a) // rel byte code offset, 16-bit signed, in excess; then a byte
 #define MP_BC_SETUP_WITH         (0x3d) // rel byte code offset, 16-bit unsigned
 #define MP_BC_WITH_CLEANUP       (0x3e)
 #define MP_BC_SETUP_EXCEPT       (0x3f) // rel byte code offset, 16-bit unsigned
@@ -109,6 +115,30 @@
 #define MP_BC_IMPORT_FROM        (0x69) // qstr
 #define MP_BC_IMPORT_STAR        (0x6a)
 
+// Variants of the opcodes above specialised for the types of their operands.  The
+// VM rewrites an opcode in place to one of these (see MICROPY_OPT_QUICKEN) and back
+// again when the operands change type.  They never appear in compiled or saved code.
+#define MP_BC_BINARY_OP_INT_LESS            (0x00) // from BINARY_OP_MULTI + MP_BINARY_OP_LESS
+#define MP_BC_BINARY_OP_INT_MORE            (0x01)
+#define MP_BC_BINARY_OP_INT_LESS_EQUAL      (0x02)
+#define MP_BC_BINARY_OP_INT_MORE_EQUAL      (0x03)
+#define MP_BC_BINARY_OP_INT_ADD             (0x04)
+#define MP_BC_BINARY_OP_INT_SUBTRACT        (0x05)
+#define MP_BC_BINARY_OP_INT_INPLACE_ADD     (0x06)
+#define MP_BC_BINARY_OP_INT_INPLACE_SUBTRACT (0x07)
+#define MP_BC_BINARY_OP_FLOAT_ADD           (0x08)
+#define MP_BC_BINARY_OP_FLOAT_SUBTRACT      (0x09)
+#define MP_BC_BINARY_OP_FLOAT_MULTIPLY      (0x0a)
+#define MP_BC_BINARY_OP_FLOAT_TRUE_DIVIDE   (0x0b)
+#define MP_BC_BINARY_OP_FLOAT_INPLACE_ADD   (0x0c)
+#define MP_BC_BINARY_OP_FLOAT_INPLACE_SUBTRACT (0x0d)
+#define MP_BC_BINARY_OP_FLOAT_INPLACE_MULTIPLY (0x0e)
+#define MP_BC_BINARY_OP_FLOAT_INPLACE_TRUE_DIVIDE (0x0f)
+#define MP_BC_LOAD_SUBSCR_LIST_INT          (0x48) // from LOAD_SUBSCR
+#define MP_BC_LOAD_SUBSCR_BYTEARRAY_INT     (0x49)
+#define MP_BC_STORE_SUBSCR_LIST_INT         (0x4a) // from STORE_SUBSCR
+#define MP_BC_STORE_SUBSCR_BYTEARRAY_INT    (0x4b)
+
 #define MP_BC_LOAD_CONST_SMALL_INT_MULTI (0x70) // + N(64)
 #define MP_BC_LOAD_FAST_MULTI            (0xb0) // + N(16)
 #define MP_BC_STORE_FAST_MULTI           (0xc0) // + N(16)
@@ -36,6 +36,10 @@
 #include "py/builtin.h"
 #include "py/frozenmod.h"
 
+#if MICROPY_MULTIPYTHON_CODE_CACHE
+#include "extmod/modmultipython.h"
+#endif
+
 #if MICROPY_DEBUG_VERBOSE // print debugging info
 #define DEBUG_PRINT (1)
 #define DEBUG_printf DEBUG_printf
@@ -144,7 +148,7 @@ STATIC void do_load_from_lexer(mp_obj_t module_obj, mp_lexer_t *lex) {
 }
 #endif
 
-#if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_MODULE_FROZEN_MPY
+#if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_MODULE_FROZEN_MPY || MICROPY_MULTIPYTHON_CODE_CACHE
 STATIC void do_execute_raw_code(mp_obj_t module_obj, mp_raw_code_t *raw_code) {
     #if MICROPY_PY___FILE__
     // TODO
@@ -222,7 +226,35 @@ STATIC void do_load(mp_obj_t module_obj, vstr_t *file) {
     #endif
 
     // If we can compile scripts then load the file and compile and execute it.
-    #if MICROPY_ENABLE_COMPILER
+    #if MICROPY_ENABLE_COMPILER && MICROPY_MULTIPYTHON_CODE_CACHE
+    {
+        // the code may have been compiled from the same source by another context
+        // already. The qstr of the file name comes first, like when the lexer makes it
+        qstr source_name = qstr_from_str(file_str);
+        multipython_code_stamp_t stamp;
+        const mp_raw_code_t *raw_code = NULL;
+        if (multipython_code_cache_has(file_str)) {
+            multipython_code_stamp(file_str, &stamp);
+            raw_code = multipython_code_cache_get(file_str, &stamp);
+        }
+        if (raw_code == NULL) {
+            // the source is stamped as it is lexed, so a module that isn't in the
+            // cache is only read once
+            mp_reader_t reader;
+            mp_reader_new_file(&reader, file_str);
+            multipython_code_stamp_reader(&reader, &stamp);
+            mp_lexer_t *lex = mp_lexer_new(source_name, reader);
+            mp_parse_tree_t parse_tree = mp_parse(lex, MP_PARSE_FILE_INPUT);
+            raw_code = mp_compile_to_raw_code(&parse_tree, source_name, MP_EMIT_OPT_NONE, false);
+            raw_code = multipython_code_cache_put(file_str, &stamp, raw_code);
+        }
+        #if MICROPY_PY___FILE__
+        mp_store_attr(module_obj, MP_QSTR___file__, MP_OBJ_NEW_QSTR(source_name));
+        #endif
+        do_execute_raw_code(module_obj, (mp_raw_code_t*)raw_code);
+        return;
+    }
+    #elif MICROPY_ENABLE_COMPILER
     {
         mp_lexer_t *lex = mp_lexer_new_from_file(file_str);
         do_load_from_lexer(module_obj, lex);
@@ -39,6 +39,21 @@
 #define BYTES_FOR_INT ((BYTES_PER_WORD * 8 + 6) / 7)
 #define DUMMY_DATA_SIZE (BYTES_FOR_INT)
 
+#if MICROPY_OPT_SUPERINSTRUCTIONS
+// What the peephole optimiser remembers of an instruction that may start a sequence
+// it fuses; the arg of a binary op has EMIT_PEEP_INVERT set if a NOT was emitted after it
+#define EMIT_PEEP_LOAD_FAST (1)
+#define EMIT_PEEP_SMALL_INT (2)
+#define EMIT_PEEP_BINARY_OP (3)
+#define EMIT_PEEP_INVERT (0x100)
+
+typedef struct _emit_peep_t {
+    size_t offset;
+    mp_int_t arg;
+    byte kind;
+} emit_peep_t;
+#endif
+
 struct _emit_t {
     // Accessed as mp_obj_t, so must be aligned as such, and we rely on the
     // memory allocator returning a suitably aligned pointer.
@@ -70,6 +85,14 @@ struct _emit_t {
     uint16_t ct_cur_raw_code;
     #endif
     mp_uint_t *const_table;
+
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    // the last instructions emitted back to back, oldest first, with nothing since
+    // them if peep_end is the current offset
+    size_t peep_end;
+    size_t peep_len;
+    emit_peep_t peep[3];
+    #endif
 };
 
 emit_t *emit_bc_new(void) {
@@ -306,6 +329,40 @@ STATIC void emit_write_bytecode_byte_signed_label(emit_t *emit, byte b1, mp_uint
     c[2] = bytecode_offset >> 8;
 }
 
+#if MICROPY_OPT_SUPERINSTRUCTIONS
+// remember the instruction just written from offset, forgetting the others if
+// something else was written since them
+STATIC void emit_peep_record(emit_t *emit, size_t offset, byte kind, mp_int_t arg) {
+    if (emit->peep_end != offset) {
+        emit->peep_len = 0;
+    } else if (emit->peep_len == MP_ARRAY_SIZE(emit->peep)) {
+        memmove(&emit->peep[0], &emit->peep[1], sizeof(emit->peep) - sizeof(emit->peep[0]));
+        emit->peep_len -= 1;
+    }
+    emit_peep_t *p = &emit->peep[emit->peep_len++];
+    p->offset = offset;
+    p->arg = arg;
+    p->kind = kind;
+    emit->peep_end = emit->bytecode_offset;
+}
+
+// return the first of the last n instructions, if they were the last ones written
+// and the emitter is allowed to fuse them, and NULL otherwise
+STATIC emit_peep_t *emit_peep_last(emit_t *emit, size_t n) {
+    if (!MICROPY_OPT_SUPERINSTRUCTIONS_DYNAMIC
+        || emit->peep_len < n || emit->peep_end != emit->bytecode_offset) {
+        return NULL;
+    }
+    return &emit->peep[emit->peep_len - n];
+}
+
+// rewind over the instructions from p so a superinstruction can be written in their place
+STATIC void emit_peep_rewind(emit_t *emit, emit_peep_t *p) {
+    emit->bytecode_offset = p->offset;
+    emit->peep_len = 0;
+}
+#endif
+
 void mp_emit_bc_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scope) {
     emit->pass = pass;
     emit->stack_size = 0;
@@ -321,6 +378,9 @@ void mp_emit_bc_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scope) {
     #endif
     emit->bytecode_offset = 0;
     emit->code_info_offset = 0;
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    emit->peep_len = 0;
+    #endif
 
     // Write local state size and exception stack size.
     {
@@ -485,6 +545,10 @@ void mp_emit_bc_set_source_line(emit_t *emit, mp_uint_t source_line) {
         emit_write_code_info_bytes_lines(emit, bytes_to_skip, lines_to_skip);
         emit->last_source_line_offset = emit->bytecode_offset;
         emit->last_source_line = source_line;
+        #if MICROPY_OPT_SUPERINSTRUCTIONS
+        // instructions before the line change can't be fused with those after it
+        emit->peep_len = 0;
+        #endif
     }
 #else
     (void)emit;
@@ -498,6 +562,10 @@ void mp_emit_bc_label_assign(emit_t *emit, mp_uint_t l) {
         return;
     }
     assert(l < emit->max_num_labels);
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    // nothing is fused across a label, it may be jumped to
+    emit->peep_len = 0;
+    #endif
     if (emit->pass < MP_PASS_EMIT) {
         // assign label offset
         assert(emit->label_offsets[l] == (mp_uint_t)-1);
@@ -540,6 +608,9 @@ void mp_emit_bc_load_const_small_int(emit_t *emit, mp_int_t arg) {
     emit_bc_pre(emit, 1);
     if (-16 <= arg && arg <= 47) {
         emit_write_bytecode_byte(emit, MP_BC_LOAD_CONST_SMALL_INT_MULTI + 16 + arg);
+        #if MICROPY_OPT_SUPERINSTRUCTIONS
+        emit_peep_record(emit, emit->bytecode_offset - 1, EMIT_PEEP_SMALL_INT, arg);
+        #endif
     } else {
         emit_write_bytecode_byte_int(emit, MP_BC_LOAD_CONST_SMALL_INT, arg);
     }
@@ -565,11 +636,29 @@ void mp_emit_bc_load_local(emit_t *emit, qstr qst, mp_uint_t local_num, int kind
     MP_STATIC_ASSERT(MP_BC_LOAD_FAST_N + MP_EMIT_IDOP_LOCAL_DEREF == MP_BC_LOAD_DEREF);
     (void)qst;
     emit_bc_pre(emit, 1);
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    size_t offset = emit->bytecode_offset;
+    if (kind == MP_EMIT_IDOP_LOCAL_FAST && local_num <= 15) {
+        emit_peep_t *p = emit_peep_last(emit, 1);
+        if (p != NULL && p->kind == EMIT_PEEP_LOAD_FAST && p->arg <= 15) {
+            // LOAD_FAST a, LOAD_FAST b -> LOAD_FAST_2 a b
+            byte locals = p->arg | local_num << 4;
+            emit_peep_rewind(emit, p);
+            emit_write_bytecode_byte_byte(emit, MP_BC_LOAD_FAST_2, locals);
+            return;
+        }
+    }
+    #endif
     if (kind == MP_EMIT_IDOP_LOCAL_FAST && local_num <= 15) {
         emit_write_bytecode_byte(emit, MP_BC_LOAD_FAST_MULTI + local_num);
     } else {
         emit_write_bytecode_byte_uint(emit, MP_BC_LOAD_FAST_N + kind, local_num);
     }
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    if (kind == MP_EMIT_IDOP_LOCAL_FAST) {
+        emit_peep_record(emit, offset, EMIT_PEEP_LOAD_FAST, local_num);
+    }
+    #endif
 }
 
 void mp_emit_bc_load_global(emit_t *emit, qstr qst, int kind) {
@@ -629,6 +718,29 @@ void mp_emit_bc_store_local(emit_t *emit, qstr qst, mp_uint_t local_num, int kin
     MP_STATIC_ASSERT(MP_BC_STORE_FAST_N + MP_EMIT_IDOP_LOCAL_DEREF == MP_BC_STORE_DEREF);
     (void)qst;
     emit_bc_pre(emit, -1);
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    if (kind == MP_EMIT_IDOP_LOCAL_FAST) {
+        emit_peep_t *p = emit_peep_last(emit, 3);
+        if (p != NULL && p[0].kind == EMIT_PEEP_LOAD_FAST && (mp_uint_t)p[0].arg == local_num
+            && p[1].kind == EMIT_PEEP_SMALL_INT && p[2].kind == EMIT_PEEP_BINARY_OP) {
+            // LOAD_FAST n, LOAD_CONST_SMALL_INT k, BINARY_OP op, STORE_FAST n -> INC_FAST n op k
+            // with op one of +=, -=, +, -
+            mp_uint_t sel = 4;
+            switch (p[2].arg) {
+                case MP_BINARY_OP_INPLACE_ADD: sel = 0; break;
+                case MP_BINARY_OP_INPLACE_SUBTRACT: sel = 1; break;
+                case MP_BINARY_OP_ADD: sel = 2; break;
+                case MP_BINARY_OP_SUBTRACT: sel = 3; break;
+            }
+            if (sel < 4) {
+                mp_uint_t arg = local_num << 8 | sel << 6 | (p[1].arg + 16);
+                emit_peep_rewind(emit, p);
+                emit_write_bytecode_byte_uint(emit, MP_BC_INC_FAST, arg);
+                return;
+            }
+        }
+    }
+    #endif
     if (kind == MP_EMIT_IDOP_LOCAL_FAST && local_num <= 15) {
         emit_write_bytecode_byte(emit, MP_BC_STORE_FAST_MULTI + local_num);
     } else {
@@ -689,6 +801,22 @@ void mp_emit_bc_jump(emit_t *emit, mp_uint_t label) {
 
 void mp_emit_bc_pop_jump_if(emit_t *emit, bool cond, mp_uint_t label) {
     emit_bc_pre(emit, -1);
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    emit_peep_t *p = emit_peep_last(emit, 1);
+    if (p != NULL && p->kind == EMIT_PEEP_BINARY_OP
+        && (p->arg & ~EMIT_PEEP_INVERT) < MP_BINARY_OP_EXCEPTION_MATCH) {
+        // BINARY_OP op, POP_JUMP_IF_cond -> COMPARE_JUMP op cond, for the comparisons,
+        // in and is, where an inverted op (not in, is not) inverts the condition
+        mp_int_t op = p->arg;
+        if (op & EMIT_PEEP_INVERT) {
+            cond = !cond;
+        }
+        emit_peep_rewind(emit, p);
+        emit_write_bytecode_byte_signed_label(emit, MP_BC_COMPARE_JUMP, label);
+        emit_write_bytecode_byte(emit, (cond ? 0x80 : 0) | (op & ~EMIT_PEEP_INVERT));
+        return;
+    }
+    #endif
     if (cond) {
         emit_write_bytecode_byte_signed_label(emit, MP_BC_POP_JUMP_IF_TRUE, label);
     } else {
@@ -790,6 +918,9 @@ void mp_emit_bc_binary_op(emit_t *emit, mp_binary_op_t op) {
         emit_bc_pre(emit, 0);
         emit_write_bytecode_byte(emit, MP_BC_UNARY_OP_MULTI + MP_UNARY_OP_NOT);
     }
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    emit_peep_record(emit, emit->bytecode_offset - 1 - invert, EMIT_PEEP_BINARY_OP, op | (invert ? EMIT_PEEP_INVERT : 0));
+    #endif
 }
 
 void mp_emit_bc_build(emit_t *emit, mp_uint_t n_args, int kind) {
@@ -75,6 +75,12 @@ void mp_emit_glue_assign_bytecode(mp_raw_code_t *rc, const byte *code,
     rc->n_raw_code = n_raw_code;
     #endif
 
+    #if MICROPY_OPT_QUICKEN
+    // the code was made in RAM, so the VM can rewrite it
+    byte *prelude_flags = (byte*)mp_decode_uint_skip(mp_decode_uint_skip(code));
+    *prelude_flags |= MP_SCOPE_FLAG_QUICKEN;
+    #endif
+
 #ifdef DEBUG_PRINT
     #if !MICROPY_DEBUG_PRINTERS
     const size_t len = 0;
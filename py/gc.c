@@ -29,6 +29,8 @@
 #include <string.h>
 
 #include "py/gc.h"
+#include "py/mphal.h"
+#include "py/mpthread.h"
 #include "py/runtime.h"
 
 #if MICROPY_ENABLE_GC
@@ -74,26 +76,59 @@
 #define ATB_3_IS_FREE(a) (((a) & ATB_MASK_3) == 0)
 
 #define BLOCK_SHIFT(block) (2 * ((block) & (BLOCKS_PER_ATB - 1)))
-#define ATB_GET_KIND(block) ((MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
-#define ATB_ANY_TO_FREE(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
-#define ATB_FREE_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
-#define ATB_FREE_TO_TAIL(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
-#define ATB_HEAD_TO_MARK(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
-#define ATB_MARK_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
-
-#define BLOCK_FROM_PTR(ptr) (((byte*)(ptr) - MP_STATE_MEM(gc_pool_start)) / BYTES_PER_BLOCK)
-#define PTR_FROM_BLOCK(block) (((block) * BYTES_PER_BLOCK + (uintptr_t)MP_STATE_MEM(gc_pool_start)))
+#define ATB_GET_KIND(area, block) (((area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
+#define ATB_ANY_TO_FREE(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
+#define ATB_FREE_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
+#define ATB_FREE_TO_TAIL(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
+#define ATB_HEAD_TO_MARK(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
+#define ATB_MARK_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
+#if MICROPY_GC_INCREMENTAL
+// heads stay marked between the steps of an incremental collection
+#define ATB_IS_HEAD(area, block) (ATB_GET_KIND(area, block) == AT_HEAD || ATB_GET_KIND(area, block) == AT_MARK)
+#else
+#define ATB_IS_HEAD(area, block) (ATB_GET_KIND(area, block) == AT_HEAD)
+#endif
+
+#define BLOCK_FROM_PTR(area, ptr) (((byte*)(ptr) - (area)->gc_pool_start) / BYTES_PER_BLOCK)
+#define PTR_FROM_BLOCK(area, block) (((block) * BYTES_PER_BLOCK + (uintptr_t)(area)->gc_pool_start))
 #define ATB_FROM_BLOCK(bl) ((bl) / BLOCKS_PER_ATB)
 
+#if MICROPY_GC_SPLIT_HEAP
+#define NEXT_AREA(area) ((area)->next)
+#else
+#define NEXT_AREA(area) (NULL)
+#endif
+
 #if MICROPY_ENABLE_FINALISER
 // FTB = finaliser table byte
 // if set, then the corresponding block may have a finaliser
 
 #define BLOCKS_PER_FTB (8)
 
-#define FTB_GET(block) ((MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
-#define FTB_SET(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
-#define FTB_CLEAR(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
+#define FTB_GET(area, block) (((area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
+#define FTB_SET(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
+#define FTB_CLEAR(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+// DTB = dirty table byte
+// if set, then the corresponding marked block was written to or allocated during
+// the mark phase of an incremental collection, and its children must be checked
+// again when the mark phase ends
+
+#define BLOCKS_PER_DTB (8)
+
+#define DTB_SET(area, block) do { (area)->gc_dirty_table_start[(block) / BLOCKS_PER_DTB] |= (1 << ((block) & 7)); } while (0)
+
+// the marking of a step checks the time after this many blocks
+#define GC_INC_MARK_CHECK (32)
+// the sweeping of a step, or the going through the heap after the stack
+// overflowed, checks the time after about this many blocks
+#define GC_INC_CHUNK (256)
+#define GC_INC_NO_BUDGET ((mp_uint_t)-1)
+
+// identifies the running thread
+#define GC_INC_THIS_THREAD() ((void*)&MP_STATE_THREAD(stack_top))
 #endif
 
 #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
@@ -104,49 +139,110 @@
 #define GC_EXIT()
 #endif
 
+#if MICROPY_MULTIPYTHON_STATS
+// keep count of the blocks the context allocates and uses (must be called with the GC entered)
+#define GC_STATS_USE(n_blocks) do { \
+        MP_STATE_MEM(gc_alloc_blocks) += (n_blocks); \
+        MP_STATE_MEM(gc_used_blocks) += (n_blocks); \
+        if (MP_STATE_MEM(gc_used_blocks) > MP_STATE_MEM(gc_peak_blocks)) { \
+            MP_STATE_MEM(gc_peak_blocks) = MP_STATE_MEM(gc_used_blocks); \
+        } \
+    } while (0)
+#define GC_STATS_UNUSE(n_blocks) do { MP_STATE_MEM(gc_used_blocks) -= (n_blocks); } while (0)
+#else
+#define GC_STATS_USE(n_blocks)
+#define GC_STATS_UNUSE(n_blocks)
+#endif
+
 // TODO waste less memory; currently requires that all entries in alloc_table have a corresponding block in pool
-void gc_init(void *start, void *end) {
+STATIC void gc_setup_area(mp_state_mem_area_t *area, void *start, void *end) {
     // align end pointer on block boundary
     end = (void*)((uintptr_t)end & (~(BYTES_PER_BLOCK - 1)));
     DEBUG_printf("Initializing GC heap: %p..%p = " UINT_FMT " bytes\n", start, end, (byte*)end - (byte*)start);
 
-    // calculate parameters for GC (T=total, A=alloc table, F=finaliser table, P=pool; all in bytes):
-    // T = A + F + P
+    // calculate parameters for GC (T=total, A=alloc table, F=finaliser table, D=dirty table, P=pool; all in bytes):
+    // T = A + F + D + P
     //     F = A * BLOCKS_PER_ATB / BLOCKS_PER_FTB
+    //     D = A * BLOCKS_PER_ATB / BLOCKS_PER_DTB
     //     P = A * BLOCKS_PER_ATB * BYTES_PER_BLOCK
-    // => T = A * (1 + BLOCKS_PER_ATB / BLOCKS_PER_FTB + BLOCKS_PER_ATB * BYTES_PER_BLOCK)
+    // => T = A * (1 + BLOCKS_PER_ATB / BLOCKS_PER_FTB + BLOCKS_PER_ATB / BLOCKS_PER_DTB + BLOCKS_PER_ATB * BYTES_PER_BLOCK)
     size_t total_byte_len = (byte*)end - (byte*)start;
-#if MICROPY_ENABLE_FINALISER
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
+#if MICROPY_ENABLE_FINALISER && MICROPY_GC_INCREMENTAL
+    // leave a byte for the rounding up of both bit tables
+    area->gc_alloc_table_byte_len = (total_byte_len - 1) * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_DTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
+#elif MICROPY_ENABLE_FINALISER
+    area->gc_alloc_table_byte_len = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
+#elif MICROPY_GC_INCREMENTAL
+    area->gc_alloc_table_byte_len = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_DTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
 #else
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len / (1 + BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
+    area->gc_alloc_table_byte_len = total_byte_len / (1 + BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
 #endif
 
-    MP_STATE_MEM(gc_alloc_table_start) = (byte*)start;
+    area->gc_alloc_table_start = (byte*)start;
 
 #if MICROPY_ENABLE_FINALISER
-    size_t gc_finaliser_table_byte_len = (MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
-    MP_STATE_MEM(gc_finaliser_table_start) = MP_STATE_MEM(gc_alloc_table_start) + MP_STATE_MEM(gc_alloc_table_byte_len);
+    size_t gc_finaliser_table_byte_len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
+    area->gc_finaliser_table_start = area->gc_alloc_table_start + area->gc_alloc_table_byte_len;
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+    size_t gc_dirty_table_byte_len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_DTB - 1) / BLOCKS_PER_DTB;
+    #if MICROPY_ENABLE_FINALISER
+    area->gc_dirty_table_start = area->gc_finaliser_table_start + gc_finaliser_table_byte_len;
+    #else
+    area->gc_dirty_table_start = area->gc_alloc_table_start + area->gc_alloc_table_byte_len;
+    #endif
 #endif
 
-    size_t gc_pool_block_len = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
-    MP_STATE_MEM(gc_pool_start) = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
-    MP_STATE_MEM(gc_pool_end) = end;
+    size_t gc_pool_block_len = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    area->gc_pool_start = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
+    area->gc_pool_end = end;
 
 #if MICROPY_ENABLE_FINALISER
-    assert(MP_STATE_MEM(gc_pool_start) >= MP_STATE_MEM(gc_finaliser_table_start) + gc_finaliser_table_byte_len);
+    assert(area->gc_pool_start >= area->gc_finaliser_table_start + gc_finaliser_table_byte_len);
+#endif
+#if MICROPY_GC_INCREMENTAL
+    assert(area->gc_pool_start >= area->gc_dirty_table_start + gc_dirty_table_byte_len);
 #endif
 
     // clear ATBs
-    memset(MP_STATE_MEM(gc_alloc_table_start), 0, MP_STATE_MEM(gc_alloc_table_byte_len));
+    memset(area->gc_alloc_table_start, 0, area->gc_alloc_table_byte_len);
 
 #if MICROPY_ENABLE_FINALISER
     // clear FTBs
-    memset(MP_STATE_MEM(gc_finaliser_table_start), 0, gc_finaliser_table_byte_len);
+    memset(area->gc_finaliser_table_start, 0, gc_finaliser_table_byte_len);
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+    // clear DTBs
+    memset(area->gc_dirty_table_start, 0, gc_dirty_table_byte_len);
 #endif
 
     // set last free ATB index to start of heap
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    area->gc_last_free_atb_index = 0;
+
+    #if MICROPY_GC_LARGE_BLOCKS
+    // large allocations start looking from the end of the heap
+    area->gc_large_free_block = gc_pool_block_len;
+    #endif
+
+    #if MICROPY_GC_SPLIT_HEAP
+    area->next = NULL;
+    #endif
+
+    DEBUG_printf("GC layout:\n");
+    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_alloc_table_start, area->gc_alloc_table_byte_len, area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+#if MICROPY_ENABLE_FINALISER
+    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_finaliser_table_start, gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
+#endif
+#if MICROPY_GC_INCREMENTAL
+    DEBUG_printf("  dirty table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_dirty_table_start, gc_dirty_table_byte_len, gc_dirty_table_byte_len * BLOCKS_PER_DTB);
+#endif
+    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_pool_start, gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+}
+
+void gc_init(void *start, void *end) {
+    gc_setup_area(&MP_STATE_MEM(area), start, end);
 
     // unlock the GC
     MP_STATE_MEM(gc_lock_depth) = 0;
@@ -160,18 +256,101 @@ void gc_init(void *start, void *end) {
     MP_STATE_MEM(gc_alloc_amount) = 0;
     #endif
 
+    #if MICROPY_GC_SPLIT_HEAP
+    // the heap doesn't grow unless asked to
+    MP_STATE_MEM(gc_heap_grow_limit) = 0;
+    #endif
+
+    #if MICROPY_MULTIPYTHON_STATS
+    MP_STATE_MEM(gc_used_blocks) = 0;
+    MP_STATE_MEM(gc_peak_blocks) = 0;
+    MP_STATE_MEM(gc_alloc_blocks) = 0;
+    MP_STATE_MEM(gc_collections) = 0;
+    MP_STATE_MEM(gc_collect_us) = 0;
+    #endif
+
+    #if MICROPY_GC_SIZE_CLASSES
+    memset(MP_STATE_MEM(gc_free_list_len), 0, sizeof(MP_STATE_MEM(gc_free_list_len)));
+    #endif
+
+    #if MICROPY_GC_MARK_THREADS
+    MP_STATE_MEM(gc_mark_parallel) = 0;
+    #endif
+
+    #if MICROPY_GC_INCREMENTAL
+    MP_STATE_MEM(gc_inc_phase) = GC_INC_PHASE_IDLE;
+    MP_STATE_MEM(gc_inc_rescan) = 0;
+    MP_STATE_MEM(gc_inc_finisher) = NULL;
+    memset(MP_STATE_MEM(gc_pause_hist), 0, sizeof(MP_STATE_MEM(gc_pause_hist)));
+    #endif
+
     #if MICROPY_PY_THREAD
     mp_thread_mutex_init(&MP_STATE_MEM(gc_mutex));
     #endif
+}
 
-    DEBUG_printf("GC layout:\n");
-    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_alloc_table_start), MP_STATE_MEM(gc_alloc_table_byte_len), MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-#if MICROPY_ENABLE_FINALISER
-    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_finaliser_table_start), gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
-#endif
-    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_pool_start), gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+#if MICROPY_GC_SPLIT_HEAP
+// The area structure is placed at the start of the memory it describes.
+// Must be called with the GC entered.
+STATIC void gc_add_area(void *start, void *end) {
+    mp_state_mem_area_t *area = (mp_state_mem_area_t*)start;
+    start = (byte*)start + sizeof(mp_state_mem_area_t);
+    gc_setup_area(area, start, end);
+
+    // the new area goes last, so earlier areas are searched first
+    mp_state_mem_area_t *prev = &MP_STATE_MEM(area);
+    while (prev->next != NULL) {
+        prev = prev->next;
+    }
+    prev->next = area;
+}
+
+void gc_add(void *start, void *end) {
+    GC_ENTER();
+    gc_add_area(start, end);
+    GC_EXIT();
 }
 
+void gc_set_grow_limit(size_t limit) {
+    GC_ENTER();
+    MP_STATE_MEM(gc_heap_grow_limit) = limit;
+    GC_EXIT();
+}
+
+// Try to add a region that can hold an allocation of n_bytes. Regions are at
+// least as big as the first one so the heap doesn't grow in small steps.
+// Must be called with the GC entered.
+STATIC bool gc_try_add_heap(size_t n_bytes) {
+    mp_context_node_t *context = mp_active_contexts[MICROPY_GET_CORE_INDEX];
+    if (context == NULL) {
+        return false;
+    }
+
+    // the tables take less than a byte per block; also leave room for the
+    // area structure and for aligning both ends of the pool
+    size_t needed = n_bytes + n_bytes / BYTES_PER_BLOCK + sizeof(mp_state_mem_area_t) + 2 * BYTES_PER_BLOCK;
+    size_t size = MP_STATE_MEM(area).gc_pool_end - MP_STATE_MEM(area).gc_alloc_table_start;
+    if (size < needed) {
+        size = needed;
+    }
+    if (size > MP_STATE_MEM(gc_heap_grow_limit)) {
+        size = MP_STATE_MEM(gc_heap_grow_limit);
+    }
+    if (size < needed) {
+        return false;
+    }
+
+    void *start = mp_context_dynmem_alloc(size, context);
+    if (start == NULL) {
+        return false;
+    }
+    MP_STATE_MEM(gc_heap_grow_limit) -= size;
+    DEBUG_printf("gc_alloc(" UINT_FMT "): adding " UINT_FMT " bytes to the heap\n", n_bytes, size);
+    gc_add_area(start, (byte*)start + size);
+    return true;
+}
+#endif
+
 void gc_lock(void) {
     GC_ENTER();
     MP_STATE_MEM(gc_lock_depth)++;
@@ -189,12 +368,28 @@ bool gc_is_locked(void) {
 }
 
 // ptr should be of type void*
-#define VERIFY_PTR(ptr) ( \
+#define VERIFY_PTR_IN_AREA(area, ptr) ( \
         ((uintptr_t)(ptr) & (BYTES_PER_BLOCK - 1)) == 0      /* must be aligned on a block */ \
-        && ptr >= (void*)MP_STATE_MEM(gc_pool_start)     /* must be above start of pool */ \
-        && ptr < (void*)MP_STATE_MEM(gc_pool_end)        /* must be below end of pool */ \
+        && ptr >= (void*)(area)->gc_pool_start     /* must be above start of pool */ \
+        && ptr < (void*)(area)->gc_pool_end        /* must be below end of pool */ \
     )
 
+// returns the heap area, of first and those after it, that ptr points into, or
+// NULL if it's not a heap pointer
+static inline mp_state_mem_area_t *gc_find_ptr_area(mp_state_mem_area_t *first, const void *ptr) {
+    for (mp_state_mem_area_t *area = first; area != NULL; area = NEXT_AREA(area)) {
+        if (VERIFY_PTR_IN_AREA(area, ptr)) {
+            return area;
+        }
+    }
+    return NULL;
+}
+
+// returns the heap area that ptr points into, or NULL if it's not a heap pointer
+static inline mp_state_mem_area_t *gc_get_ptr_area(const void *ptr) {
+    return gc_find_ptr_area(&MP_STATE_MEM(area), ptr);
+}
+
 #ifndef TRACE_MARK
 #if DEBUG_PRINT
 #define TRACE_MARK(block, ptr) DEBUG_printf("gc_mark(%p)\n", ptr)
@@ -203,39 +398,57 @@ bool gc_is_locked(void) {
 #endif
 #endif
 
+// If ptr points to an unmarked head, mark it and push it on the gc stack,
+// whose top is sp. Returns the new top of the stack.
+static inline size_t gc_mark_ptr(void *ptr, size_t sp) {
+    mp_state_mem_area_t *ptr_area = gc_get_ptr_area(ptr);
+    if (ptr_area != NULL) {
+        // Mark and push this pointer
+        size_t childblock = BLOCK_FROM_PTR(ptr_area, ptr);
+        if (ATB_GET_KIND(ptr_area, childblock) == AT_HEAD) {
+            // an unmarked head, mark it, and push it on gc stack
+            TRACE_MARK(childblock, ptr);
+            ATB_HEAD_TO_MARK(ptr_area, childblock);
+            if (sp < MICROPY_ALLOC_GC_STACK_SIZE) {
+                #if MICROPY_GC_SPLIT_HEAP
+                MP_STATE_MEM(gc_area_stack)[sp] = ptr_area;
+                #endif
+                MP_STATE_MEM(gc_stack)[sp++] = childblock;
+            } else {
+                MP_STATE_MEM(gc_stack_overflow) = 1;
+            }
+        }
+    }
+    return sp;
+}
+
+// Check all the children of the given block: mark the unmarked child blocks
+// and put those newly marked blocks on the stack. Returns the new top of the
+// stack.
+static inline size_t gc_mark_children(mp_state_mem_area_t *area, size_t block, size_t sp) {
+    // work out number of consecutive blocks in the chain starting with this one
+    size_t n_blocks = 0;
+    do {
+        n_blocks += 1;
+    } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
+
+    // check this block's children
+    void **ptrs = (void**)PTR_FROM_BLOCK(area, block);
+    for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void*); i > 0; i--, ptrs++) {
+        sp = gc_mark_ptr(*ptrs, sp);
+    }
+    return sp;
+}
+
 // Take the given block as the topmost block on the stack. Check all it's
 // children: mark the unmarked child blocks and put those newly marked
 // blocks on the stack. When all children have been checked, pop off the
 // topmost block on the stack and repeat with that one.
-STATIC void gc_mark_subtree(size_t block) {
+STATIC void gc_mark_subtree(mp_state_mem_area_t *area, size_t block) {
     // Start with the block passed in the argument.
     size_t sp = 0;
     for (;;) {
-        // work out number of consecutive blocks in the chain starting with this one
-        size_t n_blocks = 0;
-        do {
-            n_blocks += 1;
-        } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
-
-        // check this block's children
-        void **ptrs = (void**)PTR_FROM_BLOCK(block);
-        for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void*); i > 0; i--, ptrs++) {
-            void *ptr = *ptrs;
-            if (VERIFY_PTR(ptr)) {
-                // Mark and push this pointer
-                size_t childblock = BLOCK_FROM_PTR(ptr);
-                if (ATB_GET_KIND(childblock) == AT_HEAD) {
-                    // an unmarked head, mark it, and push it on gc stack
-                    TRACE_MARK(childblock, ptr);
-                    ATB_HEAD_TO_MARK(childblock);
-                    if (sp < MICROPY_ALLOC_GC_STACK_SIZE) {
-                        MP_STATE_MEM(gc_stack)[sp++] = childblock;
-                    } else {
-                        MP_STATE_MEM(gc_stack_overflow) = 1;
-                    }
-                }
-            }
-        }
+        sp = gc_mark_children(area, block, sp);
 
         // Are there any blocks on the stack?
         if (sp == 0) {
@@ -244,6 +457,9 @@ STATIC void gc_mark_subtree(size_t block) {
 
         // pop the next block off the stack
         block = MP_STATE_MEM(gc_stack)[--sp];
+        #if MICROPY_GC_SPLIT_HEAP
+        area = MP_STATE_MEM(gc_area_stack)[sp];
+        #endif
     }
 }
 
@@ -252,27 +468,336 @@ STATIC void gc_deal_with_stack_overflow(void) {
         MP_STATE_MEM(gc_stack_overflow) = 0;
 
         // scan entire memory looking for blocks which have been marked but not their children
-        for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-            // trace (again) if mark bit set
-            if (ATB_GET_KIND(block) == AT_MARK) {
-                gc_mark_subtree(block);
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            for (size_t block = 0; block < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; block++) {
+                // trace (again) if mark bit set
+                if (ATB_GET_KIND(area, block) == AT_MARK) {
+                    gc_mark_subtree(area, block);
+                }
             }
         }
     }
 }
 
-STATIC void gc_sweep(void) {
-    #if MICROPY_PY_GC_COLLECT_RETVAL
-    MP_STATE_MEM(gc_collected) = 0;
-    #endif
-    // free unmarked heads and their tails
+#if MICROPY_GC_MARK_THREADS
+// a marked block whose children are still to be checked, in the parallel mark phase
+typedef struct _gc_mark_entry_t {
+    mp_state_mem_area_t *area;
+    size_t block;
+} gc_mark_entry_t;
+
+// number of blocks the pool shared by the mark threads holds
+#define GC_MARK_POOL_SIZE (1024)
+// most blocks a mark thread takes from the pool at once, onto its empty stack
+#define GC_MARK_TAKE (MIN(16, MICROPY_ALLOC_GC_STACK_SIZE))
+
+// The blocks the threads marking in parallel share. The roots are marked and put
+// here by the collecting thread before the mark phase; then each thread checks
+// the children of blocks it takes from here on a stack of its own, giving half
+// of that stack back when another thread has run out. There is one pool for
+// all the contexts: a collection that finds it claimed by another marks alone.
+STATIC struct {
+    bool claimed;
+    bool no_helpers;            // the port has no threads to help, so it isn't worth claiming
+    bool lock;                  // spinlock for the fields below
+    bool overflow;              // a block didn't fit on a stack or in the pool
+    uint8_t busy;               // threads that have blocks to check
+    uint8_t waiting;            // threads that have run out and wait for more
+    size_t len;
+    gc_mark_entry_t pool[GC_MARK_POOL_SIZE];
+} gc_mark_shared;
+
+STATIC void gc_mark_lock(void) {
+    while (__atomic_test_and_set(&gc_mark_shared.lock, __ATOMIC_ACQUIRE)) {
+    }
+}
+
+STATIC void gc_mark_unlock(void) {
+    __atomic_clear(&gc_mark_shared.lock, __ATOMIC_RELEASE);
+}
+
+// Claim the pool for the collection the calling thread is starting. Returns
+// false if another collection has it, or there are no threads to help.
+STATIC bool gc_mark_claim(void) {
+    if (__atomic_test_and_set(&gc_mark_shared.claimed, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    if (gc_mark_shared.no_helpers) {
+        __atomic_clear(&gc_mark_shared.claimed, __ATOMIC_RELEASE);
+        return false;
+    }
+    gc_mark_shared.overflow = false;
+    gc_mark_shared.busy = 0;
+    gc_mark_shared.waiting = 0;
+    gc_mark_shared.len = 0;
+    return true;
+}
+
+// Move up to n blocks from the bottom of stack, whose top is sp, to the pool.
+// Returns the new top of the stack.
+STATIC size_t gc_mark_give(gc_mark_entry_t *stack, size_t sp, size_t n) {
+    gc_mark_lock();
+    n = MIN(n, GC_MARK_POOL_SIZE - gc_mark_shared.len);
+    memcpy(&gc_mark_shared.pool[gc_mark_shared.len], stack, n * sizeof(gc_mark_entry_t));
+    gc_mark_shared.len += n;
+    gc_mark_unlock();
+    memmove(stack, stack + n, (sp - n) * sizeof(gc_mark_entry_t));
+    return sp - n;
+}
+
+// Take blocks from the pool to stack, for a thread that has none left, waiting
+// for other threads to give some. Returns how many were taken, or 0 when all
+// the threads have run out and the heap is marked.
+STATIC size_t gc_mark_take(gc_mark_entry_t *stack) {
+    gc_mark_lock();
+    gc_mark_shared.busy--;
+    gc_mark_shared.waiting++;
+    for (;;) {
+        size_t n = MIN(gc_mark_shared.len, GC_MARK_TAKE);
+        if (n > 0) {
+            gc_mark_shared.len -= n;
+            memcpy(stack, &gc_mark_shared.pool[gc_mark_shared.len], n * sizeof(gc_mark_entry_t));
+            gc_mark_shared.busy++;
+            gc_mark_shared.waiting--;
+            gc_mark_unlock();
+            return n;
+        }
+        if (gc_mark_shared.busy == 0) {
+            // nobody has blocks left to give
+            gc_mark_unlock();
+            return 0;
+        }
+        gc_mark_unlock();
+        while (__atomic_load_n(&gc_mark_shared.len, __ATOMIC_RELAXED) == 0
+               && __atomic_load_n(&gc_mark_shared.busy, __ATOMIC_RELAXED) > 0) {
+        }
+        gc_mark_lock();
+    }
+}
+
+// As gc_mark_ptr, for a thread marking in parallel: the mark bit is set
+// atomically, so the children of each block are checked by one thread only.
+// When stack is full, half of it is given to the pool.
+static inline size_t gc_mark_ptr_shared(mp_state_mem_area_t *first, void *ptr, gc_mark_entry_t *stack, size_t sp) {
+    mp_state_mem_area_t *area = gc_find_ptr_area(first, ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        byte *atb = &area->gc_alloc_table_start[block / BLOCKS_PER_ATB];
+        if (((__atomic_load_n(atb, __ATOMIC_RELAXED) >> BLOCK_SHIFT(block)) & 3) == AT_HEAD
+            && (__atomic_fetch_or(atb, AT_MARK << BLOCK_SHIFT(block), __ATOMIC_RELAXED) & (AT_TAIL << BLOCK_SHIFT(block))) == 0) {
+            // this thread turned the head into a mark
+            if (sp == MICROPY_ALLOC_GC_STACK_SIZE) {
+                sp = gc_mark_give(stack, sp, sp / 2);
+            }
+            if (sp < MICROPY_ALLOC_GC_STACK_SIZE) {
+                stack[sp].area = area;
+                stack[sp++].block = block;
+            } else {
+                __atomic_store_n(&gc_mark_shared.overflow, true, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    return sp;
+}
+
+// Run by the collecting thread and by each of the port's helper threads, with
+// the memory state of the context collecting: check the children of the blocks
+// in the pool and of those marked on the way, until all the threads run out.
+STATIC void gc_mark_shared_run(void *mem) {
+    mp_state_mem_area_t *first = &((mp_state_mem_t*)mem)->area;
+    gc_mark_entry_t stack[MICROPY_ALLOC_GC_STACK_SIZE];
+    size_t sp = 0;
+    gc_mark_lock();
+    gc_mark_shared.busy++;
+    gc_mark_unlock();
+    for (;;) {
+        if (sp == 0) {
+            sp = gc_mark_take(stack);
+            if (sp == 0) {
+                break;
+            }
+        }
+        mp_state_mem_area_t *area = stack[--sp].area;
+        size_t block = stack[sp].block;
+
+        // a tail stays one while the heap is marked, so the blocks of the chain
+        // only change in their mark bits
+        size_t n_blocks = 0;
+        do {
+            n_blocks += 1;
+        } while (((__atomic_load_n(&area->gc_alloc_table_start[(block + n_blocks) / BLOCKS_PER_ATB], __ATOMIC_RELAXED)
+                   >> BLOCK_SHIFT(block + n_blocks)) & 3) == AT_TAIL);
+
+        void **ptrs = (void**)PTR_FROM_BLOCK(area, block);
+        for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void*); i > 0; i--, ptrs++) {
+            sp = gc_mark_ptr_shared(first, *ptrs, stack, sp);
+        }
+
+        if (sp > 1 && __atomic_load_n(&gc_mark_shared.waiting, __ATOMIC_RELAXED) > 0
+            && __atomic_load_n(&gc_mark_shared.len, __ATOMIC_RELAXED) == 0) {
+            sp = gc_mark_give(stack, sp, sp / 2);
+        }
+    }
+}
+
+// Mark the heap from the blocks in the pool, with the helper threads of the port.
+STATIC void gc_mark_parallel(void) {
+    if (mp_thread_gc_helpers_start(gc_mark_shared_run, &MP_STATE_PTR->mem) == 0) {
+        gc_mark_shared.no_helpers = true;
+    }
+    gc_mark_shared_run(&MP_STATE_PTR->mem);
+    mp_thread_gc_helpers_wait();
+    if (gc_mark_shared.overflow) {
+        MP_STATE_MEM(gc_stack_overflow) = 1;
+    }
+    MP_STATE_MEM(gc_mark_parallel) = 0;
+    __atomic_clear(&gc_mark_shared.claimed, __ATOMIC_RELEASE);
+}
+
+// Put a block the roots point to in the pool, for the mark threads to check its
+// children. Returns false if the pool is full.
+static inline bool gc_mark_defer(mp_state_mem_area_t *area, size_t block) {
+    if (gc_mark_shared.len == GC_MARK_POOL_SIZE) {
+        return false;
+    }
+    gc_mark_shared.pool[gc_mark_shared.len].area = area;
+    gc_mark_shared.pool[gc_mark_shared.len++].block = block;
+    return true;
+}
+#endif
+
+#if MICROPY_GC_SIZE_CLASSES
+// the free list of runs of n free blocks, for 2 <= n <= MICROPY_GC_SIZE_CLASSES
+#define FREE_LIST(n) (MP_STATE_MEM(gc_free_list)[(n) - 2])
+#define FREE_LIST_LEN(n) (MP_STATE_MEM(gc_free_list_len)[(n) - 2])
+
+// Remember the run of n_blocks free blocks starting at block, if it's longer
+// than one block and the free list of its size class has room. The last class
+// takes the longer runs as well.
+static inline void gc_free_list_add(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    if (n_blocks < 2) {
+        return;
+    }
+    size_t n = MIN(n_blocks, MICROPY_GC_SIZE_CLASSES);
+    uint8_t *len = &FREE_LIST_LEN(n);
+    if (*len < MICROPY_GC_FREE_LIST_LEN) {
+        FREE_LIST(n)[(*len)++] = (void*)PTR_FROM_BLOCK(area, block);
+    }
+}
+
+// Take a run of n_blocks free blocks from the free list of that size class, or
+// split one from a larger class and put the rest back, so small objects are
+// allocated one after the other from a long run. Blocks are allocated by
+// searching the allocation table too, so the blocks taken are checked to be
+// still free. Returns false if none are found.
+STATIC bool gc_free_list_take(size_t n_blocks, mp_state_mem_area_t **area_out, size_t *block_out) {
+    for (size_t n = n_blocks; n <= MICROPY_GC_SIZE_CLASSES; n++) {
+        uint8_t *len = &FREE_LIST_LEN(n);
+        while (*len > 0) {
+            void *ptr = FREE_LIST(n)[--(*len)];
+            mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+            size_t block = BLOCK_FROM_PTR(area, ptr);
+            size_t n_total = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+            size_t end = MIN(block + n_blocks, n_total);
+            size_t bl = block;
+            while (bl < end && ATB_GET_KIND(area, bl) == AT_FREE) {
+                bl++;
+            }
+            if (bl == block + n_blocks) {
+                if (n == MICROPY_GC_SIZE_CLASSES) {
+                    // the run may be longer than the class; what is left of it
+                    // goes back, to be checked when it's next taken
+                    if (bl < n_total) {
+                        FREE_LIST(n)[(*len)++] = (void*)PTR_FROM_BLOCK(area, bl);
+                    }
+                } else if (n > n_blocks) {
+                    gc_free_list_add(area, block + n_blocks, n - n_blocks);
+                }
+                *area_out = area;
+                *block_out = block;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// The sweep adds runs to the free lists in address order. Turn them round, so
+// the lowest runs are taken first and the heap fills from the bottom up.
+STATIC void gc_free_list_reverse(void) {
+    for (size_t n = 2; n <= MICROPY_GC_SIZE_CLASSES; n++) {
+        void **list = FREE_LIST(n);
+        for (size_t i = 0, j = FREE_LIST_LEN(n); i + 1 < j; i++, j--) {
+            void *ptr = list[i];
+            list[i] = list[j - 1];
+            list[j - 1] = ptr;
+        }
+    }
+}
+#endif
+
+#if MICROPY_GC_LARGE_BLOCKS
+// Look down from block end to block start of the area for a run of n_blocks
+// free blocks, setting block to its start. Returns false if there isn't one.
+// Each place the run could end is checked from its first block up, so that a
+// block in use moves the search to below it without looking at the blocks
+// skipped.
+STATIC bool gc_find_large_between(mp_state_mem_area_t *area, size_t start, size_t end, size_t n_blocks, size_t *block) {
+    while (end >= start + n_blocks) {
+        size_t bl = end - n_blocks;
+        while (bl < end && ATB_GET_KIND(area, bl) == AT_FREE) {
+            bl++;
+        }
+        if (bl == end) {
+            *block = end - n_blocks;
+            return true;
+        }
+        end = bl;
+    }
+    return false;
+}
+
+// Find a run of n_blocks free blocks for a large allocation, looking down from
+// where the last one was made, and then from the top of the area for the blocks
+// freed since.
+STATIC bool gc_find_large(mp_state_mem_area_t *area, size_t n_blocks, size_t *block) {
+    size_t top = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    size_t last = area->gc_large_free_block;
+    if (gc_find_large_between(area, 0, last, n_blocks, block)
+        || (last < top && gc_find_large_between(area, last > n_blocks ? last - n_blocks : 0, top, n_blocks, block))) {
+        area->gc_large_free_block = *block;
+        return true;
+    }
+    return false;
+}
+#endif
+
+// Blocks may have been freed anywhere in the heap, so searches for free blocks
+// must start from the ends of the areas again.
+STATIC void gc_reset_search(void) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        area->gc_last_free_atb_index = 0;
+        #if MICROPY_GC_LARGE_BLOCKS
+        area->gc_large_free_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        #endif
+    }
+}
+
+// Free the unmarked heads in blocks block..end-1 of the area, and their tails.
+// A tail at the first block is kept, its head having been swept already.
+// The runs of free blocks found on the way go on the free lists.
+STATIC void gc_sweep_blocks(mp_state_mem_area_t *area, size_t block, size_t end) {
     int free_tail = 0;
-    for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-        switch (ATB_GET_KIND(block)) {
+    #if MICROPY_GC_SIZE_CLASSES
+    // where the run of free blocks that the sweep is in started
+    size_t run = block;
+    #endif
+    for (; block < end; block++) {
+        switch (ATB_GET_KIND(area, block)) {
             case AT_HEAD:
 #if MICROPY_ENABLE_FINALISER
-                if (FTB_GET(block)) {
-                    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(block);
+                if (FTB_GET(area, block)) {
+                    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(area, block);
                     if (obj->type != NULL) {
                         // if the object has a type then see if it has a __del__ method
                         mp_obj_t dest[2];
@@ -289,11 +814,11 @@ STATIC void gc_sweep(void) {
                         }
                     }
                     // clear finaliser flag
-                    FTB_CLEAR(block);
+                    FTB_CLEAR(area, block);
                 }
 #endif
                 free_tail = 1;
-                DEBUG_printf("gc_sweep(%p)\n", PTR_FROM_BLOCK(block));
+                DEBUG_printf("gc_sweep(%p)\n", (void*)PTR_FROM_BLOCK(area, block));
                 #if MICROPY_PY_GC_COLLECT_RETVAL
                 MP_STATE_MEM(gc_collected)++;
                 #endif
@@ -301,36 +826,315 @@ STATIC void gc_sweep(void) {
 
             case AT_TAIL:
                 if (free_tail) {
-                    ATB_ANY_TO_FREE(block);
+                    ATB_ANY_TO_FREE(area, block);
+                    GC_STATS_UNUSE(1);
                     #if CLEAR_ON_SWEEP
-                    memset((void*)PTR_FROM_BLOCK(block), 0, BYTES_PER_BLOCK);
+                    memset((void*)PTR_FROM_BLOCK(area, block), 0, BYTES_PER_BLOCK);
                     #endif
+                    break;
                 }
+                #if MICROPY_GC_SIZE_CLASSES
+                gc_free_list_add(area, run, block - run);
+                run = block + 1;
+                #endif
                 break;
 
             case AT_MARK:
-                ATB_MARK_TO_HEAD(block);
+                ATB_MARK_TO_HEAD(area, block);
                 free_tail = 0;
+                #if MICROPY_GC_SIZE_CLASSES
+                gc_free_list_add(area, run, block - run);
+                run = block + 1;
+                #endif
                 break;
         }
     }
+    #if MICROPY_GC_SIZE_CLASSES
+    gc_free_list_add(area, run, block - run);
+    #endif
 }
 
+STATIC void gc_sweep(void) {
+    #if MICROPY_PY_GC_COLLECT_RETVAL
+    MP_STATE_MEM(gc_collected) = 0;
+    #endif
+    #if MICROPY_GC_SIZE_CLASSES
+    // the sweep finds all the free runs again
+    memset(MP_STATE_MEM(gc_free_list_len), 0, sizeof(MP_STATE_MEM(gc_free_list_len)));
+    #endif
+    // free unmarked heads and their tails
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        gc_sweep_blocks(area, 0, area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+    }
+    #if MICROPY_GC_SIZE_CLASSES
+    gc_free_list_reverse();
+    #endif
+}
+
+// The root pointers: nlr_top, dict_locals, dict_globals, then the root pointer
+// section of mp_state_vm. This relies on them being organised correctly in the
+// mp_state_ctx structure.
+#define GC_ROOT_START (offsetof(mp_state_ctx_t, thread.dict_locals))
+#define GC_ROOT_END (offsetof(mp_state_ctx_t, vm.qstr_last_chunk))
+
+#if MICROPY_GC_INCREMENTAL
+
+STATIC void gc_record_pause(mp_uint_t pause_us) {
+    size_t i = 0;
+    while (i < MICROPY_GC_PAUSE_BUCKETS - 1 && pause_us >= ((mp_uint_t)64 << i)) {
+        i++;
+    }
+    MP_STATE_MEM(gc_pause_hist)[i]++;
+}
+
+// Start the mark phase of an incremental collection: mark the blocks the root
+// pointers point to and leave them on the stack for the steps to come. The
+// stacks of the threads are only traced when the mark phase ends.
+STATIC void gc_inc_start(void) {
+    MP_STATE_MEM(gc_stack_overflow) = 0;
+    void **ptrs = (void**)(void*)MP_STATE_PTR;
+    size_t sp = 0;
+    for (size_t i = GC_ROOT_START / sizeof(void*); i < GC_ROOT_END / sizeof(void*); i++) {
+        sp = gc_mark_ptr(ptrs[i], sp);
+    }
+    MP_STATE_MEM(gc_inc_sp) = sp;
+    MP_STATE_MEM(gc_inc_scan_area) = NULL;
+    MP_STATE_MEM(gc_inc_phase) = GC_INC_PHASE_MARK;
+}
+
+// Check the children of the blocks on the stack of the mark phase until there
+// is nothing left to mark, or budget_us has passed since start_us. Returns true
+// if nothing is left to mark.
+STATIC bool gc_inc_mark(mp_uint_t start_us, mp_uint_t budget_us) {
+    size_t sp = MP_STATE_MEM(gc_inc_sp);
+    for (size_t n = 1;; n++) {
+        if (sp > 0) {
+            size_t block = MP_STATE_MEM(gc_stack)[--sp];
+            #if MICROPY_GC_SPLIT_HEAP
+            mp_state_mem_area_t *area = MP_STATE_MEM(gc_area_stack)[sp];
+            #else
+            mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+            #endif
+            sp = gc_mark_children(area, block, sp);
+        } else if (MP_STATE_MEM(gc_inc_scan_area) != NULL) {
+            // As gc_deal_with_stack_overflow does, but a chunk at a time: check
+            // the children of the marked blocks of the heap again.
+            mp_state_mem_area_t *area = MP_STATE_MEM(gc_inc_scan_area);
+            size_t block = MP_STATE_MEM(gc_inc_scan_block);
+            size_t n_blocks = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+            for (size_t end = MIN(block + GC_INC_CHUNK, n_blocks); block < end; block++) {
+                if (ATB_GET_KIND(area, block) == AT_MARK) {
+                    sp = gc_mark_children(area, block, sp);
+                }
+            }
+            if (block == n_blocks) {
+                area = NEXT_AREA(area);
+                block = 0;
+            }
+            MP_STATE_MEM(gc_inc_scan_area) = area;
+            MP_STATE_MEM(gc_inc_scan_block) = block;
+            n = 0;
+        } else if (MP_STATE_MEM(gc_stack_overflow)) {
+            MP_STATE_MEM(gc_stack_overflow) = 0;
+            MP_STATE_MEM(gc_inc_scan_area) = &MP_STATE_MEM(area);
+            MP_STATE_MEM(gc_inc_scan_block) = 0;
+        } else {
+            break;
+        }
+        if (n % GC_INC_MARK_CHECK == 0 && (mp_uint_t)(mp_hal_ticks_us() - start_us) >= budget_us) {
+            break;
+        }
+    }
+    MP_STATE_MEM(gc_inc_sp) = sp;
+    return sp == 0 && MP_STATE_MEM(gc_inc_scan_area) == NULL && !MP_STATE_MEM(gc_stack_overflow);
+}
+
+// Check again the children of the marked blocks that were written to or
+// allocated during the mark phase.
+STATIC void gc_inc_mark_dirty(void) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_DTB - 1) / BLOCKS_PER_DTB;
+        for (size_t i = 0; i < len; i++) {
+            byte dirty = area->gc_dirty_table_start[i];
+            if (dirty == 0) {
+                continue;
+            }
+            area->gc_dirty_table_start[i] = 0;
+            for (size_t block = i * BLOCKS_PER_DTB; dirty != 0; block++, dirty >>= 1) {
+                if ((dirty & 1) && ATB_GET_KIND(area, block) == AT_MARK) {
+                    gc_mark_subtree(area, block);
+                }
+            }
+        }
+    }
+}
+
+// Sweep from where the sweep phase has got to, until the whole heap is swept
+// or budget_us has passed since start_us. Returns true if the heap is swept.
+STATIC bool gc_inc_sweep(mp_uint_t start_us, mp_uint_t budget_us) {
+    mp_state_mem_area_t *area = MP_STATE_MEM(gc_inc_sweep_area);
+    size_t block = MP_STATE_MEM(gc_inc_sweep_block);
+    while (area != NULL) {
+        size_t n_blocks = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        while (block < n_blocks) {
+            // stop at the end of a chain, so the next step need not know if its head was freed
+            size_t end = MIN(block + GC_INC_CHUNK, n_blocks);
+            while (end < n_blocks && ATB_GET_KIND(area, end) == AT_TAIL) {
+                end++;
+            }
+            gc_sweep_blocks(area, block, end);
+            block = end;
+            if ((mp_uint_t)(mp_hal_ticks_us() - start_us) >= budget_us) {
+                goto out;
+            }
+        }
+        area = NEXT_AREA(area);
+        block = 0;
+    }
+out:
+    #if MICROPY_GC_SIZE_CLASSES
+    if (area == NULL) {
+        gc_free_list_reverse();
+    }
+    #endif
+    MP_STATE_MEM(gc_inc_sweep_area) = area;
+    MP_STATE_MEM(gc_inc_sweep_block) = block;
+    gc_reset_search();
+    #if MICROPY_OPT_INLINE_CACHE
+    // as in gc_collect_end, the sweep may have freed types and maps the inline caches name
+    MP_STATE_VM(map_version)++;
+    #endif
+    return area == NULL;
+}
+
+// Whether the sweep phase has still to get to the given block
+STATIC bool gc_inc_unswept(mp_state_mem_area_t *area, size_t block) {
+    mp_state_mem_area_t *a = MP_STATE_MEM(gc_inc_sweep_area);
+    if (a == area) {
+        return block >= MP_STATE_MEM(gc_inc_sweep_block);
+    }
+    for (; a != NULL; a = NEXT_AREA(a)) {
+        if (a == area) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool gc_collect_step(mp_uint_t budget_us) {
+    GC_ENTER();
+    if (MP_STATE_MEM(gc_lock_depth) > 0) {
+        GC_EXIT();
+        return false;
+    }
+    MP_STATE_MEM(gc_lock_depth)++;
+    mp_uint_t start_us = mp_hal_ticks_us();
+    bool done = false;
+    for (;;) {
+        if (MP_STATE_MEM(gc_inc_phase) == GC_INC_PHASE_IDLE) {
+            gc_inc_start();
+        } else if (MP_STATE_MEM(gc_inc_phase) == GC_INC_PHASE_MARK) {
+            if (!gc_inc_mark(start_us, budget_us)) {
+                break;
+            }
+            // Nothing is left to mark from the heap, so end the mark phase at
+            // once: gc_collect traces the roots again along with the stacks and
+            // registers that only the port knows how to find, then the blocks
+            // written to meanwhile, and leaves the sweep to the steps.
+            MP_STATE_MEM(gc_inc_finisher) = GC_INC_THIS_THREAD();
+            MP_STATE_MEM(gc_lock_depth)--;
+            GC_EXIT();
+            gc_collect();
+            GC_ENTER();
+            MP_STATE_MEM(gc_lock_depth)++;
+        } else {
+            if (gc_inc_sweep(start_us, budget_us)) {
+                MP_STATE_MEM(gc_inc_phase) = GC_INC_PHASE_IDLE;
+                done = true;
+            }
+            break;
+        }
+        if ((mp_uint_t)(mp_hal_ticks_us() - start_us) >= budget_us) {
+            break;
+        }
+    }
+    mp_uint_t pause_us = mp_hal_ticks_us() - start_us;
+    #if MICROPY_MULTIPYTHON_STATS
+    MP_STATE_MEM(gc_collections) += done;
+    MP_STATE_MEM(gc_collect_us) += pause_us;
+    #endif
+    gc_record_pause(pause_us);
+    MP_STATE_MEM(gc_lock_depth)--;
+    GC_EXIT();
+    return done;
+}
+
+void gc_write_barrier_slow(const void *ptr) {
+    GC_ENTER();
+    if (MP_STATE_MEM(gc_inc_phase) == GC_INC_PHASE_MARK) {
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            if ((const byte*)ptr >= area->gc_pool_start && (const byte*)ptr < area->gc_pool_end) {
+                size_t block = BLOCK_FROM_PTR(area, ptr);
+                while (ATB_GET_KIND(area, block) == AT_TAIL) {
+                    block--;
+                }
+                // an unmarked block has its children checked when it gets marked
+                if (ATB_GET_KIND(area, block) == AT_MARK) {
+                    DTB_SET(area, block);
+                }
+                break;
+            }
+        }
+    }
+    GC_EXIT();
+}
+
+void gc_pause_info(uint32_t *hist, bool reset) {
+    GC_ENTER();
+    memcpy(hist, MP_STATE_MEM(gc_pause_hist), sizeof(MP_STATE_MEM(gc_pause_hist)));
+    if (reset) {
+        memset(MP_STATE_MEM(gc_pause_hist), 0, sizeof(MP_STATE_MEM(gc_pause_hist)));
+    }
+    GC_EXIT();
+}
+
+#endif // MICROPY_GC_INCREMENTAL
+
 void gc_collect_start(void) {
     GC_ENTER();
     MP_STATE_MEM(gc_lock_depth)++;
+    #if MICROPY_MULTIPYTHON_STATS || MICROPY_GC_INCREMENTAL
+    MP_STATE_MEM(gc_collect_start_us) = mp_hal_ticks_us();
+    #endif
     #if MICROPY_GC_ALLOC_THRESHOLD
     MP_STATE_MEM(gc_alloc_amount) = 0;
     #endif
-    MP_STATE_MEM(gc_stack_overflow) = 0;
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_inc_phase) == GC_INC_PHASE_SWEEP) {
+        // finish the sweep of an incremental collection, then start afresh
+        gc_inc_sweep(mp_hal_ticks_us(), GC_INC_NO_BUDGET);
+        MP_STATE_MEM(gc_inc_phase) = GC_INC_PHASE_IDLE;
+    }
+    if (MP_STATE_MEM(gc_inc_phase) == GC_INC_PHASE_MARK) {
+        // End the mark phase of an incremental collection, keeping its marks.
+        // The roots are written to without a write barrier, so the children of
+        // the blocks they point to are checked again even if those are marked.
+        gc_inc_mark(mp_hal_ticks_us(), GC_INC_NO_BUDGET);
+        MP_STATE_MEM(gc_inc_rescan) = 1;
+    } else
+    #endif
+    {
+        MP_STATE_MEM(gc_stack_overflow) = 0;
+    }
+
+    #if MICROPY_GC_MARK_THREADS
+    // the children of the blocks the roots point to are checked by the mark threads
+    MP_STATE_MEM(gc_mark_parallel) = gc_mark_claim();
+    #endif
 
-    // Trace root pointers.  This relies on the root pointers being organised
-    // correctly in the mp_state_ctx structure.  We scan nlr_top, dict_locals,
-    // dict_globals, then the root pointer section of mp_state_vm.
-    void **ptrs = (void**)(void*)mp_active_context_mirrors[MICROPY_GET_CORE_INDEX].state;
-    size_t root_start = offsetof(mp_state_ctx_t, thread.dict_locals);
-    size_t root_end = offsetof(mp_state_ctx_t, vm.qstr_last_chunk);
-    gc_collect_root(ptrs + root_start / sizeof(void*), (root_end - root_start) / sizeof(void*));
+    // Trace root pointers.
+    void **ptrs = (void**)(void*)MP_STATE_PTR;
+    gc_collect_root(ptrs + GC_ROOT_START / sizeof(void*), (GC_ROOT_END - GC_ROOT_START) / sizeof(void*));
 
     #if MICROPY_ENABLE_PYSTACK
     // Trace root pointers from the Python stack.
@@ -339,25 +1143,87 @@ void gc_collect_start(void) {
     #endif
 }
 
+// Mark the children of a block the roots point to, or leave that to the mark
+// threads.
+static inline void gc_mark_root(mp_state_mem_area_t *area, size_t block) {
+    #if MICROPY_GC_MARK_THREADS
+    if (MP_STATE_MEM(gc_mark_parallel) && gc_mark_defer(area, block)) {
+        return;
+    }
+    #endif
+    gc_mark_subtree(area, block);
+}
+
 void gc_collect_root(void **ptrs, size_t len) {
     for (size_t i = 0; i < len; i++) {
         void *ptr = ptrs[i];
-        if (VERIFY_PTR(ptr)) {
-            size_t block = BLOCK_FROM_PTR(ptr);
-            if (ATB_GET_KIND(block) == AT_HEAD) {
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+        if (area != NULL) {
+            size_t block = BLOCK_FROM_PTR(area, ptr);
+            if (ATB_GET_KIND(area, block) == AT_HEAD) {
                 // An unmarked head: mark it, and mark all its children
                 TRACE_MARK(block, ptr);
-                ATB_HEAD_TO_MARK(block);
-                gc_mark_subtree(block);
+                ATB_HEAD_TO_MARK(area, block);
+                gc_mark_root(area, block);
             }
+            #if MICROPY_GC_INCREMENTAL
+            else if (MP_STATE_MEM(gc_inc_rescan) && ATB_GET_KIND(area, block) == AT_MARK) {
+                gc_mark_root(area, block);
+            }
+            #endif
         }
     }
 }
 
 void gc_collect_end(void) {
+    #if MICROPY_GC_MARK_THREADS
+    if (MP_STATE_MEM(gc_mark_parallel)) {
+        gc_mark_parallel();
+    }
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_inc_rescan)) {
+        MP_STATE_MEM(gc_inc_rescan) = 0;
+        gc_inc_mark_dirty();
+    }
+    #endif
     gc_deal_with_stack_overflow();
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_inc_finisher) == GC_INC_THIS_THREAD()) {
+        // called from gc_collect_step, which sweeps in steps
+        MP_STATE_MEM(gc_inc_finisher) = NULL;
+        MP_STATE_MEM(gc_inc_phase) = GC_INC_PHASE_SWEEP;
+        MP_STATE_MEM(gc_inc_sweep_area) = &MP_STATE_MEM(area);
+        MP_STATE_MEM(gc_inc_sweep_block) = 0;
+        #if MICROPY_PY_GC_COLLECT_RETVAL
+        MP_STATE_MEM(gc_collected) = 0;
+        #endif
+        #if MICROPY_GC_SIZE_CLASSES
+        memset(MP_STATE_MEM(gc_free_list_len), 0, sizeof(MP_STATE_MEM(gc_free_list_len)));
+        #endif
+        MP_STATE_MEM(gc_lock_depth)--;
+        GC_EXIT();
+        return;
+    }
+    MP_STATE_MEM(gc_inc_phase) = GC_INC_PHASE_IDLE;
+    #endif
     gc_sweep();
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    gc_reset_search();
+    #if MICROPY_OPT_INLINE_CACHE
+    // the inline caches name types and maps without holding them, and the sweep may
+    // have freed some that new ones will take the place of
+    MP_STATE_VM(map_version)++;
+    #endif
+    #if MICROPY_MULTIPYTHON_STATS || MICROPY_GC_INCREMENTAL
+    mp_uint_t pause_us = mp_hal_ticks_us() - MP_STATE_MEM(gc_collect_start_us);
+    #endif
+    #if MICROPY_MULTIPYTHON_STATS
+    MP_STATE_MEM(gc_collections)++;
+    MP_STATE_MEM(gc_collect_us) += pause_us;
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    gc_record_pause(pause_us);
+    #endif
     MP_STATE_MEM(gc_lock_depth)--;
     GC_EXIT();
 }
@@ -366,64 +1232,105 @@ void gc_sweep_all(void) {
     GC_ENTER();
     MP_STATE_MEM(gc_lock_depth)++;
     MP_STATE_MEM(gc_stack_overflow) = 0;
+    #if MICROPY_MULTIPYTHON_STATS || MICROPY_GC_INCREMENTAL
+    MP_STATE_MEM(gc_collect_start_us) = mp_hal_ticks_us();
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_inc_phase) != GC_INC_PHASE_IDLE) {
+        // drop the marks of an incremental collection so that nothing is kept
+        gc_sweep();
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            memset(area->gc_dirty_table_start, 0, (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_DTB - 1) / BLOCKS_PER_DTB);
+        }
+    }
+    MP_STATE_MEM(gc_inc_finisher) = NULL;
+    #endif
     gc_collect_end();
 }
 
+// Finds the longest run of free blocks in the first region of the heap, which
+// may lie between the small and the large blocks, and sets start and end to its
+// bounds. Everything of the region in use is outside of them.
+void gc_free_gap(void **start, void **end) {
+    GC_ENTER();
+    mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+    size_t n_blocks = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    size_t gap = n_blocks;
+    size_t gap_len = 0;
+    size_t n_free = 0;
+    for (size_t block = 0; block < n_blocks; block++) {
+        if (ATB_GET_KIND(area, block) != AT_FREE) {
+            n_free = 0;
+        } else if (++n_free > gap_len) {
+            gap = block + 1 - n_free;
+            gap_len = n_free;
+        }
+    }
+    *start = (void*)PTR_FROM_BLOCK(area, gap);
+    *end = (void*)PTR_FROM_BLOCK(area, gap + gap_len);
+    GC_EXIT();
+}
+
 void gc_info(gc_info_t *info) {
     GC_ENTER();
-    info->total = MP_STATE_MEM(gc_pool_end) - MP_STATE_MEM(gc_pool_start);
+    info->total = 0;
     info->used = 0;
     info->free = 0;
     info->max_free = 0;
     info->num_1block = 0;
     info->num_2block = 0;
     info->max_block = 0;
-    bool finish = false;
-    for (size_t block = 0, len = 0, len_free = 0; !finish;) {
-        size_t kind = ATB_GET_KIND(block);
-        switch (kind) {
-            case AT_FREE:
-                info->free += 1;
-                len_free += 1;
-                len = 0;
-                break;
-
-            case AT_HEAD:
-                info->used += 1;
-                len = 1;
-                break;
-
-            case AT_TAIL:
-                info->used += 1;
-                len += 1;
-                break;
-
-            case AT_MARK:
-                // shouldn't happen
-                break;
-        }
-
-        block++;
-        finish = (block == MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-        // Get next block type if possible
-        if (!finish) {
-            kind = ATB_GET_KIND(block);
-        }
-
-        if (finish || kind == AT_FREE || kind == AT_HEAD) {
-            if (len == 1) {
-                info->num_1block += 1;
-            } else if (len == 2) {
-                info->num_2block += 1;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        info->total += area->gc_pool_end - area->gc_pool_start;
+        bool finish = false;
+        for (size_t block = 0, len = 0, len_free = 0; !finish;) {
+            size_t kind = ATB_GET_KIND(area, block);
+            switch (kind) {
+                case AT_FREE:
+                    info->free += 1;
+                    len_free += 1;
+                    len = 0;
+                    break;
+
+                case AT_HEAD:
+                    info->used += 1;
+                    len = 1;
+                    break;
+
+                case AT_TAIL:
+                    info->used += 1;
+                    len += 1;
+                    break;
+
+                case AT_MARK:
+                    // only between the steps of an incremental collection
+                    info->used += 1;
+                    len = 1;
+                    break;
             }
-            if (len > info->max_block) {
-                info->max_block = len;
+
+            block++;
+            finish = (block == area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+            // Get next block type if possible
+            if (!finish) {
+                kind = ATB_GET_KIND(area, block);
             }
-            if (finish || kind == AT_HEAD) {
-                if (len_free > info->max_free) {
-                    info->max_free = len_free;
+
+            if (finish || kind == AT_FREE || kind == AT_HEAD) {
+                if (len == 1) {
+                    info->num_1block += 1;
+                } else if (len == 2) {
+                    info->num_2block += 1;
+                }
+                if (len > info->max_block) {
+                    info->max_block = len;
+                }
+                if (finish || kind == AT_HEAD) {
+                    if (len_free > info->max_free) {
+                        info->max_free = len_free;
+                    }
+                    len_free = 0;
                 }
-                len_free = 0;
             }
         }
     }
@@ -433,6 +1340,24 @@ void gc_info(gc_info_t *info) {
     GC_EXIT();
 }
 
+#if MICROPY_MULTIPYTHON_SHARED
+bool gc_any_block(bool (*f)(const void *ptr, void *arg), void *arg) {
+    GC_ENTER();
+    bool found = false;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL && !found; area = NEXT_AREA(area)) {
+        size_t n_blocks = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        for (size_t block = 0; block < n_blocks && !found; block++) {
+            size_t kind = ATB_GET_KIND(area, block);
+            if (kind == AT_HEAD || kind == AT_MARK) {
+                found = f((const void *)PTR_FROM_BLOCK(area, block), arg);
+            }
+        }
+    }
+    GC_EXIT();
+    return found;
+}
+#endif
+
 void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
     bool has_finaliser = alloc_flags & GC_ALLOC_FLAG_HAS_FINALISER;
     size_t n_blocks = ((n_bytes + BYTES_PER_BLOCK - 1) & (~(BYTES_PER_BLOCK - 1))) / BYTES_PER_BLOCK;
@@ -451,6 +1376,7 @@ void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
         return NULL;
     }
 
+    mp_state_mem_area_t *area;
     size_t i;
     size_t end_block;
     size_t start_block;
@@ -468,15 +1394,44 @@ void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
 
     for (;;) {
 
-        // look for a run of n_blocks available blocks
-        n_free = 0;
-        for (i = MP_STATE_MEM(gc_last_free_atb_index); i < MP_STATE_MEM(gc_alloc_table_byte_len); i++) {
-            byte a = MP_STATE_MEM(gc_alloc_table_start)[i];
-            if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
-            if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
-            if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
-            if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+        #if MICROPY_GC_SIZE_CLASSES
+        // single blocks are found quickly enough from gc_last_free_atb_index,
+        // which also fills the holes between objects from the bottom up
+        if (n_blocks >= 2 && n_blocks <= MICROPY_GC_SIZE_CLASSES && gc_free_list_take(n_blocks, &area, &start_block)) {
+            end_block = start_block + n_blocks - 1;
+            goto found_run;
         }
+        #endif
+
+        #if MICROPY_GC_LARGE_BLOCKS
+        if (n_blocks >= MICROPY_GC_LARGE_BLOCKS) {
+            for (area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+                if (gc_find_large(area, n_blocks, &start_block)) {
+                    end_block = start_block + n_blocks - 1;
+                    goto found_run;
+                }
+            }
+        }
+        #endif
+
+        // look for a run of n_blocks available blocks, which can't span areas
+        for (area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            n_free = 0;
+            for (i = area->gc_last_free_atb_index; i < area->gc_alloc_table_byte_len; i++) {
+                byte a = area->gc_alloc_table_start[i];
+                if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
+                if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
+                if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
+                if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+            }
+        }
+
+        #if MICROPY_GC_SPLIT_HEAP
+        // a collection didn't free enough, so grow the heap and search again
+        if (collected && gc_try_add_heap(n_bytes)) {
+            continue;
+        }
+        #endif
 
         GC_EXIT();
         // nothing found!
@@ -501,27 +1456,47 @@ found:
     // before this one.  Also, whenever we free or shink a block we must check
     // if this index needs adjusting (see gc_realloc and gc_free).
     if (n_free == 1) {
-        MP_STATE_MEM(gc_last_free_atb_index) = (i + 1) / BLOCKS_PER_ATB;
+        area->gc_last_free_atb_index = (i + 1) / BLOCKS_PER_ATB;
     }
 
+#if MICROPY_GC_SIZE_CLASSES || MICROPY_GC_LARGE_BLOCKS
+    // found on a free list or at the top of the heap, from start_block to end_block inclusive
+found_run:
+#endif
+
     // mark first block as used head
-    ATB_FREE_TO_HEAD(start_block);
+    ATB_FREE_TO_HEAD(area, start_block);
 
     // mark rest of blocks as used tail
     // TODO for a run of many blocks can make this more efficient
     for (size_t bl = start_block + 1; bl <= end_block; bl++) {
-        ATB_FREE_TO_TAIL(bl);
+        ATB_FREE_TO_TAIL(area, bl);
     }
 
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_inc_phase) == GC_INC_PHASE_MARK) {
+        // Allocate black: the block is kept by this collection, and as it's
+        // filled in without a write barrier its children are checked when the
+        // mark phase ends.
+        ATB_HEAD_TO_MARK(area, start_block);
+        DTB_SET(area, start_block);
+    } else if (MP_STATE_MEM(gc_inc_phase) == GC_INC_PHASE_SWEEP && gc_inc_unswept(area, start_block)) {
+        // the sweep must find the block marked when it gets to it
+        ATB_HEAD_TO_MARK(area, start_block);
+    }
+    #endif
+
     // get pointer to first block
     // we must create this pointer before unlocking the GC so a collection can find it
-    void *ret_ptr = (void*)(MP_STATE_MEM(gc_pool_start) + start_block * BYTES_PER_BLOCK);
+    void *ret_ptr = (void*)(area->gc_pool_start + start_block * BYTES_PER_BLOCK);
     DEBUG_printf("gc_alloc(%p)\n", ret_ptr);
 
     #if MICROPY_GC_ALLOC_THRESHOLD
     MP_STATE_MEM(gc_alloc_amount) += n_blocks;
     #endif
 
+    GC_STATS_USE(n_blocks);
+
     GC_EXIT();
 
     #if MICROPY_GC_CONSERVATIVE_CLEAR
@@ -542,7 +1517,7 @@ found:
         ((mp_obj_base_t*)ret_ptr)->type = NULL;
         // set mp_obj flag only if it has a finaliser
         GC_ENTER();
-        FTB_SET(start_block);
+        FTB_SET(area, start_block);
         GC_EXIT();
     }
     #else
@@ -582,24 +1557,33 @@ void gc_free(void *ptr) {
         GC_EXIT();
     } else {
         // get the GC block number corresponding to this pointer
-        assert(VERIFY_PTR(ptr));
-        size_t block = BLOCK_FROM_PTR(ptr);
-        assert(ATB_GET_KIND(block) == AT_HEAD);
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+        assert(area != NULL);
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        assert(ATB_IS_HEAD(area, block));
 
         #if MICROPY_ENABLE_FINALISER
-        FTB_CLEAR(block);
+        FTB_CLEAR(area, block);
         #endif
 
         // set the last_free pointer to this block if it's earlier in the heap
-        if (block / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = block / BLOCKS_PER_ATB;
+        if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+            area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
         }
 
         // free head and all of its tail blocks
+        #if MICROPY_GC_SIZE_CLASSES
+        size_t start_block = block;
+        #endif
         do {
-            ATB_ANY_TO_FREE(block);
+            ATB_ANY_TO_FREE(area, block);
+            GC_STATS_UNUSE(1);
             block += 1;
-        } while (ATB_GET_KIND(block) == AT_TAIL);
+        } while (ATB_GET_KIND(area, block) == AT_TAIL);
+
+        #if MICROPY_GC_SIZE_CLASSES
+        gc_free_list_add(area, start_block, block - start_block);
+        #endif
 
         GC_EXIT();
 
@@ -611,14 +1595,15 @@ void gc_free(void *ptr) {
 
 size_t gc_nbytes(const void *ptr) {
     GC_ENTER();
-    if (VERIFY_PTR(ptr)) {
-        size_t block = BLOCK_FROM_PTR(ptr);
-        if (ATB_GET_KIND(block) == AT_HEAD) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        if (ATB_IS_HEAD(area, block)) {
             // work out number of consecutive blocks in the chain starting with this on
             size_t n_blocks = 0;
             do {
                 n_blocks += 1;
-            } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+            } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
             GC_EXIT();
             return n_blocks * BYTES_PER_BLOCK;
         }
@@ -680,9 +1665,10 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     }
 
     // get the GC block number corresponding to this pointer
-    assert(VERIFY_PTR(ptr));
-    size_t block = BLOCK_FROM_PTR(ptr);
-    assert(ATB_GET_KIND(block) == AT_HEAD);
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    assert(area != NULL);
+    size_t block = BLOCK_FROM_PTR(area, ptr);
+    assert(ATB_IS_HEAD(area, block));
 
     // compute number of new blocks that are requested
     size_t new_blocks = (n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK;
@@ -695,9 +1681,9 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     // efficiently shrink it (see below for shrinking code).
     size_t n_free   = 0;
     size_t n_blocks = 1; // counting HEAD block
-    size_t max_block = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
+    size_t max_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
     for (size_t bl = block + n_blocks; bl < max_block; bl++) {
-        byte block_type = ATB_GET_KIND(bl);
+        byte block_type = ATB_GET_KIND(area, bl);
         if (block_type == AT_TAIL) {
             n_blocks++;
             continue;
@@ -723,12 +1709,13 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     if (new_blocks < n_blocks) {
         // free unneeded tail blocks
         for (size_t bl = block + new_blocks, count = n_blocks - new_blocks; count > 0; bl++, count--) {
-            ATB_ANY_TO_FREE(bl);
+            ATB_ANY_TO_FREE(area, bl);
         }
+        GC_STATS_UNUSE(n_blocks - new_blocks);
 
         // set the last_free pointer to end of this block if it's earlier in the heap
-        if ((block + new_blocks) / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = (block + new_blocks) / BLOCKS_PER_ATB;
+        if ((block + new_blocks) / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+            area->gc_last_free_atb_index = (block + new_blocks) / BLOCKS_PER_ATB;
         }
 
         GC_EXIT();
@@ -744,9 +1731,17 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     if (new_blocks <= n_blocks + n_free) {
         // mark few more blocks as used tail
         for (size_t bl = block + n_blocks; bl < block + new_blocks; bl++) {
-            assert(ATB_GET_KIND(bl) == AT_FREE);
-            ATB_FREE_TO_TAIL(bl);
+            assert(ATB_GET_KIND(area, bl) == AT_FREE);
+            ATB_FREE_TO_TAIL(area, bl);
+        }
+        GC_STATS_USE(new_blocks - n_blocks);
+
+        #if MICROPY_GC_INCREMENTAL
+        if (MP_STATE_MEM(gc_inc_phase) == GC_INC_PHASE_MARK && ATB_GET_KIND(area, block) == AT_MARK) {
+            // the new tail blocks are filled in without a write barrier
+            DTB_SET(area, block);
         }
+        #endif
 
         GC_EXIT();
 
@@ -766,7 +1761,7 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     }
 
     #if MICROPY_ENABLE_FINALISER
-    bool ftb_state = FTB_GET(block);
+    bool ftb_state = FTB_GET(area, block);
     #else
     bool ftb_state = false;
     #endif
@@ -805,110 +1800,112 @@ void gc_dump_info(void) {
 void gc_dump_alloc_table(void) {
     GC_ENTER();
     static const size_t DUMP_BYTES_PER_LINE = 64;
-    #if !EXTENSIVE_HEAP_PROFILING
-    // When comparing heap output we don't want to print the starting
-    // pointer of the heap because it changes from run to run.
-    mp_printf(&mp_plat_print, "GC memory layout; from %p:", MP_STATE_MEM(gc_pool_start));
-    #endif
-    for (size_t bl = 0; bl < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; bl++) {
-        if (bl % DUMP_BYTES_PER_LINE == 0) {
-            // a new line of blocks
-            {
-                // check if this line contains only free blocks
-                size_t bl2 = bl;
-                while (bl2 < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB && ATB_GET_KIND(bl2) == AT_FREE) {
-                    bl2++;
-                }
-                if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
-                    // there are at least 2 lines containing only free blocks, so abbreviate their printing
-                    mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
-                    bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
-                    if (bl >= MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB) {
-                        // got to end of heap
-                        break;
-                    }
-                }
-            }
-            // print header for new line of blocks
-            // (the cast to uint32_t is for 16-bit ports)
-            //mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(bl) & (uint32_t)0xfffff));
-            mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
-        }
-        int c = ' ';
-        switch (ATB_GET_KIND(bl)) {
-            case AT_FREE: c = '.'; break;
-            /* this prints out if the object is reachable from BSS or STACK (for unix only)
-            case AT_HEAD: {
-                c = 'h';
-                void **ptrs = (void**)(void*)&mp_state_ctx;
-                mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
-                for (mp_uint_t i = 0; i < len; i++) {
-                    mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                    if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                        c = 'B';
-                        break;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        #if !EXTENSIVE_HEAP_PROFILING
+        // When comparing heap output we don't want to print the starting
+        // pointer of the heap because it changes from run to run.
+        mp_printf(&mp_plat_print, "GC memory layout; from %p:", area->gc_pool_start);
+        #endif
+        for (size_t bl = 0; bl < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; bl++) {
+            if (bl % DUMP_BYTES_PER_LINE == 0) {
+                // a new line of blocks
+                {
+                    // check if this line contains only free blocks
+                    size_t bl2 = bl;
+                    while (bl2 < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB && ATB_GET_KIND(area, bl2) == AT_FREE) {
+                        bl2++;
                     }
-                }
-                if (c == 'h') {
-                    ptrs = (void**)&c;
-                    len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
-                    for (mp_uint_t i = 0; i < len; i++) {
-                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                        if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                            c = 'S';
+                    if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
+                        // there are at least 2 lines containing only free blocks, so abbreviate their printing
+                        mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
+                        bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
+                        if (bl >= area->gc_alloc_table_byte_len * BLOCKS_PER_ATB) {
+                            // got to end of heap
                             break;
                         }
                     }
                 }
-                break;
+                // print header for new line of blocks
+                // (the cast to uint32_t is for 16-bit ports)
+                //mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(area, bl) & (uint32_t)0xfffff));
+                mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
             }
-            */
-            /* this prints the uPy object type of the head block */
-            case AT_HEAD: {
-                void **ptr = (void**)(MP_STATE_MEM(gc_pool_start) + bl * BYTES_PER_BLOCK);
-                if (*ptr == &mp_type_tuple) { c = 'T'; }
-                else if (*ptr == &mp_type_list) { c = 'L'; }
-                else if (*ptr == &mp_type_dict) { c = 'D'; }
-                else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) { c = 'S'; }
-                #if MICROPY_PY_BUILTINS_BYTEARRAY
-                else if (*ptr == &mp_type_bytearray) { c = 'A'; }
-                #endif
-                #if MICROPY_PY_ARRAY
-                else if (*ptr == &mp_type_array) { c = 'A'; }
-                #endif
-                #if MICROPY_PY_BUILTINS_FLOAT
-                else if (*ptr == &mp_type_float) { c = 'F'; }
-                #endif
-                else if (*ptr == &mp_type_fun_bc) { c = 'B'; }
-                else if (*ptr == &mp_type_module) { c = 'M'; }
-                else {
+            int c = ' ';
+            switch (ATB_GET_KIND(area, bl)) {
+                case AT_FREE: c = '.'; break;
+                /* this prints out if the object is reachable from BSS or STACK (for unix only)
+                case AT_HEAD: {
                     c = 'h';
-                    #if 0
-                    // This code prints "Q" for qstr-pool data, and "q" for qstr-str
-                    // data.  It can be useful to see how qstrs are being allocated,
-                    // but is disabled by default because it is very slow.
-                    for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
-                        if ((qstr_pool_t*)ptr == pool) {
-                            c = 'Q';
+                    void **ptrs = (void**)(void*)&mp_state_ctx;
+                    mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
+                    for (mp_uint_t i = 0; i < len; i++) {
+                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                        if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
+                            c = 'B';
                             break;
                         }
-                        for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
-                            if ((const byte*)ptr == *q) {
-                                c = 'q';
+                    }
+                    if (c == 'h') {
+                        ptrs = (void**)&c;
+                        len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
+                        for (mp_uint_t i = 0; i < len; i++) {
+                            mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                            if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
+                                c = 'S';
                                 break;
                             }
                         }
                     }
+                    break;
+                }
+                */
+                /* this prints the uPy object type of the head block */
+                case AT_HEAD: {
+                    void **ptr = (void**)(area->gc_pool_start + bl * BYTES_PER_BLOCK);
+                    if (*ptr == &mp_type_tuple) { c = 'T'; }
+                    else if (*ptr == &mp_type_list) { c = 'L'; }
+                    else if (*ptr == &mp_type_dict) { c = 'D'; }
+                    else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) { c = 'S'; }
+                    #if MICROPY_PY_BUILTINS_BYTEARRAY
+                    else if (*ptr == &mp_type_bytearray) { c = 'A'; }
+                    #endif
+                    #if MICROPY_PY_ARRAY
+                    else if (*ptr == &mp_type_array) { c = 'A'; }
+                    #endif
+                    #if MICROPY_PY_BUILTINS_FLOAT
+                    else if (*ptr == &mp_type_float) { c = 'F'; }
                     #endif
+                    else if (*ptr == &mp_type_fun_bc) { c = 'B'; }
+                    else if (*ptr == &mp_type_module) { c = 'M'; }
+                    else {
+                        c = 'h';
+                        #if 0
+                        // This code prints "Q" for qstr-pool data, and "q" for qstr-str
+                        // data.  It can be useful to see how qstrs are being allocated,
+                        // but is disabled by default because it is very slow.
+                        for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
+                            if ((qstr_pool_t*)ptr == pool) {
+                                c = 'Q';
+                                break;
+                            }
+                            for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
+                                if ((const byte*)ptr == *q) {
+                                    c = 'q';
+                                    break;
+                                }
+                            }
+                        }
+                        #endif
+                    }
+                    break;
                 }
-                break;
+                case AT_TAIL: c = '='; break;
+                case AT_MARK: c = 'm'; break;
             }
-            case AT_TAIL: c = '='; break;
-            case AT_MARK: c = 'm'; break;
+            mp_printf(&mp_plat_print, "%c", c);
         }
-        mp_printf(&mp_plat_print, "%c", c);
+        mp_print_str(&mp_plat_print, "\n");
     }
-    mp_print_str(&mp_plat_print, "\n");
     GC_EXIT();
 }
 
@@ -33,6 +33,14 @@
 
 void gc_init(void *start, void *end);
 
+#if MICROPY_GC_SPLIT_HEAP
+// Used to add additional memory areas to the heap.
+void gc_add(void *start, void *end);
+
+// Allow the heap to grow by up to limit bytes when it runs out of memory.
+void gc_set_grow_limit(size_t limit);
+#endif
+
 // These lock/unlock functions can be nested.
 // They can be used to prevent the GC from allocating/freeing.
 void gc_lock(void);
@@ -48,6 +56,32 @@ void gc_collect_end(void);
 // Use this function to sweep the whole heap and run all finalisers
 void gc_sweep_all(void);
 
+#if MICROPY_GC_INCREMENTAL
+enum {
+    GC_INC_PHASE_IDLE,
+    GC_INC_PHASE_MARK,
+    GC_INC_PHASE_SWEEP,
+};
+
+// Do a step of an incremental collection, lasting about budget_us microseconds;
+// the step that ends the mark phase also calls gc_collect to trace the roots
+// again. Returns true if the step finished a collection.
+bool gc_collect_step(mp_uint_t budget_us);
+
+// While an incremental collection marks the heap, code that stores a pointer
+// in a heap object allocated before that must tell the GC about it; stores to
+// root pointers and stacks need no barrier since those are traced again at the
+// end. ptr can point anywhere into the object that is written to.
+#define gc_write_barrier(ptr) do { \
+        if (MP_STATE_MEM(gc_inc_phase) == GC_INC_PHASE_MARK) { \
+            gc_write_barrier_slow(ptr); \
+        } \
+    } while (0)
+void gc_write_barrier_slow(const void *ptr);
+#else
+#define gc_write_barrier(ptr) (void)0
+#endif
+
 enum {
     GC_ALLOC_FLAG_HAS_FINALISER = 1,
 };
@@ -68,7 +102,21 @@ typedef struct _gc_info_t {
 } gc_info_t;
 
 void gc_info(gc_info_t *info);
+
+#if MICROPY_MULTIPYTHON_SHARED
+// Call f on the first block of each allocated object, including garbage that
+// hasn't been collected yet, until it returns true; returns whether it did.
+// f must not allocate.
+bool gc_any_block(bool (*f)(const void *ptr, void *arg), void *arg);
+#endif
+void gc_free_gap(void **start, void **end);
 void gc_dump_info(void);
 void gc_dump_alloc_table(void);
 
+#if MICROPY_GC_INCREMENTAL
+// Copy the histogram of GC pauses (MICROPY_GC_PAUSE_BUCKETS counts) to hist,
+// and clear it if reset is true.
+void gc_pause_info(uint32_t *hist, bool reset);
+#endif
+
 #endif // MICROPY_INCLUDED_PY_GC_H
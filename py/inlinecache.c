@@ -0,0 +1,279 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Owen Lyke
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/builtin.h"
+#include "py/inlinecache.h"
+#include "py/objtype.h"
+#include "py/runtime.h"
+
+#if MICROPY_OPT_INLINE_CACHE
+
+// Each call site that loads a name or an attribute has an entry in a table of the VM
+// state, found from the address of the instruction. A way of the entry remembers, for
+// the globals map or the type it was filled for, which map the value was found in and
+// at what slot. The value itself is read from there on each hit, so stores of existing
+// keys don't need to invalidate anything. Ways that depend on which keys the maps have
+// are good while the map version of the context is the one they were filled at, see
+// mp_map_set_versioned(). Threads of a context share its table when there is a GIL to
+// keep it consistent, otherwise only the main thread uses it.
+
+#if MICROPY_OPT_INLINE_CACHE_SIZE & (MICROPY_OPT_INLINE_CACHE_SIZE - 1)
+#error MICROPY_OPT_INLINE_CACHE_SIZE must be a power of 2
+#endif
+
+#define INLINE_CACHE_SITE(table, ip) (&(table)[((uintptr_t)(ip) >> 1) & (MICROPY_OPT_INLINE_CACHE_SIZE - 1)])
+#define INLINE_CACHE_VALUE(way) ((way)->map->table[(way)->slot].value)
+
+STATIC void inline_cache_fill(mp_inline_cache_entry_t *table, const byte *ip, qstr qst, mp_inline_cache_kind_t kind, const void *key, const mp_map_t *map, size_t slot) {
+    mp_inline_cache_entry_t *entry = INLINE_CACHE_SITE(table, ip);
+    if (entry->ip != ip || entry->qst != qst) {
+        // the entry was another call site's
+        memset(entry->way, 0, sizeof(entry->way));
+        entry->ip = ip;
+        entry->qst = qst;
+    }
+    // the way filled for the same key is replaced, otherwise the oldest
+    size_t i = 0;
+    while (i < MICROPY_OPT_INLINE_CACHE_WAYS - 1 && !(entry->way[i].key == key && entry->way[i].kind == kind)) {
+        i++;
+    }
+    memmove(&entry->way[1], &entry->way[0], i * sizeof(mp_inline_cache_way_t));
+    mp_inline_cache_way_t *way = &entry->way[0];
+    way->key = key;
+    way->map = map;
+    way->slot = slot;
+    way->version = MP_STATE_VM(map_version);
+    way->kind = kind;
+}
+
+STATIC bool inline_cache_can_fill(const mp_map_t *map) {
+    // a slot is only remembered in maps whose keys can't change without the version
+    return map->is_fixed || map->is_versioned;
+}
+
+/******************************************************************************/
+// names
+
+mp_obj_t mp_inline_cache_load_global(const byte *ip, qstr qst) {
+    mp_inline_cache_entry_t *table = MP_STATE_THREAD(inline_cache);
+    if (table == NULL) {
+        return mp_load_global(qst);
+    }
+    mp_map_t *globals = &mp_globals_get()->map;
+    mp_inline_cache_entry_t *entry = INLINE_CACHE_SITE(table, ip);
+    if (entry->ip == ip && entry->qst == qst) {
+        for (size_t i = 0; i < MICROPY_OPT_INLINE_CACHE_WAYS; i++) {
+            mp_inline_cache_way_t *way = &entry->way[i];
+            if (way->key == globals && way->version == MP_STATE_VM(map_version)) {
+                MP_STATE_VM(inline_cache_hits)++;
+                return INLINE_CACHE_VALUE(way);
+            }
+        }
+    }
+    MP_STATE_VM(inline_cache_misses)++;
+
+    // the lookup of mp_load_global, remembering where the name was found
+    mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
+    const mp_map_t *map = globals;
+    mp_map_elem_t *elem = mp_map_lookup(globals, key, MP_MAP_LOOKUP);
+    #if MICROPY_CAN_OVERRIDE_BUILTINS
+    if (elem == NULL && MP_STATE_VM(mp_module_builtins_override_dict) != NULL) {
+        map = &MP_STATE_VM(mp_module_builtins_override_dict)->map;
+        elem = mp_map_lookup((mp_map_t*)map, key, MP_MAP_LOOKUP);
+    }
+    #endif
+    if (elem == NULL) {
+        map = &mp_module_builtins_globals.map;
+        elem = mp_map_lookup((mp_map_t*)map, key, MP_MAP_LOOKUP);
+    }
+    if (elem == NULL) {
+        // raises the NameError
+        return mp_load_global(qst);
+    }
+    // a name found past the globals also depends on their keys
+    if (inline_cache_can_fill(globals) && inline_cache_can_fill(map)) {
+        inline_cache_fill(table, ip, qst, MP_INLINE_CACHE_GLOBAL, globals, map, elem - map->table);
+    }
+    return elem->value;
+}
+
+mp_obj_t mp_inline_cache_load_name(const byte *ip, qstr qst) {
+    if (mp_locals_get() == mp_globals_get()) {
+        // at the outer scope, as in module code
+        return mp_inline_cache_load_global(ip, qst);
+    }
+    return mp_load_name(qst);
+}
+
+/******************************************************************************/
+// attributes
+
+// Fill dest like mp_load_method_maybe from a way of the call site, if one is good for base
+static inline bool inline_cache_load(mp_inline_cache_entry_t *table, const byte *ip, mp_obj_t base, qstr attr, mp_obj_t *dest) {
+    mp_inline_cache_entry_t *entry = INLINE_CACHE_SITE(table, ip);
+    if (entry->ip != ip || entry->qst != attr) {
+        return false;
+    }
+    const mp_obj_type_t *type = mp_obj_get_type(base);
+    dest[1] = MP_OBJ_NULL;
+    for (size_t i = 0; i < MICROPY_OPT_INLINE_CACHE_WAYS; i++) {
+        mp_inline_cache_way_t *way = &entry->way[i];
+        switch (way->kind) {
+            case MP_INLINE_CACHE_MEMBER:
+                if (way->key == type) {
+                    mp_map_t *members = &((mp_obj_instance_t*)MP_OBJ_TO_PTR(base))->members;
+                    if (way->slot < members->alloc && members->table[way->slot].key == MP_OBJ_NEW_QSTR(attr)) {
+                        dest[0] = members->table[way->slot].value;
+                        goto hit;
+                    }
+                }
+                break;
+            case MP_INLINE_CACHE_INSTANCE:
+                if (way->key == type && way->version == MP_STATE_VM(map_version)) {
+                    // members of the instance come first, and are a small map
+                    mp_obj_instance_t *self = MP_OBJ_TO_PTR(base);
+                    mp_map_elem_t *elem = NULL;
+                    if (self->members.used != 0) {
+                        elem = mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+                    }
+                    if (elem != NULL) {
+                        dest[0] = elem->value;
+                    } else {
+                        mp_convert_member_lookup(base, type, INLINE_CACHE_VALUE(way), dest);
+                    }
+                    goto hit;
+                }
+                break;
+            case MP_INLINE_CACHE_TYPE:
+                if (way->key == MP_OBJ_TO_PTR(base) && way->version == MP_STATE_VM(map_version)) {
+                    mp_convert_member_lookup(MP_OBJ_NULL, (const mp_obj_type_t*)MP_OBJ_TO_PTR(base), INLINE_CACHE_VALUE(way), dest);
+                    goto hit;
+                }
+                break;
+            case MP_INLINE_CACHE_NATIVE:
+                if (way->key == type && way->version == MP_STATE_VM(map_version)) {
+                    mp_convert_member_lookup(base, type, INLINE_CACHE_VALUE(way), dest);
+                    goto hit;
+                }
+                break;
+            case MP_INLINE_CACHE_MODULE:
+                if (type == &mp_type_module && way->key == &((mp_obj_module_t*)MP_OBJ_TO_PTR(base))->globals->map
+                    && way->version == MP_STATE_VM(map_version)) {
+                    dest[0] = INLINE_CACHE_VALUE(way);
+                    goto hit;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return false;
+
+hit:
+    MP_STATE_VM(inline_cache_hits)++;
+    return true;
+}
+
+// Remember where a load of attr from base, that just succeeded, found it
+STATIC void inline_cache_fill_attr(mp_inline_cache_entry_t *table, const byte *ip, mp_obj_t base, qstr attr, byte *guess) {
+    if (attr == MP_QSTR___class__ || attr == MP_QSTR___next__ || attr == MP_QSTR___dict__ || attr == MP_QSTR___name__) {
+        // loaded without a lookup in a map
+        return;
+    }
+    const mp_obj_type_t *type = mp_obj_get_type(base);
+    mp_obj_t key = MP_OBJ_NEW_QSTR(attr);
+    const mp_map_t *map;
+    size_t slot;
+    if (type == &mp_type_module) {
+        mp_map_t *globals = &((mp_obj_module_t*)MP_OBJ_TO_PTR(base))->globals->map;
+        mp_map_elem_t *elem = mp_map_lookup(globals, key, MP_MAP_LOOKUP);
+        if (elem != NULL && inline_cache_can_fill(globals)) {
+            inline_cache_fill(table, ip, attr, MP_INLINE_CACHE_MODULE, globals, globals, elem - globals->table);
+        }
+    } else if (type == &mp_type_type) {
+        map = mp_obj_class_find_attr((const mp_obj_type_t*)MP_OBJ_TO_PTR(base), attr, true, &slot);
+        if (map != NULL) {
+            inline_cache_fill(table, ip, attr, MP_INLINE_CACHE_TYPE, MP_OBJ_TO_PTR(base), map, slot);
+        }
+    } else if (mp_obj_is_instance_type(type)) {
+        mp_map_t *members = &((mp_obj_instance_t*)MP_OBJ_TO_PTR(base))->members;
+        mp_map_elem_t *elem = mp_map_lookup(members, key, MP_MAP_LOOKUP);
+        if (elem != NULL) {
+            inline_cache_fill(table, ip, attr, MP_INLINE_CACHE_MEMBER, type, NULL, elem - members->table);
+            if (guess != NULL) {
+                *guess = (elem - members->table) & 0xff;
+            }
+        } else {
+            map = mp_obj_class_find_attr(type, attr, false, &slot);
+            if (map != NULL) {
+                inline_cache_fill(table, ip, attr, MP_INLINE_CACHE_INSTANCE, type, map, slot);
+            }
+        }
+    } else if (type->attr == NULL && type->locals_dict != NULL) {
+        // the generic lookup of mp_load_method_maybe
+        mp_map_t *locals_map = &type->locals_dict->map;
+        mp_map_elem_t *elem = mp_map_lookup(locals_map, key, MP_MAP_LOOKUP);
+        if (elem != NULL && inline_cache_can_fill(locals_map)) {
+            inline_cache_fill(table, ip, attr, MP_INLINE_CACHE_NATIVE, type, locals_map, elem - locals_map->table);
+        }
+    }
+}
+
+mp_obj_t mp_inline_cache_load_attr(const byte *ip, mp_obj_t base, qstr attr, byte *guess) {
+    mp_inline_cache_entry_t *table = MP_STATE_THREAD(inline_cache);
+    if (table == NULL) {
+        return mp_load_attr(base, attr);
+    }
+    mp_obj_t dest[2];
+    if (inline_cache_load(table, ip, base, attr, dest)) {
+        if (dest[1] == MP_OBJ_NULL) {
+            return dest[0];
+        }
+        return mp_obj_new_bound_meth(dest[0], dest[1]);
+    }
+    MP_STATE_VM(inline_cache_misses)++;
+    mp_obj_t value = mp_load_attr(base, attr);
+    inline_cache_fill_attr(table, ip, base, attr, guess);
+    return value;
+}
+
+void mp_inline_cache_load_method(const byte *ip, mp_obj_t base, qstr attr, mp_obj_t *dest) {
+    mp_inline_cache_entry_t *table = MP_STATE_THREAD(inline_cache);
+    if (table == NULL) {
+        mp_load_method(base, attr, dest);
+        return;
+    }
+    if (inline_cache_load(table, ip, base, attr, dest)) {
+        return;
+    }
+    MP_STATE_VM(inline_cache_misses)++;
+    mp_load_method(base, attr, dest);
+    inline_cache_fill_attr(table, ip, base, attr, NULL);
+}
+
+#endif // MICROPY_OPT_INLINE_CACHE
@@ -0,0 +1,68 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Owen Lyke
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef MICROPY_INCLUDED_PY_INLINECACHE_H
+#define MICROPY_INCLUDED_PY_INLINECACHE_H
+
+#include "py/obj.h"
+
+#if MICROPY_OPT_INLINE_CACHE
+
+// what a way of a call site was filled for, and so how its key is matched
+typedef enum _mp_inline_cache_kind_t {
+    MP_INLINE_CACHE_NONE = 0,
+    MP_INLINE_CACHE_GLOBAL,     // key is the globals map, the value is in map
+    MP_INLINE_CACHE_MODULE,     // key is the globals map of the module loaded from
+    MP_INLINE_CACHE_MEMBER,     // key is the type of the instance, slot a guess into its members
+    MP_INLINE_CACHE_INSTANCE,   // key is the type of the instance, the value is in the locals of a class
+    MP_INLINE_CACHE_TYPE,       // key is the type loaded from, the value is in the locals of it or a base
+    MP_INLINE_CACHE_NATIVE,     // key is the native type of the object, the value is in its locals
+} mp_inline_cache_kind_t;
+
+typedef struct _mp_inline_cache_way_t {
+    const void *key;
+    const mp_map_t *map;
+    size_t slot;
+    size_t version;             // map version the way was filled at, unused for members
+    mp_inline_cache_kind_t kind;
+} mp_inline_cache_way_t;
+
+// one call site, a load of qst by the instruction at ip, newest way first
+typedef struct _mp_inline_cache_entry_t {
+    const byte *ip;
+    qstr qst;
+    mp_inline_cache_way_t way[MICROPY_OPT_INLINE_CACHE_WAYS];
+} mp_inline_cache_entry_t;
+
+// ip is the address of the argument of the instruction, and guess if not NULL the slot
+// guess of MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE, set when a member is found
+mp_obj_t mp_inline_cache_load_name(const byte *ip, qstr qst);
+mp_obj_t mp_inline_cache_load_global(const byte *ip, qstr qst);
+mp_obj_t mp_inline_cache_load_attr(const byte *ip, mp_obj_t base, qstr attr, byte *guess);
+void mp_inline_cache_load_method(const byte *ip, mp_obj_t base, qstr attr, mp_obj_t *dest);
+
+#endif // MICROPY_OPT_INLINE_CACHE
+
+#endif // MICROPY_INCLUDED_PY_INLINECACHE_H
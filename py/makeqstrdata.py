@@ -229,6 +229,75 @@ def compute_hash(qstr, bytes_hash):
     # Make sure that valid hash is never zero, zero means "hash not computed"
     return (hash & ((1 << (8 * bytes_hash)) - 1)) or 1
 
+# this must match qstr_compute_hash_full() and qstr_index_mix() in qstr.c
+def compute_index_hash(qstr):
+    hash = 5381
+    for b in qstr:
+        hash = ((hash * 33) ^ b) & 0xffffffff
+    hash ^= hash >> 16
+    hash = (hash * 0x85ebca6b) & 0xffffffff
+    hash ^= hash >> 13
+    return hash
+
+# an open addressing table of the qstrs, linear probing from their index hash,
+# at most 3/4 full so a probe always reaches an empty slot; 0 (MP_QSTR_NULL) is empty
+def make_index(qstr_list):
+    size = 1
+    while size * 3 < len(qstr_list) * 4:
+        size *= 2
+    table = [0] * size
+    for i, qstr in enumerate(qstr_list):
+        slot = compute_index_hash(bytes_cons(qstr, 'utf8')) & (size - 1)
+        while table[slot] != 0:
+            slot = (slot + 1) & (size - 1)
+        table[slot] = i + 1 # ids start after MP_QSTR_NULL
+    return table
+
+# multipliers for the hash of the qstrs keying a ROM map table, one of which is
+# picked per table; this must match mp_map_rom_index_mult in map.c
+ROM_MAP_INDEX_MULT = [
+    0x9e3779b1, 0x85ebca6b, 0xc2b2ae35, 0x27d4eb2f, 0x165667b1, 0xd3a2646d, 0xfd7046c5, 0xb55a4f09,
+    0x7feb352d, 0x846ca68b, 0x61c88647, 0xcc9e2d51, 0x1b873593, 0xe6546b65, 0x68e31da5, 0xa54ff53b,
+]
+
+# tables with fewer entries are quicker to search than to hash
+ROM_MAP_INDEX_MIN = 8
+
+# an index of the positions of the qstrs keying a ROM map table, as bytes: the
+# number of bits of the hash, the multiplier used and the slots, each holding a
+# position + 1 (0 is empty); the multiplier is chosen so that no two keys share a
+# slot if possible, else they probe to the next, and the index is at most 3/4 full
+def make_rom_map_index(key_ids):
+    n = len(key_ids)
+    if n < ROM_MAP_INDEX_MIN or n >= 255:
+        return [0]
+    min_bits = 1
+    while (1 << min_bits) * 3 < n * 4:
+        min_bits += 1
+    def slot_of(q, sel, bits):
+        return ((q * ROM_MAP_INDEX_MULT[sel]) & 0xffffffff) >> (32 - bits)
+    for bits in range(min_bits, min_bits + 2):
+        for sel in range(len(ROM_MAP_INDEX_MULT)):
+            if len(set(slot_of(q, sel, bits) for q in key_ids)) == n:
+                best = (bits, sel)
+                break
+        else:
+            continue
+        break
+    else:
+        # no perfect hash, so take the one with the fewest keys out of place
+        bits = min_bits + 1
+        sel = min(range(len(ROM_MAP_INDEX_MULT)), key=lambda sel: n - len(set(slot_of(q, sel, bits) for q in key_ids)))
+        best = (bits, sel)
+    bits, sel = best
+    table = [0] * (1 << bits)
+    for pos, q in enumerate(key_ids):
+        slot = slot_of(q, sel, bits)
+        while table[slot] != 0:
+            slot = (slot + 1) & ((1 << bits) - 1)
+        table[slot] = pos + 1
+    return [bits, sel] + table
+
 def qstr_escape(qst):
     def esc_char(m):
         c = ord(m.group(0))
@@ -242,6 +311,7 @@ def qstr_escape(qst):
 def parse_input_headers(infiles):
     qcfgs = {}
     qstrs = {}
+    rom_maps = {}
 
     # add static qstrs
     for qstr in static_qstr_list:
@@ -271,6 +341,18 @@ def parse_input_headers(infiles):
                     qcfgs[match.group(1)] = value
                     continue
 
+                # is this the keys of a ROM map table?
+                match = re.match(r'^QROMMAP\((\w+)((?:, MP_QSTR_\w+)*)\)$', line)
+                if match:
+                    name = match.group(1)
+                    keys = [k[len('MP_QSTR_'):] for k in match.group(2).split(', ')[1:]]
+                    # tables of the same name in different files can only share an index
+                    # if they have the same keys
+                    if rom_maps.get(name, keys) != keys:
+                        keys = None
+                    rom_maps[name] = keys
+                    continue
+
                 # is this a QSTR line?
                 match = re.match(r'^Q\((.*)\)$', line)
                 if not match:
@@ -308,7 +390,7 @@ def parse_input_headers(infiles):
         sys.stderr.write("ERROR: Empty preprocessor output - check for errors above\n")
         sys.exit(1)
 
-    return qcfgs, qstrs
+    return qcfgs, qstrs, rom_maps
 
 def make_bytes(cfg_bytes_len, cfg_bytes_hash, qstr):
     qbytes = bytes_cons(qstr, 'utf8')
@@ -327,7 +409,7 @@ def make_bytes(cfg_bytes_len, cfg_bytes_hash, qstr):
     qhash_str = ('\\x%02x' * cfg_bytes_hash) % tuple(((qhash >> (8 * i)) & 0xff) for i in range(cfg_bytes_hash))
     return '(const byte*)"%s%s" "%s"' % (qhash_str, qlen_str, qdata)
 
-def print_qstr_data(qcfgs, qstrs):
+def print_qstr_data(qcfgs, qstrs, rom_maps):
     # get config variables
     cfg_bytes_len = int(qcfgs['BYTES_IN_LEN'])
     cfg_bytes_hash = int(qcfgs['BYTES_IN_HASH'])
@@ -340,13 +422,37 @@ def print_qstr_data(qcfgs, qstrs):
     print('QDEF(MP_QSTR_NULL, (const byte*)"%s%s" "")' % ('\\x00' * cfg_bytes_hash, '\\x00' * cfg_bytes_len))
 
     # go through each qstr and print it out
+    qstr_list = []
     for order, ident, qstr in sorted(qstrs.values(), key=lambda x: x[0]):
         qbytes = make_bytes(cfg_bytes_len, cfg_bytes_hash, qstr)
         print('QDEF(MP_QSTR_%s, %s)' % (ident, qbytes))
+        qstr_list.append(qstr)
+
+    # print the hash index of the qstrs, one QINDEX per slot
+    print('')
+    print('#ifdef QINDEX')
+    for q in make_index(qstr_list):
+        print('QINDEX(%d)' % q)
+    print('#endif')
+
+    # print the indexes of the ROM map tables, by the id of their keys
+    if rom_maps:
+        qstr_ids = {}
+        for i, (order, ident, qstr) in enumerate(sorted(qstrs.values(), key=lambda x: x[0])):
+            qstr_ids[ident] = i + 1
+        print('')
+        print('#ifdef QROMMAP')
+        for name, keys in sorted(rom_maps.items()):
+            if keys is None:
+                index = [0]
+            else:
+                index = make_rom_map_index([qstr_ids[k] for k in keys])
+            print('QROMMAP(%s, %s)' % (name, ', '.join(str(b) for b in index)))
+        print('#endif')
 
 def do_work(infiles):
-    qcfgs, qstrs = parse_input_headers(infiles)
-    print_qstr_data(qcfgs, qstrs)
+    qcfgs, qstrs, rom_maps = parse_input_headers(infiles)
+    print_qstr_data(qcfgs, qstrs, rom_maps)
 
 if __name__ == "__main__":
     do_work(sys.argv[1:])
@@ -1,6 +1,8 @@
 """
 This script processes the output from the C preprocessor and extracts all
 qstr. Each qstr is transformed into a qstr definition of the form 'Q(...)'.
+The keys of each ROM map table that a const dict wants an index for (see
+MICROPY_OPT_MAP_ROM_INDEX) are extracted as 'QROMMAP(table, MP_QSTR_key, ...)'.
 
 This script works with Python 2.6, 2.7, 3.3 and 3.4.
 """
@@ -23,10 +25,44 @@ def write_out(fname, output):
         with open(args.output_dir + "/" + fname + ".qstr", "w") as f:
             f.write("\n".join(output) + "\n")
 
+def find_rom_maps(text):
+    # the tables that MP_DEFINE_CONST_DICT refers to the index of
+    wanted = set(re.findall(r'\bmp_rom_map_index_([_a-zA-Z0-9]+)', text))
+    output = []
+    re_table = re.compile(r'\bmp_rom_map_elem_t\s+([_a-zA-Z0-9]+)\s*\[\s*\]\s*=\s*\{')
+    for m in re_table.finditer(text):
+        name = m.group(1)
+        if name not in wanted:
+            continue
+        # split the table into its {key, value} elements, the key of each being
+        # the first qstr in it; a table with any other key is listed without keys
+        # so it gets an empty index
+        keys = []
+        depth = 1
+        elem = None
+        for i in range(m.end(), len(text)):
+            c = text[i]
+            if c == '{':
+                if depth == 1:
+                    elem = i
+                depth += 1
+            elif c == '}':
+                depth -= 1
+                if depth == 1:
+                    key = re.search(r'MP_QSTR_[_a-zA-Z0-9]+', text[elem:i])
+                    keys.append(key.group(0) if key else None)
+                elif depth == 0:
+                    break
+        if None in keys:
+            keys = []
+        output.append('QROMMAP(' + ', '.join([name] + keys) + ')')
+    return output
+
 def process_file(f):
     re_line = re.compile(r"#[line]*\s\d+\s\"([^\"]+)\"")
     re_qstr = re.compile(r'MP_QSTR_[_a-zA-Z0-9]+')
     output = []
+    text = []
     last_fname = None
     for line in f:
         if line.isspace():
@@ -39,16 +75,18 @@ def process_file(f):
             if not fname.endswith(".c"):
                 continue
             if fname != last_fname:
-                write_out(last_fname, output)
+                write_out(last_fname, output + find_rom_maps(''.join(text)))
                 output = []
+                text = []
                 last_fname = fname
             continue
+        text.append(line)
         for match in re_qstr.findall(line):
             name = match.replace('MP_QSTR_', '')
             if name not in QSTRING_BLACK_LIST:
                 output.append('Q(' + name + ')')
 
-    write_out(last_fname, output)
+    write_out(last_fname, output + find_rom_maps(''.join(text)))
     return ""
 
 
@@ -25,6 +25,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -32,6 +33,7 @@
 #include "py/mpconfig.h"
 #include "py/misc.h"
 #include "py/runtime.h"
+#include "py/gc.h"
 
 #if MICROPY_DEBUG_VERBOSE // print debugging info
 #define DEBUG_PRINT (1)
@@ -40,6 +42,14 @@
 #define DEBUG_printf(...) (void)0
 #endif
 
+#if MICROPY_OPT_INLINE_CACHE
+// The inline caches remember where in a versioned map a key was found, so adding or
+// removing keys of a versioned map, or moving them, advances the map version
+#define MAP_KEYS_CHANGED(map) do { if ((map)->is_versioned) { ++MP_STATE_VM(map_version); } } while (0)
+#else
+#define MAP_KEYS_CHANGED(map) (void)0
+#endif
+
 // Fixed empty map. Useful when need to call kw-receiving functions
 // without any keywords from C, etc.
 const mp_map_t mp_const_empty_map = {
@@ -51,6 +61,56 @@ const mp_map_t mp_const_empty_map = {
     .table = NULL,
 };
 
+#if MICROPY_OPT_MAP_ROM_INDEX
+
+// The indexes of the tables of const dicts, made by makeqstrdata.py.  Each is the
+// number of bits n of the hash, the multiplier it uses and then 2**n slots that
+// hold the position + 1 in the table of the key hashing there, or 0 if empty.
+// Tables too small to be worth hashing have just the 0 of no hash.
+#ifndef NO_QSTR
+#define QDEF(id, str)
+#define QROMMAP(name, ...) const byte mp_rom_map_index_##name[] = { __VA_ARGS__ };
+#include "genhdr/qstrdefs.generated.h"
+#undef QROMMAP
+#undef QDEF
+#endif
+
+// this must match ROM_MAP_INDEX_MULT in makeqstrdata.py
+STATIC const uint32_t mp_map_rom_index_mult[] = {
+    0x9e3779b1, 0x85ebca6b, 0xc2b2ae35, 0x27d4eb2f, 0x165667b1, 0xd3a2646d, 0xfd7046c5, 0xb55a4f09,
+    0x7feb352d, 0x846ca68b, 0x61c88647, 0xcc9e2d51, 0x1b873593, 0xe6546b65, 0x68e31da5, 0xa54ff53b,
+};
+
+// Keys are most often found on the first probe, as the multiplier is chosen so
+// that none of them collide when one can be found.
+STATIC mp_map_elem_t *mp_map_lookup_rom_index(mp_map_t *map, const byte *rom_index, mp_obj_t index) {
+    if (!mp_obj_is_qstr(index)) {
+        // a str equal to a key is interned, as all keys are qstrs
+        size_t len;
+        const char *str = mp_obj_str_get_data(index, &len);
+        qstr q = qstr_find_strn(str, len);
+        if (q == MP_QSTR_NULL) {
+            return NULL;
+        }
+        index = MP_OBJ_NEW_QSTR(q);
+    }
+    size_t bits = rom_index[0];
+    size_t mask = ((size_t)1 << bits) - 1;
+    const byte *slot = rom_index + 2;
+    uint32_t hash = (uint32_t)MP_OBJ_QSTR_VALUE(index) * mp_map_rom_index_mult[rom_index[1]];
+    for (size_t i = hash >> (32 - bits);; i = (i + 1) & mask) {
+        if (slot[i] == 0) {
+            return NULL;
+        }
+        mp_map_elem_t *elem = &map->table[slot[i] - 1];
+        if (elem->key == index) {
+            return elem;
+        }
+    }
+}
+
+#endif
+
 // This table of sizes is used to control the growth of hash tables.
 // The first set of sizes are chosen so the allocation fits exactly in a
 // 4-word GC block, and it's not so important for these small values to be
@@ -88,6 +148,8 @@ void mp_map_init(mp_map_t *map, size_t n) {
     map->all_keys_are_qstrs = 1;
     map->is_fixed = 0;
     map->is_ordered = 0;
+    map->is_versioned = 0;
+    map->is_indexed = 0;
 }
 
 void mp_map_init_fixed_table(mp_map_t *map, size_t n, const mp_obj_t *table) {
@@ -96,11 +158,25 @@ void mp_map_init_fixed_table(mp_map_t *map, size_t n, const mp_obj_t *table) {
     map->all_keys_are_qstrs = 1;
     map->is_fixed = 1;
     map->is_ordered = 1;
+    map->is_versioned = 0;
+    map->is_indexed = 0;
     map->table = (mp_map_elem_t*)table;
 }
 
+#if MICROPY_OPT_INLINE_CACHE
+// Module globals and class locals are versioned, so a lookup cached in them stays good
+// until their keys change. The version is kept per context rather than per map, to keep
+// maps small, and it also advances here in case the map reuses the memory of one that
+// the caches still name
+void mp_map_set_versioned(mp_map_t *map) {
+    map->is_versioned = 1;
+    ++MP_STATE_VM(map_version);
+}
+#endif
+
 // Differentiate from mp_map_clear() - semantics is different
 void mp_map_deinit(mp_map_t *map) {
+    MAP_KEYS_CHANGED(map);
     if (!map->is_fixed) {
         m_del(mp_map_elem_t, map->table, map->alloc);
     }
@@ -108,6 +184,7 @@ void mp_map_deinit(mp_map_t *map) {
 }
 
 void mp_map_clear(mp_map_t *map) {
+    MAP_KEYS_CHANGED(map);
     if (!map->is_fixed) {
         m_del(mp_map_elem_t, map->table, map->alloc);
     }
@@ -125,6 +202,7 @@ STATIC void mp_map_rehash(mp_map_t *map) {
     mp_map_elem_t *old_table = map->table;
     mp_map_elem_t *new_table = m_new0(mp_map_elem_t, new_alloc);
     // If we reach this point, table resizing succeeded, now we can edit the old map.
+    MAP_KEYS_CHANGED(map);
     map->alloc = new_alloc;
     map->used = 0;
     map->all_keys_are_qstrs = 1;
@@ -166,6 +244,20 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
         }
     }
 
+    #if MICROPY_OPT_MAP_ROM_INDEX
+    if (map->is_indexed) {
+        const mp_obj_rom_dict_t *dict = (const mp_obj_rom_dict_t*)((const byte*)map - offsetof(mp_obj_rom_dict_t, map));
+        if (dict->index[0] != 0) {
+            return mp_map_lookup_rom_index(map, dict->index, index);
+        }
+    }
+    #endif
+
+    if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+        // the caller stores a value in the element returned
+        gc_write_barrier(map->table);
+    }
+
     // if the map is an ordered array then we must do a brute force linear search
     if (map->is_ordered) {
         for (mp_map_elem_t *elem = &map->table[0], *top = &map->table[map->used]; elem < top; elem++) {
@@ -174,6 +266,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
                 if (MP_UNLIKELY(lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND)) {
                     // remove the found element by moving the rest of the array down
                     mp_obj_t value = elem->value;
+                    MAP_KEYS_CHANGED(map);
                     --map->used;
                     memmove(elem, elem + 1, (top - elem - 1) * sizeof(*elem));
                     // put the found element after the end so the caller can access it if needed
@@ -195,6 +288,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
             map->table = m_renew(mp_map_elem_t, map->table, map->used, map->alloc);
             mp_seq_clear(map->table, map->used, map->alloc, sizeof(*map->table));
         }
+        MAP_KEYS_CHANGED(map);
         mp_map_elem_t *elem = map->table + map->used++;
         elem->key = index;
         if (!mp_obj_is_qstr(index)) {
@@ -232,6 +326,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
         if (slot->key == MP_OBJ_NULL) {
             // found NULL slot, so index is not in table
             if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+                MAP_KEYS_CHANGED(map);
                 map->used += 1;
                 if (avail_slot == NULL) {
                     avail_slot = slot;
@@ -255,6 +350,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
             // Note: CPython does not replace the index; try x={True:'true'};x[1]='one';x
             if (lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND) {
                 // delete element in this slot
+                MAP_KEYS_CHANGED(map);
                 map->used--;
                 if (map->table[(pos + 1) % map->alloc].key == MP_OBJ_NULL) {
                     // optimisation if next slot is empty
@@ -275,6 +371,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
             if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
                 if (avail_slot != NULL) {
                     // there was an available slot, so use that
+                    MAP_KEYS_CHANGED(map);
                     map->used++;
                     avail_slot->key = index;
                     avail_slot->value = MP_OBJ_NULL;
@@ -331,6 +428,9 @@ mp_obj_t mp_set_lookup(mp_set_t *set, mp_obj_t index, mp_map_lookup_kind_t looku
             return MP_OBJ_NULL;
         }
     }
+    if (lookup_kind & MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+        gc_write_barrier(set->table);
+    }
     mp_uint_t hash = MP_OBJ_SMALL_INT_VALUE(mp_unary_op(MP_UNARY_OP_HASH, index));
     size_t pos = hash % set->alloc;
     size_t start_pos = pos;
@@ -26,10 +26,31 @@
 
 #include "py/mpstate.h"
 #include "py/obj.h"
+#include "py/runtime.h"
 #include "py/gc.h"
 
 #if MICROPY_PY_GC && MICROPY_ENABLE_GC
 
+#if MICROPY_GC_INCREMENTAL
+// collect([budget_us]): run a garbage collection, or with a budget a step of an
+// incremental one, returning whether the step finished the collection
+STATIC mp_obj_t py_gc_collect(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 1) {
+        mp_int_t budget_us = mp_obj_get_int(args[0]);
+        if (budget_us < 0) {
+            mp_raise_ValueError(NULL);
+        }
+        return mp_obj_new_bool(gc_collect_step(budget_us));
+    }
+    gc_collect();
+#if MICROPY_PY_GC_COLLECT_RETVAL
+    return MP_OBJ_NEW_SMALL_INT(MP_STATE_MEM(gc_collected));
+#else
+    return mp_const_none;
+#endif
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_collect_obj, 0, 1, py_gc_collect);
+#else
 // collect(): run a garbage collection
 STATIC mp_obj_t py_gc_collect(void) {
     gc_collect();
@@ -40,6 +61,7 @@ STATIC mp_obj_t py_gc_collect(void) {
 #endif
 }
 MP_DEFINE_CONST_FUN_OBJ_0(gc_collect_obj, py_gc_collect);
+#endif
 
 // disable(): disable the garbage collector
 STATIC mp_obj_t gc_disable(void) {
@@ -95,6 +117,22 @@ STATIC mp_obj_t gc_threshold(size_t n_args, const mp_obj_t *args) {
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_threshold_obj, 0, 1, gc_threshold);
 #endif
 
+#if MICROPY_GC_INCREMENTAL
+// pauses([reset]): return the histogram of GC pauses of the context as a tuple,
+// where item n counts the pauses shorter than 64 << n microseconds (and not in
+// an earlier item) and the last item the rest; clear it if reset is true
+STATIC mp_obj_t gc_pauses(size_t n_args, const mp_obj_t *args) {
+    uint32_t hist[MICROPY_GC_PAUSE_BUCKETS];
+    gc_pause_info(hist, n_args == 1 && mp_obj_is_true(args[0]));
+    mp_obj_t items[MICROPY_GC_PAUSE_BUCKETS];
+    for (size_t i = 0; i < MICROPY_GC_PAUSE_BUCKETS; i++) {
+        items[i] = mp_obj_new_int_from_uint(hist[i]);
+    }
+    return mp_obj_new_tuple(MICROPY_GC_PAUSE_BUCKETS, items);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_pauses_obj, 0, 1, gc_pauses);
+#endif
+
 STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_gc) },
     { MP_ROM_QSTR(MP_QSTR_collect), MP_ROM_PTR(&gc_collect_obj) },
@@ -106,6 +144,9 @@ STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     #if MICROPY_GC_ALLOC_THRESHOLD
     { MP_ROM_QSTR(MP_QSTR_threshold), MP_ROM_PTR(&gc_threshold_obj) },
     #endif
+    #if MICROPY_GC_INCREMENTAL
+    { MP_ROM_QSTR(MP_QSTR_pauses), MP_ROM_PTR(&gc_pauses_obj) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_gc_globals, mp_module_gc_globals_table);
@@ -121,6 +121,22 @@ STATIC mp_obj_t mp_micropython_pystack_use(void) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_pystack_use_obj, mp_micropython_pystack_use);
 #endif
 
+#if MICROPY_OPT_INLINE_CACHE
+STATIC mp_obj_t mp_micropython_inline_cache_info(size_t n_args, const mp_obj_t *args) {
+    // hits and misses of the inline caches of the context, cleared if the arg is true
+    mp_obj_t tuple[2] = {
+        mp_obj_new_int_from_uint(MP_STATE_VM(inline_cache_hits)),
+        mp_obj_new_int_from_uint(MP_STATE_VM(inline_cache_misses)),
+    };
+    if (n_args == 1 && mp_obj_is_true(args[0])) {
+        MP_STATE_VM(inline_cache_hits) = 0;
+        MP_STATE_VM(inline_cache_misses) = 0;
+    }
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_inline_cache_info_obj, 0, 1, mp_micropython_inline_cache_info);
+#endif
+
 #if MICROPY_ENABLE_GC
 STATIC mp_obj_t mp_micropython_heap_lock(void) {
     gc_lock();
@@ -181,6 +197,9 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     #if MICROPY_ENABLE_PYSTACK
     { MP_ROM_QSTR(MP_QSTR_pystack_use), MP_ROM_PTR(&mp_micropython_pystack_use_obj) },
     #endif
+    #if MICROPY_OPT_INLINE_CACHE
+    { MP_ROM_QSTR(MP_QSTR_inline_cache_info), MP_ROM_PTR(&mp_micropython_inline_cache_info_obj) },
+    #endif
     #if MICROPY_ENABLE_GC
     { MP_ROM_QSTR(MP_QSTR_heap_lock), MP_ROM_PTR(&mp_micropython_heap_lock_obj) },
     { MP_ROM_QSTR(MP_QSTR_heap_unlock), MP_ROM_PTR(&mp_micropython_heap_unlock_obj) },
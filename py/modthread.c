@@ -126,19 +126,17 @@ STATIC const mp_obj_type_t mp_type_thread_lock = {
 /****************************************************************/
 // _thread module
 
-STATIC size_t thread_stack_size = 0;
-
 STATIC mp_obj_t mod_thread_get_ident(void) {
     return mp_obj_new_int_from_uint((uintptr_t)mp_thread_get_state());
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_thread_get_ident_obj, mod_thread_get_ident);
 
 STATIC mp_obj_t mod_thread_stack_size(size_t n_args, const mp_obj_t *args) {
-    mp_obj_t ret = mp_obj_new_int_from_uint(thread_stack_size);
+    mp_obj_t ret = mp_obj_new_int_from_uint(MP_STATE_VM(thread_stack_size));
     if (n_args == 0) {
-        thread_stack_size = 0;
+        MP_STATE_VM(thread_stack_size) = 0;
     } else {
-        thread_stack_size = mp_obj_get_int(args[0]);
+        MP_STATE_VM(thread_stack_size) = mp_obj_get_int(args[0]);
     }
     return ret;
 }
@@ -165,6 +163,12 @@ STATIC void *thread_entry(void *args_in) {
     mp_stack_set_top(&ts + 1); // need to include ts in root-pointer scan
     mp_stack_set_limit(args->stack_size);
 
+    #if MICROPY_OPT_INLINE_CACHE
+    // without the GIL the inline caches of the context would be filled by threads
+    // at the same time, so other threads load without them
+    ts.inline_cache = MICROPY_PY_THREAD_GIL ? MP_STATE_VM(inline_cache) : NULL;
+    #endif
+
     #if MICROPY_ENABLE_PYSTACK
     // TODO threading and pystack is not fully supported, for now just make a small stack
     mp_obj_t mini_pystack[128];
@@ -196,6 +200,10 @@ STATIC void *thread_entry(void *args_in) {
         mp_obj_base_t *exc = (mp_obj_base_t*)nlr.ret_val;
         if (mp_obj_is_subclass_fast(MP_OBJ_FROM_PTR(exc->type), MP_OBJ_FROM_PTR(&mp_type_SystemExit))) {
             // swallow exception silently
+        #if MICROPY_PY_MULTIPYTHON
+        } else if (mp_active_contexts[MICROPY_GET_CORE_INDEX]->status & MP_CSTOP) {
+            // the exception that stops the context ends its threads quietly too
+        #endif
         } else {
             // print exception out
             mp_printf(MICROPY_ERROR_PRINTER, "Unhandled exception in thread started by ");
@@ -258,7 +266,7 @@ STATIC mp_obj_t mod_thread_start_new_thread(size_t n_args, const mp_obj_t *args)
     th_args->dict_globals = mp_globals_get();
 
     // set the stack size to use
-    th_args->stack_size = thread_stack_size;
+    th_args->stack_size = MP_STATE_VM(thread_stack_size);
 
     // set the function for thread entry
     th_args->fun = args[0];
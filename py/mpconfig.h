@@ -123,6 +123,26 @@
 #define MICROPY_REPL_CORE (0)
 #endif
 
+// Number of slots in the task ID -> context index used by the task switch
+// hook (must be a power of 2). It holds the tasks of contexts and of the threads
+// they start. Contexts that don't fit are still found, but by a linear scan of
+// the context list.
+#ifndef MICROPY_CONTEXT_INDEX_SIZE
+#define MICROPY_CONTEXT_INDEX_SIZE (64)
+#endif
+
+// Default depth of the response queue of a context (must be a power of 2).
+// start() can choose another depth for each context.
+#ifndef MICROPY_RESPONSE_QUEUE_DEPTH
+#define MICROPY_RESPONSE_QUEUE_DEPTH (64)
+#endif
+
+// Number of buckets in the index of multipython responses by the hash of their
+// condition (must be a power of 2).
+#ifndef MICROPY_MULTIPYTHON_RESPONSE_BUCKETS
+#define MICROPY_MULTIPYTHON_RESPONSE_BUCKETS (64)
+#endif
+
 /*****************************************************************************/
 /* Memory allocation policy                                                  */
 
@@ -156,12 +176,61 @@
 #define MICROPY_GC_CONSERVATIVE_CLEAR (MICROPY_ENABLE_GC)
 #endif
 
+// Support a GC heap made of several regions, added with gc_add(). When an
+// allocation fails even after a collection, the heap of the running context
+// grows by a region from mp_context_dynmem_alloc, up to gc_heap_grow_limit bytes.
+#ifndef MICROPY_GC_SPLIT_HEAP
+#define MICROPY_GC_SPLIT_HEAP (0)
+#endif
+
 // Support automatic GC when reaching allocation threshold,
 // configurable by gc.threshold().
 #ifndef MICROPY_GC_ALLOC_THRESHOLD
 #define MICROPY_GC_ALLOC_THRESHOLD (1)
 #endif
 
+// Support incremental collections, run by gc_collect_step() (gc.collect(budget_us))
+// in steps of bounded time, with a write barrier on the core stores into
+// objects. A histogram of the pauses of all collections is kept too.
+#ifndef MICROPY_GC_INCREMENTAL
+#define MICROPY_GC_INCREMENTAL (0)
+#endif
+
+// Number of buckets in the histogram of GC pauses; bucket n counts the pauses
+// shorter than 64 << n microseconds that aren't in an earlier one, and the last
+// bucket counts the rest.
+#ifndef MICROPY_GC_PAUSE_BUCKETS
+#define MICROPY_GC_PAUSE_BUCKETS (12)
+#endif
+
+// Allocations of 2 to this many blocks are taken from free lists of runs of free
+// blocks, one per size and filled in by the sweep and by gc_free, before the
+// allocation table is searched. The last list holds the longer runs too, which
+// small objects are split off. 0 disables the free lists.
+#ifndef MICROPY_GC_SIZE_CLASSES
+#define MICROPY_GC_SIZE_CLASSES (0)
+#endif
+
+// Number of runs of free blocks each size class remembers.
+#ifndef MICROPY_GC_FREE_LIST_LEN
+#define MICROPY_GC_FREE_LIST_LEN (16)
+#endif
+
+// Allocations of at least this many blocks are made from the top of the heap
+// down, so large buffers are kept apart from the small objects that fill it
+// from the bottom up; 0 disables this.
+#ifndef MICROPY_GC_LARGE_BLOCKS
+#define MICROPY_GC_LARGE_BLOCKS (0)
+#endif
+
+// Number of helper threads that mark the heap along with the collecting thread
+// in a full collection, run by mp_thread_gc_helpers_start() of the port, which
+// may start fewer (eg one per other CPU); 0 marks on the collecting thread
+// only. Needs MICROPY_PY_THREAD.
+#ifndef MICROPY_GC_MARK_THREADS
+#define MICROPY_GC_MARK_THREADS (0)
+#endif
+
 // Number of bytes to allocate initially when creating new chunks to store
 // interned string data.  Smaller numbers lead to more chunks being needed
 // and more wastage at the end of the chunk.  Larger numbers lead to wasted
@@ -286,6 +355,15 @@
 #define MICROPY_PERSISTENT_CODE_SAVE (0)
 #endif
 
+// Whether to provide mp_raw_code_save_file(), which needs POSIX file functions
+#ifndef MICROPY_PERSISTENT_CODE_SAVE_FILE
+#if defined(__i386__) || defined(__x86_64__) || defined(__unix__)
+#define MICROPY_PERSISTENT_CODE_SAVE_FILE (MICROPY_PERSISTENT_CODE_SAVE)
+#else
+#define MICROPY_PERSISTENT_CODE_SAVE_FILE (0)
+#endif
+#endif
+
 // Whether generated code can persist independently of the VM/runtime instance
 // This is enabled automatically when needed by other features
 #ifndef MICROPY_PERSISTENT_CODE
@@ -359,9 +437,11 @@
 // Configure dynamic compiler macros
 #if MICROPY_DYNAMIC_COMPILER
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE_DYNAMIC (mp_dynamic_compiler.opt_cache_map_lookup_in_bytecode)
+#define MICROPY_OPT_SUPERINSTRUCTIONS_DYNAMIC (mp_dynamic_compiler.opt_superinstructions)
 #define MICROPY_PY_BUILTINS_STR_UNICODE_DYNAMIC (mp_dynamic_compiler.py_builtins_str_unicode)
 #else
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE_DYNAMIC MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+#define MICROPY_OPT_SUPERINSTRUCTIONS_DYNAMIC MICROPY_OPT_SUPERINSTRUCTIONS
 #define MICROPY_PY_BUILTINS_STR_UNICODE_DYNAMIC MICROPY_PY_BUILTINS_STR_UNICODE
 #endif
 
@@ -456,6 +536,56 @@
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (0)
 #endif
 
+// Whether to cache where LOAD_NAME, LOAD_GLOBAL, LOAD_ATTR and LOAD_METHOD found
+// their value, per call site. The caches are a table in the VM state keyed on the
+// bytecode address, so they also work for code that is shared or in ROM, and are
+// checked against the type or map they were filled for and the map version (see
+// mp_map_set_versioned()). A hit skips the map lookups and the walk of the bases.
+#ifndef MICROPY_OPT_INLINE_CACHE
+#define MICROPY_OPT_INLINE_CACHE (0)
+#endif
+
+// Number of call sites the inline caches hold, a power of 2
+#ifndef MICROPY_OPT_INLINE_CACHE_SIZE
+#define MICROPY_OPT_INLINE_CACHE_SIZE (64)
+#endif
+
+// Number of types a call site is cached for before the oldest is replaced
+#ifndef MICROPY_OPT_INLINE_CACHE_WAYS
+#define MICROPY_OPT_INLINE_CACHE_WAYS (2)
+#endif
+
+// Whether the VM rewrites binary ops and subscripts, after running them, into variants
+// specialised for the types they saw (small ints, floats, lists and bytearrays indexed
+// by small ints), which check the types and rewrite themselves back if they change.
+// Only bytecode made at runtime is rewritten, frozen bytecode may be in ROM.
+#ifndef MICROPY_OPT_QUICKEN
+#define MICROPY_OPT_QUICKEN (0)
+#endif
+
+// Whether qstr_find_strn() looks strings up in hash indexes of the qstrs instead
+// of scanning the pools: one of the qstrs in ROM, generated by makeqstrdata.py,
+// and one of those interned at runtime, kept on the heap of each context.
+#ifndef MICROPY_OPT_QSTR_INDEX
+#define MICROPY_OPT_QSTR_INDEX (0)
+#endif
+
+// Whether the tables of dicts defined with MP_DEFINE_CONST_DICT are searched
+// through a hash index of their keys made at build time by makeqstrdata.py,
+// instead of linearly.  A dict defined this way has type mp_obj_rom_dict_t, so
+// any extern declaration of one must use that type.
+#ifndef MICROPY_OPT_MAP_ROM_INDEX
+#define MICROPY_OPT_MAP_ROM_INDEX (0)
+#endif
+
+// Whether the bytecode emitter fuses common instruction sequences into single
+// opcodes: load-add-store of a local and a small int, a compare followed by a
+// conditional jump, and two loads of locals.  The VM can then run bytecode that
+// uses them; .mpy files that do are marked as such and rejected by VMs without it.
+#ifndef MICROPY_OPT_SUPERINSTRUCTIONS
+#define MICROPY_OPT_SUPERINSTRUCTIONS (0)
+#endif
+
 // Whether to use fast versions of bitwise operations (and, or, xor) when the
 // arguments are both positive.  Increases Thumb2 code size by about 250 bytes.
 #ifndef MICROPY_OPT_MPZ_BITWISE
@@ -1348,6 +1478,69 @@ typedef double mp_float_t;
 #define MICROPY_PY_FRAMEBUF (0)
 #endif
 
+// Whether to provide the "multipython" module (needs a port backend that
+// runs each context on its own task, see extmod/modmultipython.h)
+#ifndef MICROPY_PY_MULTIPYTHON
+#define MICROPY_PY_MULTIPYTHON (0)
+#endif
+
+// Whether modules imported from source are compiled once and their code shared
+// by all the contexts that import them (needs the bookkeeping of persistent code)
+#ifndef MICROPY_MULTIPYTHON_CODE_CACHE
+#define MICROPY_MULTIPYTHON_CODE_CACHE (MICROPY_PY_MULTIPYTHON && MICROPY_PERSISTENT_CODE_SAVE)
+#endif
+
+// Whether the switch hook and the GC keep runtime accounting of each context
+// (run time, switches, collections, allocations), see multipython.stats()
+#ifndef MICROPY_MULTIPYTHON_STATS
+#define MICROPY_MULTIPYTHON_STATS (MICROPY_PY_MULTIPYTHON)
+#endif
+
+// Whether start() takes a CPU budget per period for a context, which is held back at
+// backward branches once it has used up its budget (needs the runtime accounting)
+#ifndef MICROPY_MULTIPYTHON_BUDGET
+#define MICROPY_MULTIPYTHON_BUDGET (MICROPY_MULTIPYTHON_STATS)
+#endif
+
+// Backward branches a context with a budget takes between two checks of it
+#ifndef MICROPY_MULTIPYTHON_BUDGET_INTERVAL
+#define MICROPY_MULTIPYTHON_BUDGET_INTERVAL (64)
+#endif
+
+// Whether to provide multipython.Pool, worker contexts that run submitted jobs
+// (see extmod/multipython_pool.c)
+#ifndef MICROPY_MULTIPYTHON_POOL
+#define MICROPY_MULTIPYTHON_POOL (MICROPY_PY_MULTIPYTHON)
+#endif
+
+// Whether contexts can share buffers outside of their heaps, seen as memoryviews
+// (see extmod/multipython_shared.c)
+#ifndef MICROPY_MULTIPYTHON_SHARED
+#define MICROPY_MULTIPYTHON_SHARED (MICROPY_PY_MULTIPYTHON && MICROPY_PY_BUILTINS_MEMORYVIEW)
+#endif
+
+// How MP_STATE_VM, MP_STATE_MEM and MP_STATE_THREAD find the state of the running
+// context (see py/mpstate.h)
+// the per-core array mp_active_states, kept up to date by the switch hook
+#define MICROPY_STATE_PTR_CORE_ARRAY (0)
+// a thread-local pointer, set by mp_context_switch on the thread that runs the
+// context (the port must call it from that thread rather than from a scheduler hook)
+#define MICROPY_STATE_PTR_THREAD_LOCAL (1)
+// the state of the main context as a static struct, for builds with one context
+#define MICROPY_STATE_PTR_STATIC (2)
+#ifndef MICROPY_STATE_PTR
+#if MICROPY_PY_MULTIPYTHON
+#define MICROPY_STATE_PTR (MICROPY_STATE_PTR_CORE_ARRAY)
+#else
+#define MICROPY_STATE_PTR (MICROPY_STATE_PTR_STATIC)
+#endif
+#endif
+
+// Storage class of thread-local variables
+#ifndef MICROPY_THREAD_LOCAL
+#define MICROPY_THREAD_LOCAL __thread
+#endif
+
 #ifndef MICROPY_PY_BTREE
 #define MICROPY_PY_BTREE (0)
 #endif
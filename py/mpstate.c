@@ -25,6 +25,7 @@
  */
 
 #include "py/mpstate.h"
+#include "py/mphal.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -37,10 +38,17 @@ int8_t mp_task_free_all( uint32_t tID );
 
 
 // switch the micropython state to a given node
+// this is called from the task switch hook so it only swaps pointers; the mirror
+// variables are refreshed only when the core actually changes context
 void mp_context_switch(mp_context_node_t* node){
     if( node == NULL ){ return; }
-    mp_active_contexts[MICROPY_GET_CORE_INDEX] = node;
-    mp_active_context_mirrors[MICROPY_GET_CORE_INDEX] = *(mp_active_contexts[MICROPY_GET_CORE_INDEX]);
+    #if MICROPY_STATE_PTR == MICROPY_STATE_PTR_THREAD_LOCAL
+    mp_active_state = node->state;
+    #endif
+    size_t core = MICROPY_GET_CORE_INDEX;
+    if( mp_active_contexts[core] == node ){ return; }
+    mp_active_contexts[core] = node;
+    mp_active_states[core] = node->state;
     mp_context_refresh();
 }
 
@@ -55,36 +63,85 @@ void mp_context_refresh( void ){
 }
 
 // operation queue functions
+// producers claim a position with a compare-and-swap on w_pos and publish the cell
+// by advancing its sequence number, the consumer hands the cell back the same way
+#define MP_QUEUE_LOAD(ptr)              __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define MP_QUEUE_STORE(ptr, val)        __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define MP_QUEUE_CAS(ptr, expected, val) __atomic_compare_exchange_n((ptr), (expected), (val), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#define MP_QUEUE_ADD(ptr, val)          __atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED)
+
+#define MP_QUEUE_CELL(queue, pos)       (&(queue)->cells[(pos) & (queue)->mask])
+#define MP_QUEUE_INDEX(queue, cell)     ((size_t)((cell) - (queue)->cells))
+#define MP_QUEUE_SEQ(queue, cell)       (MP_QUEUE_LOAD(&(cell)->seq) + MP_QUEUE_INDEX(queue, cell))
+#define MP_QUEUE_SET_SEQ(queue, cell, val) MP_QUEUE_STORE(&(cell)->seq, (val) - MP_QUEUE_INDEX(queue, cell))
+
+void mp_response_queue_init( mp_response_queue_t* queue, mp_response_cell_t* cells, size_t depth ){
+    // depth must be a power of 2
+    memset((void*)cells, 0x00, depth * sizeof(mp_response_cell_t));
+    memset((void*)queue, 0x00, sizeof(mp_response_queue_t));
+    queue->cells = cells;
+    queue->mask = depth - 1;
+}
+
+size_t mp_response_queue_depth( mp_response_queue_t* queue ){
+    return ( queue->cells == NULL ) ? 0 : queue->mask + 1;
+}
 
 size_t mp_response_queue_available( mp_response_queue_t* queue ){
-    if( queue->r_head == queue->w_head ){ return 0; }
-    if( queue->w_head > queue->r_head ){ return (queue->w_head - queue->r_head); }
-    else{ return (( queue->w_head ) + ( MP_RESPONSE_QUEUE_SIZE - 1 - queue->r_head ) ); }
+    // responses still being written are counted too
+    size_t r_pos = MP_QUEUE_LOAD(&queue->r_pos);
+    size_t w_pos = MP_QUEUE_LOAD(&queue->w_pos);
+    size_t available = w_pos - r_pos;
+    if( available > mp_response_queue_depth( queue ) ){ return 0; } // r_pos moved past our w_pos snapshot
+    return available;
 }
 
 size_t mp_response_queue_peek( mp_response_queue_t* queue, mp_response_t* response ){
-    if( queue->r_head == queue->w_head ){ return 0; }
-    *response = *(queue->buff + queue->r_head);
+    if( queue->cells == NULL ){ return 0; }
+    size_t pos = MP_QUEUE_LOAD(&queue->r_pos);
+    mp_response_cell_t* cell = MP_QUEUE_CELL(queue, pos);
+    if( MP_QUEUE_SEQ(queue, cell) != pos + 1 ){ return 0; } // empty, or not yet published
+    *response = cell->response;
     return 1;
 }
 
 size_t mp_response_queue_read( mp_response_queue_t* queue, mp_response_t* response ){
-    size_t next = 0;
-    if( queue->r_head == queue->w_head ){ return 0; }
-    next = queue->r_head + 1;
-    if( next >= MP_RESPONSE_QUEUE_SIZE ){ next = 0; }
-    *response = *(queue->buff + queue->r_head);
-    queue->r_head = next;
+    // only the context that owns the queue may read it
+    if( queue->cells == NULL ){ return 0; }
+    size_t pos = queue->r_pos;
+    mp_response_cell_t* cell = MP_QUEUE_CELL(queue, pos);
+    if( MP_QUEUE_SEQ(queue, cell) != pos + 1 ){ return 0; }
+    *response = cell->response;
+    MP_QUEUE_SET_SEQ(queue, cell, pos + queue->mask + 1); // free for the next lap
+    MP_QUEUE_STORE(&queue->r_pos, pos + 1);
+    queue->full = 0;
     return 1;
 }
 
 size_t mp_response_queue_write( mp_response_queue_t* queue, mp_response_t response ){
     // stores an operation in the operation queue, unless the queue is full. Returns the number of successful stores
-    size_t next = queue->w_head + 1;
-    if( next >= MP_RESPONSE_QUEUE_SIZE ){ next = 0; }
-    if( next == queue->r_head ){ return 0; }
-    *(queue->buff + queue->w_head) = response;
-    queue->w_head = next;
+    // safe to call from any context, core or interrupt at the same time
+    if( queue->cells == NULL ){ return 0; }
+    size_t pos = MP_QUEUE_LOAD(&queue->w_pos);
+    mp_response_cell_t* cell;
+    for( ;; ){
+        cell = MP_QUEUE_CELL(queue, pos);
+        intptr_t diff = (intptr_t)(MP_QUEUE_SEQ(queue, cell) - pos);
+        if( diff == 0 ){
+            if( MP_QUEUE_CAS(&queue->w_pos, &pos, pos + 1) ){ break; } // claimed, otherwise pos was reloaded
+        }else if( diff < 0 ){
+            // the consumer is a whole lap behind
+            MP_QUEUE_ADD(&queue->dropped, 1);
+            if( !__atomic_exchange_n(&queue->full, 1, __ATOMIC_RELAXED) ){
+                MP_QUEUE_ADD(&queue->overflows, 1);
+            }
+            return 0;
+        }else{
+            pos = MP_QUEUE_LOAD(&queue->w_pos); // another producer claimed this position
+        }
+    }
+    cell->response = response;
+    MP_QUEUE_SET_SEQ(queue, cell, pos + 1);
     return 1;
 }
 
@@ -116,14 +173,203 @@ mp_context_node_t* mp_new_context_node( void ){
     return node;
 }
 
+#if MICROPY_MULTIPYTHON_STATS
+// Unlike mp_active_contexts, which keeps the last context when a task that isn't
+// a context is switched in, this is NULL while no context runs on the core
+STATIC mp_context_node_t* mp_running_contexts[MICROPY_NUM_CORES];
+#endif
+
+// task ID -> context index (open addressing, linear probing)
+// slots are only ever overwritten with a single pointer store so that the switch
+// hook can read the index while a task is registering or removing a context.
+// A slot holds a context node, or a thread of a context tagged in the low bit
+#define MP_CONTEXT_INDEX_MASK       (MICROPY_CONTEXT_INDEX_SIZE - 1)
+#define MP_CONTEXT_INDEX_TOMBSTONE  ((void*)(uintptr_t)1)
+#define MP_CONTEXT_INDEX_THREAD     ((uintptr_t)1)
+#define MP_CONTEXT_INDEX_IS_THREAD(slot)    ((uintptr_t)(slot) & MP_CONTEXT_INDEX_THREAD)
+#define MP_CONTEXT_INDEX_TO_THREAD(slot)    ((mp_context_thread_t*)((uintptr_t)(slot) & ~MP_CONTEXT_INDEX_THREAD))
+#define MP_CONTEXT_INDEX_FROM_THREAD(thread) ((void*)((uintptr_t)(thread) | MP_CONTEXT_INDEX_THREAD))
+
+STATIC void* mp_context_index[MICROPY_CONTEXT_INDEX_SIZE];
+STATIC size_t mp_context_index_overflow = 0; // number of contexts with an ID that did not fit in the index
+
+static inline size_t mp_context_index_hash( uint32_t tID ){
+    // task IDs are usually aligned pointers so mix the bits before masking
+    tID ^= tID >> 16;
+    tID *= 0x45d9f3b;
+    tID ^= tID >> 16;
+    return (size_t)(tID & MP_CONTEXT_INDEX_MASK);
+}
+
+static inline uint32_t mp_context_index_id( void* slot ){
+    if( MP_CONTEXT_INDEX_IS_THREAD(slot) ){
+        return MP_CONTEXT_INDEX_TO_THREAD(slot)->id;
+    }
+    return ((mp_context_node_t*)slot)->id;
+}
+
+STATIC void mp_context_index_insert( uint32_t tID, void* entry, uint8_t* unindexed ){
+    // unindexed is the flag of the entry, set when it did not fit
+    if( tID == 0 ){ return; } // unassigned IDs are not indexed
+    size_t pos = mp_context_index_hash( tID );
+    for( size_t probe = 0; probe < MICROPY_CONTEXT_INDEX_SIZE; probe++ ){
+        void* slot = mp_context_index[pos];
+        if( ( slot == NULL ) || ( slot == MP_CONTEXT_INDEX_TOMBSTONE ) ){
+            mp_context_index[pos] = entry;
+            return;
+        }
+        pos = (pos + 1) & MP_CONTEXT_INDEX_MASK;
+    }
+    *unindexed = 1;
+    mp_context_index_overflow++;
+}
+
+STATIC void mp_context_index_remove( uint32_t tID, void* entry, uint8_t* unindexed ){
+    if( tID == 0 ){ return; }
+    if( *unindexed ){
+        *unindexed = 0;
+        mp_context_index_overflow--;
+        return;
+    }
+    size_t pos = mp_context_index_hash( tID );
+    for( size_t probe = 0; probe < MICROPY_CONTEXT_INDEX_SIZE; probe++ ){
+        void* slot = mp_context_index[pos];
+        if( slot == NULL ){ return; }
+        if( slot == entry ){ break; }
+        pos = (pos + 1) & MP_CONTEXT_INDEX_MASK;
+    }
+    if( mp_context_index[pos] != entry ){ return; } // not in the index
+    mp_context_index[pos] = MP_CONTEXT_INDEX_TOMBSTONE;
+
+    // a run of tombstones that ends at an empty slot (or fills the index) keeps no
+    // entry reachable, so it becomes empty again, starting next to that slot. Runs
+    // then always end at an entry and misses stop at the first empty slot
+    size_t end = (pos + 1) & MP_CONTEXT_INDEX_MASK;
+    size_t run = 1;
+    while( ( run < MICROPY_CONTEXT_INDEX_SIZE ) && ( mp_context_index[end] == MP_CONTEXT_INDEX_TOMBSTONE ) ){
+        end = (end + 1) & MP_CONTEXT_INDEX_MASK;
+        run++;
+    }
+    if( ( run < MICROPY_CONTEXT_INDEX_SIZE ) && ( mp_context_index[end] != NULL ) ){ return; }
+    for( size_t probe = 0; probe < MICROPY_CONTEXT_INDEX_SIZE; probe++ ){
+        end = (end - 1) & MP_CONTEXT_INDEX_MASK;
+        if( mp_context_index[end] != MP_CONTEXT_INDEX_TOMBSTONE ){ break; }
+        mp_context_index[end] = NULL;
+    }
+}
+
+STATIC void* mp_context_index_find( uint32_t tID ){
+    size_t pos = mp_context_index_hash( tID );
+    for( size_t probe = 0; probe < MICROPY_CONTEXT_INDEX_SIZE; probe++ ){
+        void* slot = mp_context_index[pos];
+        if( slot == NULL ){ break; }
+        if( ( slot != MP_CONTEXT_INDEX_TOMBSTONE ) && ( mp_context_index_id( slot ) == tID ) ){ return slot; }
+        pos = (pos + 1) & MP_CONTEXT_INDEX_MASK;
+    }
+    return NULL;
+}
+
 mp_context_node_t* mp_context_by_tid( uint32_t tID ){
+    // the context with the task ID, or the context of the thread with it
+    if( tID != 0 ){
+        void* slot = mp_context_index_find( tID );
+        if( slot != NULL ){
+            return MP_CONTEXT_INDEX_IS_THREAD(slot) ? MP_CONTEXT_INDEX_TO_THREAD(slot)->context : (mp_context_node_t*)slot;
+        }
+        if( mp_context_index_overflow == 0 ){ return NULL; }
+    }
+
+    // slow path: unassigned IDs and contexts or threads that did not fit in the index
     mp_context_iter_t iter = NULL;
     for( iter = mp_context_iter_first(MP_ITER_FROM_CONTEXT_PTR(mp_context_head)); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter) ){
-        if(MP_CONTEXT_PTR_FROM_ITER(iter)->id == tID){ break; }
+        mp_context_node_t* node = MP_CONTEXT_PTR_FROM_ITER(iter);
+        if( node->id == tID ){ break; }
+        if( tID == 0 ){ continue; }
+        for( mp_context_thread_t* thread = node->threads; thread != NULL; thread = thread->next ){
+            if( thread->id == tID ){ return node; }
+        }
     }
     return MP_CONTEXT_PTR_FROM_ITER(iter);
 }
 
+void mp_context_thread_add( mp_context_node_t* node, mp_context_thread_t* thread ){
+    thread->context = node;
+    thread->next = node->threads;
+    node->threads = thread;
+    thread->unindexed = 0;
+    if( thread->id != node->id ){
+        mp_context_index_insert( thread->id, MP_CONTEXT_INDEX_FROM_THREAD(thread), &thread->unindexed );
+    }
+}
+
+void mp_context_thread_remove( mp_context_thread_t* thread ){
+    mp_context_node_t* node = thread->context;
+    if( node == NULL ){ return; }
+    mp_context_thread_t** link = &node->threads;
+    while( ( *link != NULL ) && ( *link != thread ) ){ link = &(*link)->next; }
+    if( *link == NULL ){ return; } // not listed
+    *link = thread->next;
+    if( thread->id != node->id ){
+        mp_context_index_remove( thread->id, MP_CONTEXT_INDEX_FROM_THREAD(thread), &thread->unindexed );
+    }
+    thread->context = NULL;
+    thread->next = NULL;
+}
+
+void mp_context_thread_set_id( mp_context_thread_t* thread, uint32_t tID ){
+    // (re)assign the task ID of a listed thread and keep the index up to date
+    mp_context_node_t* node = thread->context;
+    if( ( node == NULL ) || ( thread->id == tID ) ){ return; }
+    if( thread->id != node->id ){
+        mp_context_index_remove( thread->id, MP_CONTEXT_INDEX_FROM_THREAD(thread), &thread->unindexed );
+    }
+    thread->id = tID;
+    if( thread->id != node->id ){
+        mp_context_index_insert( thread->id, MP_CONTEXT_INDEX_FROM_THREAD(thread), &thread->unindexed );
+    }
+}
+
+mp_context_thread_t* mp_context_thread_by_tid( uint32_t tID ){
+    // the registered thread with the task ID, NULL for contexts and unknown IDs
+    if( tID == 0 ){ return NULL; }
+    void* slot = mp_context_index_find( tID );
+    if( ( slot != NULL ) && MP_CONTEXT_INDEX_IS_THREAD(slot) ){
+        return MP_CONTEXT_INDEX_TO_THREAD(slot);
+    }
+    if( mp_context_index_overflow == 0 ){ return NULL; }
+    mp_context_iter_t iter = NULL;
+    for( iter = mp_context_iter_first(MP_ITER_FROM_CONTEXT_PTR(mp_context_head)); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter) ){
+        mp_context_node_t* node = MP_CONTEXT_PTR_FROM_ITER(iter);
+        for( mp_context_thread_t* thread = node->threads; thread != NULL; thread = thread->next ){
+            if( ( thread->id == tID ) && ( thread->id != node->id ) ){ return thread; }
+        }
+    }
+    return NULL;
+}
+
+void mp_context_set_id( mp_context_node_t* node, uint32_t tID ){
+    // (re)assign the task ID of a context and keep the index up to date
+    if( node == NULL ){ return; }
+    if( node->id == tID ){ return; }
+    mp_context_index_remove( node->id, node, &node->unindexed );
+    node->id = tID;
+    mp_context_index_insert( node->id, node, &node->unindexed );
+}
+
+int8_t mp_context_queue_alloc( mp_context_node_t* node, size_t depth ){
+    // give a context a response queue of at least 'depth' entries
+    // this must happen before notify can reach the context, see mp_task_register()
+    size_t size = 1;
+    while( size < depth ){ size <<= 1; }
+    mp_response_cell_t* cells = (mp_response_cell_t*)mp_context_dynmem_alloc( size * sizeof(mp_response_cell_t), node );
+    if( cells == NULL ){ return -1; }
+    if( node->response_queue.cells != NULL ){
+        mp_context_dynmem_free( node->response_queue.cells, node );
+    }
+    mp_response_queue_init( &node->response_queue, cells, size );
+    return 0;
+}
+
 mp_context_node_t* mp_context_predecessor( mp_context_node_t* successor ){
     mp_context_iter_t iter = NULL;
     for( iter = mp_context_iter_first(MP_ITER_FROM_CONTEXT_PTR(mp_context_head)); !mp_context_iter_done(iter); iter = mp_context_iter_next(iter) ){
@@ -164,22 +410,52 @@ void mp_context_remove( mp_context_node_t* node ){
     mp_context_node_t* successor = NULL;
     successor = node->next;
     predecessor->next = successor;
+    mp_context_index_remove( node->id, node, &node->unindexed );
+    while( node->threads != NULL ){
+        mp_context_thread_remove( node->threads ); // the port ends the threads, but they must not outlive the node in the index
+    }
+    for( size_t core = 0; core < MICROPY_NUM_CORES; core++ ){
+        if( mp_active_contexts[core] == node ){
+            mp_active_contexts[core] = NULL; // a new node at the same address must not look active
+        }
+        #if MICROPY_MULTIPYTHON_STATS
+        if( mp_running_contexts[core] == node ){
+            mp_running_contexts[core] = NULL;
+        }
+        #endif
+    }
     mp_context_dynmem_free_all( node );
     MP_STATE_FREE(node->state);
     MP_STATE_FREE(node);
 }
 
-mp_context_node_t* mp_task_register( uint32_t tID, void* addtlargs ){
+mp_context_node_t* mp_task_register( uint32_t tID, size_t queue_depth, void* addtlargs ){
+    // called with the context list lock held. The response queue holds queue_depth
+    // entries (0 for MICROPY_RESPONSE_QUEUE_DEPTH) before the lock is released, since
+    // notify can reach the node as soon as it is listed
     mp_context_node_t* node = NULL;
     node = mp_context_by_tid( tID );
     if( node != NULL ){ return NULL; } // can't register the same task ID
     node = mp_context_append_new();
     if( node == NULL ){ return NULL; } // no heap
-    node->id = tID;
+    mp_context_set_id( node, tID );
     node->args.input_kind = 0;
+    node->args.source_kind = MP_TASK_SOURCE_TEXT;
     node->args.source = NULL;
+    node->args.source_len = 0;
+    node->args.suspend = 0;
+    node->args.heap_size = 0;
+    node->args.heap = NULL;
+    node->args.heap_max = 0;
+    node->args.stack_size = 0;
+    node->args.capture = 0;
+    node->args.snapshot = NULL;
     node->args.addtl = addtlargs;
     node->status = 0;
+    if( mp_context_queue_alloc( node, ( queue_depth != 0 ) ? queue_depth : MICROPY_RESPONSE_QUEUE_DEPTH ) != 0 ){
+        mp_context_remove( node );
+        return NULL; // no heap
+    }
     return node;
 }
 
@@ -192,12 +468,42 @@ void mp_task_remove( uint32_t tID ){
 }
 
 void mp_task_switched_in( uint32_t tID ){
-    // todo: we need to handle when the switched-in task is a thread running underneath one of our contexts. (i.e. in the threadctrl->thread LL)
+    // a thread started within a context switches in the state of that context
     mp_current_tIDs[MICROPY_GET_CORE_INDEX] = tID;
     mp_context_node_t* node = mp_context_by_tid( tID );
-    if(node == NULL){ return; }
-    mp_context_switch(node);
+    #if MICROPY_MULTIPYTHON_STATS
+    mp_context_account( node );
+    #endif
+    mp_context_switch( node );
+}
+
+#if MICROPY_MULTIPYTHON_STATS
+void mp_context_account( mp_context_node_t* node ){
+    size_t core = MICROPY_GET_CORE_INDEX;
+    mp_context_node_t* previous = mp_running_contexts[core];
+    if( previous == node ){ return; }
+    mp_uint_t now = mp_hal_ticks_us();
+    if( previous != NULL ){
+        previous->run_stats.run_us += (mp_uint_t)( now - previous->run_stats.since_us );
+    }
+    if( node != NULL ){
+        node->run_stats.since_us = now;
+        node->run_stats.switches++;
+    }
+    mp_running_contexts[core] = node;
+}
+
+uint64_t mp_context_run_us( mp_context_node_t* node ){
+    uint64_t run_us = node->run_stats.run_us;
+    for( size_t core = 0; core < MICROPY_NUM_CORES; core++ ){
+        if( mp_running_contexts[core] == node ){
+            run_us += (mp_uint_t)( mp_hal_ticks_us() - node->run_stats.since_us );
+            break;
+        }
+    }
+    return run_us;
 }
+#endif
 
 
 // context dynamic memory iterators
@@ -336,6 +642,8 @@ int8_t mp_task_free_all( uint32_t tID ){
 // globals
 mp_state_ctx_t _hidden_mp_state_ctx;
 
+STATIC mp_response_cell_t mp_default_response_cells[MICROPY_RESPONSE_QUEUE_DEPTH];
+
 mp_context_node_t mp_default_context = {
     .id = 0,
     .status = 0,
@@ -344,12 +652,18 @@ mp_context_node_t mp_default_context = {
                 .source = NULL,
                 .addtl = NULL },
     .threadctrl = NULL,
+    .threads = NULL,
+    .response_queue = { .cells = mp_default_response_cells,
+                        .mask = MICROPY_RESPONSE_QUEUE_DEPTH - 1 },
     .memhead = NULL,
     .next = NULL,
 };
 
-mp_context_node_t  mp_active_context_mirrors[MICROPY_NUM_CORES];
 mp_context_node_t* mp_active_contexts[MICROPY_NUM_CORES];
+mp_state_ctx_t*    mp_active_states[MICROPY_NUM_CORES];
+#if MICROPY_STATE_PTR == MICROPY_STATE_PTR_THREAD_LOCAL
+MICROPY_THREAD_LOCAL mp_state_ctx_t* mp_active_state;
+#endif
 mp_context_node_t* mp_context_head = &mp_default_context;
 volatile uint32_t mp_current_tIDs[MICROPY_NUM_CORES];
 
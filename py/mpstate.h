@@ -33,11 +33,11 @@
 #include "py/misc.h"
 #include "py/nlr.h"
 #include "py/obj.h"
+#include "py/inlinecache.h"
 #include "py/objlist.h"
 #include "py/objexcept.h"
 #include "py/parse.h"
 
-#define MP_RESPONSE_QUEUE_SIZE    (256)
 typedef struct _mp_response_t mp_response_t;
 struct _mp_response_t{
     uint8_t     control_op;
@@ -54,6 +54,7 @@ struct _mp_response_t{
 typedef struct mp_dynamic_compiler_t {
     uint8_t small_int_bits; // must be <= host small_int_bits
     bool opt_cache_map_lookup_in_bytecode;
+    bool opt_superinstructions;
     bool py_builtins_str_unicode;
     uint8_t native_arch;
 } mp_dynamic_compiler_t;
@@ -71,11 +72,11 @@ typedef struct _mp_sched_item_t {
 } mp_sched_item_t;
 
 // This structure hold information about the memory allocation system.
-typedef struct _mp_state_mem_t {
-    #if MICROPY_MEM_STATS
-    size_t total_bytes_allocated;
-    size_t current_bytes_allocated;
-    size_t peak_bytes_allocated;
+// This structure holds one region of the GC heap: its allocation and
+// finaliser tables and the pool of blocks that they describe.
+typedef struct _mp_state_mem_area_t {
+    #if MICROPY_GC_SPLIT_HEAP
+    struct _mp_state_mem_area_t *next;
     #endif
 
     byte *gc_alloc_table_start;
@@ -83,11 +84,38 @@ typedef struct _mp_state_mem_t {
     #if MICROPY_ENABLE_FINALISER
     byte *gc_finaliser_table_start;
     #endif
+    #if MICROPY_GC_INCREMENTAL
+    byte *gc_dirty_table_start;
+    #endif
     byte *gc_pool_start;
     byte *gc_pool_end;
 
+    size_t gc_last_free_atb_index;
+    #if MICROPY_GC_LARGE_BLOCKS
+    // where the search for a large run of free blocks goes on down from
+    size_t gc_large_free_block;
+    #endif
+} mp_state_mem_area_t;
+
+typedef struct _mp_state_mem_t {
+    #if MICROPY_MEM_STATS
+    size_t total_bytes_allocated;
+    size_t current_bytes_allocated;
+    size_t peak_bytes_allocated;
+    #endif
+
+    // the first region of the heap, set up by gc_init
+    mp_state_mem_area_t area;
+
     int gc_stack_overflow;
     MICROPY_GC_STACK_ENTRY_TYPE gc_stack[MICROPY_ALLOC_GC_STACK_SIZE];
+    #if MICROPY_GC_SPLIT_HEAP
+    // the region of each block on the GC stack
+    mp_state_mem_area_t *gc_area_stack[MICROPY_ALLOC_GC_STACK_SIZE];
+
+    // number of bytes the heap may still grow by when an allocation fails
+    size_t gc_heap_grow_limit;
+    #endif
     uint16_t gc_lock_depth;
 
     // This variable controls auto garbage collection.  If set to 0 then the
@@ -100,12 +128,52 @@ typedef struct _mp_state_mem_t {
     size_t gc_alloc_threshold;
     #endif
 
-    size_t gc_last_free_atb_index;
-
     #if MICROPY_PY_GC_COLLECT_RETVAL
     size_t gc_collected;
     #endif
 
+    #if MICROPY_GC_SIZE_CLASSES
+    // runs of free blocks for each size class, those of n blocks in gc_free_list[n - 2]
+    void *gc_free_list[MICROPY_GC_SIZE_CLASSES - 1][MICROPY_GC_FREE_LIST_LEN];
+    uint8_t gc_free_list_len[MICROPY_GC_SIZE_CLASSES - 1];
+    #endif
+
+    #if MICROPY_GC_MARK_THREADS
+    // set while the collection has the pool of the mark threads, see gc_collect_end()
+    uint8_t gc_mark_parallel;
+    #endif
+
+    #if MICROPY_MULTIPYTHON_STATS
+    // accounting of the heap of the context, see multipython.stats()
+    size_t gc_used_blocks;          // blocks in use
+    size_t gc_peak_blocks;          // most blocks in use at once
+    uint64_t gc_alloc_blocks;       // blocks allocated so far
+    size_t gc_collections;
+    uint64_t gc_collect_us;         // time spent collecting
+    #endif
+    #if MICROPY_MULTIPYTHON_STATS || MICROPY_GC_INCREMENTAL
+    mp_uint_t gc_collect_start_us;
+    #endif
+
+    #if MICROPY_GC_INCREMENTAL
+    // state of an incremental collection, see gc_collect_step()
+    volatile uint8_t gc_inc_phase;
+    // set while the mark phase ends, when the roots are traced again
+    uint8_t gc_inc_rescan;
+    // top of gc_stack, kept between the steps of the mark phase
+    size_t gc_inc_sp;
+    // where the mark phase has got to going through the heap after gc_stack overflowed
+    mp_state_mem_area_t *gc_inc_scan_area;
+    size_t gc_inc_scan_block;
+    // the thread whose step ends the mark phase, so the sweep goes on in steps
+    void *gc_inc_finisher;
+    // where the sweep phase has got to
+    mp_state_mem_area_t *gc_inc_sweep_area;
+    size_t gc_inc_sweep_block;
+    // histogram of GC pauses, see MICROPY_GC_PAUSE_BUCKETS
+    uint32_t gc_pause_hist[MICROPY_GC_PAUSE_BUCKETS];
+    #endif
+
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make the GC thread-safe.
     mp_thread_mutex_t gc_mutex;
@@ -124,6 +192,10 @@ typedef struct _mp_state_vm_t {
 
     qstr_pool_t *last_pool;
 
+    #if MICROPY_OPT_QSTR_INDEX
+    qstr_index_t *qstr_index;
+    #endif
+
     // non-heap memory for creating an exception if we can't allocate RAM
     mp_obj_exception_t mp_emergency_exception_obj;
 
@@ -205,12 +277,23 @@ typedef struct _mp_state_vm_t {
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make qstr interning thread-safe.
     mp_thread_mutex_t qstr_mutex;
+
+    // stack size for new threads, as set by _thread.stack_size(), 0 for the port default
+    size_t thread_stack_size;
     #endif
 
     #if MICROPY_ENABLE_COMPILER
     mp_uint_t mp_optimise_value;
     #endif
 
+    #if MICROPY_OPT_INLINE_CACHE
+    // advanced by changes to the keys of versioned maps, and by collections
+    size_t map_version;
+    mp_inline_cache_entry_t inline_cache[MICROPY_OPT_INLINE_CACHE_SIZE];
+    size_t inline_cache_hits;
+    size_t inline_cache_misses;
+    #endif
+
     // size of the emergency exception buf, if it's dynamically allocated
     #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF && MICROPY_EMERGENCY_EXCEPTION_BUF_SIZE == 0
     mp_int_t mp_emergency_exception_buf_size;
@@ -244,6 +327,11 @@ typedef struct _mp_state_thread_t {
     uint8_t *pystack_cur;
     #endif
 
+    #if MICROPY_OPT_INLINE_CACHE
+    // the inline caches the thread uses, NULL if it can't share those of the context
+    mp_inline_cache_entry_t *inline_cache;
+    #endif
+
     ////////////////////////////////////////////////////////////
     // START ROOT POINTER SECTION
     // Everything that needs GC scanning must start here, and
@@ -273,37 +361,112 @@ typedef struct _mp_context_dynmem_node_t{
     struct _mp_context_dynmem_node_t*   next;
 }mp_context_dynmem_node_t;
 
+// what the source of a context is
+typedef enum {
+    MP_TASK_SOURCE_TEXT = 0,    // Python source, or the name of a file of it (see input_kind)
+    MP_TASK_SOURCE_FROZEN,      // the name of a frozen module
+    MP_TASK_SOURCE_MPY,         // an .mpy image of source_len bytes
+} mp_task_source_kind_t;
+
 typedef struct _mp_task_args_t {
     mp_parse_input_kind_t   input_kind;
+    mp_task_source_kind_t   source_kind;
     void*                   source;
+    size_t                  source_len; // bytes of the source, including the terminator of text
     uint8_t                 suspend;    // 1 to suspend at startup
+    size_t                  heap_size;  // initial GC heap size in bytes, 0 for the port default
+    void*                   heap;       // the initial GC heap, allocated by multipython_port_task_create() so that start() can fail
+    size_t                  heap_max;   // limit the GC heap may grow to in bytes, 0 for the port default
+    size_t                  stack_size; // stack size in bytes, 0 for the port default
+    size_t                  pystack_size; // bytes of the pystack that holds the frames of calls, 0 for the port default
+    size_t                  thread_stack_size; // stack size in bytes of threads the context starts, 0 for the port default
+    int8_t                  priority;   // priority class, see multipython_priority_e
+    uint8_t                 capture;    // 1 to boot, run the source if any and capture a snapshot of the interpreter
+    void*                   snapshot;   // snapshot to start from instead of booting, NULL to boot
     void*                   addtl;
 }mp_task_args_t;
 
+// Response queues are bounded lock-free rings with any number of producers (any
+// context, core or interrupt calling notify) and a single consumer (the context
+// that owns the queue). The sequence number of a cell tells whose turn it is to
+// use it. It is stored relative to the index of the cell, so a zeroed queue is
+// empty and ready to use.
+typedef struct _mp_response_cell_t{
+    volatile size_t     seq;
+    mp_response_t       response;
+}mp_response_cell_t;
+
 typedef struct _mp_response_queue_t{
-    mp_response_t buff[MP_RESPONSE_QUEUE_SIZE]; 
-    size_t r_head;
-    size_t w_head;
+    mp_response_cell_t* cells;
+    size_t              mask;       // depth - 1, the depth is a power of 2
+    volatile size_t     w_pos;      // next position claimed by a producer
+    volatile size_t     r_pos;      // next position read by the consumer
+    volatile size_t     overflows;  // number of times the queue filled up and turned away a response
+    volatile size_t     dropped;    // number of responses turned away
+    volatile uint8_t    full;       // set by a producer on overflow, cleared by the consumer
 }mp_response_queue_t;
 
+void mp_response_queue_init( mp_response_queue_t* queue, mp_response_cell_t* cells, size_t depth );
+size_t mp_response_queue_depth( mp_response_queue_t* queue );
 size_t mp_response_queue_available( mp_response_queue_t* queue );
 size_t mp_response_queue_peek( mp_response_queue_t* queue, mp_response_t* response );
 size_t mp_response_queue_read( mp_response_queue_t* queue, mp_response_t* response );
 size_t mp_response_queue_write( mp_response_queue_t* queue, mp_response_t response );
 
+// time a context spent switched in, kept by mp_context_account()
+typedef struct _mp_context_run_stats_t{
+    uint64_t    run_us;     // up to the last time it was switched out
+    mp_uint_t   since_us;   // when it was last switched in
+    uint32_t    switches;   // number of times it was switched in
+}mp_context_run_stats_t;
+
+// CPU budget of a context, see multipython_budget_point()
+typedef struct _mp_context_budget_t{
+    uint32_t    budget_us;      // run time the context may use in each period
+    uint32_t    period_us;
+    mp_uint_t   period_start;   // ticks_us when the current period started
+    uint64_t    period_run_us;  // run time of the context when it started
+    uint32_t    overruns;       // periods in which the context used up its budget
+    uint64_t    held_us;        // time the context was held back for it
+    uint32_t    countdown;      // backward branches until the next check
+}mp_context_budget_t;
+
+// a thread started within a context, see mp_context_thread_add(). Threads with a task
+// ID share the index of contexts, so the switch hook finds the context of a thread
+// as fast as that of a context
+typedef struct _mp_context_thread_t{
+    uint32_t                        id;         // task ID, 0 for a thread the switch hook never sees
+    struct _mp_context_node_t*      context;    // context the thread belongs to
+    mp_state_thread_t*              state;      // thread state, NULL until the thread has started
+    struct _mp_context_thread_t*    next;       // next thread of the same context
+    uint8_t                         unindexed;  // 1 while the ID did not fit in the task ID index
+}mp_context_thread_t;
+
 struct _mp_context_node_t{
     uint32_t                    id;
+    uint8_t                     unindexed;  // 1 while the ID did not fit in the task ID index
     int32_t                     status;
     mp_state_ctx_t*             state;
     mp_task_args_t              args;
     void*                       threadctrl;
+    mp_context_thread_t*        threads;    // threads of the context, including its own task once _thread is initialised
     mp_response_queue_t         response_queue;
     mp_context_dynmem_node_t*   memhead;
+    void*                       code_uses;  // shared code the context runs, see multipython_code_cache_release()
+    void*                       shared_uses; // shared buffers the context holds, see multipython_shared_release_all()
+    #if MICROPY_MULTIPYTHON_STATS
+    mp_context_run_stats_t      run_stats;
+    #endif
+    #if MICROPY_MULTIPYTHON_BUDGET
+    mp_context_budget_t         budget;
+    #endif
     struct _mp_context_node_t*  next;
 };
 
 #define MP_CNOM             0 // nominal
 #define MP_CSUSP  (0x01 << 0) // suspended
+#define MP_CSTOP  (0x01 << 1) // stop requested
+#define MP_CBUDGET (0x01 << 2) // has a CPU budget, checked at backward branches
 
 #define MP_STATE_MALLOC(size) (malloc(size))
 #define MP_STATE_FREE(ptr) (free(ptr))
@@ -315,7 +478,7 @@ extern mp_obj_dict_t    mp_active_loaded_modules_dicts[MICROPY_NUM_CORES];
 
 extern mp_context_node_t*   mp_context_head;
 extern mp_context_node_t*   mp_active_contexts[MICROPY_NUM_CORES];
-extern mp_context_node_t    mp_active_context_mirrors[MICROPY_NUM_CORES];
+extern mp_state_ctx_t*      mp_active_states[MICROPY_NUM_CORES];
 extern volatile uint32_t    mp_current_tIDs[MICROPY_NUM_CORES];
 
 void mp_context_refresh( void );
@@ -324,6 +487,14 @@ void mp_context_switch(mp_context_node_t* node);
 mp_context_node_t* mp_context_append_new( void );
 void mp_context_remove( mp_context_node_t* node );
 mp_context_node_t* mp_context_by_tid( uint32_t tID );
+void mp_context_set_id( mp_context_node_t* node, uint32_t tID );
+// the caller protects the threads of the context, and holds the context list lock for
+// threads with a task ID. The task of the context itself is listed but not indexed
+void mp_context_thread_add( mp_context_node_t* node, mp_context_thread_t* thread );
+void mp_context_thread_remove( mp_context_thread_t* thread );
+void mp_context_thread_set_id( mp_context_thread_t* thread, uint32_t tID );
+mp_context_thread_t* mp_context_thread_by_tid( uint32_t tID );
+int8_t mp_context_queue_alloc( mp_context_node_t* node, size_t depth );
 
 void mp_dynmem_append( mp_context_dynmem_node_t* node, mp_context_node_t* context );
 
@@ -331,9 +502,13 @@ void* mp_context_dynmem_alloc( size_t size, mp_context_node_t* context );
 int8_t mp_context_dynmem_free( void* mem, mp_context_node_t* context );
 int8_t mp_context_dynmem_free_all( mp_context_node_t* context );
 
-mp_context_node_t* mp_task_register( uint32_t tID, void* args );
+mp_context_node_t* mp_task_register( uint32_t tID, size_t queue_depth, void* args );
 void mp_task_remove( uint32_t tID );
 void mp_task_switched_in( uint32_t tID );
+#if MICROPY_MULTIPYTHON_STATS
+void mp_context_account( mp_context_node_t* node );    // count the time of the calling core towards node from now on (NULL for none)
+uint64_t mp_context_run_us( mp_context_node_t* node );  // time node has spent switched in
+#endif
 void* mp_task_alloc( size_t size, uint32_t tID );
 int8_t mp_task_free( void* mem, uint32_t tID );
 
@@ -356,14 +531,28 @@ void mp_dynmem_foreach(mp_context_dynmem_iter_t head, void (*f)(mp_context_dynme
 #define MP_DYNMEM_PTR_FROM_ITER(iter) ((mp_context_dynmem_node_t*)iter)
 #define MP_ITER_FROM_DYNMEM_PTR(dptr) ((mp_context_dynmem_iter_t)dptr)
 
-#define MP_STATE_VM(x) (mp_active_context_mirrors[MICROPY_GET_CORE_INDEX].state->vm.x)
-#define MP_STATE_MEM(x) (mp_active_context_mirrors[MICROPY_GET_CORE_INDEX].state->mem.x)
+// the state of the running context, see MICROPY_STATE_PTR
+#if MICROPY_STATE_PTR == MICROPY_STATE_PTR_STATIC
+#if MICROPY_PY_MULTIPYTHON
+#error "MICROPY_STATE_PTR_STATIC needs a build with a single context"
+#endif
+extern mp_state_ctx_t _hidden_mp_state_ctx;
+#define MP_STATE_PTR (&_hidden_mp_state_ctx)
+#elif MICROPY_STATE_PTR == MICROPY_STATE_PTR_THREAD_LOCAL
+extern MICROPY_THREAD_LOCAL mp_state_ctx_t* mp_active_state;
+#define MP_STATE_PTR (mp_active_state)
+#else
+#define MP_STATE_PTR (mp_active_states[MICROPY_GET_CORE_INDEX])
+#endif
+
+#define MP_STATE_VM(x) (MP_STATE_PTR->vm.x)
+#define MP_STATE_MEM(x) (MP_STATE_PTR->mem.x)
 
 #if MICROPY_PY_THREAD
 extern mp_state_thread_t *mp_thread_get_state(void);
 #define MP_STATE_THREAD(x) (mp_thread_get_state()->x)
 #else
-#define MP_STATE_THREAD(x) (mp_active_context_mirrors[MICROPY_GET_CORE_INDEX].state->thread.x)
+#define MP_STATE_THREAD(x) (MP_STATE_PTR->thread.x)
 #endif
 
 #endif // MICROPY_INCLUDED_PY_MPSTATE_H
@@ -47,6 +47,15 @@ void mp_thread_mutex_init(mp_thread_mutex_t *mutex);
 int mp_thread_mutex_lock(mp_thread_mutex_t *mutex, int wait);
 void mp_thread_mutex_unlock(mp_thread_mutex_t *mutex);
 
+#if MICROPY_GC_MARK_THREADS
+// Call fn(arg) on each of up to MICROPY_GC_MARK_THREADS helper threads, which
+// hold no Python state and take no signals, without waiting for it to return.
+// Returns the number of threads fn is called on.
+int mp_thread_gc_helpers_start(void (*fn)(void*), void *arg);
+// Wait until fn has returned on all the threads it was called on.
+void mp_thread_gc_helpers_wait(void);
+#endif
+
 #endif // MICROPY_PY_THREAD
 
 #if MICROPY_PY_THREAD && MICROPY_PY_THREAD_GIL
@@ -304,18 +304,37 @@ typedef struct _mp_rom_obj_t { mp_const_obj_t o; } mp_rom_obj_t;
         .table = (mp_map_elem_t*)(mp_rom_map_elem_t*)table_name, \
     }
 
+#if MICROPY_OPT_MAP_ROM_INDEX
+// The index of the table is generated by makeqstrdata.py from the keys that
+// makeqstrdefs.py finds in it, so the table must be in a file listed in SRC_QSTR
 #define MP_DEFINE_CONST_DICT(dict_name, table_name) \
-    const mp_obj_dict_t dict_name = { \
+    const mp_obj_rom_dict_t dict_name = { \
         .base = {&mp_type_dict}, \
         .map = { \
             .all_keys_are_qstrs = 1, \
             .is_fixed = 1, \
             .is_ordered = 1, \
+            .is_indexed = 1, \
             .used = MP_ARRAY_SIZE(table_name), \
             .alloc = MP_ARRAY_SIZE(table_name), \
             .table = (mp_map_elem_t*)(mp_rom_map_elem_t*)table_name, \
         }, \
+        .index = mp_rom_map_index_##table_name, \
     }
+#else
+#define MP_DEFINE_CONST_DICT(dict_name, table_name) \
+    const mp_obj_rom_dict_t dict_name = { \
+        .base = {&mp_type_dict}, \
+        .map = { \
+            .all_keys_are_qstrs = 1, \
+            .is_fixed = 1, \
+            .is_ordered = 1, \
+            .used = MP_ARRAY_SIZE(table_name), \
+            .alloc = MP_ARRAY_SIZE(table_name), \
+            .table = (mp_map_elem_t*)(mp_rom_map_elem_t*)table_name, \
+        }, \
+    }
+#endif
 
 // These macros are used to declare and define constant staticmethond and classmethod objects
 // You can put "static" in front of the definitions to make them local
@@ -354,7 +373,9 @@ typedef struct _mp_map_t {
     size_t all_keys_are_qstrs : 1;
     size_t is_fixed : 1;    // a fixed array that can't be modified; must also be ordered
     size_t is_ordered : 1;  // an ordered array
-    size_t used : (8 * sizeof(size_t) - 3);
+    size_t is_versioned : 1; // changes to the keys advance the map version, see mp_map_set_versioned()
+    size_t is_indexed : 1;  // the table of a mp_obj_rom_dict_t, searched through its index
+    size_t used : (8 * sizeof(size_t) - 5);
     size_t alloc;
     mp_map_elem_t *table;
 } mp_map_t;
@@ -369,6 +390,15 @@ typedef enum _mp_map_lookup_kind_t {
 
 extern const mp_map_t mp_const_empty_map;
 
+#if MICROPY_OPT_MAP_ROM_INDEX && !defined(NO_QSTR)
+// the indexes of the tables of const dicts, defined in map.c
+#define QDEF(id, str)
+#define QROMMAP(name, ...) extern const byte mp_rom_map_index_##name[];
+#include "genhdr/qstrdefs.generated.h"
+#undef QROMMAP
+#undef QDEF
+#endif
+
 static inline bool mp_map_slot_is_filled(const mp_map_t *map, size_t pos) { return ((map)->table[pos].key != MP_OBJ_NULL && (map)->table[pos].key != MP_OBJ_SENTINEL); }
 
 void mp_map_init(mp_map_t *map, size_t n);
@@ -379,6 +409,9 @@ void mp_map_free(mp_map_t *map);
 mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t lookup_kind);
 void mp_map_clear(mp_map_t *map);
 void mp_map_dump(mp_map_t *map);
+#if MICROPY_OPT_INLINE_CACHE
+void mp_map_set_versioned(mp_map_t *map);
+#endif
 
 // Underlying set implementation (not set object)
 
@@ -767,6 +800,18 @@ typedef struct _mp_obj_dict_t {
     mp_obj_base_t base;
     mp_map_t map;
 } mp_obj_dict_t;
+
+// A dict defined with MP_DEFINE_CONST_DICT; with MICROPY_OPT_MAP_ROM_INDEX it
+// has the index of its table after the dict
+#if MICROPY_OPT_MAP_ROM_INDEX
+typedef struct _mp_obj_rom_dict_t {
+    mp_obj_base_t base;
+    mp_map_t map;
+    const byte *index;
+} mp_obj_rom_dict_t;
+#else
+typedef mp_obj_dict_t mp_obj_rom_dict_t;
+#endif
 void mp_obj_dict_init(mp_obj_dict_t *dict, size_t n_args);
 size_t mp_obj_dict_len(mp_obj_t self_in);
 mp_obj_t mp_obj_dict_get(mp_obj_t self_in, mp_obj_t index);
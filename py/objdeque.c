@@ -31,6 +31,7 @@
 #if MICROPY_PY_COLLECTIONS_DEQUE
 
 #include "py/runtime.h"
+#include "py/gc.h"
 
 typedef struct _mp_obj_deque_t {
     mp_obj_base_t base;
@@ -106,6 +107,7 @@ STATIC mp_obj_t mp_obj_deque_append(mp_obj_t self_in, mp_obj_t arg) {
     }
 
     self->items[self->i_put] = arg;
+    gc_write_barrier(self->items);
     self->i_put = new_i_put;
 
     if (self->i_get == new_i_put) {
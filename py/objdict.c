@@ -314,6 +314,11 @@ STATIC mp_obj_t dict_popitem(mp_obj_t self_in) {
     if (next == NULL) {
         mp_raise_msg(&mp_type_KeyError, "popitem(): dictionary is empty");
     }
+    #if MICROPY_OPT_INLINE_CACHE
+    if (self->map.is_versioned) {
+        ++MP_STATE_VM(map_version);
+    }
+    #endif
     self->map.used--;
     mp_obj_t items[] = {next->key, next->value};
     next->key = MP_OBJ_SENTINEL; // must mark key as sentinel to indicate that it was deleted
@@ -29,6 +29,7 @@
 #include <assert.h>
 
 #include "py/runtime.h"
+#include "py/gc.h"
 #include "py/bc.h"
 #include "py/objgenerator.h"
 #include "py/objfun.h"
@@ -183,6 +184,8 @@ mp_vm_return_kind_t mp_obj_gen_resume(mp_obj_t self_in, mp_obj_t send_value, mp_
 
     self->globals = mp_globals_get();
     mp_globals_set(self->code_state.old_globals);
+    // the state of the generator was written to as it ran
+    gc_write_barrier(self);
 
     switch (ret_kind) {
         case MP_VM_RETURN_NORMAL:
@@ -29,6 +29,7 @@
 
 #include "py/objlist.h"
 #include "py/runtime.h"
+#include "py/gc.h"
 #include "py/stackctrl.h"
 
 STATIC mp_obj_t mp_obj_new_list_iterator(mp_obj_t list, size_t cur, mp_obj_iter_buf_t *iter_buf);
@@ -211,9 +212,11 @@ STATIC mp_obj_t list_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value) {
                 }
                 mp_seq_replace_slice_grow_inplace(self->items, self->len,
                     slice_out.start, slice_out.stop, value_items, value_len, len_adj, sizeof(*self->items));
+                gc_write_barrier(self->items);
             } else {
                 mp_seq_replace_slice_no_grow(self->items, self->len,
                     slice_out.start, slice_out.stop, value_items, value_len, sizeof(*self->items));
+                gc_write_barrier(self->items);
                 // Clear "freed" elements at the end of list
                 mp_seq_clear(self->items, self->len + len_adj, self->len, sizeof(*self->items));
                 // TODO: apply allocation policy re: alloc_size
@@ -240,6 +243,7 @@ mp_obj_t mp_obj_list_append(mp_obj_t self_in, mp_obj_t arg) {
         mp_seq_clear(self->items, self->len + 1, self->alloc, sizeof(*self->items));
     }
     self->items[self->len++] = arg;
+    gc_write_barrier(self->items);
     return mp_const_none; // return None, as per CPython
 }
 
@@ -258,6 +262,7 @@ STATIC mp_obj_t list_extend(mp_obj_t self_in, mp_obj_t arg_in) {
 
         memcpy(self->items + self->len, arg->items, sizeof(mp_obj_t) * arg->len);
         self->len += arg->len;
+        gc_write_barrier(self->items);
     } else {
         list_extend_from_iter(self_in, arg_in);
     }
@@ -386,6 +391,7 @@ STATIC mp_obj_t list_insert(mp_obj_t self_in, mp_obj_t idx, mp_obj_t obj) {
          self->items[i] = self->items[i-1];
     }
     self->items[index] = obj;
+    gc_write_barrier(self->items);
 
     return mp_const_none;
 }
@@ -494,6 +500,7 @@ void mp_obj_list_store(mp_obj_t self_in, mp_obj_t index, mp_obj_t value) {
     mp_obj_list_t *self = MP_OBJ_TO_PTR(self_in);
     size_t i = mp_get_index(self->base.type, self->len, index, false);
     self->items[i] = value;
+    gc_write_barrier(self->items);
 }
 
 /******************************************************************************/
@@ -236,6 +236,72 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
     }
 }
 
+#if MICROPY_OPT_INLINE_CACHE
+// The walk of mp_obj_class_lookup for the inline caches, which only need to know where
+// attr is. Returns 1 if it was found in the locals of a class, 0 if it wasn't found and
+// -1 if the result can't be cached: the locals aren't versioned, or the load of an
+// instance attribute reaches a native base, which may have it through its load_attr.
+STATIC int class_find_attr(const mp_obj_type_t *type, mp_obj_t key, bool is_type, const mp_map_t **map, size_t *slot) {
+    for (;;) {
+        if (!is_type && mp_obj_is_native_type(type)) {
+            return -1;
+        }
+        if (type->locals_dict != NULL) {
+            mp_map_t *locals_map = &type->locals_dict->map;
+            mp_map_elem_t *elem = mp_map_lookup(locals_map, key, MP_MAP_LOOKUP);
+            if (elem != NULL) {
+                if (!locals_map->is_fixed && !locals_map->is_versioned) {
+                    return -1;
+                }
+                *map = locals_map;
+                *slot = elem - locals_map->table;
+                return 1;
+            }
+        }
+
+        if (type->parent == NULL) {
+            return 0;
+        #if MICROPY_MULTIPLE_INHERITANCE
+        } else if (((mp_obj_base_t*)type->parent)->type == &mp_type_tuple) {
+            const mp_obj_tuple_t *parent_tuple = type->parent;
+            const mp_obj_t *item = parent_tuple->items;
+            const mp_obj_t *top = item + parent_tuple->len - 1;
+            for (; item < top; ++item) {
+                mp_obj_type_t *bt = (mp_obj_type_t*)MP_OBJ_TO_PTR(*item);
+                if (bt == &mp_type_object) {
+                    continue;
+                }
+                int found = class_find_attr(bt, key, is_type, map, slot);
+                if (found != 0) {
+                    return found;
+                }
+            }
+            type = (mp_obj_type_t*)MP_OBJ_TO_PTR(*item);
+        #endif
+        } else {
+            type = type->parent;
+        }
+        if (type == &mp_type_object) {
+            return 0;
+        }
+    }
+}
+
+// The map and slot where a load of attr from an instance of type (or if is_type from
+// type itself) finds it, or NULL if it isn't in the locals of a class or the load does
+// more than take it from there, as with properties and descriptors.
+const mp_map_t *mp_obj_class_find_attr(const mp_obj_type_t *type, qstr attr, bool is_type, size_t *slot) {
+    if (!is_type && (type->flags & TYPE_FLAG_HAS_SPECIAL_ACCESSORS)) {
+        return NULL;
+    }
+    const mp_map_t *map = NULL;
+    if (class_find_attr(type, MP_OBJ_NEW_QSTR(attr), is_type, &map, slot) != 1) {
+        return NULL;
+    }
+    return map;
+}
+#endif
+
 STATIC void instance_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
     qstr meth = (kind == PRINT_STR) ? MP_QSTR___str__ : MP_QSTR___repr__;
@@ -1023,6 +1089,12 @@ STATIC void type_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
     } else {
         // delete/store attribute
 
+        #if MICROPY_OPT_INLINE_CACHE
+        // a store may also give the class special accessors, which change how its
+        // attributes load even when its keys stay the same
+        ++MP_STATE_VM(map_version);
+        #endif
+
         if (self->locals_dict != NULL) {
             assert(self->locals_dict->base.type == &mp_type_dict); // MicroPython restriction, for now
             mp_map_t *locals_map = &self->locals_dict->map;
@@ -1141,6 +1213,11 @@ mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict)
     }
 
     o->locals_dict = MP_OBJ_TO_PTR(locals_dict);
+    #if MICROPY_OPT_INLINE_CACHE
+    if (!o->locals_dict->map.is_fixed) {
+        mp_map_set_versioned(&o->locals_dict->map);
+    }
+    #endif
 
     #if ENABLE_SPECIAL_ACCESSORS
     // Check if the class has any special accessor methods
@@ -51,4 +51,9 @@ mp_obj_t mp_obj_instance_call(mp_obj_t self_in, size_t n_args, size_t n_kw, cons
 // this needs to be exposed for the above macros to work correctly
 mp_obj_t mp_obj_instance_make_new(const mp_obj_type_t *self_in, size_t n_args, size_t n_kw, const mp_obj_t *args);
 
+#if MICROPY_OPT_INLINE_CACHE
+// where a load of attr from an instance of type, or from type itself, finds it
+const mp_map_t *mp_obj_class_find_attr(const mp_obj_type_t *type, qstr attr, bool is_type, size_t *slot);
+#endif
+
 #endif // MICROPY_INCLUDED_PY_OBJTYPE_H
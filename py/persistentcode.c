@@ -49,7 +49,11 @@
 
 // Macros to encode/decode native architecture to/from the feature byte
 #define MPY_FEATURE_ENCODE_ARCH(arch) ((arch) << 2)
-#define MPY_FEATURE_DECODE_ARCH(feat) ((feat) >> 2)
+#define MPY_FEATURE_DECODE_ARCH(feat) (((feat) & 0x7f) >> 2)
+
+// The top bit of the feature byte is set if the bytecode uses superinstructions.
+// A VM without them sees it as an unknown native architecture and rejects the file.
+#define MPY_FEATURE_SUPERINSTRUCTIONS (0x80)
 
 // The feature flag bits encode the compile-time config options that
 // affect the generate bytecode.
@@ -340,7 +344,7 @@ STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader, qstr_window_t *qw) {
     byte *ip2;
     bytecode_prelude_t prelude = {0};
     #if MICROPY_EMIT_NATIVE
-    size_t prelude_offset;
+    size_t prelude_offset = 0;
     mp_uint_t type_sig = 0;
     size_t n_qstr_link = 0;
     #endif
@@ -407,13 +411,15 @@ STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader, qstr_window_t *qw) {
         ip2[2] = source_file; ip2[3] = source_file >> 8;
     }
 
+    size_t n_obj = 0;
+    size_t n_raw_code = 0;
     mp_uint_t *const_table = NULL;
     if (kind != MP_CODE_NATIVE_ASM) {
         // Load constant table for bytecode, native and viper
 
         // Number of entries in constant table
-        size_t n_obj = read_uint(reader, NULL);
-        size_t n_raw_code = read_uint(reader, NULL);
+        n_obj = read_uint(reader, NULL);
+        n_raw_code = read_uint(reader, NULL);
 
         // Allocate constant table
         size_t n_alloc = prelude.n_pos_args + prelude.n_kwonly_args + n_obj + n_raw_code;
@@ -487,6 +493,9 @@ mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader) {
         || read_uint(reader, NULL) > QSTR_WINDOW_SIZE) {
         mp_raise_ValueError("incompatible .mpy file");
     }
+    if (!MICROPY_OPT_SUPERINSTRUCTIONS && (header[2] & MPY_FEATURE_SUPERINSTRUCTIONS)) {
+        mp_raise_ValueError("incompatible .mpy file");
+    }
     if (MPY_FEATURE_DECODE_ARCH(header[2]) != MP_NATIVE_ARCH_NONE
         && MPY_FEATURE_DECODE_ARCH(header[2]) != MPY_FEATURE_ARCH) {
         mp_raise_ValueError("incompatible .mpy arch");
@@ -598,6 +607,15 @@ STATIC void save_obj(mp_print_t *print, mp_obj_t o) {
 
 STATIC void save_bytecode(mp_print_t *print, qstr_window_t *qw, const byte *ip, const byte *ip_top) {
     while (ip < ip_top) {
+        #if MICROPY_OPT_QUICKEN
+        byte opcode = mp_bc_unquicken(*ip);
+        if (opcode != *ip) {
+            // all the specialised opcodes are a single byte
+            mp_print_bytes(print, &opcode, 1);
+            ip += 1;
+            continue;
+        }
+        #endif
         size_t sz;
         uint f = mp_opcode_format(ip, &sz, true);
         if (f == MP_OPCODE_QSTR) {
@@ -625,7 +643,17 @@ STATIC void save_raw_code(mp_print_t *print, mp_raw_code_t *rc, qstr_window_t *q
         extract_prelude(&ip, &ip2, &prelude);
         size_t prelude_len = ip - (const byte*)rc->fun_data;
         const byte *ip_top = (const byte*)rc->fun_data + rc->fun_data_len;
+        #if MICROPY_OPT_QUICKEN
+        // the saved code may be frozen into ROM, so leave out the flag that lets it be rewritten
+        const byte *flags = mp_decode_uint_skip(mp_decode_uint_skip(rc->fun_data));
+        size_t flags_offset = flags - (const byte*)rc->fun_data;
+        byte scope_flags = *flags & ~MP_SCOPE_FLAG_QUICKEN;
+        mp_print_bytes(print, rc->fun_data, flags_offset);
+        mp_print_bytes(print, &scope_flags, 1);
+        mp_print_bytes(print, flags + 1, prelude_len - flags_offset - 1);
+        #else
         mp_print_bytes(print, rc->fun_data, prelude_len);
+        #endif
 
         // Save bytecode
         save_bytecode(print, qstr_window, ip, ip_top);
@@ -739,6 +767,9 @@ void mp_raw_code_save(mp_raw_code_t *rc, mp_print_t *print) {
     if (mp_raw_code_has_native(rc)) {
         header[2] |= MPY_FEATURE_ENCODE_ARCH(MPY_FEATURE_ARCH_DYNAMIC);
     }
+    if (MICROPY_OPT_SUPERINSTRUCTIONS_DYNAMIC) {
+        header[2] |= MPY_FEATURE_SUPERINSTRUCTIONS;
+    }
     mp_print_bytes(print, header, sizeof(header));
     mp_print_uint(print, QSTR_WINDOW_SIZE);
 
@@ -751,7 +782,7 @@ void mp_raw_code_save(mp_raw_code_t *rc, mp_print_t *print) {
 // here we define mp_raw_code_save_file depending on the port
 // TODO abstract this away properly
 
-#if defined(__i386__) || defined(__x86_64__) || defined(__unix__)
+#if MICROPY_PERSISTENT_CODE_SAVE_FILE
 
 #include <unistd.h>
 #include <sys/stat.h>
@@ -770,8 +801,6 @@ void mp_raw_code_save_file(mp_raw_code_t *rc, const char *filename) {
     close(fd);
 }
 
-#else
-#error mp_raw_code_save_file not implemented for this platform
-#endif
+#endif // MICROPY_PERSISTENT_CODE_SAVE_FILE
 
 #endif // MICROPY_PERSISTENT_CODE_SAVE
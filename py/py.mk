@@ -256,6 +256,7 @@ PY_CORE_O_BASENAME = $(addprefix py/,\
 	moduerrno.o \
 	modthread.o \
 	vm.o \
+	inlinecache.o \
 	bc.o \
 	showbc.o \
 	repl.o \
@@ -287,6 +288,10 @@ PY_EXTMOD_O_BASENAME = \
 	extmod/moduwebsocket.o \
 	extmod/modwebrepl.o \
 	extmod/modframebuf.o \
+	extmod/modmultipython.o \
+	extmod/multipython_codecache.o \
+	extmod/multipython_pool.o \
+	extmod/multipython_shared.o \
 	extmod/vfs.o \
 	extmod/vfs_reader.o \
 	extmod/vfs_posix.o \
@@ -357,6 +362,8 @@ $(PY_BUILD)/gc.o: CFLAGS += $(CSUPEROPT)
 
 # optimising vm for speed, adds only a small amount to code size but makes a huge difference to speed (20% faster)
 $(PY_BUILD)/vm.o: CFLAGS += $(CSUPEROPT)
+# the hits of the inline caches are part of the dispatch of the instructions they serve
+$(PY_BUILD)/inlinecache.o: CFLAGS += $(CSUPEROPT)
 # Optimizing vm.o for modern deeply pipelined CPUs with branch predictors
 # may require disabling tail jump optimization. This will make sure that
 # each opcode has its own dispatching jump which will improve branch
@@ -32,8 +32,10 @@
 #include "py/qstr.h"
 #include "py/gc.h"
 
-// NOTE: we are using linear arrays to store and search for qstr's (unique strings, interned strings)
-// ultimately we will replace this with a static hash table of some kind
+// NOTE: we are using linear arrays to store qstr's (unique strings, interned strings)
+// and, unless MICROPY_OPT_QSTR_INDEX is enabled, to search for them; with it they are
+// found through a hash index of the ROM pool made at build time and one of the pools
+// allocated at runtime
 // also probably need to include the length in the string data, to allow null bytes in the string
 
 #if MICROPY_DEBUG_VERBOSE // print debugging info
@@ -84,14 +86,20 @@
 // allocated pool is twice this size.  The value here must be <= MP_QSTRnumber_of.
 #define MICROPY_ALLOC_QSTR_ENTRIES_INIT (10)
 
-// this must match the equivalent function in makeqstrdata.py
-mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
-    // djb2 algorithm; see http://www.cse.yorku.ca/~oz/hash.html
-    mp_uint_t hash = 5381;
+// Initial number of slots in the index of the runtime qstrs, a power of 2.
+#define MICROPY_ALLOC_QSTR_INDEX_INIT (32)
+
+// djb2 algorithm; see http://www.cse.yorku.ca/~oz/hash.html
+STATIC uint32_t qstr_compute_hash_full(const byte *data, size_t len) {
+    uint32_t hash = 5381;
     for (const byte *top = data + len; data < top; data++) {
         hash = ((hash << 5) + hash) ^ (*data); // hash * 33 ^ data
     }
-    hash &= Q_HASH_MASK;
+    return hash;
+}
+
+STATIC mp_uint_t qstr_short_hash(uint32_t full_hash) {
+    mp_uint_t hash = full_hash & Q_HASH_MASK;
     // Make sure that valid hash is never zero, zero means "hash not computed"
     if (hash == 0) {
         hash++;
@@ -99,6 +107,11 @@ mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
     return hash;
 }
 
+// this must match the equivalent function in makeqstrdata.py
+mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
+    return qstr_short_hash(qstr_compute_hash_full(data, len));
+}
+
 const qstr_pool_t mp_qstr_const_pool = {
     NULL,               // no previous pool
     0,                  // no previous pool
@@ -123,6 +136,9 @@ extern const qstr_pool_t MICROPY_QSTR_EXTRA_POOL;
 void qstr_init(void) {
     MP_STATE_VM(last_pool) = (qstr_pool_t*)&CONST_POOL; // we won't modify the const_pool since it has no allocated room left
     MP_STATE_VM(qstr_last_chunk) = NULL;
+    #if MICROPY_OPT_QSTR_INDEX
+    MP_STATE_VM(qstr_index) = NULL;
+    #endif
 
     #if MICROPY_PY_THREAD
     mp_thread_mutex_init(&MP_STATE_VM(qstr_mutex));
@@ -139,10 +155,122 @@ STATIC const byte *find_qstr(qstr q) {
     return pool->qstrs[q - pool->total_prev_len];
 }
 
+#if MICROPY_OPT_QSTR_INDEX
+
+// The full djb2 hash has poorly mixed low bits for short strings, so it is
+// scrambled before picking a slot.  This must match compute_index_hash() in
+// makeqstrdata.py.
+STATIC uint32_t qstr_index_mix(uint32_t hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+// The index of mp_qstr_const_pool, an open addressing table made by makeqstrdata.py.
+STATIC const uint16_t mp_qstr_const_index[] = {
+#ifndef NO_QSTR
+#define QDEF(id, str)
+#define QINDEX(id) id,
+#include "genhdr/qstrdefs.generated.h"
+#undef QINDEX
+#undef QDEF
+#endif
+};
+
+STATIC qstr qstr_index_find_const(uint32_t index_hash, mp_uint_t str_hash, const char *str, size_t str_len) {
+    size_t mask = MP_ARRAY_SIZE(mp_qstr_const_index) - 1;
+    for (size_t i = index_hash & mask;; i = (i + 1) & mask) {
+        qstr q = mp_qstr_const_index[i];
+        if (q == MP_QSTR_NULL) {
+            return MP_QSTR_NULL;
+        }
+        const byte *qd = mp_qstr_const_pool.qstrs[q];
+        if (Q_GET_HASH(qd) == str_hash && Q_GET_LENGTH(qd) == str_len && memcmp(Q_GET_DATA(qd), str, str_len) == 0) {
+            return q;
+        }
+    }
+}
+
+STATIC qstr qstr_index_find_dynamic(uint32_t index_hash, mp_uint_t str_hash, const char *str, size_t str_len) {
+    // This may run without qstr_mutex, so the index is read once; an index
+    // replaced by qstr_index_grow() stays valid for its qstrs until collected.
+    const qstr_index_t *index = MP_STATE_VM(qstr_index);
+    if (index == NULL) {
+        // no qstrs have been added yet by this context, search any extra pool
+        for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != &mp_qstr_const_pool; pool = pool->prev) {
+            for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
+                if (Q_GET_HASH(*q) == str_hash && Q_GET_LENGTH(*q) == str_len && memcmp(Q_GET_DATA(*q), str, str_len) == 0) {
+                    return pool->total_prev_len + (q - pool->qstrs);
+                }
+            }
+        }
+        return MP_QSTR_NULL;
+    }
+    size_t mask = index->alloc - 1;
+    for (size_t i = index_hash & mask;; i = (i + 1) & mask) {
+        qstr q = index->slot[i];
+        if (q == MP_QSTR_NULL) {
+            return MP_QSTR_NULL;
+        }
+        const byte *qd = find_qstr(q);
+        if (Q_GET_HASH(qd) == str_hash && Q_GET_LENGTH(qd) == str_len && memcmp(Q_GET_DATA(qd), str, str_len) == 0) {
+            return q;
+        }
+    }
+}
+
+STATIC void qstr_index_insert(qstr_index_t *index, qstr q) {
+    const byte *qd = find_qstr(q);
+    size_t mask = index->alloc - 1;
+    size_t i = qstr_index_mix(qstr_compute_hash_full(Q_GET_DATA(qd), Q_GET_LENGTH(qd))) & mask;
+    while (index->slot[i] != MP_QSTR_NULL) {
+        i = (i + 1) & mask;
+    }
+    index->slot[i] = q;
+    index->used += 1;
+}
+
+// qstr_mutex must be taken while in this function
+// Makes sure the index has room for one more qstr, keeping it at most 3/4 full
+// so that a probe always ends on an empty slot.  A bigger index is filled with
+// all the qstrs above mp_qstr_const_pool before it replaces the old one.
+STATIC void qstr_index_reserve(void) {
+    qstr_index_t *index = MP_STATE_VM(qstr_index);
+    size_t n = QSTR_TOTAL() - MP_QSTRnumber_of + 1;
+    if (index != NULL && n * 4 <= index->alloc * 3) {
+        return;
+    }
+    size_t new_alloc = index == NULL ? MICROPY_ALLOC_QSTR_INDEX_INIT : index->alloc * 2;
+    while (n * 4 > new_alloc * 3) {
+        new_alloc *= 2;
+    }
+    qstr_index_t *new_index = m_new_obj_var_maybe(qstr_index_t, qstr, new_alloc);
+    if (new_index == NULL) {
+        QSTR_EXIT();
+        m_malloc_fail(sizeof(qstr_index_t) + new_alloc * sizeof(qstr));
+    }
+    new_index->alloc = new_alloc;
+    new_index->used = 0;
+    memset(new_index->slot, 0, new_alloc * sizeof(qstr));
+    for (qstr q = MP_QSTRnumber_of; q < QSTR_TOTAL(); ++q) {
+        qstr_index_insert(new_index, q);
+    }
+    MP_STATE_VM(qstr_index) = new_index;
+    DEBUG_printf("QSTR: allocate new index of size %d\n", new_alloc);
+}
+
+#endif // MICROPY_OPT_QSTR_INDEX
+
 // qstr_mutex must be taken while in this function
 STATIC qstr qstr_add(const byte *q_ptr) {
     DEBUG_printf("QSTR: add hash=%d len=%d data=%.*s\n", Q_GET_HASH(q_ptr), Q_GET_LENGTH(q_ptr), Q_GET_LENGTH(q_ptr), Q_GET_DATA(q_ptr));
 
+    #if MICROPY_OPT_QSTR_INDEX
+    // grow the index first so a failed allocation leaves the pools and index in step
+    qstr_index_reserve();
+    #endif
+
     // make sure we have room in the pool for a new qstr
     if (MP_STATE_VM(last_pool)->len >= MP_STATE_VM(last_pool)->alloc) {
         size_t new_alloc = MP_STATE_VM(last_pool)->alloc * 2;
@@ -165,12 +293,30 @@ STATIC qstr qstr_add(const byte *q_ptr) {
 
     // add the new qstr
     MP_STATE_VM(last_pool)->qstrs[MP_STATE_VM(last_pool)->len++] = q_ptr;
+    qstr q = MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+
+    #if MICROPY_OPT_QSTR_INDEX
+    qstr_index_insert(MP_STATE_VM(qstr_index), q);
+    #endif
 
     // return id for the newly-added qstr
-    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+    return q;
 }
 
 qstr qstr_find_strn(const char *str, size_t str_len) {
+    #if MICROPY_OPT_QSTR_INDEX
+    // work out hashes of str
+    uint32_t full_hash = qstr_compute_hash_full((const byte*)str, str_len);
+    uint32_t index_hash = qstr_index_mix(full_hash);
+    mp_uint_t str_hash = qstr_short_hash(full_hash);
+
+    // search the indexes for the data
+    qstr q = qstr_index_find_const(index_hash, str_hash, str, str_len);
+    if (q == MP_QSTR_NULL) {
+        q = qstr_index_find_dynamic(index_hash, str_hash, str, str_len);
+    }
+    return q;
+    #else
     // work out hash of str
     mp_uint_t str_hash = qstr_compute_hash((const byte*)str, str_len);
 
@@ -185,6 +331,7 @@ qstr qstr_find_strn(const char *str, size_t str_len) {
 
     // not found; return null qstr
     return 0;
+    #endif
 }
 
 qstr qstr_from_str(const char *str) {
@@ -271,6 +418,14 @@ const byte *qstr_data(qstr q, size_t *len) {
     return Q_GET_DATA(qd);
 }
 
+size_t qstr_count(void) {
+    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len;
+}
+
+size_t qstr_count_static(void) {
+    return CONST_POOL.total_prev_len + CONST_POOL.len;
+}
+
 void qstr_pool_info(size_t *n_pool, size_t *n_qstr, size_t *n_str_data_bytes, size_t *n_total_bytes) {
     QSTR_ENTER();
     *n_pool = 0;
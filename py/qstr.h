@@ -55,6 +55,15 @@ typedef struct _qstr_pool_t {
     const byte *qstrs[];
 } qstr_pool_t;
 
+// The index of the qstrs interned at runtime, see MICROPY_OPT_QSTR_INDEX.  It is
+// an open addressing table with linear probing; a slot holds a qstr, or
+// MP_QSTR_NULL if it is empty.
+typedef struct _qstr_index_t {
+    size_t alloc; // number of slots, a power of 2
+    size_t used;
+    qstr slot[];
+} qstr_index_t;
+
 #define QSTR_FROM_STR_STATIC(s) (qstr_from_strn((s), strlen(s)))
 #define QSTR_TOTAL() (MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len)
 
@@ -71,6 +80,9 @@ const char *qstr_str(qstr q);
 size_t qstr_len(qstr q);
 const byte *qstr_data(qstr q, size_t *len);
 
+size_t qstr_count(void);        // number of qstrs interned, they are numbered from 0
+size_t qstr_count_static(void); // number of qstrs in the const pools, the same in every context
+
 void qstr_pool_info(size_t *n_pool, size_t *n_qstr, size_t *n_str_data_bytes, size_t *n_total_bytes);
 void qstr_dump_data(void);
 
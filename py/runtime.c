@@ -96,6 +96,9 @@ void mp_init(void) {
 
     // initialise the __main__ module
     mp_obj_dict_init(&MP_STATE_VM(dict_main), 1);
+    #if MICROPY_OPT_INLINE_CACHE
+    mp_map_set_versioned(&MP_STATE_VM(dict_main).map);
+    #endif
     mp_obj_dict_store(MP_OBJ_FROM_PTR(&MP_STATE_VM(dict_main)), MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR___main__));
     mp_context_refresh();
 
@@ -104,6 +107,10 @@ void mp_init(void) {
     mp_globals_set(&MP_STATE_VM(dict_main));
     mp_context_refresh();
 
+    #if MICROPY_OPT_INLINE_CACHE
+    MP_STATE_THREAD(inline_cache) = MP_STATE_VM(inline_cache);
+    #endif
+
     #if MICROPY_CAN_OVERRIDE_BUILTINS
     // start with no extensions to builtins
     MP_STATE_VM(mp_module_builtins_override_dict) = NULL;
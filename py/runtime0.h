@@ -35,6 +35,7 @@
 #define MP_SCOPE_FLAG_REFGLOBALS   (0x10) // used only if native emitter enabled
 #define MP_SCOPE_FLAG_HASCONSTS    (0x20) // used only if native emitter enabled
 #define MP_SCOPE_FLAG_VIPERRET_POS    (6) // 3 bits used for viper return type
+#define MP_SCOPE_FLAG_QUICKEN      (0x40) // only in the prelude of bytecode, set when loaded into RAM
 
 // types for native (viper) function signature
 #define MP_NATIVE_TYPE_OBJ  (0x00)
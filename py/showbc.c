@@ -165,6 +165,15 @@ const byte *mp_bytecode_print_str(const byte *ip) {
     mp_uint_t unum;
     qstr qst;
 
+    #if MICROPY_OPT_QUICKEN
+    byte opcode = mp_bc_unquicken(*ip);
+    if (opcode != *ip) {
+        // show a specialised opcode as the one it was rewritten from
+        mp_bytecode_print_str(&opcode);
+        return ip + 1;
+    }
+    #endif
+
     switch (*ip++) {
         case MP_BC_LOAD_CONST_FALSE:
             printf("LOAD_CONST_FALSE");
@@ -216,6 +225,13 @@ const byte *mp_bytecode_print_str(const byte *ip) {
             printf("LOAD_DEREF " UINT_FMT, unum);
             break;
 
+        #if MICROPY_OPT_SUPERINSTRUCTIONS
+        case MP_BC_LOAD_FAST_2:
+            printf("LOAD_FAST_2 %d %d", *ip & 0xf, *ip >> 4);
+            ip += 1;
+            break;
+        #endif
+
         case MP_BC_LOAD_NAME:
             DECODE_QSTR;
             printf("LOAD_NAME %s", qstr_str(qst));
@@ -263,6 +279,15 @@ const byte *mp_bytecode_print_str(const byte *ip) {
             printf("STORE_FAST_N " UINT_FMT, unum);
             break;
 
+        #if MICROPY_OPT_SUPERINSTRUCTIONS
+        case MP_BC_INC_FAST:
+            DECODE_UINT;
+            printf("INC_FAST " UINT_FMT " %s " INT_FMT, unum >> 8,
+                (unum & 0x80) ? ((unum & 0x40) ? "-" : "+") : ((unum & 0x40) ? "-=" : "+="),
+                (mp_int_t)(unum & 0x3f) - 16);
+            break;
+        #endif
+
         case MP_BC_STORE_DEREF:
             DECODE_UINT;
             printf("STORE_DEREF " UINT_FMT, unum);
@@ -355,6 +380,15 @@ const byte *mp_bytecode_print_str(const byte *ip) {
             printf("JUMP_IF_FALSE_OR_POP " UINT_FMT, (mp_uint_t)(ip + unum - mp_showbc_code_start));
             break;
 
+        #if MICROPY_OPT_SUPERINSTRUCTIONS
+        case MP_BC_COMPARE_JUMP:
+            DECODE_SLABEL;
+            printf("COMPARE_JUMP_IF_%s " UINT_FMT " %d", (*ip & 0x80) ? "TRUE" : "FALSE",
+                (mp_uint_t)(ip + unum - mp_showbc_code_start), *ip & 0x7f);
+            ip += 1;
+            break;
+        #endif
+
         case MP_BC_SETUP_WITH:
             DECODE_ULABEL; // loop-like labels are always forward
             printf("SETUP_WITH " UINT_FMT, (mp_uint_t)(ip + unum - mp_showbc_code_start));
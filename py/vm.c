@@ -32,8 +32,13 @@
 #include "py/emitglue.h"
 #include "py/objtype.h"
 #include "py/runtime.h"
+#include "py/gc.h"
 #include "py/bc0.h"
 #include "py/bc.h"
+#include "py/inlinecache.h"
+#include "py/objlist.h"
+#include "py/objarray.h"
+#include "py/smallint.h"
 
 #if 0
 #define TRACE(ip) printf("sp=%d ", (int)(sp - &code_state->state[0] + 1)); mp_bytecode_print2(ip, 1, code_state->fun_bc->const_table);
@@ -108,6 +113,61 @@
     exc_sp--; /* pop back to previous exception handler */ \
     CLEAR_SYS_EXC_INFO() /* just clear sys.exc_info(), not compliant, but it shouldn't be used in 1st place */
 
+#if MICROPY_OPT_QUICKEN
+
+// rewrite the opcode being run, if the bytecode may be rewritten at all
+#define QUICKEN(quick_opcode) do { \
+    byte q = (quick_opcode); \
+    if (q != ip[-1] && quick_bytecode_in_ram(code_state)) { \
+        *(byte*)(ip - 1) = q; \
+    } \
+} while (0)
+
+// rewrite a specialised opcode back to the generic one it was made from
+#define DEOPTIMISE(opcode) (*(byte*)(ip - 1) = (opcode))
+
+// Checked only when there's an opcode to rewrite, so code that's not rewritten
+// pays for it on every run of the generic opcodes but calls don't pay at all
+static inline bool quick_bytecode_in_ram(const mp_code_state_t *code_state) {
+    const byte *scope_flags = mp_decode_uint_skip(mp_decode_uint_skip(code_state->fun_bc->bytecode));
+    return (*scope_flags & MP_SCOPE_FLAG_QUICKEN) != 0;
+}
+
+#if MICROPY_PY_BUILTINS_FLOAT
+// the operands of a float variant of a binary op, see mp_bc_quicken_binary_op()
+static inline bool quick_float_operands(mp_obj_t lhs, mp_obj_t rhs, mp_float_t *lhs_val, mp_float_t *rhs_val) {
+    if (mp_obj_is_float(lhs)) {
+        *lhs_val = mp_obj_float_get(lhs);
+        if (mp_obj_is_float(rhs)) {
+            *rhs_val = mp_obj_float_get(rhs);
+            return true;
+        } else if (mp_obj_is_small_int(rhs)) {
+            *rhs_val = (mp_float_t)MP_OBJ_SMALL_INT_VALUE(rhs);
+            return true;
+        }
+    } else if (mp_obj_is_small_int(lhs) && mp_obj_is_float(rhs)) {
+        *lhs_val = (mp_float_t)MP_OBJ_SMALL_INT_VALUE(lhs);
+        *rhs_val = mp_obj_float_get(rhs);
+        return true;
+    }
+    return false;
+}
+#endif
+
+// an index into a sequence of len items, or len if it's out of range
+static inline size_t quick_index(mp_obj_t index, size_t len) {
+    mp_int_t i = MP_OBJ_SMALL_INT_VALUE(index);
+    if (i < 0) {
+        i += (mp_int_t)len;
+        if (i < 0) {
+            return len;
+        }
+    }
+    return (size_t)i < len ? (size_t)i : len;
+}
+
+#endif // MICROPY_OPT_QUICKEN
+
 // fastn has items in reverse order (fastn[0] is local[0], fastn[-1] is local[1], etc)
 // sp points to bottom of stack which grows up
 // returns:
@@ -263,7 +323,31 @@ dispatch_loop:
                     goto load_check;
                 }
 
-                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                #if MICROPY_OPT_SUPERINSTRUCTIONS
+                ENTRY(MP_BC_LOAD_FAST_2): {
+                    mp_uint_t locals = *ip++;
+                    obj_shared = fastn[-(locals & 0xf)];
+                    if (obj_shared == MP_OBJ_NULL) {
+                        goto local_name_error;
+                    }
+                    PUSH(obj_shared);
+                    obj_shared = fastn[-(locals >> 4)];
+                    goto load_check;
+                }
+                #endif
+
+                #if MICROPY_OPT_INLINE_CACHE
+                ENTRY(MP_BC_LOAD_NAME): {
+                    MARK_EXC_IP_SELECTIVE();
+                    const byte *site = ip;
+                    DECODE_QSTR;
+                    PUSH(mp_inline_cache_load_name(site, qst));
+                    #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                    ip++; // the byte of the slot guess, unused here
+                    #endif
+                    DISPATCH();
+                }
+                #elif !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
                 ENTRY(MP_BC_LOAD_NAME): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
@@ -292,7 +376,18 @@ dispatch_loop:
                 }
                 #endif
 
-                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                #if MICROPY_OPT_INLINE_CACHE
+                ENTRY(MP_BC_LOAD_GLOBAL): {
+                    MARK_EXC_IP_SELECTIVE();
+                    const byte *site = ip;
+                    DECODE_QSTR;
+                    PUSH(mp_inline_cache_load_global(site, qst));
+                    #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                    ip++; // the byte of the slot guess, unused here
+                    #endif
+                    DISPATCH();
+                }
+                #elif !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
                 ENTRY(MP_BC_LOAD_GLOBAL): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
@@ -321,7 +416,31 @@ dispatch_loop:
                 }
                 #endif
 
-                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                #if MICROPY_OPT_INLINE_CACHE
+                ENTRY(MP_BC_LOAD_ATTR): {
+                    MARK_EXC_IP_SELECTIVE();
+                    const byte *site = ip;
+                    DECODE_QSTR;
+                    mp_obj_t top = TOP();
+                    #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                    // members of instances are first tried at the slot guessed in the
+                    // bytecode, which the inline cache updates when it finds one
+                    byte *guess = (byte*)ip++;
+                    if (mp_obj_is_instance_type(mp_obj_get_type(top))) {
+                        mp_obj_instance_t *self = MP_OBJ_TO_PTR(top);
+                        mp_uint_t x = *guess;
+                        if (x < self->members.alloc && self->members.table[x].key == MP_OBJ_NEW_QSTR(qst)) {
+                            SET_TOP(self->members.table[x].value);
+                            DISPATCH();
+                        }
+                    }
+                    #else
+                    byte *guess = NULL;
+                    #endif
+                    SET_TOP(mp_inline_cache_load_attr(site, top, qst, guess));
+                    DISPATCH();
+                }
+                #elif !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
                 ENTRY(MP_BC_LOAD_ATTR): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
@@ -361,8 +480,14 @@ dispatch_loop:
 
                 ENTRY(MP_BC_LOAD_METHOD): {
                     MARK_EXC_IP_SELECTIVE();
+                    #if MICROPY_OPT_INLINE_CACHE
+                    const byte *site = ip;
+                    DECODE_QSTR;
+                    mp_inline_cache_load_method(site, *sp, qst, sp);
+                    #else
                     DECODE_QSTR;
                     mp_load_method(*sp, qst, sp);
+                    #endif
                     sp += 1;
                     DISPATCH();
                 }
@@ -383,6 +508,9 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_SUBSCR): {
                     MARK_EXC_IP_SELECTIVE();
                     mp_obj_t index = POP();
+                    #if MICROPY_OPT_QUICKEN
+                    QUICKEN(mp_bc_quicken_subscr(MP_BC_LOAD_SUBSCR, TOP(), index));
+                    #endif
                     SET_TOP(mp_obj_subscr(TOP(), index, MP_OBJ_SENTINEL));
                     DISPATCH();
                 }
@@ -393,6 +521,31 @@ dispatch_loop:
                     DISPATCH();
                 }
 
+                #if MICROPY_OPT_SUPERINSTRUCTIONS
+                ENTRY(MP_BC_INC_FAST): {
+                    MARK_EXC_IP_SELECTIVE();
+                    DECODE_UINT;
+                    mp_obj_t *local = &fastn[-(unum >> 8)];
+                    mp_int_t k = (mp_int_t)(unum & 0x3f) - 16;
+                    if (mp_obj_is_small_int(*local)) {
+                        mp_int_t val = MP_OBJ_SMALL_INT_VALUE(*local);
+                        val = (unum & 0x40) ? val - k : val + k;
+                        if (MP_SMALL_INT_FITS(val)) {
+                            *local = MP_OBJ_NEW_SMALL_INT(val);
+                            DISPATCH();
+                        }
+                    } else if (*local == MP_OBJ_NULL) {
+                        goto local_name_error;
+                    }
+                    static const byte inc_fast_op[4] = {
+                        MP_BINARY_OP_INPLACE_ADD, MP_BINARY_OP_INPLACE_SUBTRACT,
+                        MP_BINARY_OP_ADD, MP_BINARY_OP_SUBTRACT,
+                    };
+                    *local = mp_binary_op(inc_fast_op[(unum >> 6) & 3], *local, MP_OBJ_NEW_SMALL_INT(k));
+                    DISPATCH();
+                }
+                #endif
+
                 ENTRY(MP_BC_STORE_DEREF): {
                     DECODE_UINT;
                     mp_obj_cell_set(fastn[-unum], POP());
@@ -447,6 +600,7 @@ dispatch_loop:
                             }
                         }
                         elem->value = sp[-1];
+                        gc_write_barrier(self->members.table);
                         sp -= 2;
                         ip++;
                         DISPATCH();
@@ -461,6 +615,9 @@ dispatch_loop:
 
                 ENTRY(MP_BC_STORE_SUBSCR):
                     MARK_EXC_IP_SELECTIVE();
+                    #if MICROPY_OPT_QUICKEN
+                    QUICKEN(mp_bc_quicken_subscr(MP_BC_STORE_SUBSCR, sp[-1], sp[0]));
+                    #endif
                     mp_obj_subscr(sp[-1], sp[0], sp[-2]);
                     sp -= 3;
                     DISPATCH();
@@ -572,6 +729,39 @@ dispatch_loop:
                     DISPATCH_WITH_PEND_EXC_CHECK();
                 }
 
+                #if MICROPY_OPT_SUPERINSTRUCTIONS
+                ENTRY(MP_BC_COMPARE_JUMP): {
+                    MARK_EXC_IP_SELECTIVE();
+                    DECODE_SLABEL;
+                    const byte *target = ip + slab;
+                    mp_uint_t op = *ip++; // binary op, 0x80 bit set to jump if true
+                    mp_obj_t rhs = POP();
+                    mp_obj_t lhs = POP();
+                    bool result;
+                    if ((op & 0x7f) == MP_BINARY_OP_IS) {
+                        result = lhs == rhs;
+                    } else if (mp_obj_is_small_int(lhs) && mp_obj_is_small_int(rhs)
+                        && (op & 0x7f) <= MP_BINARY_OP_NOT_EQUAL) {
+                        mp_int_t lhs_val = MP_OBJ_SMALL_INT_VALUE(lhs);
+                        mp_int_t rhs_val = MP_OBJ_SMALL_INT_VALUE(rhs);
+                        switch (op & 0x7f) {
+                            case MP_BINARY_OP_LESS: result = lhs_val < rhs_val; break;
+                            case MP_BINARY_OP_MORE: result = lhs_val > rhs_val; break;
+                            case MP_BINARY_OP_EQUAL: result = lhs_val == rhs_val; break;
+                            case MP_BINARY_OP_LESS_EQUAL: result = lhs_val <= rhs_val; break;
+                            case MP_BINARY_OP_MORE_EQUAL: result = lhs_val >= rhs_val; break;
+                            default: result = lhs_val != rhs_val; break;
+                        }
+                    } else {
+                        result = mp_obj_is_true(mp_binary_op(op & 0x7f, lhs, rhs));
+                    }
+                    if (result == ((op & 0x80) != 0)) {
+                        ip = target;
+                    }
+                    DISPATCH_WITH_PEND_EXC_CHECK();
+                }
+                #endif
+
                 ENTRY(MP_BC_SETUP_WITH): {
                     MARK_EXC_IP_SELECTIVE();
                     // stack: (..., ctx_mgr)
@@ -1214,6 +1404,160 @@ yield:
                     mp_import_all(POP());
                     DISPATCH();
 
+                #if MICROPY_OPT_QUICKEN
+                // The opcodes that QUICKEN() specialises to.  Each checks its operands are
+                // of the types it was made for, and if not rewrites itself back to the
+                // generic opcode and does what that does.  Operands of the right types that
+                // the fast path doesn't handle, like an overflowing sum or an index out of
+                // range, take the generic path without a rewrite.
+                #define QUICK_INT_BINARY_OP(name, result) \
+                ENTRY(MP_BC_BINARY_OP_INT_##name): { \
+                    MARK_EXC_IP_SELECTIVE(); \
+                    mp_obj_t rhs = POP(); \
+                    mp_obj_t lhs = TOP(); \
+                    if (mp_obj_is_small_int(lhs) && mp_obj_is_small_int(rhs)) { \
+                        mp_int_t lhs_val = MP_OBJ_SMALL_INT_VALUE(lhs); \
+                        mp_int_t rhs_val = MP_OBJ_SMALL_INT_VALUE(rhs); \
+                        result \
+                    } else { \
+                        DEOPTIMISE(MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_##name); \
+                    } \
+                    SET_TOP(mp_binary_op(MP_BINARY_OP_##name, lhs, rhs)); \
+                    DISPATCH(); \
+                }
+                #define QUICK_INT_COMPARE(cmp) \
+                    SET_TOP(mp_obj_new_bool(lhs_val cmp rhs_val)); \
+                    DISPATCH();
+                #define QUICK_INT_ARITH(arith) { \
+                    mp_int_t val = lhs_val arith rhs_val; \
+                    if (MP_SMALL_INT_FITS(val)) { \
+                        SET_TOP(MP_OBJ_NEW_SMALL_INT(val)); \
+                        DISPATCH(); \
+                    } \
+                }
+                QUICK_INT_BINARY_OP(LESS, QUICK_INT_COMPARE(<))
+                QUICK_INT_BINARY_OP(MORE, QUICK_INT_COMPARE(>))
+                QUICK_INT_BINARY_OP(LESS_EQUAL, QUICK_INT_COMPARE(<=))
+                QUICK_INT_BINARY_OP(MORE_EQUAL, QUICK_INT_COMPARE(>=))
+                QUICK_INT_BINARY_OP(ADD, QUICK_INT_ARITH(+))
+                QUICK_INT_BINARY_OP(SUBTRACT, QUICK_INT_ARITH(-))
+                QUICK_INT_BINARY_OP(INPLACE_ADD, QUICK_INT_ARITH(+))
+                QUICK_INT_BINARY_OP(INPLACE_SUBTRACT, QUICK_INT_ARITH(-))
+                #undef QUICK_INT_BINARY_OP
+                #undef QUICK_INT_COMPARE
+                #undef QUICK_INT_ARITH
+
+                #if MICROPY_PY_BUILTINS_FLOAT
+                #define QUICK_FLOAT_BINARY_OP(name, arith, fast) \
+                ENTRY(MP_BC_BINARY_OP_FLOAT_##name): { \
+                    MARK_EXC_IP_SELECTIVE(); \
+                    mp_obj_t rhs = POP(); \
+                    mp_obj_t lhs = TOP(); \
+                    mp_float_t lhs_val, rhs_val; \
+                    if (quick_float_operands(lhs, rhs, &lhs_val, &rhs_val)) { \
+                        if (fast) { \
+                            SET_TOP(mp_obj_new_float(lhs_val arith rhs_val)); \
+                            DISPATCH(); \
+                        } \
+                    } else { \
+                        DEOPTIMISE(MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_##name); \
+                    } \
+                    SET_TOP(mp_binary_op(MP_BINARY_OP_##name, lhs, rhs)); \
+                    DISPATCH(); \
+                }
+                QUICK_FLOAT_BINARY_OP(ADD, +, true)
+                QUICK_FLOAT_BINARY_OP(SUBTRACT, -, true)
+                QUICK_FLOAT_BINARY_OP(MULTIPLY, *, true)
+                QUICK_FLOAT_BINARY_OP(TRUE_DIVIDE, /, rhs_val != 0)
+                QUICK_FLOAT_BINARY_OP(INPLACE_ADD, +, true)
+                QUICK_FLOAT_BINARY_OP(INPLACE_SUBTRACT, -, true)
+                QUICK_FLOAT_BINARY_OP(INPLACE_MULTIPLY, *, true)
+                QUICK_FLOAT_BINARY_OP(INPLACE_TRUE_DIVIDE, /, rhs_val != 0)
+                #undef QUICK_FLOAT_BINARY_OP
+                #endif
+
+                ENTRY(MP_BC_LOAD_SUBSCR_LIST_INT): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t index = POP();
+                    mp_obj_t base = TOP();
+                    if (mp_obj_is_type(base, &mp_type_list) && mp_obj_is_small_int(index)) {
+                        mp_obj_list_t *list = MP_OBJ_TO_PTR(base);
+                        size_t i = quick_index(index, list->len);
+                        if (i < list->len) {
+                            SET_TOP(list->items[i]);
+                            DISPATCH();
+                        }
+                    } else {
+                        DEOPTIMISE(MP_BC_LOAD_SUBSCR);
+                    }
+                    SET_TOP(mp_obj_subscr(base, index, MP_OBJ_SENTINEL));
+                    DISPATCH();
+                }
+
+                ENTRY(MP_BC_STORE_SUBSCR_LIST_INT): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t base = sp[-1];
+                    mp_obj_t index = sp[0];
+                    if (mp_obj_is_type(base, &mp_type_list) && mp_obj_is_small_int(index)) {
+                        mp_obj_list_t *list = MP_OBJ_TO_PTR(base);
+                        size_t i = quick_index(index, list->len);
+                        if (i < list->len) {
+                            list->items[i] = sp[-2];
+                            gc_write_barrier(list->items);
+                            sp -= 3;
+                            DISPATCH();
+                        }
+                    } else {
+                        DEOPTIMISE(MP_BC_STORE_SUBSCR);
+                    }
+                    mp_obj_subscr(base, index, sp[-2]);
+                    sp -= 3;
+                    DISPATCH();
+                }
+
+                #if MICROPY_PY_BUILTINS_BYTEARRAY
+                ENTRY(MP_BC_LOAD_SUBSCR_BYTEARRAY_INT): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t index = POP();
+                    mp_obj_t base = TOP();
+                    if (mp_obj_is_type(base, &mp_type_bytearray) && mp_obj_is_small_int(index)) {
+                        mp_obj_array_t *array = MP_OBJ_TO_PTR(base);
+                        size_t i = quick_index(index, array->len);
+                        if (i < array->len) {
+                            SET_TOP(MP_OBJ_NEW_SMALL_INT(((byte*)array->items)[i]));
+                            DISPATCH();
+                        }
+                    } else {
+                        DEOPTIMISE(MP_BC_LOAD_SUBSCR);
+                    }
+                    SET_TOP(mp_obj_subscr(base, index, MP_OBJ_SENTINEL));
+                    DISPATCH();
+                }
+
+                ENTRY(MP_BC_STORE_SUBSCR_BYTEARRAY_INT): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t base = sp[-1];
+                    mp_obj_t index = sp[0];
+                    if (mp_obj_is_type(base, &mp_type_bytearray) && mp_obj_is_small_int(index)) {
+                        mp_obj_array_t *array = MP_OBJ_TO_PTR(base);
+                        size_t i = quick_index(index, array->len);
+                        mp_obj_t value = sp[-2];
+                        if (i < array->len && mp_obj_is_small_int(value)
+                            && (mp_uint_t)MP_OBJ_SMALL_INT_VALUE(value) <= 0xff) {
+                            ((byte*)array->items)[i] = MP_OBJ_SMALL_INT_VALUE(value);
+                            sp -= 3;
+                            DISPATCH();
+                        }
+                    } else {
+                        DEOPTIMISE(MP_BC_STORE_SUBSCR);
+                    }
+                    mp_obj_subscr(base, index, sp[-2]);
+                    sp -= 3;
+                    DISPATCH();
+                }
+                #endif
+                #endif // MICROPY_OPT_QUICKEN
+
 #if MICROPY_OPT_COMPUTED_GOTO
                 ENTRY(MP_BC_LOAD_CONST_SMALL_INT_MULTI):
                     PUSH(MP_OBJ_NEW_SMALL_INT((mp_int_t)ip[-1] - MP_BC_LOAD_CONST_SMALL_INT_MULTI - 16));
@@ -1234,9 +1578,21 @@ yield:
 
                 ENTRY(MP_BC_BINARY_OP_MULTI): {
                     MARK_EXC_IP_SELECTIVE();
+                    mp_uint_t op = (mp_uint_t)ip[-1] - MP_BC_BINARY_OP_MULTI;
+                    #if MICROPY_OPT_QUICKEN
+                    if (op >= MP_BINARY_OP_NUM_BYTECODE) {
+                        // another thread running the same code specialised the opcode
+                        // after it was dispatched here, so dispatch it again
+                        ip--;
+                        DISPATCH();
+                    }
+                    #endif
                     mp_obj_t rhs = POP();
                     mp_obj_t lhs = TOP();
-                    SET_TOP(mp_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
+                    #if MICROPY_OPT_QUICKEN
+                    QUICKEN(mp_bc_quicken_binary_op(MP_BC_BINARY_OP_MULTI + op, lhs, rhs));
+                    #endif
+                    SET_TOP(mp_binary_op(op, lhs, rhs));
                     DISPATCH();
                 }
 
@@ -1259,7 +1615,11 @@ yield:
                     } else if (ip[-1] < MP_BC_BINARY_OP_MULTI + MP_BINARY_OP_NUM_BYTECODE) {
                         mp_obj_t rhs = POP();
                         mp_obj_t lhs = TOP();
-                        SET_TOP(mp_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
+                        mp_binary_op_t op = ip[-1] - MP_BC_BINARY_OP_MULTI;
+                        #if MICROPY_OPT_QUICKEN
+                        QUICKEN(mp_bc_quicken_binary_op(ip[-1], lhs, rhs));
+                        #endif
+                        SET_TOP(mp_binary_op(op, lhs, rhs));
                         DISPATCH();
                     } else
 #endif
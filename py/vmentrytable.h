@@ -40,6 +40,9 @@ static const void *const entry_table[256] = {
     [MP_BC_LOAD_NULL] = &&entry_MP_BC_LOAD_NULL,
     [MP_BC_LOAD_FAST_N] = &&entry_MP_BC_LOAD_FAST_N,
     [MP_BC_LOAD_DEREF] = &&entry_MP_BC_LOAD_DEREF,
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    [MP_BC_LOAD_FAST_2] = &&entry_MP_BC_LOAD_FAST_2,
+    #endif
     [MP_BC_LOAD_NAME] = &&entry_MP_BC_LOAD_NAME,
     [MP_BC_LOAD_GLOBAL] = &&entry_MP_BC_LOAD_GLOBAL,
     [MP_BC_LOAD_ATTR] = &&entry_MP_BC_LOAD_ATTR,
@@ -48,6 +51,9 @@ static const void *const entry_table[256] = {
     [MP_BC_LOAD_BUILD_CLASS] = &&entry_MP_BC_LOAD_BUILD_CLASS,
     [MP_BC_LOAD_SUBSCR] = &&entry_MP_BC_LOAD_SUBSCR,
     [MP_BC_STORE_FAST_N] = &&entry_MP_BC_STORE_FAST_N,
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    [MP_BC_INC_FAST] = &&entry_MP_BC_INC_FAST,
+    #endif
     [MP_BC_STORE_DEREF] = &&entry_MP_BC_STORE_DEREF,
     [MP_BC_STORE_NAME] = &&entry_MP_BC_STORE_NAME,
     [MP_BC_STORE_GLOBAL] = &&entry_MP_BC_STORE_GLOBAL,
@@ -67,6 +73,9 @@ static const void *const entry_table[256] = {
     [MP_BC_POP_JUMP_IF_FALSE] = &&entry_MP_BC_POP_JUMP_IF_FALSE,
     [MP_BC_JUMP_IF_TRUE_OR_POP] = &&entry_MP_BC_JUMP_IF_TRUE_OR_POP,
     [MP_BC_JUMP_IF_FALSE_OR_POP] = &&entry_MP_BC_JUMP_IF_FALSE_OR_POP,
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    [MP_BC_COMPARE_JUMP] = &&entry_MP_BC_COMPARE_JUMP,
+    #endif
     [MP_BC_SETUP_WITH] = &&entry_MP_BC_SETUP_WITH,
     [MP_BC_WITH_CLEANUP] = &&entry_MP_BC_WITH_CLEANUP,
     [MP_BC_UNWIND_JUMP] = &&entry_MP_BC_UNWIND_JUMP,
@@ -105,6 +114,32 @@ static const void *const entry_table[256] = {
     [MP_BC_IMPORT_NAME] = &&entry_MP_BC_IMPORT_NAME,
     [MP_BC_IMPORT_FROM] = &&entry_MP_BC_IMPORT_FROM,
     [MP_BC_IMPORT_STAR] = &&entry_MP_BC_IMPORT_STAR,
+    #if MICROPY_OPT_QUICKEN
+    [MP_BC_BINARY_OP_INT_LESS] = &&entry_MP_BC_BINARY_OP_INT_LESS,
+    [MP_BC_BINARY_OP_INT_MORE] = &&entry_MP_BC_BINARY_OP_INT_MORE,
+    [MP_BC_BINARY_OP_INT_LESS_EQUAL] = &&entry_MP_BC_BINARY_OP_INT_LESS_EQUAL,
+    [MP_BC_BINARY_OP_INT_MORE_EQUAL] = &&entry_MP_BC_BINARY_OP_INT_MORE_EQUAL,
+    [MP_BC_BINARY_OP_INT_ADD] = &&entry_MP_BC_BINARY_OP_INT_ADD,
+    [MP_BC_BINARY_OP_INT_SUBTRACT] = &&entry_MP_BC_BINARY_OP_INT_SUBTRACT,
+    [MP_BC_BINARY_OP_INT_INPLACE_ADD] = &&entry_MP_BC_BINARY_OP_INT_INPLACE_ADD,
+    [MP_BC_BINARY_OP_INT_INPLACE_SUBTRACT] = &&entry_MP_BC_BINARY_OP_INT_INPLACE_SUBTRACT,
+    #if MICROPY_PY_BUILTINS_FLOAT
+    [MP_BC_BINARY_OP_FLOAT_ADD] = &&entry_MP_BC_BINARY_OP_FLOAT_ADD,
+    [MP_BC_BINARY_OP_FLOAT_SUBTRACT] = &&entry_MP_BC_BINARY_OP_FLOAT_SUBTRACT,
+    [MP_BC_BINARY_OP_FLOAT_MULTIPLY] = &&entry_MP_BC_BINARY_OP_FLOAT_MULTIPLY,
+    [MP_BC_BINARY_OP_FLOAT_TRUE_DIVIDE] = &&entry_MP_BC_BINARY_OP_FLOAT_TRUE_DIVIDE,
+    [MP_BC_BINARY_OP_FLOAT_INPLACE_ADD] = &&entry_MP_BC_BINARY_OP_FLOAT_INPLACE_ADD,
+    [MP_BC_BINARY_OP_FLOAT_INPLACE_SUBTRACT] = &&entry_MP_BC_BINARY_OP_FLOAT_INPLACE_SUBTRACT,
+    [MP_BC_BINARY_OP_FLOAT_INPLACE_MULTIPLY] = &&entry_MP_BC_BINARY_OP_FLOAT_INPLACE_MULTIPLY,
+    [MP_BC_BINARY_OP_FLOAT_INPLACE_TRUE_DIVIDE] = &&entry_MP_BC_BINARY_OP_FLOAT_INPLACE_TRUE_DIVIDE,
+    #endif
+    [MP_BC_LOAD_SUBSCR_LIST_INT] = &&entry_MP_BC_LOAD_SUBSCR_LIST_INT,
+    [MP_BC_STORE_SUBSCR_LIST_INT] = &&entry_MP_BC_STORE_SUBSCR_LIST_INT,
+    #if MICROPY_PY_BUILTINS_BYTEARRAY
+    [MP_BC_LOAD_SUBSCR_BYTEARRAY_INT] = &&entry_MP_BC_LOAD_SUBSCR_BYTEARRAY_INT,
+    [MP_BC_STORE_SUBSCR_BYTEARRAY_INT] = &&entry_MP_BC_STORE_SUBSCR_BYTEARRAY_INT,
+    #endif
+    #endif
     [MP_BC_LOAD_CONST_SMALL_INT_MULTI ... MP_BC_LOAD_CONST_SMALL_INT_MULTI + 63] = &&entry_MP_BC_LOAD_CONST_SMALL_INT_MULTI,
     [MP_BC_LOAD_FAST_MULTI ... MP_BC_LOAD_FAST_MULTI + 15] = &&entry_MP_BC_LOAD_FAST_MULTI,
     [MP_BC_STORE_FAST_MULTI ... MP_BC_STORE_FAST_MULTI + 15] = &&entry_MP_BC_STORE_FAST_MULTI,
@@ -0,0 +1,21 @@
+# Function call overhead in a context started by multipython, where the frames
+# come from the pystack of the context when the port has one
+import bench, multipython
+
+SRC = """
+import multipython
+def f(x):
+    return x + 1
+def test(num):
+    for i in iter(range(num)):
+        a = f(i)
+test({})
+multipython.notify(1)
+"""
+
+def test(num):
+    multipython.response(condition=1, context=multipython.context(), argument=1)
+    multipython.start(SRC.format(num), 0)
+    multipython.check_responses(None)
+
+bench.run(test)
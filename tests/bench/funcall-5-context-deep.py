@@ -0,0 +1,24 @@
+# Deep call chains in a context started by multipython. The frames have too many
+# locals to go on the C stack, so without a pystack each one comes from the heap
+import bench, multipython
+
+SRC = """
+import multipython
+def f(n):
+    a = b = c = d = e = g = h = k = n
+    if n:
+        return f(n - 1) + a + b + c + d + e + g + h + k
+    return 0
+def test(num):
+    for i in iter(range(num // 16)):
+        a = f(16)
+test({})
+multipython.notify(1)
+"""
+
+def test(num):
+    multipython.response(condition=1, context=multipython.context(), argument=1)
+    multipython.start(SRC.format(num), 0, heap_size=16 * 1024)
+    multipython.check_responses(None)
+
+bench.run(test)
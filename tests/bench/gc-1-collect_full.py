@@ -0,0 +1,17 @@
+# Frames that each make some garbage and then collect it with a full collection,
+# with a few thousand live objects on the heap that every collection marks
+import bench
+import gc
+
+def frame(f):
+    return [(f, i, str(i)) for i in range(20)]
+
+def test(num):
+    live = {}
+    for i in range(2000):
+        live[i] = [i, str(i)]
+    for f in range(num // 20000):
+        frame(f)
+        gc.collect()
+
+bench.run(test)
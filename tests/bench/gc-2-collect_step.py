@@ -0,0 +1,17 @@
+# As gc-1-collect_full.py, but each frame gives the collector a step of 1 ms of
+# an incremental collection instead
+import bench
+import gc
+
+def frame(f):
+    return [(f, i, str(i)) for i in range(20)]
+
+def test(num):
+    live = {}
+    for i in range(2000):
+        live[i] = [i, str(i)]
+    for f in range(num // 20000):
+        frame(f)
+        gc.collect(1000)
+
+bench.run(test)
@@ -0,0 +1,12 @@
+# Full collections of a heap half filled with small live objects, so the time
+# spent marking grows with the heap; run with -X heapsize=... to compare sizes
+import bench
+import gc
+
+def test(num):
+    gc.collect()
+    live = [[i, (i, i + 1)] for i in range(gc.mem_free() // 192)]
+    for i in range(num // 400000):
+        gc.collect()
+
+bench.run(test)
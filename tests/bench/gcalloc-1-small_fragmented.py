@@ -0,0 +1,15 @@
+# Allocation of small objects of a few blocks on a heap fragmented by many
+# live objects of one block with holes between them, as left behind by a
+# script that keeps some of what it makes
+import bench
+
+def test(num):
+    live = [(i,) for i in range(8000)]
+    for i in range(0, len(live), 2):
+        live[i] = None
+    for i in range(num // 20):
+        t = (i, i, i, i, i, i)
+        l = [i, i, i]
+        d = {1: i}
+
+bench.run(test)
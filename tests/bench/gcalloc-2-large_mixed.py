@@ -0,0 +1,14 @@
+# Large buffers of different sizes, like the layer data of an effect, made and
+# dropped among many small objects that live for a while, so the heap must find
+# room for large blocks in between the small ones
+import bench
+
+def test(num):
+    layers = [None] * 8
+    small = [None] * 500
+    for i in range(num // 200):
+        layers[i % 8] = bytearray(1024 + (i % 5) * 512)
+        for j in range(20):
+            small[(i * 20 + j) % 500] = (i, j, str(j))
+
+bench.run(test)
@@ -0,0 +1,36 @@
+# An LED effect in the style of the scripts run in contexts: each frame fades a
+# strip of RGB pixels held in a bytearray and draws a chasing segment on it,
+# walking the pixels with counters compared against the strip length
+import bench
+
+NUM_LEDS = 60
+
+def frame(buf, pos, n):
+    i = 0
+    while i < n:
+        j = i * 3
+        if buf[j] > 8:
+            buf[j] -= 8
+        else:
+            buf[j] = 0
+        i += 1
+    k = 0
+    while k < 5:
+        p = pos + k
+        if p >= n:
+            p -= n
+        p *= 3
+        buf[p] = 255
+        buf[p + 1] = 32
+        k += 1
+
+def test(num):
+    buf = bytearray(NUM_LEDS * 3)
+    pos = 0
+    for f in range(num // 200):
+        frame(buf, pos, NUM_LEDS)
+        pos += 1
+        if pos == NUM_LEDS:
+            pos = 0
+
+bench.run(test)
@@ -0,0 +1,13 @@
+# Make strings at runtime that are equal to names interned in ROM, each new
+# str being looked up among the qstrs of the firmware before it is allocated
+import bench
+
+NAMES = [b'append', b'extend', b'insert', b'remove', b'reverse', b'sort', b'count', b'index']
+
+def test(num):
+    l = []
+    for i in range(num // 80):
+        for n in NAMES:
+            getattr(l, n.decode())
+
+bench.run(test)
@@ -0,0 +1,18 @@
+# Make strings at runtime that are equal to names interned at runtime, as a
+# script with a few hundred attributes, **kwargs keys or parsed config names
+# adds to the qstrs of the firmware
+import bench
+
+class C:
+    pass
+
+def test(num):
+    o = C()
+    names = [b'attr%d' % i for i in range(500)]
+    for n in names:
+        setattr(o, n.decode(), 1)
+    for i in range(num // 5000):
+        for n in names:
+            getattr(o, n.decode())
+
+bench.run(test)
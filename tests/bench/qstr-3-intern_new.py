@@ -0,0 +1,14 @@
+# Intern many new strings, each one searched for among all the qstrs before it
+# is added, the instance being replaced to keep its dict small
+import bench
+
+class C:
+    pass
+
+def test(num):
+    for i in range(num // 1000):
+        if i % 500 == 0:
+            o = C()
+        setattr(o, 'name_%d' % i, i)
+
+bench.run(test)
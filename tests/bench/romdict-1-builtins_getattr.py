@@ -0,0 +1,13 @@
+# Look up names in the globals of the builtins module, a ROM table of well
+# over a hundred entries, by getattr() which no inline cache can help
+import bench
+import builtins
+
+NAMES = ['print', 'len', 'isinstance', 'ValueError', 'StopIteration', 'zip']
+
+def test(num):
+    for i in range(num // 60):
+        for n in NAMES:
+            getattr(builtins, n)
+
+bench.run(test)
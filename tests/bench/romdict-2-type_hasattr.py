@@ -0,0 +1,16 @@
+# Look up methods, and names that aren't there, in the locals of native types
+# by hasattr(), as duck-typing code does
+import bench
+
+def test(num):
+    s = ''
+    l = []
+    for i in range(num // 60):
+        hasattr(s, 'zfill')
+        hasattr(s, 'upper')
+        hasattr(s, 'read')
+        hasattr(l, 'sort')
+        hasattr(l, 'keys')
+        hasattr(l, 'write')
+
+bench.run(test)
@@ -0,0 +1,10 @@
+# Cost of reaching the interpreter state (MP_STATE_VM/MEM/THREAD, see
+# MICROPY_STATE_PTR). This one touches no state and is the baseline of the group;
+# compare the group across builds with MICROPY_MICROPYTHON=<binary> ./run-bench-tests
+import bench
+
+def test(num):
+    for i in range(num // 10):
+        a = i + 1
+
+bench.run(test)
@@ -0,0 +1,8 @@
+# Same loop, allocating from the GC heap (MP_STATE_MEM) on every iteration
+import bench
+
+def test(num):
+    for i in range(num // 10):
+        a = (i, i)
+
+bench.run(test)
@@ -0,0 +1,11 @@
+# Same loop, raising and catching an exception (nlr_top of MP_STATE_THREAD)
+import bench
+
+def test(num):
+    for i in range(num // 10):
+        try:
+            raise ValueError
+        except ValueError:
+            pass
+
+bench.run(test)
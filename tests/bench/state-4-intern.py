@@ -0,0 +1,13 @@
+# Same loop, looking up a string in the qstr pools (MP_STATE_VM) on every iteration
+import bench
+
+class C:
+    attr = 1
+
+def test(num):
+    o = C()
+    name = 'at' + 'tr'
+    for i in range(num // 10):
+        a = getattr(o, name)
+
+bench.run(test)
@@ -0,0 +1,19 @@
+import bench
+
+class Foo:
+
+    def step(self):
+        return 1
+
+class Bar:
+
+    def step(self):
+        return 1
+
+def test(num):
+    objs = (Foo(), Bar())
+    i = 0
+    while i < num:
+        i += objs[i & 1].step()
+
+bench.run(test)
@@ -0,0 +1,15 @@
+import bench
+
+class Node:
+
+    def __init__(self, child=None):
+        self.child = child
+        self.value = 1
+
+def test(num):
+    o = Node(Node(Node()))
+    i = 0
+    while i < num:
+        i += o.child.child.value
+
+bench.run(test)
@@ -0,0 +1,30 @@
+# A control loop in the style of the scripts run in contexts: state kept on an
+# object, a module constant, builtins and methods of a base class
+import bench, math
+
+class Filter:
+
+    def __init__(self, k):
+        self.k = k
+        self.y = 0.0
+
+    def update(self, x):
+        self.y += self.k * (x - self.y)
+        return self.y
+
+class Controller(Filter):
+
+    def __init__(self):
+        Filter.__init__(self, 0.5)
+        self.target = 1.0
+
+    def step(self, x):
+        return max(-1.0, min(1.0, self.target - self.update(x) * math.e))
+
+def test(num):
+    c = Controller()
+    x = 0.0
+    for i in range(num // 10):
+        x = c.step(x)
+
+bench.run(test)
@@ -0,0 +1,104 @@
+# check that an incremental collection run in steps by gc.collect(budget_us)
+# keeps what is stored while it marks, and frees the garbage
+
+import gc
+
+try:
+    gc.collect(0)
+    gc.pauses
+except (TypeError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+
+# end any collection that the check above started
+while not gc.collect(1000):
+    pass
+
+class A:
+    pass
+
+def item(i):
+    return [i, str(i) * 2, (i, 'x' + str(i))]
+
+def check(o, i):
+    return o == [i, str(i) * 2, (i, 'x' + str(i))]
+
+def counter(n):
+    # the state of the generator changes while a collection marks
+    l = []
+    for i in range(n):
+        l.append(item(i))
+        yield l
+
+def closure(v):
+    def f():
+        return v
+    return f
+
+lst = []
+dct = {}
+obj = A()
+gen = counter(1000)
+cells = []
+old = [item(i) for i in range(100)]
+steps = 0
+cycles = 0
+for i in range(600):
+    o = item(i)
+    r = i % 5
+    if r == 0:
+        lst.append(o)
+    elif r == 1:
+        dct[i] = o
+    elif r == 2:
+        setattr(obj, 'a%d' % (i % 50), (i, o))
+    elif r == 3:
+        cells.append(closure(o))
+    else:
+        last = next(gen)
+    # objects that were there before the collection started move between containers
+    if old:
+        x = old.pop()
+        if i % 2:
+            lst.append(x)
+        else:
+            dct['old%d' % x[0]] = x
+    for j in range(2):
+        if gc.collect(0):
+            cycles += 1
+        steps += 1
+
+print(cycles > 0, steps)
+print(all(check(o, o[0]) for o in lst))
+print(all(check(o, o[0]) for o in dct.values()))
+print(all(check(getattr(obj, k)[1], getattr(obj, k)[0]) for k in dir(obj) if k.startswith('a')))
+print(all(check(f(), f()[0]) for f in cells))
+print(all(check(o, j) for j, o in enumerate(last)))
+print(len(lst), len(dct), len(cells), len(last))
+
+# garbage made before a collection is freed by it
+while not gc.collect(1000):
+    pass
+free = gc.mem_free()
+garbage = [bytearray(100) for i in range(50)]
+garbage = None
+while not gc.collect(1000):
+    pass
+print(gc.mem_free() >= free)
+
+# a full collection ends a collection run in steps
+gc.collect(0)
+gc.collect()
+print(check(lst[0], 0))
+
+# the histogram counts the pauses, and can be cleared
+hist = gc.pauses(True)
+print(len(hist), sum(hist) > 0)
+print(sum(gc.pauses()))
+gc.collect()
+print(sum(gc.pauses()))
+
+try:
+    gc.collect(-1)
+except ValueError:
+    print('ValueError')
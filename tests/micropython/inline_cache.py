@@ -0,0 +1,72 @@
+# check that the inline caches of attribute and global loads see changes
+
+import micropython
+
+try:
+    micropython.inline_cache_info
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+class A:
+    x = 1
+    def f(self):
+        return 'A.f'
+
+class B(A):
+    pass
+
+def load(o):
+    return o.f(), o.x
+
+# fill the caches, then change the classes and instances they were filled for
+b = B()
+for i in range(3):
+    print(load(b))
+B.f = lambda self: 'B.f'
+print(load(b))
+b.x = 5
+print(load(b))
+del B.f
+print(load(b))
+A.x = 7
+print(load(A()))
+
+# a second type at the same call site
+class C:
+    x = 'C.x'
+    def f(self):
+        return 'C.f'
+for o in (b, C(), b, C()):
+    print(load(o))
+
+# attributes of types and modules
+import sys
+def type_attr():
+    return A.x, sys.maxsize > 0
+print(type_attr())
+A.x = 8
+print(type_attr())
+
+# globals, and builtins behind them
+y = 1
+def glob():
+    return y, abs(-1)
+print(glob())
+y = 2
+abs = lambda x: 'abs'
+print(glob())
+del abs
+print(glob())
+del y
+try:
+    glob()
+except NameError:
+    print('NameError')
+
+# the caches were used
+micropython.inline_cache_info(True)
+for i in range(3):
+    load(b)
+hits, misses = micropython.inline_cache_info()
+print(hits > misses)
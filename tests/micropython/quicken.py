@@ -0,0 +1,61 @@
+# check that binary ops and subscripts give the same results when the types of
+# their operands change after the VM specialised them to the first types seen
+
+def arith(a, b):
+    x = a
+    x += b
+    x -= b
+    return a + b, a - b, x
+
+def compare(a, b):
+    return a < b, a > b, a <= b, a >= b
+
+def div(a, b):
+    x = a
+    x *= b
+    x /= b
+    return a * b, a / b, x
+
+for a, b in ((1, 2), (1, 2), (1.5, 2), (2, 0.5), (1 << 29, 1 << 29), ('a', 'b'), (1, 2), ([1], [2])):
+    try:
+        print(arith(a, b))
+    except TypeError:
+        print('TypeError')
+
+for a, b in ((1, 2), (2, 2), (1.5, 1), ('a', 'b'), (1 << 70, 1), (3, 2)):
+    print(compare(a, b))
+
+for a, b in ((1.5, 2.0), (1.5, 2.0), (3, 1.5), (2, 4), (1.5, 2.0)):
+    print(div(a, b))
+try:
+    div(1.5, 0.0)
+except ZeroDivisionError:
+    print('ZeroDivisionError')
+
+# a list += extends the list in place, which a specialised add mustn't undo
+l = [1]
+for b in (1.0, [2]):
+    try:
+        x = l
+        x += b
+        print(x, l)
+    except TypeError:
+        print('TypeError')
+
+def subscr(seq, i, v):
+    seq[i] = v
+    return seq[i], seq[-1]
+
+l = [1, 2, 3]
+b = bytearray(3)
+for args in ((l, 0, 5), (l, -2, 6), (b, 1, 7), (b, -1, 255), ({-1: 0}, 'k', 9), (l, 1, 'x'), (b, 0, 8), ((1, 2), 0, 1)):
+    try:
+        print(subscr(*args))
+    except TypeError:
+        print('TypeError')
+for args in ((l, 5, 1), (l, -4, 1), (b, 3, 1), (b, -4, 1)):
+    try:
+        print(subscr(*args))
+    except IndexError:
+        print('IndexError')
+print(l, b)
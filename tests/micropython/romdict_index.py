@@ -0,0 +1,25 @@
+# check that every name in the ROM tables of modules and types is found by a
+# lookup in them, and that names that aren't there aren't found
+
+import builtins, sys
+
+try:
+    import ustruct, ujson, uio
+    mods = [builtins, sys, ustruct, ujson, uio]
+except ImportError:
+    mods = [builtins, sys]
+
+def check(obj):
+    names = dir(obj)
+    # names as qstrs, and as strs made at runtime
+    found = all(hasattr(obj, n) for n in names)
+    found_str = all(hasattr(obj, bytes(n, 'ascii').decode()) for n in names)
+    missing = not hasattr(obj, 'not_a_name') and not hasattr(obj, 'not a name that is interned')
+    return found and found_str and missing
+
+print([check(m) for m in mods] == [True] * len(mods))
+print([check(t) for t in (str, bytes, list, dict, int, set, bytearray)])
+
+# a module's globals dict in ROM
+d = builtins.__dict__ if hasattr(builtins, '__dict__') else {'len': len}
+print(d['len'] is len, 'not_a_name' in d)
@@ -0,0 +1,163 @@
+# check that the fused forms of load-add-store of a local, compare-and-jump and
+# loading two locals behave like the sequences they replace
+
+# increment of a local by a small int, for each of the fused ops
+def inc(x):
+    a = x
+    a += 1
+    b = x
+    b -= 16
+    c = x
+    c = c + 47
+    d = x
+    d = d - -16
+    return a, b, c, d
+
+for x in (0, -3, 2.5, (1 << 30) - 1, (1 << 62) - 1, -(1 << 62), 1 << 70):
+    print(inc(x))
+try:
+    inc('a')
+except TypeError:
+    print('TypeError')
+
+# a list += extends in place, a list = list + makes a new one
+l = [1]
+def inc_list(x):
+    y = x
+    y += [2][0:0]
+    return y is x
+print(inc_list(l))
+
+class Num:
+    def __init__(self, v):
+        self.v = v
+    def __add__(self, other):
+        return Num(self.v + other)
+    def __sub__(self, other):
+        return Num(self.v - other * 10)
+    def __lt__(self, other):
+        # a result that isn't a bool is tested for truth
+        return [1] if self.v < other else []
+    def __repr__(self):
+        return 'Num(%d)' % self.v
+print(inc(Num(5)))
+
+# the local is unbound
+def unbound_inc(c):
+    if c:
+        i = 0
+    i += 1
+try:
+    unbound_inc(False)
+except NameError:
+    print('NameError')
+
+# a local past the ones encoded in the opcode
+def many_locals():
+    v0 = v1 = v2 = v3 = v4 = v5 = v6 = v7 = v8 = v9 = 0
+    v10 = v11 = v12 = v13 = v14 = v15 = v16 = v17 = v18 = v19 = 0
+    v19 += 3
+    v18 = v18 - 1
+    return v18, v19, v0 + v17
+print(many_locals())
+
+# a store to a different local isn't fused
+def other_local(x):
+    y = x + 1
+    return x, y
+print(other_local(4))
+
+# compare and jump, for each comparison and both conditions
+def compare(a, b):
+    r = []
+    if a < b:
+        r.append('<')
+    if a > b:
+        r.append('>')
+    if a == b:
+        r.append('==')
+    if a <= b:
+        r.append('<=')
+    if a >= b:
+        r.append('>=')
+    if a != b:
+        r.append('!=')
+    if not a < b:
+        r.append('!<')
+    return r
+
+for a, b in ((1, 2), (2, 2), (3, 2), (1.5, 2), (2, 2.0), ('a', 'b'), (1 << 70, 1), (-1, 1 << 70)):
+    print(a, b, compare(a, b))
+try:
+    compare(1, 'a')
+except TypeError:
+    print('TypeError')
+
+def less(a, b):
+    if a < b:
+        return True
+    return False
+print(less(Num(1), 2), less(Num(3), 2))
+
+def membership(a, b):
+    r = []
+    if a in b:
+        r.append('in')
+    if a not in b:
+        r.append('not in')
+    if a is b:
+        r.append('is')
+    if a is not b:
+        r.append('is not')
+    return r
+
+print(membership(1, [1, 2]))
+print(membership(3, (1, 2)))
+print(membership(l, l))
+print(membership('a', 'abc'))
+
+# backward jumps of loops
+def count(n):
+    i = 0
+    s = 0
+    while i < n:
+        s += i
+        i += 1
+    while n > 0:
+        n -= 1
+    return i, s, n
+print(count(10))
+print(count(0))
+
+# exception matching stays as it was
+try:
+    raise ValueError
+except TypeError:
+    print('wrong')
+except ValueError:
+    print('ValueError')
+
+# load of two locals, either of which may be unbound
+def two(x, y):
+    return x, y
+print(two(1, 2))
+
+def unbound_second(c):
+    a = 1
+    if c:
+        b = 2
+    return a + b
+try:
+    unbound_second(False)
+except NameError:
+    print('NameError')
+
+def unbound_first(c):
+    if c:
+        a = 1
+    b = 2
+    return a + b
+try:
+    unbound_first(False)
+except NameError:
+    print('NameError')
@@ -0,0 +1,65 @@
+# test priority classes and CPU budgets of contexts
+
+try:
+    import multipython
+    multipython.PRIORITY_NORMAL
+    multipython.stats
+except (ImportError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+import utime
+
+
+def info(ctx):
+    return [c for c in multipython.get() if c['context_address'] == ctx][0]
+
+
+def stop(ctx):
+    multipython.control(ids=ctx, op=multipython.CONTROL_STOP, use_context=True)
+    while multipython.get_tID(ctx) is not None:
+        utime.sleep_ms(1)
+
+
+spin = """
+while True:
+    pass
+"""
+
+# a context that spins runs for its budget in each period and is held back for the rest
+ctx = multipython.start(spin, 0, budget_us=10000, period_us=50000)
+try:
+    budget = info(ctx)['budget']
+except KeyError:
+    print('SKIP')
+    raise SystemExit
+print(budget[:2])
+utime.sleep_ms(20)
+s = multipython.stats(ctx)
+t = utime.ticks_us()
+utime.sleep_ms(500)
+share = (multipython.stats(ctx)[0] - s[0]) / utime.ticks_diff(utime.ticks_us(), t)
+budget_us, period_us, overruns, held_us = info(ctx)['budget']
+print(overruns >= 5, held_us >= 5 * 30000, 0.1 < share < 0.4)
+
+# a held context still stops
+t = utime.ticks_ms()
+stop(ctx)
+print(utime.ticks_diff(utime.ticks_ms(), t) < 200)
+
+# without a budget nothing is counted
+ctx = multipython.start(spin, 0)
+utime.sleep_ms(20)
+print(info(ctx)['budget'], info(ctx)['priority'] == multipython.PRIORITY_NORMAL)
+stop(ctx)
+
+# priority classes; the ones above normal may be refused by the host, which isn't an error
+for p in (multipython.PRIORITY_LOW, multipython.PRIORITY_HIGH, multipython.PRIORITY_REALTIME):
+    ctx = multipython.start("x = 1", 0, suspend=1, priority=p)
+    print(info(ctx)['priority'] == p)
+    stop(ctx)
+
+for kw in ({'priority': 7}, {'budget_us': -1}, {'budget_us': 1000, 'period_us': 0}):
+    try:
+        multipython.start("x = 1", 0, **kw)
+    except ValueError:
+        print('ValueError')
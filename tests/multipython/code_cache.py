@@ -0,0 +1,77 @@
+# test that modules imported from source share their code between contexts
+
+try:
+    import multipython
+    multipython.code_cache
+except (ImportError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+import utime, uos
+
+MOD = 'mp_code_cache_mod'
+with open(MOD + '.py', 'w') as f:
+    f.write("""
+greeting = 'hello from a module that is shared' + '!'
+def work(n):
+    return sum(i * 1.5 for i in range(n))
+class Counter:
+    def __init__(self):
+        self.n = 0
+    def add(self, k=1):
+        self.n += k
+        return self.n
+""")
+
+me = multipython.context()
+multipython.response(condition=1, context=me, argument=1)
+
+def cached():
+    return [(users, size > 0) for path, users, size in multipython.code_cache() if MOD in path]
+
+# workers started from the same source reach the import with the same qstrs,
+# so the first one compiles the module and the others use its code
+src = """
+import multipython, utime
+import mp_code_cache_mod as m
+c = m.Counter()
+c.add(); c.add(2)
+print(m.greeting, m.work(10), c.n)
+multipython.notify(1)
+while True:
+    utime.sleep_ms(1)
+"""
+ctxs = []
+for i in range(3):
+    ctx = multipython.start(src, 0)
+    print(multipython.check_responses(2000))
+    ctxs.append(ctx)
+print(cached())
+
+# this context reaches the import with other qstrs, so it can't use that code and
+# shares its own instead
+import sys
+sys.path.insert(0, '')
+import mp_code_cache_mod
+print(mp_code_cache_mod.work(4), mp_code_cache_mod.__file__.endswith(MOD + '.py'))
+print(cached())
+
+# a module rewritten while contexts still use its code is compiled again from the
+# new source, even at the same length, and shared from a new entry
+with open(MOD + '.py', 'r') as f:
+    text = f.read()
+with open(MOD + '.py', 'w') as f:
+    f.write(text.replace('hello from a module', 'HELLO FROM A MODULE'))
+ctx = multipython.start(src, 0)
+print(multipython.check_responses(2000))
+ctxs.append(ctx)
+print(cached())
+
+# entries are freed when the last context using them ends
+for i, ctx in enumerate(ctxs):
+    multipython.response(condition=10 + i, context=ctx, control_op=multipython.CONTROL_STOP)
+    multipython.notify(10 + i)
+    while multipython.get_tID(ctx) is not None:
+        utime.sleep_ms(1)
+    print(cached())
+
+uos.remove(MOD + '.py')
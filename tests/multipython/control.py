@@ -0,0 +1,48 @@
+# test suspending, resuming and stopping a running context
+
+try:
+    import multipython
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+import utime
+
+multipython.response(condition=2, context=multipython.context(), argument=1)
+
+src = """
+import multipython
+multipython.notify(2)
+n = 0
+while True:
+    n += 1
+"""
+ctx = multipython.start(src, 0)
+while multipython.check_responses() is None:
+    utime.sleep_ms(1)
+tid = multipython.get_tID(ctx)
+
+# the main interpreter can't be controlled
+try:
+    multipython.control(None, multipython.CONTROL_SUSPEND)
+except OSError:
+    print('OSError')
+
+print(multipython.control(ids=tid, op=multipython.CONTROL_SUSPEND) == [tid])
+print(multipython.get(tid)[0]['status'] & 1)
+print(multipython.control(ids=tid, op=multipython.CONTROL_RESUME) == [tid])
+print(multipython.get(tid)[0]['status'] & 1)
+print(multipython.control(ids=ctx, op=multipython.CONTROL_STOP, use_context=True) == [tid])
+
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print('stopped')
+
+# a context that starts suspended runs once resumed
+ctx = multipython.start("print('resumed')", 0, 0, 1)
+tid = multipython.get_tID(ctx)
+utime.sleep_ms(10)
+print('resuming')
+multipython.control(ids=tid, op=multipython.CONTROL_RESUME)
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print('done')
@@ -0,0 +1,60 @@
+# test sizing the heap of a context and growing it on demand
+
+try:
+    import multipython
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+import utime
+
+multipython.response(condition=4, context=multipython.context(), argument=1)
+
+src = """
+import gc, multipython
+total = gc.mem_free() + gc.mem_alloc()
+print(total < 16 * 1024)
+try:
+    l = [bytearray(1024) for i in range(100)]
+    print('allocated', len(l))
+    print(gc.mem_free() + gc.mem_alloc() > total)
+except MemoryError:
+    print('MemoryError')
+l = None
+gc.collect()
+multipython.notify(4)
+"""
+
+def run(**kw):
+    ctx = multipython.start(src, 0, **kw)
+    while multipython.check_responses() is None:
+        utime.sleep_ms(1)
+    while multipython.get_tID(ctx) is not None:
+        utime.sleep_ms(1)
+
+# a small heap that can't grow
+run(heap_size=16 * 1024, heap_max=16 * 1024)
+
+# the same heap allowed to grow
+run(heap_size=16 * 1024, heap_max=1024 * 1024)
+
+# a heap big enough from the start, on a bigger stack
+run(heap_size=256 * 1024, heap_max=1, stack_size=512 * 1024)
+
+try:
+    multipython.start(src, 0, heap_size=-1)
+except ValueError:
+    print('ValueError')
+
+# heaps too small for the tables of the GC
+for n in (1, 2, 8, 16):
+    try:
+        multipython.start(src, 0, heap_size=n)
+    except ValueError:
+        print('ValueError', n)
+if hasattr(multipython, 'snapshot'):
+    try:
+        multipython.snapshot(heap_size=8)
+    except ValueError:
+        print('ValueError')
+else:
+    print('ValueError')
@@ -0,0 +1,41 @@
+# test that notify finds responses by their condition among many
+
+try:
+    import multipython
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+
+me = multipython.context()
+
+def drain():
+    got = []
+    while True:
+        r = multipython.check_responses()
+        if r is None:
+            return got
+        got.append(r)
+
+for i in range(200):
+    multipython.response(condition=i, context=me, argument=i)
+# several responses to one condition arrive in the order they were made
+multipython.response(condition=7, context=me, argument='second')
+multipython.response(condition=7, context=me, argument='third')
+
+multipython.notify(7)
+print(drain())
+multipython.notify(199)
+multipython.notify(0)
+print(drain())
+multipython.notify(1000)
+print(drain())
+
+# hashable and unhashable objects work as conditions too
+multipython.response(condition=(1, 2), context=me, argument='tuple')
+multipython.response(condition=[1, 2], context=me, argument='list')
+multipython.response(condition=-5, context=me, argument='negative')
+multipython.notify((1, 2))
+multipython.notify([1, 2])
+multipython.notify(-5)
+multipython.notify(None)
+print(drain())
@@ -0,0 +1,84 @@
+# test multipython.Pool: jobs run by worker contexts, with their results copied back
+
+try:
+    import multipython
+    multipython.Pool
+except (ImportError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+import uos
+
+MOD = 'mp_pool_mod'
+with open(MOD + '.py', 'w') as f:
+    f.write("""
+def square(x):
+    return x * x
+def describe(a, b=2, **kw):
+    return (a, b, sorted(kw.items()))
+def echo(x):
+    return x
+def fail(msg):
+    raise ValueError(msg, 42)
+def fail_custom():
+    class MyError(Exception):
+        pass
+    raise MyError('custom')
+def unsendable():
+    return object()
+""")
+
+import mp_pool_mod as m
+
+with multipython.Pool(2) as pool:
+    # functions of an importable module, positional and keyword arguments
+    f = pool.submit(m.square, 7)
+    print(f.result(), f.done(), f.result())
+    print(pool.submit(m.describe, 1, c=3, d=4).result())
+
+    # objects are copied both ways
+    data = (None, True, False, -5, 1 << 70, 2.5, 'str', b'bytes', bytearray(b'ba'), [1, [2]], {'k': (1, 2)})
+    print(pool.submit(m.echo, data).result() == data)
+
+    # functions by name
+    print(pool.submit('mp_pool_mod.square', 9).result())
+
+    # map keeps the order
+    print(pool.map(m.square, range(20)))
+
+    # exceptions come back with their type and args
+    try:
+        pool.submit(m.fail, 'bad').result()
+    except ValueError as e:
+        print('ValueError', e.args)
+    try:
+        pool.submit(m.fail_custom).result()
+    except RuntimeError as e:
+        print('RuntimeError', e.args)
+    try:
+        pool.submit(m.unsendable).result()
+    except TypeError:
+        print('TypeError')
+    try:
+        pool.submit(m.echo, object())
+    except TypeError:
+        print('TypeError')
+    try:
+        pool.submit(lambda: 1)
+    except ValueError:
+        print('ValueError')
+
+    # many jobs in flight at once
+    futures = [pool.submit(m.square, i) for i in range(100)]
+    print(sum(f.result() for f in futures))
+
+    workers, submitted, completed, stolen = pool.stats()
+    print(workers, submitted, completed == submitted, stolen >= 0)
+
+# the with block closed the pool, after its workers ended
+for f in (lambda: pool.submit(m.square, 1), pool.stats):
+    try:
+        f()
+    except ValueError:
+        print('ValueError')
+
+uos.remove(MOD + '.py')
@@ -0,0 +1,40 @@
+# test starting contexts from code that is already compiled
+
+try:
+    import multipython
+    multipython.compile
+except (ImportError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+import utime
+
+me = multipython.context()
+multipython.response(condition=1, context=me, argument=1)
+
+def run(src, type=0):
+    ctx = multipython.start(src, type)
+    while multipython.get_tID(ctx) is not None:
+        utime.sleep_ms(1)
+    print(multipython.check_responses(0))
+
+# compiled once here, then only loaded by each context
+mpy = multipython.compile("""
+import multipython
+def f(n):
+    return sum(i * i for i in range(n))
+print(f(100), 'abc' + 'def', 1.5 * 2)
+multipython.notify(1)
+""", 0)
+print(type(mpy), mpy[0] == ord('M'))
+for i in range(3):
+    run(mpy)
+run(bytearray(mpy))
+
+# an image that isn't one
+run(b'X\x00\x00\x00')
+
+# the same errors as compiling in the context
+try:
+    multipython.compile("1 +", 0)
+except SyntaxError:
+    print('SyntaxError')
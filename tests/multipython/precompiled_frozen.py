@@ -0,0 +1,24 @@
+# test starting contexts from frozen modules, which are found by name
+
+try:
+    import multipython
+    multipython.FROZEN
+except (ImportError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+import utime
+
+# the port has to freeze the module
+try:
+    ctx = multipython.start("upip_utarfile.py", multipython.FROZEN)
+except OSError:
+    print('SKIP')
+    raise SystemExit
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print('done')
+
+try:
+    multipython.start("not_frozen.py", multipython.FROZEN)
+except OSError:
+    print('OSError')
@@ -0,0 +1,34 @@
+# test that contexts run their calls on a pystack of the size given to start()
+
+try:
+    import multipython, micropython
+    micropython.pystack_use
+except (ImportError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+
+me = multipython.context()
+multipython.response(condition=1, context=me, argument=1)
+multipython.response(condition=2, context=me, argument=2)
+
+src = """
+import multipython, micropython
+def f(n):
+    return f(n - 1) + 1 if n else micropython.pystack_use()
+try:
+    print(f(50) > micropython.pystack_use())
+    multipython.notify(1)
+except RuntimeError as e:
+    print(e)
+    multipython.notify(2)
+"""
+
+# the default is enough for a chain of 50 calls, 512 bytes are not
+print(multipython.check_responses(2000) if multipython.start(src, 0) else None)
+print(multipython.check_responses(2000) if multipython.start(src, 0, pystack_size=512) else None)
+print(multipython.check_responses(2000) if multipython.start(src, 0, pystack_size=64 * 1024) else None)
+
+try:
+    multipython.start(src, 0, pystack_size=-1)
+except ValueError:
+    print('ValueError')
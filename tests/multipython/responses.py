@@ -0,0 +1,55 @@
+# test blocking reads and overflow accounting of the response queues
+
+try:
+    import multipython
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+import utime
+
+me = multipython.context()
+print(multipython.queue_stats()[0])
+
+# nothing arrives, so a timed wait returns None after the timeout
+t = utime.ticks_ms()
+print(multipython.check_responses(20))
+print(utime.ticks_diff(utime.ticks_ms(), t) >= 15)
+
+# small ints as conditions, since strings are interned by each context on its own
+READY, PING, DONE, FILL = 1, 2, 3, 4
+multipython.response(condition=READY, context=me, argument=READY)
+multipython.response(condition=DONE, context=me, argument=DONE)
+
+# a worker that sleeps until it is sent a job
+src = """
+import multipython
+multipython.notify(1)
+while True:
+    if multipython.check_responses(None) == 2:
+        multipython.notify(3)
+"""
+ctx = multipython.start(src, 0, queue_depth=3)
+print(multipython.check_responses(None))
+print(multipython.queue_stats(ctx)[0])
+multipython.response(condition=PING, context=ctx, argument=PING)
+multipython.notify(PING)
+print(multipython.check_responses(1000))
+multipython.notify(PING)
+print(multipython.check_responses(None))
+
+# stopping a parked worker ends it
+multipython.control(ids=ctx, op=multipython.CONTROL_STOP, use_context=True)
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print('stopped')
+
+# a context that never reads turns responses away once its queue is full
+ctx = multipython.start("pass", 0, 0, 1, queue_depth=2)
+multipython.response(condition=FILL, context=ctx, argument=1)
+for i in range(5):
+    multipython.notify(FILL)
+print(multipython.queue_stats(ctx))
+multipython.control(ids=ctx, op=multipython.CONTROL_STOP, use_context=True)
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print(multipython.queue_stats(ctx))
@@ -0,0 +1,80 @@
+# test buffers shared between contexts without copies
+
+try:
+    import multipython
+    multipython.shared_alloc
+except (ImportError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+import utime
+
+me = multipython.context()
+multipython.response(condition=1, context=me, argument=1)
+
+def held(handle):
+    return [holders for h, size, holders in multipython.shared_info() if h == handle]
+
+# a new buffer is zeroed and writable
+view = multipython.shared_alloc(16)
+print(type(view), len(view), bytes(view[:4]))
+view[0:4] = b'abcd'
+handle = multipython.shared_handle(view)
+print(handle == multipython.shared_handle(view[2:]), held(handle))
+
+# another context sees the same memory: it checks what we wrote, then writes back
+src = """
+import multipython
+v = multipython.shared_attach({})
+ok = bytes(v[0:4]) == b'abcd'
+v[4] = 1 if ok else 2
+multipython.notify(1)
+while True:
+    multipython.check_responses(None)
+""".format(handle)
+ctx = multipython.start(src, 0)
+print(multipython.check_responses(2000), view[4], held(handle))
+
+# the buffer lives on while any context holds it
+multipython.shared_release(view)
+print(len(view), held(handle))
+multipython.control(ids=ctx, op=multipython.CONTROL_STOP, use_context=True)
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print(held(handle))
+
+# handles of freed buffers and views of other memory are refused
+for f, arg in ((multipython.shared_attach, handle), (multipython.shared_handle, memoryview(bytearray(4))),
+        (multipython.shared_release, view)):
+    try:
+        f(arg)
+    except ValueError as e:
+        print('ValueError')
+try:
+    multipython.shared_handle(bytearray(4))
+except TypeError:
+    print('TypeError')
+
+# a context holds a buffer as often as it attached it
+view = multipython.shared_alloc(8)
+handle = multipython.shared_handle(view)
+again = multipython.shared_attach(handle)
+again[7] = 7
+print(view[7], held(handle))
+multipython.shared_release(again)
+print(held(handle))
+multipython.shared_release(view)
+print(held(handle))
+
+# slices taken before the release keep the memory alive until they are gone
+view = multipython.shared_alloc(1 << 16)
+handle = multipython.shared_handle(view)
+tail = view[10:]
+tail[0] = 5
+multipython.shared_release(view)
+print(len(view), held(handle), tail[0], len(tail))
+tail[1] = 6
+print(bytes(tail[:2]))
+try:
+    multipython.shared_release(tail)
+except ValueError:
+    print('ValueError')
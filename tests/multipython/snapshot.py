@@ -0,0 +1,66 @@
+# test starting contexts from a snapshot of a booted interpreter
+
+try:
+    import multipython
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+import utime
+
+me = multipython.context()
+multipython.response(condition=1, context=me, argument=1)
+
+def run(src, **kw):
+    ctx = multipython.start(src, 0, **kw)
+    print(multipython.check_responses(2000))
+    while multipython.get_tID(ctx) is not None:
+        utime.sleep_ms(1)
+
+# there is nothing to start from before the first snapshot
+try:
+    multipython.start("pass", 0, snapshot=True)
+except OSError:
+    print('OSError')
+
+print(multipython.snapshot(32 * 1024) > 0)
+
+src = """
+import gc, multipython
+x = [i * i for i in range(1000)]
+d = {str(i): i for i in range(100)}
+gc.collect()
+print(sum(x), len(d), d['42'])
+multipython.notify(1)
+"""
+for i in range(3):
+    run(src, snapshot=True)
+
+# the heap of a cloned context can still grow beyond the snapshot
+run("import multipython\nb = bytearray(200000)\nprint(len(b))\nmultipython.notify(1)", snapshot=True, heap_max=1024 * 1024)
+
+# a new snapshot replaces the old one
+print(multipython.snapshot() > 0)
+run(src, snapshot=True)
+
+# data that holds the address of an object in the heap of the snapshot is copied as it is
+boot = """
+import array, ustruct as struct
+x = [1]
+H = hex(id(x))
+B = struct.pack('P', id(x))
+BA = bytearray(B)
+A = array.array('P', [id(x)])
+I = id(x) << 64 | id(x)
+"""
+print(multipython.snapshot(source=boot) > 0)
+src = """
+import ustruct as struct, multipython
+a = int(H, 16)
+print(struct.unpack('P', B)[0] == a, struct.unpack('P', BA)[0] == a, A[0] == a, I == a << 64 | a, x)
+multipython.notify(1)
+"""
+# the heap of the snapshot may be reused by the first clone, so that one doesn't move
+idle = multipython.start("import utime\nutime.sleep_ms(200)", 0, snapshot=True)
+run(src, snapshot=True)
+while multipython.get_tID(idle) is not None:
+    utime.sleep_ms(1)
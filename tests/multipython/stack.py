@@ -0,0 +1,43 @@
+# test per-context stack sizes and the stack high water reported by get()
+
+try:
+    import multipython
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+import utime
+
+me = multipython.context()
+multipython.response(condition=1, context=me, argument=1)
+
+def stack(ctx):
+    return [c['stack'] for c in multipython.get() if c['context_address'] == ctx][0]
+
+src = """
+import multipython
+def f(n):
+    return f(n - 1) + 1 if n else 0
+f({})
+try:
+    import _thread
+    print(_thread.stack_size())
+except ImportError:
+    print({})
+multipython.notify(1)
+while True:
+    multipython.check_responses(None)
+"""
+
+used = []
+for depth, thread_stack in ((0, 0), (100, 32768)):
+    ctx = multipython.start(src.format(depth, thread_stack), 0, stack_size=128 * 1024, thread_stack_size=thread_stack)
+    multipython.check_responses(2000)
+    size, high_water = stack(ctx)
+    print(size, high_water < size)
+    used.append(high_water)
+    multipython.control(ids=ctx, op=multipython.CONTROL_STOP, use_context=True)
+    while multipython.get_tID(ctx) is not None:
+        utime.sleep_ms(1)
+
+# a port that can't measure the stack reports 0
+print(used[0] == used[1] == 0 or used[0] < used[1])
@@ -0,0 +1,26 @@
+# test starting a context from source and getting a response back from it
+
+try:
+    import multipython
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+import utime
+
+multipython.response(condition=1, context=multipython.context(), argument=42)
+
+ctx = multipython.start("import multipython\nprint('in context')\nmultipython.notify(1)\n", 0)
+
+# wait for the context to report back
+while True:
+    r = multipython.check_responses()
+    if r is not None:
+        break
+    utime.sleep_ms(1)
+print(r)
+print(isinstance(ctx, int))
+
+# the context is removed once its source has run
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print('done')
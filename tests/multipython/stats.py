@@ -0,0 +1,51 @@
+# test the runtime accounting of contexts
+
+try:
+    import multipython
+    multipython.stats
+except (ImportError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+import gc, utime
+
+me = multipython.context()
+multipython.response(condition=1, context=me, argument=1)
+
+# a context that allocates, collects and then parks until it is stopped
+src = """
+import multipython, gc
+l = [bytearray(100) for i in range(100)]
+l = None
+gc.collect()
+gc.collect()
+multipython.notify(1)
+while True:
+    multipython.check_responses(-1)
+"""
+ctx = multipython.start(src, 0)
+print(multipython.check_responses(2000))
+utime.sleep_ms(50)
+
+run_us, switches, collections, gc_us, alloc, used, peak = multipython.stats(ctx)
+print(switches >= 1, collections >= 2, gc_us >= 0)
+print(alloc >= 100 * 100, used < alloc, peak >= 100 * 100, peak >= used)
+
+# parked contexts don't run
+s = multipython.stats(ctx)
+utime.sleep_ms(50)
+print(multipython.stats(ctx)[0] - s[0] < 40000)
+
+# get() carries the same tuple
+print(len([c for c in multipython.get() if c['context_address'] == ctx][0]['stats']))
+
+# the calling context
+before = multipython.stats()
+gc.collect()
+after = multipython.stats(None)
+print(after[2] - before[2], after[3] >= before[3], after[0] >= before[0])
+
+multipython.response(condition=2, context=ctx, control_op=multipython.CONTROL_STOP)
+multipython.notify(2)
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print(multipython.stats(ctx))
@@ -0,0 +1,50 @@
+# test that threads started inside a context end with it
+
+try:
+    import multipython
+    import _thread
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+import gc, utime
+
+me = multipython.context()
+multipython.response(condition=1, context=me, argument=1)
+
+src = """
+import multipython, _thread, gc
+lock = _thread.allocate_lock()
+lock.acquire()
+def spin(i):
+    l = [i] * 10
+    while True:
+        l = [x for x in l]
+        gc.collect()
+def block(i):
+    lock.acquire()
+for i in range(3):
+    _thread.start_new_thread({}, (i,))
+multipython.notify(1)
+{}
+"""
+
+# contexts that return or are stopped while their threads run or block
+wait = "while True:\n    multipython.check_responses(None)"
+for f, tail in (("spin", ""), ("spin", wait), ("block", ""), ("block", wait)):
+    for n in range(3):
+        ctx = multipython.start(src.format(f, tail), 0)
+        print(multipython.check_responses(2000))
+        if tail:
+            multipython.control(ids=ctx, op=multipython.CONTROL_STOP, use_context=True)
+        while multipython.get_tID(ctx) is not None:
+            utime.sleep_ms(1)
+        gc.collect()
+
+# threads of the main interpreter are unaffected
+res = []
+def f():
+    res.append(sum(range(10)))
+_thread.start_new_thread(f, ())
+while not res:
+    utime.sleep_ms(1)
+print(res, len(multipython.get()))
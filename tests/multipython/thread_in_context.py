@@ -0,0 +1,40 @@
+# test threads started inside a context, collecting the context's heap
+
+try:
+    import multipython
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+import utime
+
+multipython.response(condition=3, context=multipython.context(), argument=1)
+
+src = """
+import multipython, _thread, gc
+lock = _thread.allocate_lock()
+res = []
+def f(i):
+    x = [str(j) for j in range(200)]
+    gc.collect()
+    with lock:
+        res.append((i, len(x)))
+for i in range(4):
+    _thread.start_new_thread(f, (i,))
+while True:
+    with lock:
+        if len(res) == 4:
+            break
+print(sorted(res))
+multipython.notify(3)
+"""
+ctx = multipython.start(src, 0)
+
+# collect the main heap while the context runs
+l = []
+while multipython.check_responses() is None:
+    l.append([i for i in range(10)])
+    if len(l) > 100:
+        l = []
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print('done')
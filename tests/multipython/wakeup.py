@@ -0,0 +1,43 @@
+# test that control operations carried by responses take effect when notified
+
+try:
+    import multipython
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+import utime
+
+me = multipython.context()
+multipython.response(condition=1, context=me, argument=1)
+
+# a context that starts suspended is resumed by a notified response
+ctx = multipython.start("import multipython\nmultipython.notify(1)", 0, 0, 1)
+multipython.response(condition=2, context=ctx, control_op=multipython.CONTROL_RESUME)
+utime.sleep_ms(10)
+print(multipython.check_responses(0))
+multipython.notify(2)
+print(multipython.check_responses(1000))
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+
+# and a running one is suspended, resumed and stopped the same way
+src = """
+import multipython
+multipython.notify(1)
+while True:
+    pass
+"""
+ctx = multipython.start(src, 0)
+print(multipython.check_responses(1000))
+tid = multipython.get_tID(ctx)
+multipython.response(condition=3, context=ctx, control_op=multipython.CONTROL_SUSPEND)
+multipython.response(condition=4, context=ctx, control_op=multipython.CONTROL_RESUME)
+multipython.response(condition=5, context=ctx, control_op=multipython.CONTROL_STOP)
+multipython.notify(3)
+print(multipython.get(tid)[0]['status'] & 1)
+multipython.notify(4)
+print(multipython.get(tid)[0]['status'] & 1)
+multipython.notify(5)
+while multipython.get_tID(ctx) is not None:
+    utime.sleep_ms(1)
+print('stopped')
@@ -61,6 +61,7 @@ class Config:
     MICROPY_LONGINT_IMPL_NONE = 0
     MICROPY_LONGINT_IMPL_LONGLONG = 1
     MICROPY_LONGINT_IMPL_MPZ = 2
+    MICROPY_OPT_SUPERINSTRUCTIONS = False
 config = Config()
 
 class QStrType:
@@ -112,6 +113,8 @@ MP_OPCODE_OFFSET = 3
 MP_BC_MAKE_CLOSURE = 0x62
 MP_BC_MAKE_CLOSURE_DEFARGS = 0x63
 MP_BC_RAISE_VARARGS = 0x5c
+MP_BC_LOAD_FAST_2 = 0x2c
+MP_BC_COMPARE_JUMP = 0x3a
 # extra byte if caching enabled:
 MP_BC_LOAD_NAME = 0x1b
 MP_BC_LOAD_GLOBAL = 0x1c
@@ -139,10 +142,10 @@ def make_opcode_format():
     OC4(B, B, V, V), # 0x20-0x23
     OC4(Q, Q, Q, B), # 0x24-0x27
     OC4(V, V, Q, Q), # 0x28-0x2b
-    OC4(U, U, U, U), # 0x2c-0x2f
+    OC4(B, V, U, U), # 0x2c-0x2f
     OC4(B, B, B, B), # 0x30-0x33
     OC4(B, O, O, O), # 0x34-0x37
-    OC4(O, O, U, U), # 0x38-0x3b
+    OC4(O, O, O, U), # 0x38-0x3b
     OC4(U, O, B, O), # 0x3c-0x3f
     OC4(O, B, B, O), # 0x40-0x43
     OC4(O, U, O, B), # 0x44-0x47
@@ -218,6 +221,8 @@ def mp_opcode_format(bytecode, ip, count_var_uint, opcode_format=make_opcode_for
             opcode == MP_BC_RAISE_VARARGS
             or opcode == MP_BC_MAKE_CLOSURE
             or opcode == MP_BC_MAKE_CLOSURE_DEFARGS
+            or opcode == MP_BC_LOAD_FAST_2
+            or opcode == MP_BC_COMPARE_JUMP
         )
         ip += 1
         if f == MP_OPCODE_VAR_UINT:
@@ -715,7 +720,10 @@ def read_mpy(filename):
         qw_size = read_uint(f)
         config.MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE = (feature_byte & 1) != 0
         config.MICROPY_PY_BUILTINS_STR_UNICODE = (feature_byte & 2) != 0
-        config.native_arch = feature_byte >> 2
+        config.native_arch = (feature_byte & 0x7f) >> 2
+        if feature_byte & 0x80:
+            # any file using superinstructions needs a VM built with them
+            config.MICROPY_OPT_SUPERINSTRUCTIONS = True
         config.mp_small_int_bits = header[3]
         qstr_win = QStrWindow(qw_size)
         return read_raw_code(f, qstr_win)
@@ -745,6 +753,12 @@ def freeze_mpy(base_qstrs, raw_codes):
     print('#endif')
     print()
 
+    if config.MICROPY_OPT_SUPERINSTRUCTIONS:
+        print('#if !MICROPY_OPT_SUPERINSTRUCTIONS')
+        print('#error "incompatible MICROPY_OPT_SUPERINSTRUCTIONS"')
+        print('#endif')
+        print()
+
     print('#if MICROPY_LONGINT_IMPL != %u' % config.MICROPY_LONGINT_IMPL)
     print('#error "incompatible MICROPY_LONGINT_IMPL"')
     print('#endif')
@@ -842,7 +856,7 @@ def main():
 
     # set config values for qstrs, and get the existing base set of qstrs
     if args.qstr_header:
-        qcfgs, base_qstrs = qstrutil.parse_input_headers([args.qstr_header])
+        qcfgs, base_qstrs, _ = qstrutil.parse_input_headers([args.qstr_header])
         config.MICROPY_QSTR_BYTES_IN_LEN = int(qcfgs['BYTES_IN_LEN'])
         config.MICROPY_QSTR_BYTES_IN_HASH = int(qcfgs['BYTES_IN_HASH'])
     else: